@@ -0,0 +1,80 @@
+#include "AnimCore.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <glm/gtc/matrix_transform.hpp>
+
+using glm::mat4;
+using std::runtime_error;
+using std::vector;
+
+void Skeleton::resize(int numJoints) {
+	names.resize(numJoints);
+	parents.resize(numJoints, -1);
+	positions.resize(numJoints);
+	orientations.resize(numJoints);
+	modelSpace.resize(numJoints);
+}
+
+mat4 jointToParentMatrix(const glm::vec3 &position, const glm::quat &orientation) {
+	mat4 transM = glm::translate(mat4(), position);
+	mat4 rotM = glm::mat4_cast(orientation);
+	return transM * rotM;
+}
+
+float angleBetween(const glm::quat &a, const glm::quat &b) {
+	glm::quat na = glm::normalize(a);
+	glm::quat nb = glm::normalize(b);
+	float sign = (na.x * nb.x + na.y * nb.y + na.z * nb.z + na.w * nb.w) < 0 ? -1.0f : 1.0f;
+
+	float difference = 0;
+	float sum = 0;
+	float ca[4] = { na.x, na.y, na.z, na.w };
+	float cb[4] = { sign * nb.x, sign * nb.y, sign * nb.z, sign * nb.w };
+	for(int i = 0; i < 4; ++i) {
+		difference += (ca[i] - cb[i]) * (ca[i] - cb[i]);
+		sum += (ca[i] + cb[i]) * (ca[i] + cb[i]);
+	}
+	return 2.0f * atan2f(sqrtf(difference), sqrtf(sum));
+}
+
+void validateJointOrder(const vector<int> &parents) {
+	for(int i = 0; i < parents.size(); ++i) {
+		if(parents[i] < -1 || parents[i] >= i) {
+			throw runtime_error("Joint " + std::to_string(i) + " has parent " + std::to_string(parents[i]) +
+								"; parents must come before their children.");
+		}
+	}
+}
+
+Skeleton buildSkeleton(const vector<Joint> &joints) {
+	Skeleton skeleton;
+	skeleton.resize(joints.size());
+
+	for(int i = 0; i < joints.size(); ++i) {
+		skeleton.names[i] = joints[i].name;
+		skeleton.parents[i] = joints[i].parentIndex;
+		skeleton.positions[i] = joints[i].position;
+		skeleton.orientations[i] = joints[i].orientation;
+	}
+
+	validateJointOrder(skeleton.parents);
+	return skeleton;
+}
+
+void computeModelSpace(Skeleton &skeleton) {
+	const int numJoints = skeleton.numJoints();
+	const int *parents = skeleton.parents.data();
+	const glm::vec3 *positions = skeleton.positions.data();
+	const glm::quat *orientations = skeleton.orientations.data();
+	mat4 *modelSpace = skeleton.modelSpace.data();
+
+	for(int i = 0; i < numJoints; ++i) {
+		mat4 combinedM = jointToParentMatrix(positions[i], orientations[i]);
+		if(parents[i] > -1) {
+			combinedM = modelSpace[parents[i]] * combinedM;
+		}
+		modelSpace[i] = combinedM;
+	}
+}
@@ -15,9 +15,42 @@ struct Joint {
 	int parentIndex;
 };
 
+// Joints stored as parallel arrays indexed by joint, so a pass over the pose
+// only touches the data it needs. names are cold and only read by tools; the
+// rest is walked every frame.
+//
+// Parents always come before their children. buildSkeleton checks it, which
+// lets computeModelSpace build every matrix in one pass from the root.
 struct Skeleton {
-	std::vector<Joint> joints;
+	std::vector<std::string> names;
+	std::vector<int> parents;             // -1 for roots
+	std::vector<glm::vec3> positions;     // joint space, relative to the parent
+	std::vector<glm::quat> orientations;  // joint space
+	std::vector<glm::mat4> modelSpace;    // joint to model, from computeModelSpace
+
+	int numJoints() const { return static_cast<int>(parents.size()); }
+	void resize(int numJoints);
 };
 
+// Joint space to parent space: the rotation, then the translation.
+glm::mat4 jointToParentMatrix(const glm::vec3 &position, const glm::quat &orientation);
+
+// Angle between two orientations, in radians, either way round the sphere.
+// atan2 of the half chord lengths stays accurate for the tiny angles
+// quantization and key reduction produce, where acos of the dot product does
+// not.
+float angleBetween(const glm::quat &a, const glm::quat &b);
+
+// Throws a runtime_error naming the first joint whose parent does not come
+// before it.
+void validateJointOrder(const std::vector<int> &parents);
+
+// Copies the joints into a skeleton and validates their order. The joint
+// positions and orientations are taken as relative to their parents.
+Skeleton buildSkeleton(const std::vector<Joint> &joints);
+
+// Fills modelSpace from the joint space transforms. Every joint is visited
+// once, after its parent.
+void computeModelSpace(Skeleton &skeleton);
 
-#endif
\ No newline at end of file
+#endif
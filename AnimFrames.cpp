@@ -0,0 +1,139 @@
+#include "AnimFrames.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+	#include <malloc.h>
+#endif
+
+namespace {
+
+float *allocateFloats(size_t count) {
+	if(count == 0) {
+		return nullptr;
+	}
+
+	size_t bytes = count * sizeof(float);
+	void *p = nullptr;
+
+#ifdef _WIN32
+	p = _aligned_malloc(bytes, AnimFrames::kAlignment);
+#else
+	if(posix_memalign(&p, AnimFrames::kAlignment, bytes) != 0) {
+		p = nullptr;
+	}
+#endif
+
+	if(!p) {
+		throw std::bad_alloc();
+	}
+
+	memset(p, 0, bytes);
+	return static_cast<float *>(p);
+}
+
+void freeFloats(float *p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+}
+
+AnimFrames::AnimFrames()
+	: mData(nullptr), mNumFrames(0), mNumComponents(0), mFrameStride(0), mComponentStride(0), mLayout(FrameMajor) {
+}
+
+AnimFrames::AnimFrames(int numFrames, int numComponents, Layout layout)
+	: mData(nullptr), mNumFrames(0), mNumComponents(0), mFrameStride(0), mComponentStride(0), mLayout(FrameMajor) {
+	resize(numFrames, numComponents, layout);
+}
+
+AnimFrames::AnimFrames(const AnimFrames &other)
+	: mData(nullptr), mNumFrames(0), mNumComponents(0), mFrameStride(0), mComponentStride(0), mLayout(FrameMajor) {
+	resize(other.mNumFrames, other.mNumComponents, other.mLayout);
+	if(mData) {
+		memcpy(mData, other.mData, sizeInBytes());
+	}
+}
+
+AnimFrames::AnimFrames(AnimFrames &&other)
+	: mData(nullptr), mNumFrames(0), mNumComponents(0), mFrameStride(0), mComponentStride(0), mLayout(FrameMajor) {
+	swap(*this, other);
+}
+
+AnimFrames::~AnimFrames() {
+	freeFloats(mData);
+}
+
+AnimFrames &AnimFrames::operator=(AnimFrames other) {
+	swap(*this, other);
+	return *this;
+}
+
+void AnimFrames::resize(int numFrames, int numComponents, Layout layout) {
+	freeFloats(mData);
+	mData = nullptr;
+
+	mData = allocateFloats(size_t(numFrames) * numComponents);
+	mNumFrames = numFrames;
+	mNumComponents = numComponents;
+	mLayout = layout;
+
+	if(layout == FrameMajor) {
+		mFrameStride = numComponents;
+		mComponentStride = 1;
+	} else {
+		mFrameStride = 1;
+		mComponentStride = numFrames;
+	}
+}
+
+AnimFrames AnimFrames::withLayout(Layout layout) const {
+	AnimFrames result(mNumFrames, mNumComponents, layout);
+
+	for(int f = 0; f < mNumFrames; ++f) {
+		for(int c = 0; c < mNumComponents; ++c) {
+			result.value(f, c) = value(f, c);
+		}
+	}
+
+	return result;
+}
+
+void swap(AnimFrames &a, AnimFrames &b) {
+	std::swap(a.mData, b.mData);
+	std::swap(a.mNumFrames, b.mNumFrames);
+	std::swap(a.mNumComponents, b.mNumComponents);
+	std::swap(a.mFrameStride, b.mFrameStride);
+	std::swap(a.mComponentStride, b.mComponentStride);
+	std::swap(a.mLayout, b.mLayout);
+}
+
+bool operator==(const AnimFrames &a, const AnimFrames &b) {
+	if(a.numFrames() != b.numFrames() || a.numComponents() != b.numComponents()) {
+		return false;
+	}
+
+	if(a.layout() == b.layout()) {
+		return a.empty() || memcmp(a.data(), b.data(), a.sizeInBytes()) == 0;
+	}
+
+	for(int f = 0; f < a.numFrames(); ++f) {
+		for(int c = 0; c < a.numComponents(); ++c) {
+			if(a.value(f, c) != b.value(f, c)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool operator!=(const AnimFrames &a, const AnimFrames &b) {
+	return !(a == b);
+}
@@ -0,0 +1,73 @@
+#ifndef ANIM_FRAMES_H
+#define ANIM_FRAMES_H
+
+#include <cstddef>
+
+// The animated components of every frame of a clip in one aligned block.
+//
+// FrameMajor keeps each frame's components together, which suits sampling a
+// whole pose at one time. ComponentMajor keeps each component's values for
+// all frames together, so a single joint channel can be streamed across time.
+// value() hides the difference: it is a multiply-add on two strides.
+class AnimFrames {
+public:
+	enum Layout {
+		FrameMajor,
+		ComponentMajor
+	};
+
+	// Blocks start on a cache line.
+	static const size_t kAlignment = 64;
+
+	AnimFrames();
+	AnimFrames(int numFrames, int numComponents, Layout layout = FrameMajor);
+	AnimFrames(const AnimFrames &other);
+	AnimFrames(AnimFrames &&other);
+	~AnimFrames();
+
+	AnimFrames &operator=(AnimFrames other);
+
+	// Discards the current contents. New values are zero.
+	void resize(int numFrames, int numComponents, Layout layout = FrameMajor);
+
+	int numFrames() const { return mNumFrames; }
+	int numComponents() const { return mNumComponents; }
+	Layout layout() const { return mLayout; }
+	bool empty() const { return mNumFrames == 0 || mNumComponents == 0; }
+	size_t sizeInBytes() const { return size_t(mNumFrames) * mNumComponents * sizeof(float); }
+
+	float value(int frame, int component) const {
+		return mData[frame * mFrameStride + component * mComponentStride];
+	}
+	float &value(int frame, int component) {
+		return mData[frame * mFrameStride + component * mComponentStride];
+	}
+
+	// FrameMajor only: the numComponents values of one frame.
+	const float *frame(int frame) const { return mData + frame * mFrameStride; }
+	float *frame(int frame) { return mData + frame * mFrameStride; }
+
+	// ComponentMajor only: the numFrames values of one component.
+	const float *channel(int component) const { return mData + component * mComponentStride; }
+	float *channel(int component) { return mData + component * mComponentStride; }
+
+	const float *data() const { return mData; }
+	float *data() { return mData; }
+
+	// A copy of the same values stored in the other layout.
+	AnimFrames withLayout(Layout layout) const;
+
+	friend void swap(AnimFrames &a, AnimFrames &b);
+private:
+	float *mData;
+	int mNumFrames;
+	int mNumComponents;
+	int mFrameStride;
+	int mComponentStride;
+	Layout mLayout;
+};
+
+bool operator==(const AnimFrames &a, const AnimFrames &b);
+bool operator!=(const AnimFrames &a, const AnimFrames &b);
+
+#endif
@@ -0,0 +1,147 @@
+#include "AnimSampler.h"
+
+#include <cmath>
+#include <stdexcept>
+
+using std::runtime_error;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+namespace {
+
+inline vec3 interpolate(const vec3 &a, const vec3 &b, float t) {
+	return a + (b - a) * t;
+}
+
+// Normalized lerp along the shorter arc.
+inline quat shorterNlerp(const quat &a, const quat &b, float t) {
+	float sign = (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) < 0 ? -1.0f : 1.0f;
+	quat q(a.w + (sign * b.w - a.w) * t,
+		   a.x + (sign * b.x - a.x) * t,
+		   a.y + (sign * b.y - a.y) * t,
+		   a.z + (sign * b.z - a.z) * t);
+	return glm::normalize(q);
+}
+
+// Constant angular speed along the shorter arc.
+inline quat shorterSlerp(const quat &a, const quat &b, float t) {
+	float cosAngle = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	float sign = cosAngle < 0 ? -1.0f : 1.0f;
+	cosAngle *= sign;
+
+	// sin(angle) vanishes as the two line up, and nlerp is as good there.
+	if(cosAngle > 0.9995f) {
+		return shorterNlerp(a, b, t);
+	}
+
+	float angle = std::acos(cosAngle);
+	float scale = 1.0f / std::sin(angle);
+	float wa = std::sin((1.0f - t) * angle) * scale;
+	float wb = std::sin(t * angle) * scale * sign;
+	return quat(a.w * wa + b.w * wb,
+				a.x * wa + b.x * wb,
+				a.y * wa + b.y * wb,
+				a.z * wa + b.z * wb);
+}
+
+}
+
+AnimSampler::AnimSampler() : mAnim(nullptr), mRotation(Nlerp) {
+}
+
+AnimSampler::AnimSampler(const MD5_AnimInfo &anim, Rotation rotation)
+	: mAnim(&anim), mRotation(rotation), mEvaluator(anim) {
+	if(anim.numFrames <= 0) {
+		throw runtime_error("The clip has no frames to sample.");
+	}
+}
+
+void AnimSampler::loadFrame(int frame, vector<vec3> &positions, vector<quat> &orientations) const {
+	if(mBaked.empty()) {
+		computeLocalPose(*mAnim, frame, positions, orientations);
+		return;
+	}
+
+	const int numJoints = mEvaluator.numJoints();
+	const float *joint = mBaked.frame(frame);
+
+	positions.resize(numJoints);
+	orientations.resize(numJoints);
+	for(int i = 0; i < numJoints; ++i, joint += kBakedJointSize) {
+		positions[i] = vec3(joint[0], joint[1], joint[2]);
+		orientations[i] = quat(joint[7], joint[4], joint[5], joint[6]);
+	}
+}
+
+float AnimSampler::loadFrames(double seconds) {
+	const double position = framePositionAtTime(*mAnim, seconds);
+	const int frame = static_cast<int>(position);
+	const float t = static_cast<float>(position - frame);
+
+	loadFrame(frame, mPositions, mOrientations);
+	if(t > 0) {
+		loadFrame((frame + 1) % mAnim->numFrames, mNextPositions, mNextOrientations);
+	}
+	return t;
+}
+
+void AnimSampler::sampleLocalPose(double seconds, vector<vec3> &positions, vector<quat> &orientations) {
+	const float t = loadFrames(seconds);
+	const int numJoints = mEvaluator.numJoints();
+
+	positions.resize(numJoints);
+	orientations.resize(numJoints);
+
+	for(int i = 0; i < numJoints; ++i) {
+		if(t > 0) {
+			positions[i] = interpolate(mPositions[i], mNextPositions[i], t);
+			orientations[i] = mRotation == Slerp ? shorterSlerp(mOrientations[i], mNextOrientations[i], t)
+												 : shorterNlerp(mOrientations[i], mNextOrientations[i], t);
+		} else {
+			positions[i] = mPositions[i];
+			orientations[i] = mOrientations[i];
+		}
+	}
+}
+
+void AnimSampler::samplePose(double seconds, vector<mat4> &pose) {
+	// The blend can go in place: each joint only reads its own two values.
+	sampleLocalPose(seconds, mPositions, mOrientations);
+	mEvaluator.evaluate(mPositions, mOrientations, pose);
+}
+
+void AnimSampler::bake() {
+	const int numFrames = mAnim->numFrames;
+	const int numJoints = mEvaluator.numJoints();
+
+	// Frees the old bake before the new one is allocated.
+	clearBake();
+	AnimFrames baked(numFrames, numJoints * kBakedJointSize);
+
+	vector<vec3> positions;
+	vector<quat> orientations;
+	for(int frame = 0; frame < numFrames; ++frame) {
+		computeLocalPose(*mAnim, frame, positions, orientations);
+
+		float *joint = baked.frame(frame);
+		for(int i = 0; i < numJoints; ++i, joint += kBakedJointSize) {
+			joint[0] = positions[i].x;
+			joint[1] = positions[i].y;
+			joint[2] = positions[i].z;
+			joint[3] = 0.0f;
+			joint[4] = orientations[i].x;
+			joint[5] = orientations[i].y;
+			joint[6] = orientations[i].z;
+			joint[7] = orientations[i].w;
+		}
+	}
+
+	swap(mBaked, baked);
+}
+
+void AnimSampler::clearBake() {
+	mBaked = AnimFrames();
+}
@@ -0,0 +1,70 @@
+#ifndef ANIM_SAMPLER_H
+#define ANIM_SAMPLER_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "AnimFrames.h"
+#include "MD5_AnimReader.h"
+#include "PoseEvaluator.h"
+
+// Poses a clip at any time, not just on its frames. The two frames either
+// side of the time are decoded from the clip's frame data and blended in
+// joint space: positions linearly, orientations with a normalized lerp or a
+// slerp, both along the shorter arc. Time loops the way frameAtTime does, so
+// past the last frame the clip blends back into its first. The blended pose
+// goes through a PoseEvaluator to model space.
+//
+// Nothing is kept per frame unless bake() is called. A baked sampler decodes
+// every frame once into a block of 8 floats per joint, position and padding
+// then orientation, each joint on a 32 byte boundary. Sampling then only
+// blends, and gives the same poses as before.
+//
+// The clip must outlive the sampler. A sampler is not shared between
+// threads; use one per playing instance.
+class AnimSampler {
+public:
+	enum Rotation {
+		Nlerp,
+		Slerp
+	};
+
+	AnimSampler();
+	explicit AnimSampler(const MD5_AnimInfo &anim, Rotation rotation = Nlerp);
+
+	int numJoints() const { return mEvaluator.numJoints(); }
+	Rotation rotation() const { return mRotation; }
+
+	void sampleLocalPose(double seconds, std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations);
+	// Model space transform of every joint, built by PoseEvaluator.
+	void samplePose(double seconds, std::vector<glm::mat4> &pose);
+
+	// Opt-in, for when the memory is there: frames x joints x 32 bytes.
+	void bake();
+	void clearBake();
+	bool baked() const { return !mBaked.empty(); }
+	size_t bakedSizeInBytes() const { return mBaked.sizeInBytes(); }
+private:
+	// Floats per joint in the bake: x y z, padding, then the quaternion.
+	static const int kBakedJointSize = 8;
+
+	// Fills mPositions and mOrientations, and their next frame counterparts,
+	// with the frames either side of seconds. Returns how far between them
+	// seconds is.
+	float loadFrames(double seconds);
+	void loadFrame(int frame, std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations) const;
+private:
+	const MD5_AnimInfo *mAnim;
+	Rotation mRotation;
+	PoseEvaluator mEvaluator;
+	// The frames either side, then the blend of them.
+	std::vector<glm::vec3> mPositions;
+	std::vector<glm::quat> mOrientations;
+	std::vector<glm::vec3> mNextPositions;
+	std::vector<glm::quat> mNextOrientations;
+	AnimFrames mBaked;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "AnimationThread.h"
+
+#include <chrono>
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+typedef std::chrono::steady_clock Clock;
+
+AnimationThread::AnimationThread()
+	: mTime(0.0), mNumSteps(0), mNumDroppedSteps(0), mStopping(false) {
+}
+
+AnimationThread::~AnimationThread() {
+	stop();
+}
+
+void AnimationThread::start(double stepSeconds, StepFunction step, double startTime) {
+	stop();
+
+	mTime = startTime;
+	mNumSteps = 1;
+	mNumDroppedSteps = 0;
+	step(startTime);
+
+	mStopping = false;
+	mThread = std::thread(&AnimationThread::run, this, stepSeconds, step);
+}
+
+void AnimationThread::stop() {
+	if(!mThread.joinable()) {
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	mThread.join();
+}
+
+void AnimationThread::run(double stepSeconds, StepFunction step) {
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double>(stepSeconds));
+	double time = mTime;
+	Clock::time_point deadline = Clock::now() + period;
+
+	for(;;) {
+		{
+			unique_lock<mutex> lock(mMutex);
+			if(mCondition.wait_until(lock, deadline, [this]() { return mStopping; })) {
+				return;
+			}
+		}
+
+		const Clock::time_point now = Clock::now();
+		if(now - deadline > kMaxCatchUpSteps * period) {
+			const int behind = static_cast<int>((now - deadline) / period);
+			mNumDroppedSteps += behind;
+			deadline += behind * period;
+		}
+
+		time += stepSeconds;
+		step(time);
+		mTime = time;
+		++mNumSteps;
+
+		deadline += period;
+	}
+}
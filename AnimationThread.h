@@ -0,0 +1,58 @@
+#ifndef ANIMATION_THREAD_H
+#define ANIMATION_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Advances animation on its own thread at a fixed step, away from rendering.
+//
+// step(time) is called with time going up by exactly stepSeconds each call.
+// The calls are scheduled against steady_clock deadlines rather than by
+// sleeping a step after each one, so step's own cost does not make the clock
+// drift. If the thread falls more than kMaxCatchUpSteps behind, e.g. after
+// the process was suspended, the missed steps are dropped and the schedule
+// restarts from now instead of running them back to back.
+class AnimationThread {
+public:
+	typedef std::function<void(double time)> StepFunction;
+
+	static const int kMaxCatchUpSteps = 4;
+
+	AnimationThread();
+	// Stops the thread.
+	~AnimationThread();
+
+	// The first step, at startTime, runs on the calling thread before start
+	// returns, so it has published something by then. Restarts the thread
+	// if it is already running.
+	void start(double stepSeconds, StepFunction step, double startTime = 0.0);
+	// Returns after the current step, if any, finishes. step is not called
+	// again until the next start.
+	void stop();
+	bool running() const { return mThread.joinable(); }
+
+	// Time of the last step.
+	double time() const { return mTime; }
+	int numSteps() const { return mNumSteps; }
+	int numDroppedSteps() const { return mNumDroppedSteps; }
+private:
+	AnimationThread(const AnimationThread &);
+	AnimationThread &operator=(const AnimationThread &);
+
+	void run(double stepSeconds, StepFunction step);
+
+	std::thread mThread;
+	std::atomic<double> mTime;
+	std::atomic<int> mNumSteps;
+	std::atomic<int> mNumDroppedSteps;
+
+	// Lets stop() cut a wait for the next deadline short.
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping;
+};
+
+#endif
@@ -0,0 +1,619 @@
+#include "BakedAsset.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using std::ofstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+namespace {
+
+const char kMagic[8] = { 'B', 'O', 'N', 'E', 'S', 'B', 'K', '\0' };
+const uint32_t kByteOrder = 0x01020304;
+const size_t kChunkAlignment = 16;
+
+inline uint32_t makeTag(char a, char b, char c, char d) {
+	return uint32_t(a) | (uint32_t(b) << 8) | (uint32_t(c) << 16) | (uint32_t(d) << 24);
+}
+
+// Mesh data
+const uint32_t kTagJoints = makeTag('J', 'N', 'T', 'S');
+const uint32_t kTagJointNames = makeTag('J', 'N', 'A', 'M');
+const uint32_t kTagTextureNames = makeTag('T', 'E', 'X', 'N');
+const uint32_t kTagMeshHeader = makeTag('M', 'H', 'D', 'R');
+const uint32_t kTagVertices = makeTag('M', 'V', 'R', 'T');
+const uint32_t kTagTriangles = makeTag('M', 'T', 'R', 'I');
+const uint32_t kTagWeights = makeTag('M', 'W', 'G', 'T');
+
+// Precomputed GPU data
+const uint32_t kTagPositions = makeTag('S', 'P', 'O', 'S');
+const uint32_t kTagJointIndices = makeTag('S', 'J', 'N', 'T');
+const uint32_t kTagJointWeights = makeTag('S', 'W', 'G', 'T');
+const uint32_t kTagTextureCoords = makeTag('S', 'U', 'V', '0');
+const uint32_t kTagIndices = makeTag('S', 'I', 'D', 'X');
+const uint32_t kTagInverseBindPose = makeTag('I', 'B', 'P', 'M');
+
+// Animation data
+const uint32_t kTagAnimHeader = makeTag('A', 'H', 'D', 'R');
+const uint32_t kTagHierarchy = makeTag('A', 'H', 'I', 'E');
+const uint32_t kTagAnimJointNames = makeTag('A', 'N', 'A', 'M');
+const uint32_t kTagBaseframe = makeTag('A', 'B', 'A', 'S');
+const uint32_t kTagBounds = makeTag('A', 'B', 'N', 'D');
+const uint32_t kTagFrames = makeTag('A', 'F', 'R', 'M');
+
+// On-disk records. Fixed size types only, so the layout does not depend on
+// how glm packs its vectors.
+struct BakedJoint {
+	float position[3];
+	float orientation[4]; // x, y, z, w
+	float jointToWorld[16];
+	int32_t parentIndex;
+};
+
+struct BakedMeshHeader {
+	uint32_t numVertices;
+	uint32_t numTriangles;
+	uint32_t numWeights;
+};
+
+struct BakedVertex {
+	float u;
+	float v;
+	int32_t startWeight;
+	int32_t weightCount;
+};
+
+struct BakedTriangle {
+	uint16_t indices[3];
+};
+
+struct BakedWeight {
+	int32_t jointIndex;
+	float weightBias;
+	float position[3];
+};
+
+struct BakedAnimHeader {
+	int32_t numFrames;
+	int32_t numJoints;
+	int32_t frameRate;
+	int32_t numComponents;
+};
+
+struct BakedJointInfo {
+	int32_t parent;
+	int32_t flags;
+	int32_t startIndex;
+};
+
+struct BakedBaseframe {
+	float position[3];
+	float orientation[4];
+	float jointToWorld[16];
+};
+
+struct BakedBounds {
+	float min[3];
+	float max[3];
+};
+
+void storeVec3(float *out, const vec3 &v) {
+	out[0] = v.x; out[1] = v.y; out[2] = v.z;
+}
+
+void storeQuat(float *out, const quat &q) {
+	out[0] = q.x; out[1] = q.y; out[2] = q.z; out[3] = q.w;
+}
+
+void storeMat4(float *out, const mat4 &m) {
+	for(int col = 0; col < 4; ++col) {
+		for(int row = 0; row < 4; ++row) {
+			out[col * 4 + row] = m[col][row];
+		}
+	}
+}
+
+vec3 loadVec3(const float *in) {
+	return vec3(in[0], in[1], in[2]);
+}
+
+quat loadQuat(const float *in) {
+	return quat(in[3], in[0], in[1], in[2]);
+}
+
+mat4 loadMat4(const float *in) {
+	mat4 m;
+	for(int col = 0; col < 4; ++col) {
+		for(int row = 0; row < 4; ++row) {
+			m[col][row] = in[col * 4 + row];
+		}
+	}
+	return m;
+}
+
+class ChunkWriter {
+public:
+	template<typename T>
+	void add(uint32_t tag, uint32_t index, const vector<T> &items) {
+		add(tag, index, items.empty() ? nullptr : &items[0], items.size() * sizeof(T));
+	}
+
+	void add(uint32_t tag, uint32_t index, const void *data, size_t size) {
+		Pending chunk;
+		chunk.tag = tag;
+		chunk.index = index;
+		chunk.data.assign(static_cast<const char *>(data), static_cast<const char *>(data) + size);
+		mChunks.push_back(chunk);
+	}
+
+	void addStrings(uint32_t tag, const vector<string> &strings) {
+		vector<char> data;
+		for(const string &s : strings) {
+			uint32_t length = s.size();
+			const char *lengthBytes = reinterpret_cast<const char *>(&length);
+			data.insert(data.end(), lengthBytes, lengthBytes + sizeof(length));
+			data.insert(data.end(), s.begin(), s.end());
+		}
+		add(tag, 0, data);
+	}
+
+	void write(const string &filename) {
+		size_t tableEnd = sizeof(BakedHeader) + mChunks.size() * sizeof(BakedChunk);
+		size_t offset = align(tableEnd);
+
+		vector<BakedChunk> table;
+		for(const Pending &pending : mChunks) {
+			BakedChunk chunk;
+			chunk.tag = pending.tag;
+			chunk.index = pending.index;
+			chunk.offset = offset;
+			chunk.size = pending.data.size();
+			table.push_back(chunk);
+
+			offset = align(offset + chunk.size);
+		}
+
+		vector<char> file(offset, 0);
+		if(!table.empty()) {
+			memcpy(&file[sizeof(BakedHeader)], &table[0], table.size() * sizeof(BakedChunk));
+		}
+		for(size_t i = 0; i < mChunks.size(); ++i) {
+			if(!mChunks[i].data.empty()) {
+				memcpy(&file[table[i].offset], &mChunks[i].data[0], mChunks[i].data.size());
+			}
+		}
+
+		BakedHeader header;
+		memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kBakedVersion;
+		header.byteOrder = kByteOrder;
+		header.payloadSize = file.size() - sizeof(BakedHeader);
+		header.checksum = checksum(&file[sizeof(BakedHeader)], header.payloadSize);
+		header.numChunks = table.size();
+		header.reserved = 0;
+		memcpy(&file[0], &header, sizeof(header));
+
+		ofstream out(filename, std::ios::binary);
+		out.write(&file[0], file.size());
+		if(!out) {
+			throw runtime_error(string("Could not write ") + filename);
+		}
+	}
+private:
+	static size_t align(size_t offset) {
+		return (offset + kChunkAlignment - 1) & ~(kChunkAlignment - 1);
+	}
+private:
+	struct Pending {
+		uint32_t tag;
+		uint32_t index;
+		vector<char> data;
+	};
+
+	vector<Pending> mChunks;
+};
+
+void addMesh(ChunkWriter &writer, const MD5_MeshInfo &mesh) {
+	vector<BakedJoint> joints;
+	vector<string> jointNames;
+	for(const Joint &joint : mesh.joints) {
+		BakedJoint baked;
+		storeVec3(baked.position, joint.position);
+		storeQuat(baked.orientation, joint.orientation);
+		storeMat4(baked.jointToWorld, joint.jointToWorld);
+		baked.parentIndex = joint.parentIndex;
+		joints.push_back(baked);
+		jointNames.push_back(joint.name);
+	}
+	writer.add(kTagJoints, 0, joints);
+	writer.addStrings(kTagJointNames, jointNames);
+
+	vector<string> textureNames;
+	for(uint32_t i = 0; i < mesh.meshes.size(); ++i) {
+		const MD5_Mesh &md5mesh = mesh.meshes[i];
+		textureNames.push_back(md5mesh.textureFilename);
+
+		BakedMeshHeader header;
+		header.numVertices = md5mesh.vertices.size();
+		header.numTriangles = md5mesh.triangles.size();
+		header.numWeights = md5mesh.weights.size();
+		writer.add(kTagMeshHeader, i, &header, sizeof(header));
+
+		vector<BakedVertex> vertices;
+		for(const MD5_Vertex &vertex : md5mesh.vertices) {
+			BakedVertex baked = { vertex.u, vertex.v, vertex.startWeight, vertex.weightCount };
+			vertices.push_back(baked);
+		}
+		writer.add(kTagVertices, i, vertices);
+
+		vector<BakedTriangle> triangles;
+		for(const MD5_Triangle &triangle : md5mesh.triangles) {
+			BakedTriangle baked = { { triangle.indices[0], triangle.indices[1], triangle.indices[2] } };
+			triangles.push_back(baked);
+		}
+		writer.add(kTagTriangles, i, triangles);
+
+		vector<BakedWeight> weights;
+		for(const MD5_Weight &weight : md5mesh.weights) {
+			BakedWeight baked;
+			baked.jointIndex = weight.jointIndex;
+			baked.weightBias = weight.weightBias;
+			storeVec3(baked.position, weight.position);
+			weights.push_back(baked);
+		}
+		writer.add(kTagWeights, i, weights);
+
+		// GPU-ready data in the bind pose
+		MeshStreams streams = buildMeshStreams(md5mesh, mesh.joints);
+		writer.add(kTagPositions, i, streams.positions);
+		writer.add(kTagJointIndices, i, streams.jointIndices);
+		writer.add(kTagJointWeights, i, streams.jointWeights);
+		writer.add(kTagTextureCoords, i, streams.textureCoords);
+		writer.add(kTagIndices, i, streams.indices);
+	}
+	writer.addStrings(kTagTextureNames, textureNames);
+
+	vector<float> inverseBindPose;
+	for(const mat4 &m : buildInverseBindPose(mesh.joints)) {
+		float values[16];
+		storeMat4(values, m);
+		inverseBindPose.insert(inverseBindPose.end(), values, values + 16);
+	}
+	writer.add(kTagInverseBindPose, 0, inverseBindPose);
+}
+
+void addAnim(ChunkWriter &writer, const MD5_AnimInfo &anim) {
+	BakedAnimHeader header;
+	header.numFrames = anim.numFrames;
+	header.numJoints = anim.jointsInfo.size();
+	header.frameRate = anim.frameRate;
+	header.numComponents = anim.framesData.numComponents();
+	writer.add(kTagAnimHeader, 0, &header, sizeof(header));
+
+	vector<BakedJointInfo> hierarchy;
+	vector<string> names;
+	for(const JointInfo &info : anim.jointsInfo) {
+		BakedJointInfo baked = { info.parent, info.flags, info.startIndex };
+		hierarchy.push_back(baked);
+		names.push_back(info.name);
+	}
+	writer.add(kTagHierarchy, 0, hierarchy);
+	writer.addStrings(kTagAnimJointNames, names);
+
+	vector<BakedBaseframe> baseframe;
+	for(const BaseframeJoint &joint : anim.baseframeJoints) {
+		BakedBaseframe baked;
+		storeVec3(baked.position, joint.position);
+		storeQuat(baked.orientation, joint.orientation);
+		storeMat4(baked.jointToWorld, joint.jointToWorld);
+		baseframe.push_back(baked);
+	}
+	writer.add(kTagBaseframe, 0, baseframe);
+
+	vector<BakedBounds> bounds;
+	for(const FrameBounds &frameBounds : anim.bounds) {
+		BakedBounds baked;
+		storeVec3(baked.min, frameBounds.min);
+		storeVec3(baked.max, frameBounds.max);
+		bounds.push_back(baked);
+	}
+	writer.add(kTagBounds, 0, bounds);
+
+	// Frames are stored frame major on disk whatever the in memory layout.
+	if(anim.framesData.layout() == AnimFrames::FrameMajor) {
+		writer.add(kTagFrames, 0, anim.framesData.data(), anim.framesData.sizeInBytes());
+	} else {
+		AnimFrames frames = anim.framesData.withLayout(AnimFrames::FrameMajor);
+		writer.add(kTagFrames, 0, frames.data(), frames.sizeInBytes());
+	}
+}
+
+}
+
+void writeBakedAsset(const string &filename, const MD5_MeshInfo *mesh, const MD5_AnimInfo *anim) {
+	ChunkWriter writer;
+
+	if(mesh) {
+		addMesh(writer, *mesh);
+	}
+	if(anim) {
+		addAnim(writer, *anim);
+	}
+
+	writer.write(filename);
+}
+
+BakedAsset::BakedAsset()
+	: mChunks(nullptr), mNumChunks(0) {
+}
+
+BakedAsset::BakedAsset(const string &filename)
+	: mChunks(nullptr), mNumChunks(0) {
+	open(filename);
+}
+
+void BakedAsset::open(const string &filename) {
+	mFile.open(filename);
+	mChunks = nullptr;
+	mNumChunks = 0;
+
+	if(mFile.size() < sizeof(BakedHeader)) {
+		throw runtime_error(filename + " is too small to be a baked asset.");
+	}
+
+	BakedHeader header;
+	memcpy(&header, mFile.begin(), sizeof(header));
+
+	if(memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+		throw runtime_error(filename + " is not a baked asset.");
+	}
+	if(header.version != kBakedVersion) {
+		throw runtime_error(filename + " was baked with a different version of bones_cook.");
+	}
+	if(header.byteOrder != kByteOrder) {
+		throw runtime_error(filename + " was baked on a machine with a different byte order.");
+	}
+	if(header.payloadSize != mFile.size() - sizeof(BakedHeader)) {
+		throw runtime_error(filename + " is truncated.");
+	}
+	if(header.checksum != checksum(mFile.begin() + sizeof(BakedHeader), header.payloadSize)) {
+		throw runtime_error(filename + " failed its checksum.");
+	}
+
+	const BakedChunk *chunks = reinterpret_cast<const BakedChunk *>(mFile.begin() + sizeof(BakedHeader));
+	if(header.numChunks > header.payloadSize / sizeof(BakedChunk)) {
+		throw runtime_error(filename + " has a corrupt chunk table.");
+	}
+	for(uint32_t i = 0; i < header.numChunks; ++i) {
+		if(chunks[i].offset > mFile.size() || chunks[i].size > mFile.size() - chunks[i].offset) {
+			throw runtime_error(filename + " has a chunk outside the file.");
+		}
+	}
+
+	mChunks = chunks;
+	mNumChunks = header.numChunks;
+}
+
+const BakedChunk *BakedAsset::findChunk(uint32_t tag, uint32_t index) const {
+	for(uint32_t i = 0; i < mNumChunks; ++i) {
+		if(mChunks[i].tag == tag && mChunks[i].index == index) {
+			return &mChunks[i];
+		}
+	}
+	return nullptr;
+}
+
+const char *BakedAsset::chunkData(uint32_t tag, uint32_t index, size_t elementSize, size_t &count) const {
+	const BakedChunk *chunk = findChunk(tag, index);
+	if(!chunk || chunk->size % elementSize != 0) {
+		throw runtime_error("Baked asset is missing a chunk or has one of the wrong size.");
+	}
+
+	count = chunk->size / elementSize;
+	return mFile.begin() + chunk->offset;
+}
+
+template<typename T>
+vector<T> BakedAsset::chunkArray(uint32_t tag, uint32_t index) const {
+	size_t count;
+	const char *data = chunkData(tag, index, sizeof(T), count);
+
+	vector<T> items(count);
+	if(count > 0) {
+		memcpy(&items[0], data, count * sizeof(T));
+	}
+	return items;
+}
+
+vector<string> BakedAsset::chunkStrings(uint32_t tag) const {
+	size_t size;
+	const char *p = chunkData(tag, 0, 1, size);
+	const char *end = p + size;
+
+	vector<string> strings;
+	while(p != end) {
+		uint32_t length;
+		if(end - p < static_cast<ptrdiff_t>(sizeof(length))) {
+			throw runtime_error("Baked asset has a corrupt string table.");
+		}
+		memcpy(&length, p, sizeof(length));
+		p += sizeof(length);
+
+		if(static_cast<size_t>(end - p) < length) {
+			throw runtime_error("Baked asset has a corrupt string table.");
+		}
+		strings.push_back(string(p, p + length));
+		p += length;
+	}
+
+	return strings;
+}
+
+bool BakedAsset::hasMesh() const {
+	return findChunk(kTagJoints, 0) != nullptr;
+}
+
+bool BakedAsset::hasAnim() const {
+	return findChunk(kTagAnimHeader, 0) != nullptr;
+}
+
+int BakedAsset::numMeshes() const {
+	int count = 0;
+	while(findChunk(kTagMeshHeader, count)) {
+		++count;
+	}
+	return count;
+}
+
+MD5_MeshInfo BakedAsset::meshInfo() const {
+	MD5_MeshInfo mesh;
+
+	vector<BakedJoint> joints = chunkArray<BakedJoint>(kTagJoints, 0);
+	vector<string> jointNames = chunkStrings(kTagJointNames);
+	if(jointNames.size() != joints.size()) {
+		throw runtime_error("Baked asset joint names do not match the joints.");
+	}
+
+	mesh.joints.resize(joints.size());
+	for(size_t i = 0; i < joints.size(); ++i) {
+		Joint &joint = mesh.joints[i];
+		joint.name = jointNames[i];
+		joint.position = loadVec3(joints[i].position);
+		joint.orientation = loadQuat(joints[i].orientation);
+		joint.jointToWorld = loadMat4(joints[i].jointToWorld);
+		joint.parentIndex = joints[i].parentIndex;
+	}
+
+	vector<string> textureNames = chunkStrings(kTagTextureNames);
+	mesh.meshes.resize(numMeshes());
+	if(textureNames.size() != mesh.meshes.size()) {
+		throw runtime_error("Baked asset texture names do not match the meshes.");
+	}
+
+	for(uint32_t i = 0; i < mesh.meshes.size(); ++i) {
+		MD5_Mesh &md5mesh = mesh.meshes[i];
+		md5mesh.textureFilename = textureNames[i];
+
+		vector<BakedVertex> vertices = chunkArray<BakedVertex>(kTagVertices, i);
+		md5mesh.vertices.resize(vertices.size());
+		for(size_t v = 0; v < vertices.size(); ++v) {
+			md5mesh.vertices[v].u = vertices[v].u;
+			md5mesh.vertices[v].v = vertices[v].v;
+			md5mesh.vertices[v].startWeight = vertices[v].startWeight;
+			md5mesh.vertices[v].weightCount = vertices[v].weightCount;
+		}
+
+		vector<BakedTriangle> triangles = chunkArray<BakedTriangle>(kTagTriangles, i);
+		md5mesh.triangles.resize(triangles.size());
+		for(size_t t = 0; t < triangles.size(); ++t) {
+			for(int k = 0; k < 3; ++k) {
+				md5mesh.triangles[t].indices[k] = triangles[t].indices[k];
+			}
+		}
+
+		vector<BakedWeight> weights = chunkArray<BakedWeight>(kTagWeights, i);
+		md5mesh.weights.resize(weights.size());
+		for(size_t w = 0; w < weights.size(); ++w) {
+			md5mesh.weights[w].jointIndex = weights[w].jointIndex;
+			md5mesh.weights[w].weightBias = weights[w].weightBias;
+			md5mesh.weights[w].position = loadVec3(weights[w].position);
+		}
+	}
+
+	return mesh;
+}
+
+MD5_AnimInfo BakedAsset::animInfo() const {
+	MD5_AnimInfo anim;
+
+	vector<BakedAnimHeader> header = chunkArray<BakedAnimHeader>(kTagAnimHeader, 0);
+	if(header.size() != 1) {
+		throw runtime_error("Baked asset has a corrupt animation header.");
+	}
+
+	anim.numFrames = header[0].numFrames;
+	anim.frameRate = header[0].frameRate;
+	const int numComponents = header[0].numComponents;
+
+	vector<BakedJointInfo> hierarchy = chunkArray<BakedJointInfo>(kTagHierarchy, 0);
+	vector<string> names = chunkStrings(kTagAnimJointNames);
+	vector<BakedBaseframe> baseframe = chunkArray<BakedBaseframe>(kTagBaseframe, 0);
+	if(names.size() != hierarchy.size() || baseframe.size() != hierarchy.size()) {
+		throw runtime_error("Baked asset hierarchy does not match the baseframe.");
+	}
+
+	anim.jointsInfo.resize(hierarchy.size());
+	anim.baseframeJoints.resize(hierarchy.size());
+	for(size_t i = 0; i < hierarchy.size(); ++i) {
+		JointInfo &info = anim.jointsInfo[i];
+		info.name = names[i];
+		info.parent = hierarchy[i].parent;
+		info.flags = hierarchy[i].flags;
+		info.startIndex = hierarchy[i].startIndex;
+
+		BaseframeJoint &joint = anim.baseframeJoints[i];
+		joint.position = loadVec3(baseframe[i].position);
+		joint.orientation = loadQuat(baseframe[i].orientation);
+		joint.jointToWorld = loadMat4(baseframe[i].jointToWorld);
+	}
+
+	vector<BakedBounds> bounds = chunkArray<BakedBounds>(kTagBounds, 0);
+	if(!bounds.empty() && bounds.size() != static_cast<size_t>(anim.numFrames)) {
+		throw runtime_error("Baked asset bounds do not match its header.");
+	}
+	anim.bounds.resize(bounds.size());
+	for(size_t i = 0; i < bounds.size(); ++i) {
+		anim.bounds[i].min = loadVec3(bounds[i].min);
+		anim.bounds[i].max = loadVec3(bounds[i].max);
+	}
+
+	size_t count;
+	const float *frames = reinterpret_cast<const float *>(chunkData(kTagFrames, 0, sizeof(float), count));
+	if(count != static_cast<size_t>(anim.numFrames) * numComponents) {
+		throw runtime_error("Baked asset frame data does not match its header.");
+	}
+
+	anim.framesData.resize(anim.numFrames, numComponents);
+	if(count) {
+		memcpy(anim.framesData.data(), frames, anim.framesData.sizeInBytes());
+	}
+
+	return anim;
+}
+
+MeshStreams BakedAsset::meshStreams(int mesh) const {
+	MeshStreams streams;
+
+	streams.positions = chunkArray<float>(kTagPositions, mesh);
+	streams.jointIndices = chunkArray<int>(kTagJointIndices, mesh);
+	streams.jointWeights = chunkArray<float>(kTagJointWeights, mesh);
+	streams.textureCoords = chunkArray<float>(kTagTextureCoords, mesh);
+	streams.indices = chunkArray<unsigned short>(kTagIndices, mesh);
+
+	return streams;
+}
+
+string BakedAsset::textureFilename(int mesh) const {
+	vector<string> textureNames = chunkStrings(kTagTextureNames);
+	if(mesh < 0 || mesh >= static_cast<int>(textureNames.size())) {
+		throw runtime_error("Baked asset has no such mesh.");
+	}
+	return textureNames[mesh];
+}
+
+vector<mat4> BakedAsset::inverseBindPose() const {
+	vector<float> values = chunkArray<float>(kTagInverseBindPose, 0);
+
+	vector<mat4> matrices(values.size() / 16);
+	for(size_t i = 0; i < matrices.size(); ++i) {
+		matrices[i] = loadMat4(&values[i * 16]);
+	}
+	return matrices;
+}
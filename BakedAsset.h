@@ -0,0 +1,74 @@
+#ifndef BAKED_ASSET_H
+#define BAKED_ASSET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "MD5_MeshReader.h"
+#include "MD5_AnimReader.h"
+#include "MappedFile.h"
+#include "MeshStreams.h"
+
+// Binary form of an MD5 mesh and/or animation written by bones_cook. It
+// holds the parsed MD5 data plus the bind pose vertex streams and inverse
+// bind pose matrices, so loading is a map, a checksum and a few memcpys.
+//
+// Layout: BakedHeader, then a table of numChunks BakedChunk entries, then
+// the chunk data. Every chunk starts on a 16 byte boundary. The checksum
+// covers everything after the header.
+const uint32_t kBakedVersion = 2;
+
+struct BakedHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t payloadSize;
+	uint64_t checksum;
+	uint32_t numChunks;
+	uint32_t reserved;
+};
+
+struct BakedChunk {
+	uint32_t tag;
+	uint32_t index;
+	uint64_t offset;
+	uint64_t size;
+};
+
+void writeBakedAsset(const std::string &filename, const MD5_MeshInfo *mesh, const MD5_AnimInfo *anim);
+
+class BakedAsset {
+public:
+	BakedAsset();
+	explicit BakedAsset(const std::string &filename);
+
+	// Maps the file and validates the header, version and checksum. Throws a
+	// runtime_error if any of them are wrong.
+	void open(const std::string &filename);
+
+	bool hasMesh() const;
+	bool hasAnim() const;
+
+	MD5_MeshInfo meshInfo() const;
+	MD5_AnimInfo animInfo() const;
+
+	int numMeshes() const;
+	MeshStreams meshStreams(int mesh) const;
+	std::string textureFilename(int mesh) const;
+	std::vector<glm::mat4> inverseBindPose() const;
+private:
+	const BakedChunk *findChunk(uint32_t tag, uint32_t index) const;
+	const char *chunkData(uint32_t tag, uint32_t index, size_t elementSize, size_t &count) const;
+
+	template<typename T>
+	std::vector<T> chunkArray(uint32_t tag, uint32_t index) const;
+	std::vector<std::string> chunkStrings(uint32_t tag) const;
+private:
+	MappedFile mFile;
+	const BakedChunk *mChunks;
+	uint32_t mNumChunks;
+};
+
+#endif
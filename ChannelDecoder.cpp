@@ -0,0 +1,131 @@
+#include "ChannelDecoder.h"
+
+#include <map>
+#include <stdexcept>
+
+using std::map;
+using std::runtime_error;
+using std::vector;
+
+namespace {
+
+const int kNumChannels = 6;
+const int kNumPatterns = 1 << kNumChannels;
+
+// Position of channel's value among a joint's components: the number of
+// lower flag bits that are set.
+constexpr int componentOffset(int flags, int channel) {
+	return channel == 0 ? 0 : ((flags >> (channel - 1)) & 1) + componentOffset(flags, channel - 1);
+}
+
+// Flags is a constant, so the test folds away and only the copy is left.
+template<int Flags, int Channel>
+inline void decodeChannel(const float *source, const ChannelTargets &targets, int joint) {
+	if(Flags & (1 << Channel)) {
+		targets.rows[Channel][joint * targets.steps[Channel]] = source[componentOffset(Flags, Channel)];
+	}
+}
+
+template<int Flags>
+void decodeGroup(const float *components, const int *joints, const int *startIndices, int count,
+				 const ChannelTargets &targets) {
+	for(int i = 0; i < count; ++i) {
+		const float *source = components + startIndices[i];
+		const int joint = joints[i];
+
+		decodeChannel<Flags, 0>(source, targets, joint);
+		decodeChannel<Flags, 1>(source, targets, joint);
+		decodeChannel<Flags, 2>(source, targets, joint);
+		decodeChannel<Flags, 3>(source, targets, joint);
+		decodeChannel<Flags, 4>(source, targets, joint);
+		decodeChannel<Flags, 5>(source, targets, joint);
+	}
+}
+
+typedef void (*GroupDecoder)(const float *, const int *, const int *, int, const ChannelTargets &);
+
+// Fills table[0..Flags] with the decoder for each pattern.
+template<int Flags>
+struct DecoderTable {
+	static void fill(GroupDecoder *table) {
+		table[Flags] = &decodeGroup<Flags>;
+		DecoderTable<Flags - 1>::fill(table);
+	}
+};
+
+template<>
+struct DecoderTable<-1> {
+	static void fill(GroupDecoder *) {
+	}
+};
+
+struct Decoders {
+	GroupDecoder table[kNumPatterns];
+
+	Decoders() {
+		DecoderTable<kNumPatterns - 1>::fill(table);
+	}
+};
+
+const Decoders kDecoders;
+
+}
+
+ChannelDecoder::ChannelDecoder() : mNumComponents(0) {
+}
+
+ChannelDecoder::ChannelDecoder(const vector<JointInfo> &jointsInfo, int numComponents)
+	: mNumComponents(numComponents) {
+	// Joints keep their order within a group, so writes still walk forward.
+	map<int, vector<int>> jointsByFlags;
+	for(int i = 0; i < jointsInfo.size(); ++i) {
+		const JointInfo &jointInfo = jointsInfo[i];
+		const int flags = jointInfo.flags & (kNumPatterns - 1);
+		if(flags == 0) {
+			continue;
+		}
+
+		const int count = componentOffset(flags, kNumChannels);
+		if(jointInfo.startIndex < 0 || jointInfo.startIndex + count > numComponents) {
+			throw runtime_error("Joint " + jointInfo.name + " reads past the end of the frame.");
+		}
+		jointsByFlags[flags].push_back(i);
+	}
+
+	for(auto &pattern : jointsByFlags) {
+		Group group = {pattern.first, static_cast<int>(mJoints.size()), static_cast<int>(pattern.second.size())};
+		mGroups.push_back(group);
+
+		for(int joint : pattern.second) {
+			mJoints.push_back(joint);
+			mStartIndices.push_back(jointsInfo[joint].startIndex);
+		}
+	}
+}
+
+void ChannelDecoder::decode(const float *components, const ChannelTargets &targets) const {
+	for(const Group &group : mGroups) {
+		kDecoders.table[group.flags](components, mJoints.data() + group.first, mStartIndices.data() + group.first,
+									 group.count, targets);
+	}
+}
+
+ChannelTargets ChannelDecoder::targets(vector<glm::vec3> &positions, vector<glm::quat> &orientations) {
+	ChannelTargets targets = {};
+	if(positions.empty()) {
+		return targets;
+	}
+
+	static_assert(sizeof(glm::vec3) % sizeof(float) == 0 && sizeof(glm::quat) % sizeof(float) == 0,
+				  "Elements must be a whole number of floats apart.");
+	targets.rows[0] = &positions[0].x;
+	targets.rows[1] = &positions[0].y;
+	targets.rows[2] = &positions[0].z;
+	targets.rows[3] = &orientations[0].x;
+	targets.rows[4] = &orientations[0].y;
+	targets.rows[5] = &orientations[0].z;
+	for(int channel = 0; channel < kNumChannels; ++channel) {
+		targets.steps[channel] = (channel < 3 ? sizeof(glm::vec3) : sizeof(glm::quat)) / sizeof(float);
+	}
+	return targets;
+}
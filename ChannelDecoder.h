@@ -0,0 +1,56 @@
+#ifndef CHANNEL_DECODER_H
+#define CHANNEL_DECODER_H
+
+#include <vector>
+
+#include "MD5_AnimReader.h"
+
+// Where decoded components are written. Component c (0-5 for x, y, z, qx, qy,
+// qz, the order of the flag bits) of joint j goes to rows[c][j * steps[c]].
+// A struct of arrays block has steps of 1; for vectors of vec3 and quat, rows
+// point at the members of element 0 and the steps are the element sizes in
+// floats.
+struct ChannelTargets {
+	float *rows[6];
+	int steps[6];
+};
+
+// Copies the animated components of a frame over a pose that already holds
+// the baseframe, without testing flags per joint.
+//
+// At load the joints are grouped by their 6 bit flag pattern. Each group is
+// decoded by one of 64 functions compiled for its pattern, which know which
+// components a joint has and where each one sits in the frame, so the inner
+// loop is a straight run of loads and stores. Joints that animate nothing
+// are dropped.
+class ChannelDecoder {
+public:
+	ChannelDecoder();
+	// Throws a runtime_error if a joint's components run past the end of a
+	// numComponents frame.
+	ChannelDecoder(const std::vector<JointInfo> &jointsInfo, int numComponents);
+
+	int numComponents() const { return mNumComponents; }
+	// Distinct flag patterns among the animated joints.
+	int numGroups() const { return mGroups.size(); }
+
+	// components holds the numComponents values of one frame.
+	void decode(const float *components, const ChannelTargets &targets) const;
+
+	// Targets for a vector of positions and one of orientations.
+	static ChannelTargets targets(std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations);
+private:
+	struct Group {
+		int flags;
+		int first;
+		int count;
+	};
+
+	int mNumComponents;
+	std::vector<Group> mGroups;
+	// Joint and startIndex pairs, group after group.
+	std::vector<int> mJoints;
+	std::vector<int> mStartIndices;
+};
+
+#endif
@@ -0,0 +1,1417 @@
+#include "ColladaReader.h"
+#include "MD5_Tokenizer.h"
+#include "MappedFile.h"
+#include "MeshStreams.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <glm/gtc/matrix_transform.hpp>
+
+using std::map;
+using std::max;
+using std::min;
+using std::pair;
+using std::runtime_error;
+using std::set;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+
+namespace {
+
+inline bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Pull parser over an XML document held in memory. Names and attribute values
+// point into the document, so nothing is copied until a caller asks for it.
+// Comments, processing instructions, CDATA and the doctype are skipped.
+class XmlCursor {
+public:
+	enum Event {
+		StartElement,
+		EndElement,
+		End
+	};
+
+	XmlCursor(const char *begin, const char *end)
+		: mBegin(begin), mCur(begin), mEnd(end), mPendingEnd(false) {
+	}
+
+	Event next();
+
+	// After a StartElement: moves to the element's next child and returns
+	// true, or returns false at its end tag. Each child has to be read to
+	// its end, with skipElement() or a nextChild() loop of its own.
+	bool nextChild();
+	// After a StartElement: skips everything up to and including its end tag.
+	void skipElement();
+
+	// Name of the element last started or ended.
+	bool is(const char *name) const { return mName == name; }
+	// Empty when the element started last has no such attribute.
+	string attribute(const char *name) const;
+
+	// The text of the element just started, up to its first child or its
+	// end tag.
+	void readFloats(vector<float> &out);
+	// Steps over the text instead, for a readFloats(text, out) later on.
+	MD5_Token skipText();
+	void readFloats(const MD5_Token &text, vector<float> &out) const;
+	void readInts(vector<int> &out);
+	void readWords(vector<string> &out);
+	string readText();
+
+	// Throws a runtime_error that names the current line.
+	[[noreturn]] void error(const string &message) const;
+private:
+	[[noreturn]] void errorAt(const char *where, const string &message) const;
+	bool startsWith(const char *text) const;
+	void skipPast(const char *terminator);
+	void skipSpace();
+	const char *textEnd() const;
+private:
+	const char *mBegin;
+	const char *mCur;
+	const char *mEnd;
+
+	MD5_Token mName;
+	vector<pair<MD5_Token, MD5_Token>> mAttributes;
+	// A self-closing tag reports its end on the following call.
+	bool mPendingEnd;
+};
+
+bool XmlCursor::startsWith(const char *text) const {
+	size_t len = strlen(text);
+	return static_cast<size_t>(mEnd - mCur) >= len && memcmp(mCur, text, len) == 0;
+}
+
+void XmlCursor::skipPast(const char *terminator) {
+	const char *found = std::search(mCur, mEnd, terminator, terminator + strlen(terminator));
+	if(found == mEnd) {
+		error("Unterminated markup.");
+	}
+	mCur = found + strlen(terminator);
+}
+
+void XmlCursor::skipSpace() {
+	while(mCur != mEnd && isSpace(*mCur)) {
+		++mCur;
+	}
+}
+
+XmlCursor::Event XmlCursor::next() {
+	if(mPendingEnd) {
+		mPendingEnd = false;
+		return EndElement;
+	}
+
+	for(;;) {
+		mCur = std::find(mCur, mEnd, '<');
+		if(mCur == mEnd) {
+			return End;
+		}
+		++mCur;
+
+		if(startsWith("!--")) {
+			skipPast("-->");
+			continue;
+		}
+		if(startsWith("![CDATA[")) {
+			skipPast("]]>");
+			continue;
+		}
+		if(startsWith("?") || startsWith("!")) {
+			skipPast(">");
+			continue;
+		}
+
+		bool closing = startsWith("/");
+		if(closing) {
+			++mCur;
+		}
+
+		mName.begin = mCur;
+		while(mCur != mEnd && !isSpace(*mCur) && *mCur != '>' && *mCur != '/') {
+			++mCur;
+		}
+		mName.end = mCur;
+		if(mName.begin == mName.end) {
+			error("Expected an element name.");
+		}
+
+		if(closing) {
+			skipPast(">");
+			return EndElement;
+		}
+
+		mAttributes.clear();
+		for(;;) {
+			skipSpace();
+			if(mCur == mEnd) {
+				error("Unterminated tag.");
+			}
+			if(*mCur == '>') {
+				++mCur;
+				return StartElement;
+			}
+			if(*mCur == '/') {
+				skipPast(">");
+				mPendingEnd = true;
+				return StartElement;
+			}
+
+			MD5_Token name;
+			name.begin = mCur;
+			while(mCur != mEnd && !isSpace(*mCur) && *mCur != '=') {
+				++mCur;
+			}
+			name.end = mCur;
+
+			skipSpace();
+			if(mCur == mEnd || *mCur != '=') {
+				error("Expected = after attribute " + name.str() + ".");
+			}
+			++mCur;
+			skipSpace();
+			if(mCur == mEnd || (*mCur != '"' && *mCur != '\'')) {
+				error("Expected a quoted value for attribute " + name.str() + ".");
+			}
+
+			MD5_Token value;
+			value.begin = mCur + 1;
+			value.end = std::find(value.begin, mEnd, *mCur);
+			if(value.end == mEnd) {
+				error("Unterminated attribute value.");
+			}
+			mCur = value.end + 1;
+
+			mAttributes.push_back(std::make_pair(name, value));
+		}
+	}
+}
+
+bool XmlCursor::nextChild() {
+	Event event = next();
+	if(event == End) {
+		error("Unexpected end of file.");
+	}
+	return event == StartElement;
+}
+
+void XmlCursor::skipElement() {
+	int depth = 1;
+	while(depth > 0) {
+		Event event = next();
+		if(event == End) {
+			error("Unexpected end of file.");
+		}
+		depth += (event == StartElement) ? 1 : -1;
+	}
+}
+
+string XmlCursor::attribute(const char *name) const {
+	for(const pair<MD5_Token, MD5_Token> &attribute : mAttributes) {
+		if(attribute.first != name) {
+			continue;
+		}
+
+		// Ids and targets rarely hold entities, but decode the predefined ones.
+		string value;
+		for(const char *p = attribute.second.begin; p != attribute.second.end; ++p) {
+			static const char *kEntities[][2] = {
+				{"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}
+			};
+
+			bool decoded = false;
+			for(const auto &entity : kEntities) {
+				size_t len = strlen(entity[0]);
+				if(static_cast<size_t>(attribute.second.end - p) >= len && memcmp(p, entity[0], len) == 0) {
+					value += entity[1];
+					p += len - 1;
+					decoded = true;
+					break;
+				}
+			}
+			if(!decoded) {
+				value += *p;
+			}
+		}
+		return value;
+	}
+	return string();
+}
+
+const char *XmlCursor::textEnd() const {
+	return mPendingEnd ? mCur : std::find(mCur, mEnd, '<');
+}
+
+void XmlCursor::readFloats(vector<float> &out) {
+	readFloats(skipText(), out);
+}
+
+MD5_Token XmlCursor::skipText() {
+	MD5_Token text = {mCur, textEnd()};
+	mCur = text.end;
+	return text;
+}
+
+void XmlCursor::readFloats(const MD5_Token &text, vector<float> &out) const {
+	const char *cur = text.begin;
+	for(;;) {
+		while(cur != text.end && isSpace(*cur)) {
+			++cur;
+		}
+		if(cur == text.end) {
+			return;
+		}
+
+		float value;
+		const char *after = MD5_Number::parseFloat(cur, text.end, value);
+		if(!after) {
+			errorAt(cur, "Expected a number.");
+		}
+		out.push_back(value);
+		cur = after;
+	}
+}
+
+void XmlCursor::readInts(vector<int> &out) {
+	const char *end = textEnd();
+	for(;;) {
+		while(mCur != end && isSpace(*mCur)) {
+			++mCur;
+		}
+		if(mCur == end) {
+			return;
+		}
+
+		int value;
+		const char *after = MD5_Number::parseInt(mCur, end, value);
+		if(!after) {
+			error("Expected an integer.");
+		}
+		out.push_back(value);
+		mCur = after;
+	}
+}
+
+void XmlCursor::readWords(vector<string> &out) {
+	const char *end = textEnd();
+	for(;;) {
+		while(mCur != end && isSpace(*mCur)) {
+			++mCur;
+		}
+		if(mCur == end) {
+			return;
+		}
+
+		const char *start = mCur;
+		while(mCur != end && !isSpace(*mCur)) {
+			++mCur;
+		}
+		out.push_back(string(start, mCur));
+	}
+}
+
+string XmlCursor::readText() {
+	vector<string> words;
+	readWords(words);
+
+	string text;
+	for(const string &word : words) {
+		if(!text.empty()) {
+			text += ' ';
+		}
+		text += word;
+	}
+	return text;
+}
+
+void XmlCursor::error(const string &message) const {
+	errorAt(mCur, message);
+}
+
+void XmlCursor::errorAt(const char *where, const string &message) const {
+	long line = 1 + std::count(mBegin, where, '\n');
+
+	stringstream out;
+	out << "Line " << line << ": " << message;
+	throw runtime_error(out.str());
+}
+
+// What the parser keeps of the document.
+
+struct Source {
+	// The float_array, left as text until findSource() is asked for the
+	// source, so the ones nothing refers to, such as normals, are never read.
+	MD5_Token floatText;
+	vector<float> floats;
+	vector<string> names;
+	int stride;
+};
+typedef map<string, Source> Sources;
+
+struct Input {
+	string semantic;
+	string source;
+	int offset;
+	int set;
+};
+
+// One <triangles>, <polylist> or <polygons> element with its vertices split
+// wherever a position is used with different texture coordinates.
+struct Primitive {
+	vector<int> positionIndices;
+	vector<vec2> textureCoords;
+	vector<MD5_Triangle> triangles;
+};
+
+struct Geometry {
+	vector<vec3> positions;
+	vector<Primitive> primitives;
+};
+
+struct Skin {
+	string geometryId;
+	mat4 bindShape;
+	vector<string> jointNames;
+	vector<mat4> inverseBindMatrices;
+
+	// The influences of position i are influences[firstInfluence[i]] on,
+	// influenceCounts[i] of them, as (index into jointNames, weight).
+	vector<int> influenceCounts;
+	vector<int> firstInfluence;
+	vector<pair<int, float>> influences;
+};
+
+enum TransformType {
+	Translate,
+	Rotate,
+	Scale,
+	Matrix
+};
+
+struct TransformElement {
+	string sid;
+	TransformType type;
+	float values[16];
+};
+
+struct SceneJoint {
+	string id;
+	string sid;
+	string name;
+	int parent;
+	// The transforms of the plain nodes between the joint and its parent
+	// joint, or the scene root.
+	mat4 preTransform;
+	vector<TransformElement> elements;
+};
+
+enum Interpolation {
+	Linear,
+	Step,
+	Bezier
+};
+
+struct Channel {
+	string nodeId;
+	string sid;
+	// What follows the sid in the target: ".ANGLE", "(3)(0)" or empty.
+	string member;
+
+	vector<float> times;
+	vector<float> values;
+	int stride;
+
+	vector<Interpolation> interpolations;
+	// Absolute (time, value) control points, one pair per key and value.
+	vector<float> inTangents;
+	vector<float> outTangents;
+};
+
+string stripHash(const string &uri) {
+	return (!uri.empty() && uri[0] == '#') ? uri.substr(1) : uri;
+}
+
+int toInt(const string &text, int fallback) {
+	return text.empty() ? fallback : atoi(text.c_str());
+}
+
+// COLLADA writes matrices row by row.
+mat4 rowMajor(const float *values) {
+	mat4 m;
+	for(int row = 0; row < 4; ++row) {
+		for(int col = 0; col < 4; ++col) {
+			m[col][row] = values[row * 4 + col];
+		}
+	}
+	return m;
+}
+
+mat4 composeElements(const vector<TransformElement> &elements) {
+	mat4 m;
+	for(const TransformElement &element : elements) {
+		const float *v = element.values;
+		switch(element.type) {
+		case Translate:
+			m = glm::translate(m, vec3(v[0], v[1], v[2]));
+			break;
+		case Rotate:
+			if(v[0] != 0 || v[1] != 0 || v[2] != 0) {
+				m = glm::rotate(m, v[3], vec3(v[0], v[1], v[2]));
+			}
+			break;
+		case Scale:
+			m = glm::scale(m, vec3(v[0], v[1], v[2]));
+			break;
+		case Matrix:
+			m = m * rowMajor(v);
+			break;
+		}
+	}
+	return m;
+}
+
+// Splits m into a translation and a rotation with w <= 0, as the MD5 files
+// store them. Any scale is divided out of the axes and lost.
+void decompose(const mat4 &m, vec3 &position, quat &orientation) {
+	position = vec3(m[3].x, m[3].y, m[3].z);
+
+	mat4 rotation;
+	for(int col = 0; col < 3; ++col) {
+		vec3 axis(m[col].x, m[col].y, m[col].z);
+		float len = glm::length(axis);
+		if(len > 0) {
+			axis = axis / len;
+		}
+		rotation[col] = vec4(axis, 0);
+	}
+
+	orientation = glm::normalize(glm::quat_cast(rotation));
+	if(orientation.w > 0) {
+		orientation = -orientation;
+	}
+}
+
+mat4 rigidTransform(const vec3 &position, const quat &orientation) {
+	return glm::translate(mat4(), position) * glm::mat4_cast(orientation);
+}
+
+// x(s) of a cubic Bezier segment is monotonic for the curves exporters
+// write, so bisection finds the parameter at time t.
+float sampleBezier(float t, float t0, float v0, float outT, float outV, float inT, float inV, float t1, float v1) {
+	float lo = 0;
+	float hi = 1;
+	float s = 0.5f;
+
+	for(int i = 0; i < 24; ++i) {
+		s = (lo + hi) * 0.5f;
+		float r = 1 - s;
+		float x = r * r * r * t0 + 3 * r * r * s * outT + 3 * r * s * s * inT + s * s * s * t1;
+		if(x < t) {
+			lo = s;
+		} else {
+			hi = s;
+		}
+	}
+
+	float r = 1 - s;
+	return r * r * r * v0 + 3 * r * r * s * outV + 3 * r * s * s * inV + s * s * s * v1;
+}
+
+// Value number component of channel at time t. Before the first key and after
+// the last the curve holds its end values.
+float sampleChannel(const Channel &channel, int component, float t) {
+	const vector<float> &times = channel.times;
+	const int stride = channel.stride;
+
+	if(t <= times.front()) {
+		return channel.values[component];
+	}
+	if(t >= times.back()) {
+		return channel.values[(times.size() - 1) * stride + component];
+	}
+
+	int key = std::upper_bound(times.begin(), times.end(), t) - times.begin() - 1;
+	float t0 = times[key];
+	float t1 = times[key + 1];
+	float v0 = channel.values[key * stride + component];
+	float v1 = channel.values[(key + 1) * stride + component];
+
+	Interpolation interpolation = key < channel.interpolations.size() ? channel.interpolations[key] : Linear;
+
+	if(interpolation == Step) {
+		return v0;
+	}
+
+	const size_t tangentStride = 2 * stride;
+	if(interpolation == Bezier &&
+	   channel.outTangents.size() == times.size() * tangentStride &&
+	   channel.inTangents.size() == times.size() * tangentStride) {
+		const float *out = &channel.outTangents[key * tangentStride + 2 * component];
+		const float *in = &channel.inTangents[(key + 1) * tangentStride + 2 * component];
+		return sampleBezier(t, t0, v0, out[0], out[1], in[0], in[1], t1, v1);
+	}
+
+	return glm::mix(v0, v1, (t - t0) / (t1 - t0));
+}
+
+// Writes the channel's value at time t into the element it targets.
+void applyChannel(const Channel &channel, float t, TransformElement &element) {
+	const int numValues = element.type == Matrix ? 16 : (element.type == Rotate ? 4 : 3);
+	const string &member = channel.member;
+
+	if(member.empty()) {
+		for(int i = 0; i < min(channel.stride, numValues); ++i) {
+			element.values[i] = sampleChannel(channel, i, t);
+		}
+		return;
+	}
+
+	int index = -1;
+	if(member == ".ANGLE") {
+		index = 3;
+	} else if(member == ".X") {
+		index = 0;
+	} else if(member == ".Y") {
+		index = 1;
+	} else if(member == ".Z") {
+		index = 2;
+	} else if(member[0] == '(') {
+		int row = 0;
+		int col = -1;
+		sscanf(member.c_str(), "(%d)(%d)", &row, &col);
+		index = col < 0 ? row : row * 4 + col;
+	}
+
+	if(index >= 0 && index < numValues) {
+		element.values[index] = sampleChannel(channel, 0, t);
+	}
+}
+
+class ColladaParser {
+public:
+	ColladaParser(const char *begin, const char *end) : mXml(begin, end) {}
+
+	void parseDocument();
+	MD5_VO build(int frameRate);
+private:
+	Input readInput();
+	void parseSource(Sources &sources);
+	void parseGeometry(const string &id);
+	void parseMesh(Geometry &geometry);
+	void parsePrimitive(Geometry &geometry, Sources &sources, const map<string, string> &vertexPositions);
+	void parseSkin();
+	void parseNode(int parentJoint, const mat4 &offset);
+	void parseAnimation();
+
+	const Source &findSource(Sources &sources, const string &id);
+	int findJoint(const string &name) const;
+	mat4 localTransform(int joint, const vector<TransformElement> &elements) const;
+
+	void addMeshes(const Geometry &geometry, const Skin *skin, const vector<int> &skinJoints,
+				   const mat4 &bindShape, MD5_MeshInfo &meshInfo) const;
+	MD5_AnimInfo buildAnim(int frameRate, const vector<mat4> &localBind, const MD5_MeshInfo &meshInfo) const;
+private:
+	XmlCursor mXml;
+
+	// Turns the file's up axis into Z up.
+	mat4 mUpAxis;
+
+	map<string, Geometry> mGeometries;
+	vector<Skin> mSkins;
+	vector<SceneJoint> mJoints;
+	vector<Channel> mChannels;
+};
+
+void ColladaParser::parseDocument() {
+	for(;;) {
+		XmlCursor::Event event = mXml.next();
+		if(event == XmlCursor::End) {
+			break;
+		}
+		if(event != XmlCursor::StartElement) {
+			continue;
+		}
+
+		// Everything else is descended into, so these are found wherever the
+		// libraries put them.
+		if(mXml.is("up_axis")) {
+			string axis = mXml.readText();
+			if(axis == "Y_UP") {
+				mUpAxis = glm::rotate(mat4(), 90.0f, vec3(1, 0, 0));
+			} else if(axis == "X_UP") {
+				mUpAxis = glm::rotate(mat4(), -90.0f, vec3(0, 1, 0));
+			}
+			mXml.skipElement();
+		} else if(mXml.is("geometry")) {
+			parseGeometry(mXml.attribute("id"));
+		} else if(mXml.is("skin")) {
+			parseSkin();
+		} else if(mXml.is("node")) {
+			parseNode(-1, mat4());
+		} else if(mXml.is("animation")) {
+			parseAnimation();
+		} else if(mXml.is("library_images") || mXml.is("library_materials") || mXml.is("library_effects") ||
+				  mXml.is("library_cameras") || mXml.is("library_lights")) {
+			mXml.skipElement();
+		}
+	}
+}
+
+Input ColladaParser::readInput() {
+	Input input;
+	input.semantic = mXml.attribute("semantic");
+	input.source = stripHash(mXml.attribute("source"));
+	input.offset = toInt(mXml.attribute("offset"), 0);
+	input.set = toInt(mXml.attribute("set"), 0);
+	return input;
+}
+
+void ColladaParser::parseSource(Sources &sources) {
+	string id = mXml.attribute("id");
+	Source source;
+	source.floatText.begin = source.floatText.end = nullptr;
+	source.stride = 1;
+
+	while(mXml.nextChild()) {
+		if(mXml.is("float_array")) {
+			source.floatText = mXml.skipText();
+			mXml.skipElement();
+		} else if(mXml.is("Name_array") || mXml.is("IDREF_array")) {
+			mXml.readWords(source.names);
+			mXml.skipElement();
+		} else if(mXml.is("technique_common")) {
+			while(mXml.nextChild()) {
+				if(mXml.is("accessor")) {
+					source.stride = max(toInt(mXml.attribute("stride"), 1), 1);
+				}
+				mXml.skipElement();
+			}
+		} else {
+			mXml.skipElement();
+		}
+	}
+
+	sources[id] = std::move(source);
+}
+
+const Source &ColladaParser::findSource(Sources &sources, const string &id) {
+	Sources::iterator found = sources.find(id);
+	if(found == sources.end()) {
+		mXml.error("No source " + id + ".");
+	}
+
+	Source &source = found->second;
+	if(source.floatText.begin != source.floatText.end) {
+		mXml.readFloats(source.floatText, source.floats);
+		source.floatText.begin = source.floatText.end;
+	}
+	return source;
+}
+
+void ColladaParser::parseGeometry(const string &id) {
+	Geometry &geometry = mGeometries[id];
+
+	while(mXml.nextChild()) {
+		if(mXml.is("mesh")) {
+			parseMesh(geometry);
+		} else {
+			mXml.skipElement();
+		}
+	}
+}
+
+void ColladaParser::parseMesh(Geometry &geometry) {
+	Sources sources;
+	// <vertices> id to the source holding its positions.
+	map<string, string> vertexPositions;
+
+	while(mXml.nextChild()) {
+		if(mXml.is("source")) {
+			parseSource(sources);
+		} else if(mXml.is("vertices")) {
+			string id = mXml.attribute("id");
+			while(mXml.nextChild()) {
+				if(mXml.is("input") && mXml.attribute("semantic") == "POSITION") {
+					vertexPositions[id] = stripHash(mXml.attribute("source"));
+				}
+				mXml.skipElement();
+			}
+		} else if(mXml.is("triangles") || mXml.is("polylist") || mXml.is("polygons")) {
+			parsePrimitive(geometry, sources, vertexPositions);
+		} else {
+			mXml.skipElement();
+		}
+	}
+}
+
+void ColladaParser::parsePrimitive(Geometry &geometry, Sources &sources, const map<string, string> &vertexPositions) {
+	const bool isTriangles = mXml.is("triangles");
+	const bool isPolygons = mXml.is("polygons");
+
+	vector<Input> inputs;
+	vector<int> polygonSizes;
+	vector<int> indices;
+
+	while(mXml.nextChild()) {
+		if(mXml.is("input")) {
+			inputs.push_back(readInput());
+		} else if(mXml.is("vcount")) {
+			mXml.readInts(polygonSizes);
+		} else if(mXml.is("p")) {
+			// <polygons> has one <p> per polygon; its size is fixed up below.
+			size_t before = indices.size();
+			mXml.readInts(indices);
+			if(isPolygons) {
+				polygonSizes.push_back(indices.size() - before);
+			}
+		}
+		mXml.skipElement();
+	}
+
+	int stride = 0;
+	int positionOffset = -1;
+	int textureOffset = -1;
+	const Source *positions = nullptr;
+	const Source *textureCoords = nullptr;
+
+	for(const Input &input : inputs) {
+		stride = max(stride, input.offset + 1);
+
+		if(input.semantic == "VERTEX") {
+			map<string, string>::const_iterator found = vertexPositions.find(input.source);
+			if(found == vertexPositions.end()) {
+				mXml.error("No vertices " + input.source + ".");
+			}
+			positionOffset = input.offset;
+			positions = &findSource(sources, found->second);
+		} else if(input.semantic == "TEXCOORD" && (!textureCoords || input.set == 0)) {
+			textureOffset = input.offset;
+			textureCoords = &findSource(sources, input.source);
+		}
+	}
+
+	if(!positions) {
+		mXml.error("Primitive without a VERTEX input.");
+	}
+
+	const int numPositions = positions->floats.size() / max(positions->stride, 3);
+	if(geometry.positions.empty()) {
+		for(int i = 0; i < numPositions; ++i) {
+			const float *p = &positions->floats[i * max(positions->stride, 3)];
+			geometry.positions.push_back(vec3(p[0], p[1], p[2]));
+		}
+	}
+
+	if(isTriangles) {
+		polygonSizes.assign(indices.size() / (3 * stride), 3);
+	} else if(isPolygons) {
+		for(int &size : polygonSizes) {
+			size /= stride;
+		}
+	}
+
+	Primitive primitive;
+	map<pair<int, int>, int> vertexIds;
+
+	auto vertex = [&](size_t corner) {
+		int position = indices[corner * stride + positionOffset];
+		int uv = textureOffset >= 0 ? indices[corner * stride + textureOffset] : -1;
+		if(position < 0 || position >= numPositions) {
+			mXml.error("Position index out of range.");
+		}
+
+		pair<int, int> key(position, uv);
+		map<pair<int, int>, int>::iterator found = vertexIds.find(key);
+		if(found != vertexIds.end()) {
+			return found->second;
+		}
+
+		int id = primitive.positionIndices.size();
+		if(id > 0xffff) {
+			mXml.error("A mesh has more vertices than 16 bit indices can reach.");
+		}
+
+		vec2 textureCoord;
+		if(uv >= 0) {
+			size_t first = size_t(uv) * textureCoords->stride;
+			if(first + 1 >= textureCoords->floats.size()) {
+				mXml.error("Texture coordinate index out of range.");
+			}
+			textureCoord = vec2(textureCoords->floats[first], textureCoords->floats[first + 1]);
+		}
+
+		primitive.positionIndices.push_back(position);
+		primitive.textureCoords.push_back(textureCoord);
+		vertexIds[key] = id;
+		return id;
+	};
+
+	size_t corner = 0;
+	for(int size : polygonSizes) {
+		if((corner + size) * stride > indices.size()) {
+			mXml.error("Fewer indices than the polygon counts need.");
+		}
+
+		if(size >= 3) {
+			int first = vertex(corner);
+			int previous = vertex(corner + 1);
+			for(int i = 2; i < size; ++i) {
+				int current = vertex(corner + i);
+
+				MD5_Triangle triangle;
+				triangle.indices[0] = first;
+				triangle.indices[1] = previous;
+				triangle.indices[2] = current;
+				primitive.triangles.push_back(triangle);
+
+				previous = current;
+			}
+		}
+		corner += size;
+	}
+
+	if(!primitive.triangles.empty()) {
+		geometry.primitives.push_back(std::move(primitive));
+	}
+}
+
+void ColladaParser::parseSkin() {
+	Skin skin;
+	skin.geometryId = stripHash(mXml.attribute("source"));
+
+	Sources sources;
+	string jointsSource;
+	string matricesSource;
+	vector<Input> weightInputs;
+	vector<int> indices;
+
+	while(mXml.nextChild()) {
+		if(mXml.is("bind_shape_matrix")) {
+			vector<float> values;
+			mXml.readFloats(values);
+			if(values.size() != 16) {
+				mXml.error("bind_shape_matrix needs 16 values.");
+			}
+			skin.bindShape = rowMajor(values.data());
+			mXml.skipElement();
+		} else if(mXml.is("source")) {
+			parseSource(sources);
+		} else if(mXml.is("joints")) {
+			while(mXml.nextChild()) {
+				if(mXml.is("input")) {
+					Input input = readInput();
+					if(input.semantic == "JOINT") {
+						jointsSource = input.source;
+					} else if(input.semantic == "INV_BIND_MATRIX") {
+						matricesSource = input.source;
+					}
+				}
+				mXml.skipElement();
+			}
+		} else if(mXml.is("vertex_weights")) {
+			while(mXml.nextChild()) {
+				if(mXml.is("input")) {
+					weightInputs.push_back(readInput());
+				} else if(mXml.is("vcount")) {
+					mXml.readInts(skin.influenceCounts);
+				} else if(mXml.is("v")) {
+					mXml.readInts(indices);
+				}
+				mXml.skipElement();
+			}
+		} else {
+			mXml.skipElement();
+		}
+	}
+
+	skin.jointNames = findSource(sources, jointsSource).names;
+
+	const vector<float> &matrices = findSource(sources, matricesSource).floats;
+	if(matrices.size() != skin.jointNames.size() * 16) {
+		mXml.error("Skin has " + std::to_string(skin.jointNames.size()) + " joints but " +
+				   std::to_string(matrices.size() / 16) + " inverse bind matrices.");
+	}
+	for(size_t i = 0; i < matrices.size(); i += 16) {
+		skin.inverseBindMatrices.push_back(rowMajor(&matrices[i]));
+	}
+
+	int stride = 0;
+	int jointOffset = -1;
+	int weightOffset = -1;
+	const Source *weights = nullptr;
+	for(const Input &input : weightInputs) {
+		stride = max(stride, input.offset + 1);
+		if(input.semantic == "JOINT") {
+			jointOffset = input.offset;
+		} else if(input.semantic == "WEIGHT") {
+			weightOffset = input.offset;
+			weights = &findSource(sources, input.source);
+		}
+	}
+
+	int total = 0;
+	for(int count : skin.influenceCounts) {
+		skin.firstInfluence.push_back(total);
+		total += count;
+	}
+
+	if(total > 0) {
+		if(jointOffset < 0 || !weights) {
+			mXml.error("vertex_weights needs JOINT and WEIGHT inputs.");
+		}
+		if(indices.size() < size_t(total) * stride) {
+			mXml.error("Fewer skin indices than vcount needs.");
+		}
+	}
+
+	for(int i = 0; i < total; ++i) {
+		int joint = indices[i * stride + jointOffset];
+		int weight = indices[i * stride + weightOffset];
+		if(joint >= int(skin.jointNames.size()) || weight < 0 || weight >= int(weights->floats.size())) {
+			mXml.error("Skin index out of range.");
+		}
+		// Joint -1 binds to the bind shape itself, which has no joint here.
+		skin.influences.push_back(std::make_pair(joint, weights->floats[weight]));
+	}
+
+	mSkins.push_back(std::move(skin));
+}
+
+void ColladaParser::parseNode(int parentJoint, const mat4 &offset) {
+	SceneJoint joint;
+	joint.id = mXml.attribute("id");
+	joint.sid = mXml.attribute("sid");
+	joint.name = mXml.attribute("name");
+	joint.parent = parentJoint;
+	joint.preTransform = offset;
+
+	const bool isJoint = mXml.attribute("type") == "JOINT";
+	bool placed = false;
+	int childParent = parentJoint;
+	mat4 childOffset = offset;
+
+	// Transforms come before child nodes, so by the first child the node's
+	// own transform is known.
+	auto place = [&]() {
+		if(placed) {
+			return;
+		}
+		placed = true;
+
+		if(isJoint) {
+			mJoints.push_back(joint);
+			childParent = mJoints.size() - 1;
+			childOffset = mat4();
+		} else {
+			childOffset = offset * composeElements(joint.elements);
+		}
+	};
+
+	while(mXml.nextChild()) {
+		int numValues = 0;
+		TransformType type = Translate;
+
+		if(mXml.is("translate")) {
+			type = Translate;
+			numValues = 3;
+		} else if(mXml.is("rotate")) {
+			type = Rotate;
+			numValues = 4;
+		} else if(mXml.is("scale")) {
+			type = Scale;
+			numValues = 3;
+		} else if(mXml.is("matrix")) {
+			type = Matrix;
+			numValues = 16;
+		}
+
+		if(numValues > 0) {
+			TransformElement element;
+			element.sid = mXml.attribute("sid");
+			element.type = type;
+
+			vector<float> values;
+			mXml.readFloats(values);
+			if(values.size() != size_t(numValues)) {
+				mXml.error("Transform element has the wrong number of values.");
+			}
+			std::copy(values.begin(), values.end(), element.values);
+			joint.elements.push_back(element);
+
+			mXml.skipElement();
+		} else if(mXml.is("node")) {
+			place();
+			parseNode(childParent, childOffset);
+		} else {
+			mXml.skipElement();
+		}
+	}
+
+	place();
+}
+
+void ColladaParser::parseAnimation() {
+	Sources sources;
+	// Sampler id to its inputs' semantic and source.
+	map<string, map<string, string>> samplers;
+	vector<pair<string, string>> channels;
+
+	while(mXml.nextChild()) {
+		if(mXml.is("source")) {
+			parseSource(sources);
+		} else if(mXml.is("sampler")) {
+			map<string, string> &inputs = samplers[mXml.attribute("id")];
+			while(mXml.nextChild()) {
+				if(mXml.is("input")) {
+					Input input = readInput();
+					inputs[input.semantic] = input.source;
+				}
+				mXml.skipElement();
+			}
+		} else if(mXml.is("channel")) {
+			channels.push_back(std::make_pair(stripHash(mXml.attribute("source")), mXml.attribute("target")));
+			mXml.skipElement();
+		} else if(mXml.is("animation")) {
+			parseAnimation();
+		} else {
+			mXml.skipElement();
+		}
+	}
+
+	for(const pair<string, string> &source : channels) {
+		map<string, map<string, string>>::const_iterator sampler = samplers.find(source.first);
+		if(sampler == samplers.end()) {
+			mXml.error("No sampler " + source.first + ".");
+		}
+		const map<string, string> &inputs = sampler->second;
+
+		Channel channel;
+		const string &target = source.second;
+		size_t slash = target.find('/');
+		if(slash == string::npos) {
+			continue;
+		}
+		channel.nodeId = target.substr(0, slash);
+		size_t member = target.find_first_of(".(", slash + 1);
+		channel.sid = target.substr(slash + 1, member == string::npos ? string::npos : member - slash - 1);
+		channel.member = member == string::npos ? string() : target.substr(member);
+
+		map<string, string>::const_iterator input = inputs.find("INPUT");
+		map<string, string>::const_iterator output = inputs.find("OUTPUT");
+		if(input == inputs.end() || output == inputs.end()) {
+			mXml.error("Sampler " + source.first + " needs INPUT and OUTPUT.");
+		}
+
+		channel.times = findSource(sources, input->second).floats;
+		const Source &values = findSource(sources, output->second);
+		channel.values = values.floats;
+		channel.stride = values.stride;
+
+		if(channel.times.empty() || channel.values.size() != channel.times.size() * channel.stride) {
+			mXml.error("Sampler " + source.first + " has mismatched keys.");
+		}
+
+		input = inputs.find("INTERPOLATION");
+		if(input != inputs.end()) {
+			for(const string &name : findSource(sources, input->second).names) {
+				channel.interpolations.push_back(name == "BEZIER" ? Bezier : (name == "STEP" ? Step : Linear));
+			}
+		}
+		input = inputs.find("IN_TANGENT");
+		if(input != inputs.end()) {
+			channel.inTangents = findSource(sources, input->second).floats;
+		}
+		input = inputs.find("OUT_TANGENT");
+		if(input != inputs.end()) {
+			channel.outTangents = findSource(sources, input->second).floats;
+		}
+
+		mChannels.push_back(std::move(channel));
+	}
+}
+
+// Skins name joints by sid, channels by id. Exporters are not consistent, so
+// try the name last.
+int ColladaParser::findJoint(const string &name) const {
+	for(int i = 0; i < mJoints.size(); ++i) {
+		if(mJoints[i].sid == name) {
+			return i;
+		}
+	}
+	for(int i = 0; i < mJoints.size(); ++i) {
+		if(mJoints[i].id == name) {
+			return i;
+		}
+	}
+	for(int i = 0; i < mJoints.size(); ++i) {
+		if(mJoints[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+mat4 ColladaParser::localTransform(int joint, const vector<TransformElement> &elements) const {
+	mat4 local = mJoints[joint].preTransform * composeElements(elements);
+	return mJoints[joint].parent < 0 ? mUpAxis * local : local;
+}
+
+MD5_VO ColladaParser::build(int frameRate) {
+	if(mJoints.empty()) {
+		SceneJoint origin;
+		origin.name = "origin";
+		origin.parent = -1;
+		mJoints.push_back(origin);
+	}
+	const int numJoints = mJoints.size();
+
+	vector<mat4> localBind(numJoints);
+	vector<mat4> sceneBind(numJoints);
+	for(int i = 0; i < numJoints; ++i) {
+		localBind[i] = localTransform(i, mJoints[i].elements);
+		int parent = mJoints[i].parent;
+		sceneBind[i] = parent < 0 ? localBind[i] : sceneBind[parent] * localBind[i];
+	}
+
+	// The mesh is bound where the skin says, which need not be where the
+	// scene has the joints.
+	vector<mat4> meshBind = sceneBind;
+	vector<bool> fromSkin(numJoints, false);
+	vector<vector<int>> skinJoints(mSkins.size());
+	for(int s = 0; s < mSkins.size(); ++s) {
+		const Skin &skin = mSkins[s];
+		for(int k = 0; k < skin.jointNames.size(); ++k) {
+			int joint = findJoint(skin.jointNames[k]);
+			skinJoints[s].push_back(joint);
+			if(joint >= 0 && !fromSkin[joint]) {
+				meshBind[joint] = mUpAxis * glm::inverse(skin.inverseBindMatrices[k]);
+				fromSkin[joint] = true;
+			}
+		}
+	}
+
+	MD5_VO vo;
+	MD5_MeshInfo &meshInfo = vo.mesh;
+
+	meshInfo.joints.resize(numJoints);
+	for(int i = 0; i < numJoints; ++i) {
+		Joint &joint = meshInfo.joints[i];
+		joint.name = "\"" + mJoints[i].name + "\"";
+		joint.parentIndex = mJoints[i].parent;
+		decompose(meshBind[i], joint.position, joint.orientation);
+		joint.jointToWorld = rigidTransform(joint.position, joint.orientation);
+	}
+
+	set<string> skinned;
+	for(int s = 0; s < mSkins.size(); ++s) {
+		map<string, Geometry>::const_iterator geometry = mGeometries.find(mSkins[s].geometryId);
+		if(geometry == mGeometries.end()) {
+			throw runtime_error("Skin refers to missing geometry " + mSkins[s].geometryId + ".");
+		}
+		skinned.insert(geometry->first);
+		addMeshes(geometry->second, &mSkins[s], skinJoints[s], mUpAxis * mSkins[s].bindShape, meshInfo);
+	}
+
+	// Geometry no skin uses rides on the first joint.
+	for(const pair<const string, Geometry> &geometry : mGeometries) {
+		if(!skinned.count(geometry.first)) {
+			addMeshes(geometry.second, nullptr, vector<int>(), mUpAxis, meshInfo);
+		}
+	}
+
+	vo.animations.push_back(buildAnim(frameRate, localBind, meshInfo));
+	return vo;
+}
+
+void ColladaParser::addMeshes(const Geometry &geometry, const Skin *skin, const vector<int> &skinJoints,
+							  const mat4 &bindShape, MD5_MeshInfo &meshInfo) const {
+	vector<mat4> worldToJoint(meshInfo.joints.size());
+	for(int i = 0; i < worldToJoint.size(); ++i) {
+		worldToJoint[i] = glm::inverse(meshInfo.joints[i].jointToWorld);
+	}
+
+	for(const Primitive &primitive : geometry.primitives) {
+		MD5_Mesh mesh;
+		mesh.triangles = primitive.triangles;
+
+		for(int v = 0; v < primitive.positionIndices.size(); ++v) {
+			int position = primitive.positionIndices[v];
+			vec4 bindPosition = bindShape * vec4(geometry.positions[position], 1);
+
+			vector<pair<float, int>> influences;
+			if(skin && position < skin->influenceCounts.size()) {
+				int first = skin->firstInfluence[position];
+				for(int k = 0; k < skin->influenceCounts[position]; ++k) {
+					const pair<int, float> &influence = skin->influences[first + k];
+					int joint = influence.first < 0 ? -1 : skinJoints[influence.first];
+					if(joint >= 0 && influence.second > 0) {
+						influences.push_back(std::make_pair(influence.second, joint));
+					}
+				}
+			}
+
+			std::sort(influences.begin(), influences.end(), [](const pair<float, int> &a, const pair<float, int> &b) {
+				return a.first > b.first;
+			});
+			if(influences.size() > kMaxJointsPerVertex) {
+				influences.resize(kMaxJointsPerVertex);
+			}
+			if(influences.empty()) {
+				influences.push_back(std::make_pair(1.0f, 0));
+			}
+
+			float total = 0;
+			for(const pair<float, int> &influence : influences) {
+				total += influence.first;
+			}
+
+			MD5_Vertex vertex;
+			vertex.u = primitive.textureCoords[v].x;
+			vertex.v = 1 - primitive.textureCoords[v].y;
+			vertex.startWeight = mesh.weights.size();
+			vertex.weightCount = influences.size();
+			mesh.vertices.push_back(vertex);
+
+			for(const pair<float, int> &influence : influences) {
+				MD5_Weight weight;
+				weight.jointIndex = influence.second;
+				weight.weightBias = influence.first / total;
+				vec4 local = worldToJoint[influence.second] * bindPosition;
+				weight.position = vec3(local.x, local.y, local.z);
+				mesh.weights.push_back(weight);
+			}
+		}
+
+		meshInfo.meshes.push_back(std::move(mesh));
+	}
+}
+
+MD5_AnimInfo ColladaParser::buildAnim(int frameRate, const vector<mat4> &localBind, const MD5_MeshInfo &meshInfo) const {
+	const int numJoints = mJoints.size();
+
+	vector<vector<const Channel *>> jointChannels(numJoints);
+	float duration = 0;
+	for(const Channel &channel : mChannels) {
+		int joint = findJoint(channel.nodeId);
+		if(joint >= 0) {
+			jointChannels[joint].push_back(&channel);
+			duration = max(duration, channel.times.back());
+		}
+	}
+
+	MD5_AnimInfo anim;
+	anim.frameRate = frameRate;
+	anim.numFrames = static_cast<int>(std::floor(duration * frameRate + 0.5f)) + 1;
+
+	int numComponents = 0;
+	anim.jointsInfo.resize(numJoints);
+	anim.baseframeJoints.resize(numJoints);
+	for(int i = 0; i < numJoints; ++i) {
+		JointInfo &info = anim.jointsInfo[i];
+		info.name = meshInfo.joints[i].name;
+		info.parent = mJoints[i].parent;
+		info.flags = jointChannels[i].empty() ? 0 : 63;
+		info.startIndex = numComponents;
+		if(info.flags) {
+			numComponents += 6;
+		}
+
+		BaseframeJoint &base = anim.baseframeJoints[i];
+		decompose(localBind[i], base.position, base.orientation);
+	}
+
+	// How far each joint's weights reach, for the bounds. -1 when none do.
+	vector<float> radius(numJoints, -1.0f);
+	for(const MD5_Mesh &mesh : meshInfo.meshes) {
+		for(const MD5_Weight &weight : mesh.weights) {
+			radius[weight.jointIndex] = max(radius[weight.jointIndex], glm::length(weight.position));
+		}
+	}
+	const bool anyWeights = std::any_of(radius.begin(), radius.end(), [](float r) { return r >= 0; });
+
+	anim.framesData.resize(anim.numFrames, numComponents);
+	anim.bounds.resize(anim.numFrames);
+
+	vector<mat4> pose(numJoints);
+	for(int frame = 0; frame < anim.numFrames; ++frame) {
+		float t = float(frame) / frameRate;
+		float *values = anim.framesData.frame(frame);
+
+		for(int i = 0; i < numJoints; ++i) {
+			vec3 position = anim.baseframeJoints[i].position;
+			quat orientation = anim.baseframeJoints[i].orientation;
+
+			if(!jointChannels[i].empty()) {
+				vector<TransformElement> elements = mJoints[i].elements;
+				for(const Channel *channel : jointChannels[i]) {
+					for(TransformElement &element : elements) {
+						if(element.sid == channel->sid) {
+							applyChannel(*channel, t, element);
+						}
+					}
+				}
+				decompose(localTransform(i, elements), position, orientation);
+
+				float *out = values + anim.jointsInfo[i].startIndex;
+				out[0] = position.x;
+				out[1] = position.y;
+				out[2] = position.z;
+				out[3] = orientation.x;
+				out[4] = orientation.y;
+				out[5] = orientation.z;
+			}
+
+			int parent = mJoints[i].parent;
+			pose[i] = rigidTransform(position, orientation);
+			if(parent > -1) {
+				pose[i] = pose[parent] * pose[i];
+			}
+		}
+
+		FrameBounds &bounds = anim.bounds[frame];
+		bool first = true;
+		for(int i = 0; i < numJoints; ++i) {
+			if(anyWeights && radius[i] < 0) {
+				continue;
+			}
+			vec3 center(pose[i][3].x, pose[i][3].y, pose[i][3].z);
+			vec3 reach(max(radius[i], 0.0f));
+			bounds.min = first ? center - reach : glm::min(bounds.min, center - reach);
+			bounds.max = first ? center + reach : glm::max(bounds.max, center + reach);
+			first = false;
+		}
+	}
+
+	return anim;
+}
+
+}
+
+MD5_VO ColladaReader::parse(const string &filename, int frameRate) {
+	if(frameRate <= 0) {
+		throw runtime_error("frameRate must be positive.");
+	}
+
+	MappedFile file(filename);
+	ColladaParser parser(file.begin(), file.end());
+	parser.parseDocument();
+	return parser.build(frameRate);
+}
@@ -0,0 +1,38 @@
+#ifndef COLLADA_READER_H
+#define COLLADA_READER_H
+
+#include <string>
+
+#include "MD5Reader.h"
+
+// Imports a skinned character from a COLLADA (.dae) file into the structures
+// the MD5 readers produce, so the renderers and tools take it unchanged.
+//
+// The file is mapped and read front to back with a pull parser; no document
+// tree is built. Only the parts that end up in the result are kept: each
+// mesh's positions, texture coordinates and triangles, the skin weights and
+// inverse bind matrices, the joint nodes and their transforms, and the
+// animation keys. A source's numbers are only read once something refers to
+// it, so normals and other unused sources cost a scan of their text and no
+// more. Everything else is skipped as it is read.
+//
+// What comes out:
+// - One joint per JOINT node, parents first. A skin's inverse bind matrix
+//   gives the joint's bind pose; joints outside every skin use the scene.
+// - One MD5_Mesh per <triangles>, <polylist> or <polygons> element. Polygons
+//   are split into fans. Vertices keep their 4 heaviest weights; vertices
+//   without any are bound to the first joint. textureFilename is empty.
+// - One MD5_AnimInfo sampled at frameRate from the animation channels, with
+//   per frame bounds. Joints no channel targets are left to the baseframe.
+//   Without animations the clip is the bind pose as a single frame.
+//
+// Y_UP and X_UP files are turned to Z_UP, the MD5 convention. Scale is
+// dropped from joint transforms, and units are not converted. Bezier,
+// linear and step keys are followed; other interpolations are linear.
+class ColladaReader {
+public:
+	// Throws a runtime_error naming the line when the file is malformed.
+	static MD5_VO parse(const std::string &filename, int frameRate = 24);
+};
+
+#endif
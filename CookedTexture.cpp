@@ -0,0 +1,455 @@
+#include "CookedTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using std::max;
+using std::min;
+using std::ofstream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char kMagic[8] = { 'B', 'O', 'N', 'E', 'S', 'T', 'X', '\0' };
+const uint32_t kByteOrder = 0x01020304;
+const size_t kLevelAlignment = 16;
+
+size_t align(size_t offset) {
+	return (offset + kLevelAlignment - 1) & ~(kLevelAlignment - 1);
+}
+
+size_t blockBytes(uint32_t format) {
+	return format == CookedTexture::BC1 ? 8 : 16;
+}
+
+size_t levelBytes(uint32_t format, int width, int height) {
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+typedef unsigned char Block[16][4];
+
+// The 16 texels of the block at (bx, by). Levels smaller than a block repeat
+// their edge texels.
+void fetchBlock(const unsigned char *rgba, int width, int height, int bx, int by, Block block) {
+	for(int y = 0; y < 4; ++y) {
+		for(int x = 0; x < 4; ++x) {
+			int sx = min(bx * 4 + x, width - 1);
+			int sy = min(by * 4 + y, height - 1);
+			memcpy(block[y * 4 + x], rgba + (size_t(sy) * width + sx) * 4, 4);
+		}
+	}
+}
+
+uint16_t pack565(const float *color) {
+	int r = min(max(int(color[0] * 31 / 255 + 0.5f), 0), 31);
+	int g = min(max(int(color[1] * 63 / 255 + 0.5f), 0), 63);
+	int b = min(max(int(color[2] * 31 / 255 + 0.5f), 0), 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t packed, int *color) {
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// The colours a block's endpoints select between. BC1 blocks whose first
+// endpoint is not the larger use three colours and transparent black; the
+// encoder never writes those, but the decoder reads them.
+void colorPalette(uint16_t c0, uint16_t c1, bool fourColors, int palette[4][4]) {
+	unpack565(c0, palette[0]);
+	unpack565(c1, palette[1]);
+	for(int c = 0; c < 3; ++c) {
+		if(fourColors) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = fourColors ? 255 : 0;
+}
+
+// Fits the endpoints to the block's principal axis in RGB, insets them a
+// little so rounding to 565 stays inside the colours, and picks the nearest
+// palette entry for each texel.
+void encodeColorBlock(const Block block, unsigned char *out) {
+	float mean[3] = { 0, 0, 0 };
+	for(int i = 0; i < 16; ++i) {
+		for(int c = 0; c < 3; ++c) {
+			mean[c] += block[i][c] / 16.0f;
+		}
+	}
+
+	float covariance[3][3] = {};
+	for(int i = 0; i < 16; ++i) {
+		float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+		for(int a = 0; a < 3; ++a) {
+			for(int b = 0; b < 3; ++b) {
+				covariance[a][b] += d[a] * d[b];
+			}
+		}
+	}
+
+	float axis[3] = { 1, 1, 1 };
+	for(int iteration = 0; iteration < 8; ++iteration) {
+		float next[3];
+		for(int a = 0; a < 3; ++a) {
+			next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+		}
+		float largest = max(std::fabs(next[0]), max(std::fabs(next[1]), std::fabs(next[2])));
+		if(largest == 0) {
+			break;
+		}
+		for(int a = 0; a < 3; ++a) {
+			axis[a] = next[a] / largest;
+		}
+	}
+	float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	for(int a = 0; a < 3; ++a) {
+		axis[a] /= length;
+	}
+
+	float lowest = 0;
+	float highest = 0;
+	for(int i = 0; i < 16; ++i) {
+		float t = 0;
+		for(int c = 0; c < 3; ++c) {
+			t += (block[i][c] - mean[c]) * axis[c];
+		}
+		lowest = min(lowest, t);
+		highest = max(highest, t);
+	}
+
+	float inset = (highest - lowest) / 16;
+	float end0[3];
+	float end1[3];
+	for(int c = 0; c < 3; ++c) {
+		end0[c] = mean[c] + axis[c] * (highest - inset);
+		end1[c] = mean[c] + axis[c] * (lowest + inset);
+	}
+
+	uint16_t c0 = pack565(end0);
+	uint16_t c1 = pack565(end1);
+	if(c0 < c1) {
+		std::swap(c0, c1);
+	}
+
+	uint32_t indices = 0;
+	if(c0 != c1) {
+		int palette[4][4];
+		colorPalette(c0, c1, true, palette);
+
+		for(int i = 0; i < 16; ++i) {
+			int best = 0;
+			int bestError = 1 << 30;
+			for(int p = 0; p < 4; ++p) {
+				int error = 0;
+				for(int c = 0; c < 3; ++c) {
+					int d = block[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if(error < bestError) {
+					best = p;
+					bestError = error;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+		}
+	}
+
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for(int i = 0; i < 4; ++i) {
+		out[4 + i] = (indices >> (8 * i)) & 0xff;
+	}
+}
+
+void alphaPalette(int a0, int a1, int palette[8]) {
+	palette[0] = a0;
+	palette[1] = a1;
+	if(a0 > a1) {
+		for(int i = 2; i < 8; ++i) {
+			palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+		}
+	} else {
+		for(int i = 2; i < 6; ++i) {
+			palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Eight evenly spaced levels between the block's lowest and highest alpha.
+void encodeAlphaBlock(const Block block, unsigned char *out) {
+	int lowest = 255;
+	int highest = 0;
+	for(int i = 0; i < 16; ++i) {
+		lowest = min(lowest, int(block[i][3]));
+		highest = max(highest, int(block[i][3]));
+	}
+
+	int palette[8];
+	alphaPalette(highest, lowest, palette);
+
+	uint64_t indices = 0;
+	if(highest != lowest) {
+		for(int i = 0; i < 16; ++i) {
+			int best = 0;
+			for(int p = 1; p < 8; ++p) {
+				if(std::abs(block[i][3] - palette[p]) < std::abs(block[i][3] - palette[best])) {
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (3 * i);
+		}
+	}
+
+	out[0] = highest;
+	out[1] = lowest;
+	for(int i = 0; i < 6; ++i) {
+		out[2 + i] = (indices >> (8 * i)) & 0xff;
+	}
+}
+
+void decodeBlock(const unsigned char *in, uint32_t format, Block block) {
+	const unsigned char *color = in;
+	if(format == CookedTexture::BC3) {
+		int palette[8];
+		alphaPalette(in[0], in[1], palette);
+
+		uint64_t indices = 0;
+		for(int i = 0; i < 6; ++i) {
+			indices |= uint64_t(in[2 + i]) << (8 * i);
+		}
+		for(int i = 0; i < 16; ++i) {
+			block[i][3] = palette[(indices >> (3 * i)) & 7];
+		}
+		color = in + 8;
+	}
+
+	uint16_t c0 = color[0] | (color[1] << 8);
+	uint16_t c1 = color[2] | (color[3] << 8);
+	uint32_t indices = color[4] | (color[5] << 8) | (color[6] << 16) | (uint32_t(color[7]) << 24);
+
+	int palette[4][4];
+	colorPalette(c0, c1, format == CookedTexture::BC3 || c0 > c1, palette);
+	for(int i = 0; i < 16; ++i) {
+		const int *entry = palette[(indices >> (2 * i)) & 3];
+		block[i][0] = entry[0];
+		block[i][1] = entry[1];
+		block[i][2] = entry[2];
+		if(format == CookedTexture::BC1) {
+			block[i][3] = entry[3];
+		}
+	}
+}
+
+// Halves each dimension that is above 1, averaging the 2x2 texels (or 2x1 at
+// an odd edge) that fold into each new one.
+void downsample(const vector<unsigned char> &in, int width, int height, vector<unsigned char> &out) {
+	int outWidth = max(width / 2, 1);
+	int outHeight = max(height / 2, 1);
+	out.resize(size_t(outWidth) * outHeight * 4);
+
+	for(int y = 0; y < outHeight; ++y) {
+		for(int x = 0; x < outWidth; ++x) {
+			int x0 = min(x * 2, width - 1);
+			int x1 = min(x * 2 + 1, width - 1);
+			int y0 = min(y * 2, height - 1);
+			int y1 = min(y * 2 + 1, height - 1);
+
+			for(int c = 0; c < 4; ++c) {
+				int sum = in[(size_t(y0) * width + x0) * 4 + c] + in[(size_t(y0) * width + x1) * 4 + c] +
+						  in[(size_t(y1) * width + x0) * 4 + c] + in[(size_t(y1) * width + x1) * 4 + c];
+				out[(size_t(y) * outWidth + x) * 4 + c] = (sum + 2) / 4;
+			}
+		}
+	}
+}
+
+}
+
+string cookedTextureFilename(const string &imageFilename) {
+	size_t dot = imageFilename.find_last_of('.');
+	size_t slash = imageFilename.find_last_of("/\\");
+	if(dot == string::npos || (slash != string::npos && dot < slash)) {
+		return imageFilename + ".btex";
+	}
+	return imageFilename.substr(0, dot) + ".btex";
+}
+
+size_t writeCookedTexture(const string &filename, const unsigned char *pixels, int width, int height, int channels) {
+	if(width <= 0 || height <= 0 || (channels != 3 && channels != 4)) {
+		throw runtime_error("Only RGB and RGBA images can be cooked.");
+	}
+
+	vector<unsigned char> level(size_t(width) * height * 4);
+	bool hasAlpha = false;
+	for(size_t i = 0; i < size_t(width) * height; ++i) {
+		memcpy(&level[i * 4], pixels + i * channels, channels);
+		level[i * 4 + 3] = channels == 4 ? pixels[i * channels + 3] : 255;
+		hasAlpha = hasAlpha || level[i * 4 + 3] != 255;
+	}
+	const uint32_t format = hasAlpha ? CookedTexture::BC3 : CookedTexture::BC1;
+
+	int numLevels = 1;
+	for(int w = width, h = height; w > 1 || h > 1; w = max(w / 2, 1), h = max(h / 2, 1)) {
+		++numLevels;
+	}
+
+	vector<CookedLevel> table(numLevels);
+	size_t offset = align(sizeof(CookedTextureHeader) + numLevels * sizeof(CookedLevel));
+	for(int i = 0, w = width, h = height; i < numLevels; ++i, w = max(w / 2, 1), h = max(h / 2, 1)) {
+		table[i].width = w;
+		table[i].height = h;
+		table[i].offset = offset;
+		table[i].size = levelBytes(format, w, h);
+		offset = align(offset + table[i].size);
+	}
+
+	vector<char> file(offset, 0);
+	memcpy(&file[sizeof(CookedTextureHeader)], &table[0], numLevels * sizeof(CookedLevel));
+
+	vector<unsigned char> smaller;
+	for(int i = 0; i < numLevels; ++i) {
+		const int w = table[i].width;
+		const int h = table[i].height;
+		unsigned char *out = reinterpret_cast<unsigned char *>(&file[table[i].offset]);
+
+		for(int by = 0; by < (h + 3) / 4; ++by) {
+			for(int bx = 0; bx < (w + 3) / 4; ++bx) {
+				Block block;
+				fetchBlock(&level[0], w, h, bx, by, block);
+				if(format == CookedTexture::BC3) {
+					encodeAlphaBlock(block, out);
+					out += 8;
+				}
+				encodeColorBlock(block, out);
+				out += 8;
+			}
+		}
+
+		if(i + 1 < numLevels) {
+			downsample(level, w, h, smaller);
+			level.swap(smaller);
+		}
+	}
+
+	CookedTextureHeader header;
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kCookedTextureVersion;
+	header.byteOrder = kByteOrder;
+	header.payloadSize = file.size() - sizeof(CookedTextureHeader);
+	header.checksum = checksum(&file[sizeof(CookedTextureHeader)], header.payloadSize);
+	header.format = format;
+	header.width = width;
+	header.height = height;
+	header.numLevels = numLevels;
+	memcpy(&file[0], &header, sizeof(header));
+
+	ofstream out(filename, std::ios::binary);
+	out.write(&file[0], file.size());
+	if(!out) {
+		throw runtime_error(string("Could not write ") + filename);
+	}
+	return file.size();
+}
+
+CookedTexture::CookedTexture()
+	: mLevels(nullptr) {
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+CookedTexture::CookedTexture(const string &filename)
+	: mLevels(nullptr) {
+	open(filename);
+}
+
+void CookedTexture::open(const string &filename) {
+	mFile.open(filename);
+	mLevels = nullptr;
+	memset(&mHeader, 0, sizeof(mHeader));
+
+	if(mFile.size() < sizeof(CookedTextureHeader)) {
+		throw runtime_error(filename + " is too small to be a cooked texture.");
+	}
+
+	CookedTextureHeader header;
+	memcpy(&header, mFile.begin(), sizeof(header));
+
+	if(memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+		throw runtime_error(filename + " is not a cooked texture.");
+	}
+	if(header.version != kCookedTextureVersion) {
+		throw runtime_error(filename + " was cooked with a different version of bones_cook.");
+	}
+	if(header.byteOrder != kByteOrder) {
+		throw runtime_error(filename + " was cooked on a machine with a different byte order.");
+	}
+	if(header.payloadSize != mFile.size() - sizeof(CookedTextureHeader)) {
+		throw runtime_error(filename + " is truncated.");
+	}
+	if(header.checksum != checksum(mFile.begin() + sizeof(CookedTextureHeader), header.payloadSize)) {
+		throw runtime_error(filename + " failed its checksum.");
+	}
+	if((header.format != BC1 && header.format != BC3) || header.numLevels == 0 ||
+	   header.numLevels > header.payloadSize / sizeof(CookedLevel)) {
+		throw runtime_error(filename + " has a corrupt header.");
+	}
+
+	const CookedLevel *levels = reinterpret_cast<const CookedLevel *>(mFile.begin() + sizeof(CookedTextureHeader));
+	for(uint32_t i = 0; i < header.numLevels; ++i) {
+		const CookedLevel &level = levels[i];
+		if(level.offset > mFile.size() || level.size > mFile.size() - level.offset ||
+		   level.width == 0 || level.height == 0 ||
+		   level.size != levelBytes(header.format, level.width, level.height)) {
+			throw runtime_error(filename + " has a corrupt level table.");
+		}
+	}
+
+	mHeader = header;
+	mLevels = levels;
+}
+
+size_t CookedTexture::sizeInBytes() const {
+	size_t size = 0;
+	for(int i = 0; i < numLevels(); ++i) {
+		size += levelSize(i);
+	}
+	return size;
+}
+
+void CookedTexture::decodeLevel(int level, vector<unsigned char> &rgba) const {
+	const int w = levelWidth(level);
+	const int h = levelHeight(level);
+	const unsigned char *in = reinterpret_cast<const unsigned char *>(levelData(level));
+	rgba.resize(size_t(w) * h * 4);
+
+	for(int by = 0; by < (h + 3) / 4; ++by) {
+		for(int bx = 0; bx < (w + 3) / 4; ++bx) {
+			Block block;
+			decodeBlock(in, mHeader.format, block);
+			in += blockBytes(mHeader.format);
+
+			for(int y = 0; y < 4 && by * 4 + y < h; ++y) {
+				for(int x = 0; x < 4 && bx * 4 + x < w; ++x) {
+					memcpy(&rgba[(size_t(by * 4 + y) * w + bx * 4 + x) * 4], block[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef COOKED_TEXTURE_H
+#define COOKED_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// A texture with its whole mip chain block compressed ahead of time by
+// bones_cook and stored next to the source image. Opaque images are BC1
+// (DXT1, 8 bytes per 4x4 block), images with any alpha are BC3 (DXT5, 16
+// bytes). Loading is a map and a checksum; the levels go to
+// glCompressedTexImage2D as they are.
+//
+// Layout: CookedTextureHeader, a table of numLevels CookedLevel entries,
+// then the level data, largest first. Every level starts on a 16 byte
+// boundary. The checksum covers everything after the header.
+const uint32_t kCookedTextureVersion = 1;
+
+struct CookedTextureHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t payloadSize;
+	uint64_t checksum;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t numLevels;
+};
+
+struct CookedLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// Where bones_cook puts the cooked form of an image: the same path with the
+// extension replaced by .btex.
+std::string cookedTextureFilename(const std::string &imageFilename);
+
+// Builds the mip chain of an RGB or RGBA image down to 1x1 by averaging 2x2
+// texels, compresses every level and writes the file. Rows are stored in the
+// order given. Returns the size of the file.
+size_t writeCookedTexture(const std::string &filename, const unsigned char *pixels,
+						  int width, int height, int channels);
+
+class CookedTexture {
+public:
+	enum Format {
+		BC1 = 1,
+		BC3 = 3
+	};
+
+	CookedTexture();
+	explicit CookedTexture(const std::string &filename);
+
+	// Maps the file and validates the header, version, checksum and level
+	// table. Throws a runtime_error if any of them are wrong.
+	void open(const std::string &filename);
+
+	Format format() const { return static_cast<Format>(mHeader.format); }
+	int width() const { return mHeader.width; }
+	int height() const { return mHeader.height; }
+	int numLevels() const { return mHeader.numLevels; }
+
+	int levelWidth(int level) const { return mLevels[level].width; }
+	int levelHeight(int level) const { return mLevels[level].height; }
+	const char *levelData(int level) const { return mFile.begin() + mLevels[level].offset; }
+	size_t levelSize(int level) const { return mLevels[level].size; }
+
+	// Compressed size of all levels.
+	size_t sizeInBytes() const;
+
+	// Expands one level to 4 bytes per texel, for drivers without S3TC.
+	void decodeLevel(int level, std::vector<unsigned char> &rgba) const;
+private:
+	CookedTexture(const CookedTexture &);
+	CookedTexture &operator=(const CookedTexture &);
+private:
+	MappedFile mFile;
+	CookedTextureHeader mHeader;
+	const CookedLevel *mLevels;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include "CrowdEvaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "ThreadPool.h"
+
+#define CROWD_KERNEL
+#include "CrowdKernels.h"
+
+#ifdef CROWD_EVALUATOR_SSE2
+	#include <emmintrin.h>
+#endif
+
+// Like PoseEvaluator.cpp, this file is built with -ffp-contract=off so its
+// poses match that evaluator's bit for bit.
+using glm::mat4;
+using std::runtime_error;
+using std::string;
+using std::to_string;
+using std::vector;
+
+namespace {
+
+using crowd_kernels::kMatrixSize;
+
+const int kNumInputRows = 6;
+
+// Batches handed to each pool thread, so a slow thread does not hold up the
+// rest at the end.
+const int kTasksPerThread = 4;
+
+struct ScalarLanes {
+	typedef float Value;
+	static const int kWidth = 1;
+
+	static Value load(const float *p) { return *p; }
+	static void store(float *p, Value v) { *p = v; }
+	static Value broadcast(float f) { return f; }
+	static Value add(Value a, Value b) { return a + b; }
+	static Value sub(Value a, Value b) { return a - b; }
+	static Value mul(Value a, Value b) { return a * b; }
+
+	// w as the readers compute it.
+	static Value quatW(Value x, Value y, Value z) {
+		float temp = 1.0f - x * x - y * y - z * z;
+		return temp < 0.0f ? 0.0f : -sqrtf(temp);
+	}
+
+	// rows holds the 4 elements of a matrix column, one row of lanes each.
+	// Writes lane l's column to columns[l] for the first count lanes.
+	static void storeColumns(const float *rows, int count, float *const *columns) {
+		for(int lane = 0; lane < count; ++lane) {
+			for(int r = 0; r < 4; ++r) {
+				columns[lane][r] = rows[r];
+			}
+		}
+	}
+};
+
+#ifdef CROWD_EVALUATOR_SSE2
+struct SSELanes {
+	typedef __m128 Value;
+	static const int kWidth = 4;
+
+	static Value load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, Value v) { _mm_storeu_ps(p, v); }
+	static Value broadcast(float f) { return _mm_set1_ps(f); }
+	static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+	static Value sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+	static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+
+	static Value quatW(Value x, Value y, Value z) {
+		const __m128 one = _mm_set1_ps(1.0f);
+		__m128 temp = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 negative = _mm_cmplt_ps(temp, _mm_setzero_ps());
+		return _mm_andnot_ps(negative, _mm_xor_ps(_mm_sqrt_ps(temp), _mm_set1_ps(-0.0f)));
+	}
+
+	static void storeColumns(const float *rows, int count, float *const *columns) {
+		__m128 lanes[4] = {_mm_loadu_ps(rows), _mm_loadu_ps(rows + 4), _mm_loadu_ps(rows + 8), _mm_loadu_ps(rows + 12)};
+		_MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+		for(int lane = 0; lane < count; ++lane) {
+			_mm_storeu_ps(columns[lane], lanes[lane]);
+		}
+	}
+};
+#endif
+
+}
+
+CrowdEvaluator::CrowdEvaluator() : mLanes(maxLanes()) {
+}
+
+CrowdEvaluator::CrowdEvaluator(const vector<const MD5_AnimInfo *> &clips, const vector<mat4> &inverseBindPose)
+	: mInverseBindPose(inverseBindPose), mLanes(maxLanes()) {
+	for(int i = 0; i < clips.size(); ++i) {
+		const MD5_AnimInfo &anim = *clips[i];
+		Skeleton skeleton = buildSkeleton(anim);
+		const int numJoints = skeleton.numJoints();
+
+		if(i == 0) {
+			mParents = skeleton.parents;
+		} else if(skeleton.parents != mParents) {
+			throw runtime_error("Clip " + to_string(i) + " does not share the first clip's hierarchy.");
+		}
+		if(anim.framesData.numFrames() == 0) {
+			throw runtime_error("Clip " + to_string(i) + " has no frames.");
+		}
+
+		Clip clip = {&anim, ChannelDecoder(anim.jointsInfo, anim.framesData.numComponents()),
+					 vector<float>(kNumInputRows * numJoints)};
+		for(int j = 0; j < numJoints; ++j) {
+			clip.base[0 * numJoints + j] = skeleton.positions[j].x;
+			clip.base[1 * numJoints + j] = skeleton.positions[j].y;
+			clip.base[2 * numJoints + j] = skeleton.positions[j].z;
+			clip.base[3 * numJoints + j] = skeleton.orientations[j].x;
+			clip.base[4 * numJoints + j] = skeleton.orientations[j].y;
+			clip.base[5 * numJoints + j] = skeleton.orientations[j].z;
+		}
+		mClips.push_back(clip);
+	}
+
+	if(!mInverseBindPose.empty() && mInverseBindPose.size() != mParents.size()) {
+		throw runtime_error("The inverse bind pose has " + to_string(mInverseBindPose.size()) +
+							" joints but the clips have " + to_string(mParents.size()) + ".");
+	}
+}
+
+int CrowdEvaluator::maxLanes() {
+#ifdef CROWD_EVALUATOR_AVX
+	if(__builtin_cpu_supports("avx")) {
+		return 8;
+	}
+#endif
+#ifdef CROWD_EVALUATOR_SSE2
+	return 4;
+#else
+	return 1;
+#endif
+}
+
+void CrowdEvaluator::setLanes(int lanes) {
+	if((lanes != 1 && lanes != 4 && lanes != 8) || lanes > maxLanes()) {
+		throw runtime_error("Batches of " + to_string(lanes) + " instances are not available.");
+	}
+	mLanes = lanes;
+}
+
+int CrowdEvaluator::frameOf(const CrowdInstance &instance) const {
+	return frameAtTime(*mClips[instance.clip].anim, instance.time);
+}
+
+void CrowdEvaluator::evaluate(const vector<CrowdInstance> &instances, vector<mat4> &palettes,
+							  ThreadPool *pool) const {
+	const int numInstances = instances.size();
+	palettes.resize(instances.size() * mParents.size());
+	if(numInstances == 0 || mParents.empty()) {
+		return;
+	}
+
+	for(const CrowdInstance &instance : instances) {
+		if(instance.clip < 0 || instance.clip >= mClips.size()) {
+			throw runtime_error("Clip " + to_string(instance.clip) + " is out of range.");
+		}
+	}
+
+	const int numBatches = (numInstances + mLanes - 1) / mLanes;
+	const int numTasks = pool ? std::min<int>(numBatches, pool->size() * kTasksPerThread) : 1;
+
+	auto runTask = [&](int task) {
+		const int first = static_cast<long long>(numBatches) * task / numTasks;
+		const int end = static_cast<long long>(numBatches) * (task + 1) / numTasks;
+
+		switch(mLanes) {
+#ifdef CROWD_EVALUATOR_AVX
+		case 8:
+			evaluateBatches(8, evaluateCrowdBatchAVX, instances.data(), numInstances, first, end, palettes.data());
+			break;
+#endif
+#ifdef CROWD_EVALUATOR_SSE2
+		case 4:
+			evaluateBatches(4, crowd_kernels::evaluateBatch<SSELanes>, instances.data(), numInstances, first, end,
+							palettes.data());
+			break;
+#endif
+		default:
+			evaluateBatches(1, crowd_kernels::evaluateBatch<ScalarLanes>, instances.data(), numInstances, first, end,
+							palettes.data());
+			break;
+		}
+	};
+
+	if(numTasks == 1) {
+		runTask(0);
+	} else {
+		pool->parallelFor(numTasks, runTask);
+	}
+}
+
+void CrowdEvaluator::evaluateBatches(int width, void (*evaluateBatch)(const CrowdBatch &), const CrowdInstance *instances,
+									 int numInstances, int firstBatch, int endBatch, mat4 *palettes) const {
+	const int W = width;
+	const int numJoints = mParents.size();
+	const bool skinning = !mInverseBindPose.empty();
+
+	vector<float> input(kNumInputRows * numJoints * W);
+	vector<float> model(kMatrixSize * numJoints * W);
+	vector<float> palette(skinning ? kMatrixSize * W : 0);
+	vector<float> components;
+
+	CrowdBatch batch = {input.data(), mParents.data(), numJoints, skinning ? mInverseBindPose.data() : nullptr,
+						model.data(), palette.data(), nullptr, 0};
+
+	for(int batchIndex = firstBatch; batchIndex < endBatch; ++batchIndex) {
+		const int first = batchIndex * W;
+		const int count = std::min(W, numInstances - first);
+
+		// A short last batch repeats its final instance in the spare lanes.
+		for(int lane = 0; lane < W; ++lane) {
+			const CrowdInstance &instance = instances[first + std::min(lane, count - 1)];
+			const Clip &clip = mClips[instance.clip];
+			const AnimFrames &frames = clip.anim->framesData;
+			const int frame = frameOf(instance);
+
+			for(int k = 0; k < kNumInputRows * numJoints; ++k) {
+				input[k * W + lane] = clip.base[k];
+			}
+
+			const float *frameComponents;
+			if(frames.layout() == AnimFrames::FrameMajor) {
+				frameComponents = frames.frame(frame);
+			} else {
+				components.resize(frames.numComponents());
+				for(int c = 0; c < frames.numComponents(); ++c) {
+					components[c] = frames.value(frame, c);
+				}
+				frameComponents = components.data();
+			}
+
+			ChannelTargets targets;
+			for(int row = 0; row < kNumInputRows; ++row) {
+				targets.rows[row] = input.data() + row * numJoints * W + lane;
+				targets.steps[row] = W;
+			}
+			clip.decoder.decode(frameComponents, targets);
+		}
+
+		batch.out = palettes + first * numJoints;
+		batch.count = count;
+		evaluateBatch(batch);
+	}
+}
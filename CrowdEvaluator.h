@@ -0,0 +1,76 @@
+#ifndef CROWD_EVALUATOR_H
+#define CROWD_EVALUATOR_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ChannelDecoder.h"
+#include "MD5_AnimReader.h"
+
+class ThreadPool;
+struct CrowdBatch;
+
+// One character of a crowd: the clip it plays and how far into it it is.
+struct CrowdInstance {
+	int clip;
+	// Seconds. Wraps at the end of the clip.
+	float time;
+};
+
+// Evaluates many characters that share a skeleton at once.
+//
+// Instances are taken a batch at a time, one per SIMD lane: 4 with SSE2, or 8
+// with AVX on CPUs that have it. Each lane decodes its own frame into a struct
+// of arrays block, and from there every step of the pose (w, the rotation
+// matrices, parent concatenation and the skinning palette) runs across the
+// batch with one register per matrix element. With a pool, batches are
+// shared out between the threads.
+//
+// The arithmetic is PoseEvaluator's, so each instance's pose is bit-identical
+// to what PoseEvaluator builds for its frame.
+class CrowdEvaluator {
+public:
+	CrowdEvaluator();
+	// The clips must outlive the evaluator and share one hierarchy. With an
+	// inverse bind pose, evaluate() writes skinning palettes instead of
+	// model space poses. Throws a runtime_error if the clips disagree or one
+	// is rejected by ChannelDecoder.
+	explicit CrowdEvaluator(const std::vector<const MD5_AnimInfo *> &clips,
+							const std::vector<glm::mat4> &inverseBindPose = std::vector<glm::mat4>());
+
+	// 1, 4 or 8 instances per batch. maxLanes() depends on the build and,
+	// for 8, on the CPU.
+	static int maxLanes();
+	int lanes() const { return mLanes; }
+	void setLanes(int lanes);
+
+	int numJoints() const { return mParents.size(); }
+	int numClips() const { return mClips.size(); }
+
+	// The frame an instance samples, by frameAtTime.
+	int frameOf(const CrowdInstance &instance) const;
+
+	// Writes numJoints() matrices per instance to palettes, instance after
+	// instance in one contiguous block.
+	void evaluate(const std::vector<CrowdInstance> &instances, std::vector<glm::mat4> &palettes,
+				  ThreadPool *pool = nullptr) const;
+private:
+	struct Clip {
+		const MD5_AnimInfo *anim;
+		ChannelDecoder decoder;
+		// Baseframe position and orientation rows, numJoints each.
+		std::vector<float> base;
+	};
+
+	// Decodes batches of width instances and hands each to evaluateBatch,
+	// one of the kernels in CrowdKernels.h.
+	void evaluateBatches(int width, void (*evaluateBatch)(const CrowdBatch &), const CrowdInstance *instances,
+						 int numInstances, int firstBatch, int endBatch, glm::mat4 *palettes) const;
+
+	std::vector<int> mParents;
+	std::vector<Clip> mClips;
+	std::vector<glm::mat4> mInverseBindPose;
+	int mLanes;
+};
+
+#endif
@@ -0,0 +1,69 @@
+// The 8 lane kernels. Everything here is marked for AVX by CROWD_KERNEL
+// rather than the file being built with -mavx, so no inline function from
+// the headers above gets an AVX copy that other files could link to.
+#include <vector>
+#include <glm/glm.hpp>
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define CROWD_KERNEL __attribute__((target("avx")))
+#else
+	#define CROWD_KERNEL
+#endif
+#include "CrowdKernels.h"
+
+#ifdef CROWD_EVALUATOR_AVX
+#include <immintrin.h>
+
+// Like CrowdEvaluator.cpp, this file is built with -ffp-contract=off.
+namespace {
+
+struct AVXLanes {
+	typedef __m256 Value;
+	static const int kWidth = 8;
+
+	CROWD_KERNEL static Value load(const float *p) { return _mm256_loadu_ps(p); }
+	CROWD_KERNEL static void store(float *p, Value v) { _mm256_storeu_ps(p, v); }
+	CROWD_KERNEL static Value broadcast(float f) { return _mm256_set1_ps(f); }
+	CROWD_KERNEL static Value add(Value a, Value b) { return _mm256_add_ps(a, b); }
+	CROWD_KERNEL static Value sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+	CROWD_KERNEL static Value mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+
+	CROWD_KERNEL static Value quatW(Value x, Value y, Value z) {
+		const __m256 one = _mm256_set1_ps(1.0f);
+		__m256 temp = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		__m256 negative = _mm256_cmp_ps(temp, _mm256_setzero_ps(), _CMP_LT_OQ);
+		return _mm256_andnot_ps(negative, _mm256_xor_ps(_mm256_sqrt_ps(temp), _mm256_set1_ps(-0.0f)));
+	}
+
+	// Transposes within each 128 bit half: the low halves hold lanes 0-3,
+	// the high halves lanes 4-7.
+	CROWD_KERNEL static void storeColumns(const float *rows, int count, float *const *columns) {
+		const __m256 r0 = _mm256_loadu_ps(rows);
+		const __m256 r1 = _mm256_loadu_ps(rows + 8);
+		const __m256 r2 = _mm256_loadu_ps(rows + 16);
+		const __m256 r3 = _mm256_loadu_ps(rows + 24);
+
+		const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		const __m256 lanes[4] = {
+			_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+			_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+			_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+			_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2))
+		};
+
+		for(int lane = 0; lane < count; ++lane) {
+			const __m256 pair = lanes[lane & 3];
+			_mm_storeu_ps(columns[lane], lane < 4 ? _mm256_castps256_ps128(pair) : _mm256_extractf128_ps(pair, 1));
+		}
+	}
+};
+
+}
+
+CROWD_KERNEL void evaluateCrowdBatchAVX(const CrowdBatch &batch) {
+	crowd_kernels::evaluateBatch<AVXLanes>(batch);
+}
+#endif
@@ -0,0 +1,178 @@
+#ifndef CROWD_KERNELS_H
+#define CROWD_KERNELS_H
+
+#include <glm/glm.hpp>
+
+// CrowdEvaluator's per joint arithmetic, shared by CrowdEvaluator.cpp (scalar
+// and SSE2 lanes) and CrowdEvaluatorAVX.cpp (AVX lanes). Each file includes
+// this with CROWD_KERNEL defined first: empty, or a target attribute so the
+// AVX instantiations are compiled for AVX while the rest of the build is not.
+//
+// A Lanes type holds kWidth floats per Value and provides load, store,
+// broadcast, add, sub, mul, quatW and storeColumns.
+
+#ifndef CROWD_KERNEL
+	#error "Define CROWD_KERNEL before including CrowdKernels.h."
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CROWD_EVALUATOR_SSE2
+#endif
+
+// As with PoseEvaluator's AVX kernel, only the functions marked for AVX use
+// it, and maxLanes() checks the CPU before offering 8 lanes.
+#if defined(CROWD_EVALUATOR_SSE2) && (defined(__GNUC__) || defined(__clang__))
+	#define CROWD_EVALUATOR_AVX
+#endif
+
+// One batch after its lanes are decoded. The joint loop runs from here, so a
+// call covers every joint of the batch.
+struct CrowdBatch {
+	// Joint space rows as (row * numJoints + joint) * width + lane.
+	const float *input;
+	const int *parents;
+	int numJoints;
+	// nullptr for model space poses.
+	const glm::mat4 *inverseBindPose;
+	// Scratch, 16 * numJoints * width and 16 * width floats.
+	float *model;
+	float *palette;
+	// The first lane's matrices; each lane's follow numJoints on from the last.
+	glm::mat4 *out;
+	// Lanes to write, up to the width.
+	int count;
+};
+
+// The AVX instantiation of evaluateBatch, from CrowdEvaluatorAVX.cpp. Only
+// call it when maxLanes() is 8.
+void evaluateCrowdBatchAVX(const CrowdBatch &batch);
+
+namespace crowd_kernels {
+
+const int kMatrixSize = 16;
+
+// Model space transform of joint i for every lane. input holds the joint
+// space rows as (row * numJoints + joint) * width + lane, model the matrices
+// as (joint * 16 + column * 4 + row) * width + lane. The operations and their
+// order are PoseEvaluator's localJoint and concatJoint.
+template<typename Lanes>
+CROWD_KERNEL void evaluateJoint(const float *input, int numJoints, int i, int parent, float *model) {
+	typedef typename Lanes::Value Value;
+	const int W = Lanes::kWidth;
+
+	const Value x = Lanes::load(input + (3 * numJoints + i) * W);
+	const Value y = Lanes::load(input + (4 * numJoints + i) * W);
+	const Value z = Lanes::load(input + (5 * numJoints + i) * W);
+	const Value w = Lanes::quatW(x, y, z);
+
+	const Value x2 = Lanes::add(x, x);
+	const Value y2 = Lanes::add(y, y);
+	const Value z2 = Lanes::add(z, z);
+	const Value xx = Lanes::mul(x, x2);
+	const Value yy = Lanes::mul(y, y2);
+	const Value zz = Lanes::mul(z, z2);
+	const Value xy = Lanes::mul(x, y2);
+	const Value xz = Lanes::mul(x, z2);
+	const Value yz = Lanes::mul(y, z2);
+	const Value wx = Lanes::mul(w, x2);
+	const Value wy = Lanes::mul(w, y2);
+	const Value wz = Lanes::mul(w, z2);
+	const Value one = Lanes::broadcast(1.0f);
+
+	Value local[4][3];
+	local[0][0] = Lanes::sub(one, Lanes::add(yy, zz));
+	local[0][1] = Lanes::add(xy, wz);
+	local[0][2] = Lanes::sub(xz, wy);
+	local[1][0] = Lanes::sub(xy, wz);
+	local[1][1] = Lanes::sub(one, Lanes::add(xx, zz));
+	local[1][2] = Lanes::add(yz, wx);
+	local[2][0] = Lanes::add(xz, wy);
+	local[2][1] = Lanes::sub(yz, wx);
+	local[2][2] = Lanes::sub(one, Lanes::add(xx, yy));
+	local[3][0] = Lanes::load(input + (0 * numJoints + i) * W);
+	local[3][1] = Lanes::load(input + (1 * numJoints + i) * W);
+	local[3][2] = Lanes::load(input + (2 * numJoints + i) * W);
+
+	float *out = model + i * kMatrixSize * W;
+	if(parent < 0) {
+		for(int c = 0; c < 4; ++c) {
+			for(int r = 0; r < 3; ++r) {
+				Lanes::store(out + (c * 4 + r) * W, local[c][r]);
+			}
+			Lanes::store(out + (c * 4 + 3) * W, Lanes::broadcast(c == 3 ? 1.0f : 0.0f));
+		}
+		return;
+	}
+
+	const float *P = model + parent * kMatrixSize * W;
+	for(int r = 0; r < 4; ++r) {
+		const Value p0 = Lanes::load(P + r * W);
+		const Value p1 = Lanes::load(P + (4 + r) * W);
+		const Value p2 = Lanes::load(P + (8 + r) * W);
+
+		for(int c = 0; c < 4; ++c) {
+			Value sum = Lanes::add(Lanes::mul(p0, local[c][0]), Lanes::mul(p1, local[c][1]));
+			sum = Lanes::add(sum, Lanes::mul(p2, local[c][2]));
+			if(c == 3) {
+				sum = Lanes::add(sum, Lanes::load(P + (12 + r) * W));
+			}
+			Lanes::store(out + (c * 4 + r) * W, sum);
+		}
+	}
+}
+
+// palette = pose * inverseBindPose for every lane, summed in glm's order.
+template<typename Lanes>
+CROWD_KERNEL void multiplyBindPose(const float *pose, const glm::mat4 &inverseBindPose, float *palette) {
+	typedef typename Lanes::Value Value;
+	const int W = Lanes::kWidth;
+
+	Value columns[4][4];
+	for(int c = 0; c < 4; ++c) {
+		for(int r = 0; r < 4; ++r) {
+			columns[c][r] = Lanes::load(pose + (c * 4 + r) * W);
+		}
+	}
+
+	for(int c = 0; c < 4; ++c) {
+		const Value b0 = Lanes::broadcast(inverseBindPose[c][0]);
+		const Value b1 = Lanes::broadcast(inverseBindPose[c][1]);
+		const Value b2 = Lanes::broadcast(inverseBindPose[c][2]);
+		const Value b3 = Lanes::broadcast(inverseBindPose[c][3]);
+
+		for(int r = 0; r < 4; ++r) {
+			Value sum = Lanes::add(Lanes::mul(columns[0][r], b0), Lanes::mul(columns[1][r], b1));
+			sum = Lanes::add(sum, Lanes::mul(columns[2][r], b2));
+			sum = Lanes::add(sum, Lanes::mul(columns[3][r], b3));
+			Lanes::store(palette + (c * 4 + r) * W, sum);
+		}
+	}
+}
+
+template<typename Lanes>
+CROWD_KERNEL void evaluateBatch(const CrowdBatch &batch) {
+	const int W = Lanes::kWidth;
+	const int numJoints = batch.numJoints;
+
+	for(int j = 0; j < numJoints; ++j) {
+		evaluateJoint<Lanes>(batch.input, numJoints, j, batch.parents[j], batch.model);
+
+		const float *result = batch.model + j * kMatrixSize * W;
+		if(batch.inverseBindPose) {
+			multiplyBindPose<Lanes>(result, batch.inverseBindPose[j], batch.palette);
+			result = batch.palette;
+		}
+
+		for(int c = 0; c < 4; ++c) {
+			float *columns[W] = {};
+			for(int lane = 0; lane < batch.count; ++lane) {
+				columns[lane] = &batch.out[lane * numJoints + j][c][0];
+			}
+			Lanes::storeColumns(result + c * 4 * W, batch.count, columns);
+		}
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include "Culling.h"
+
+#include <cmath>
+
+using glm::mat4;
+using glm::vec3;
+using glm::vec4;
+
+FrameBounds boundsAtFrame(const MD5_AnimInfo &anim, float frame) {
+	const int numFrames = anim.bounds.size();
+	if(numFrames == 0) {
+		FrameBounds empty = { vec3(0, 0, 0), vec3(0, 0, 0) };
+		return empty;
+	}
+
+	frame = fmodf(frame, float(numFrames));
+	if(frame < 0) {
+		frame += numFrames;
+	}
+
+	int first = static_cast<int>(frame);
+	if(first >= numFrames) {
+		first = numFrames - 1;
+	}
+	int second = (first + 1) % numFrames;
+	float t = frame - first;
+
+	const FrameBounds &a = anim.bounds[first];
+	const FrameBounds &b = anim.bounds[second];
+
+	FrameBounds bounds;
+	bounds.min = a.min + (b.min - a.min) * t;
+	bounds.max = a.max + (b.max - a.max) * t;
+	return bounds;
+}
+
+FrameBounds animatedBounds(const MD5_AnimInfo &anim, float seconds) {
+	return boundsAtFrame(anim, seconds * anim.frameRate);
+}
+
+FrameBounds transformBounds(const FrameBounds &bounds, const mat4 &transform) {
+	// Arvo's method: each matrix entry scales either the min or the max of
+	// the source box into the destination.
+	FrameBounds result;
+	for(int row = 0; row < 3; ++row) {
+		float low = transform[3][row];
+		float high = transform[3][row];
+
+		for(int col = 0; col < 3; ++col) {
+			float a = transform[col][row] * bounds.min[col];
+			float b = transform[col][row] * bounds.max[col];
+			low += a < b ? a : b;
+			high += a < b ? b : a;
+		}
+
+		result.min[row] = low;
+		result.max[row] = high;
+	}
+	return result;
+}
+
+Frustum extractFrustum(const mat4 &viewProjection) {
+	// Gribb and Hartmann: each plane is the last row of the matrix plus or
+	// minus one of the others. glm matrices are indexed [column][row].
+	vec4 rows[4];
+	for(int row = 0; row < 4; ++row) {
+		rows[row] = vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+	}
+
+	Frustum frustum;
+	for(int i = 0; i < 3; ++i) {
+		frustum.planes[2 * i] = rows[3] + rows[i];
+		frustum.planes[2 * i + 1] = rows[3] - rows[i];
+	}
+	return frustum;
+}
+
+bool isVisible(const Frustum &frustum, const FrameBounds &bounds) {
+	for(int i = 0; i < 6; ++i) {
+		const vec4 &plane = frustum.planes[i];
+
+		// The corner furthest along the plane normal.
+		vec3 corner(plane.x >= 0 ? bounds.max.x : bounds.min.x,
+					plane.y >= 0 ? bounds.max.y : bounds.min.y,
+					plane.z >= 0 ? bounds.max.z : bounds.min.z);
+
+		if(plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0) {
+			return false;
+		}
+	}
+	return true;
+}
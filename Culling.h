@@ -0,0 +1,30 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "MD5_AnimReader.h"
+
+// The six planes of a view frustum, pointing inwards. A point p is inside a
+// plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// The clip's bounds box at a fractional frame, blended between the frames
+// either side of it. The clip loops, so frames past the end wrap around.
+FrameBounds boundsAtFrame(const MD5_AnimInfo &anim, float frame);
+
+// The same at a time in seconds, played at the clip's frame rate.
+FrameBounds animatedBounds(const MD5_AnimInfo &anim, float seconds);
+
+// Smallest axis aligned box holding the transformed box.
+FrameBounds transformBounds(const FrameBounds &bounds, const glm::mat4 &transform);
+
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+// False only when the box is entirely outside one of the planes, so a box
+// near a frustum corner can be kept even though it is not visible.
+bool isVisible(const Frustum &frustum, const FrameBounds &bounds);
+
+#endif
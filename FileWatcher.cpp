@@ -0,0 +1,145 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <sys/stat.h>
+
+#ifdef __linux__
+	#define FILE_WATCHER_USE_INOTIFY
+	#include <poll.h>
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// How long to wait for more events once one has arrived, so a save that
+// writes a file in several steps is reported once.
+const int kSettleMilliseconds = 100;
+// How often the watcher checks whether it is being destroyed while idle.
+const int kIdleMilliseconds = 200;
+const int kPollMilliseconds = 500;
+
+std::time_t modificationTime(const string &filename) {
+	struct stat info;
+	return stat(filename.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+}
+
+FileWatcher::FileWatcher(const vector<string> &filenames, Callback callback)
+	: mCallback(callback), mStopping(false), mInotify(-1) {
+	for(const string &filename : filenames) {
+		WatchedFile file;
+		size_t slash = filename.find_last_of("/\\");
+		file.filename = filename;
+		file.directory = slash == string::npos ? "." : filename.substr(0, slash);
+		file.name = slash == string::npos ? filename : filename.substr(slash + 1);
+		file.modified = modificationTime(filename);
+		mFiles.push_back(file);
+	}
+
+#ifdef FILE_WATCHER_USE_INOTIFY
+	// Watch the directories rather than the files: saving through a rename
+	// replaces the inode a file watch would be attached to.
+	mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(mInotify != -1) {
+		for(const WatchedFile &file : mFiles) {
+			auto sameDirectory = [&file](const std::pair<int, string> &watch) { return watch.second == file.directory; };
+			if(std::find_if(mWatches.begin(), mWatches.end(), sameDirectory) != mWatches.end()) {
+				continue;
+			}
+
+			int watch = inotify_add_watch(mInotify, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if(watch == -1) {
+				close(mInotify);
+				mInotify = -1;
+				mWatches.clear();
+				break;
+			}
+			mWatches.push_back(std::make_pair(watch, file.directory));
+		}
+	}
+#endif
+
+	if(mInotify != -1) {
+		mThread = std::thread(&FileWatcher::watchLoop, this);
+	} else {
+		mThread = std::thread(&FileWatcher::pollLoop, this);
+	}
+}
+
+FileWatcher::~FileWatcher() {
+	mStopping = true;
+	mThread.join();
+
+#ifdef FILE_WATCHER_USE_INOTIFY
+	if(mInotify != -1) {
+		close(mInotify);
+	}
+#endif
+}
+
+void FileWatcher::watchLoop() {
+#ifdef FILE_WATCHER_USE_INOTIFY
+	// Big enough for several events with names up to NAME_MAX.
+	alignas(inotify_event) char buffer[16 * 1024];
+	set<string> changed;
+
+	while(!mStopping) {
+		pollfd descriptor = { mInotify, POLLIN, 0 };
+		int timeout = changed.empty() ? kIdleMilliseconds : kSettleMilliseconds;
+
+		if(poll(&descriptor, 1, timeout) > 0) {
+			ssize_t length;
+			while((length = read(mInotify, buffer, sizeof(buffer))) > 0) {
+				for(char *p = buffer; p < buffer + length; ) {
+					const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+					p += sizeof(inotify_event) + event->len;
+					if(event->len == 0) {
+						continue;
+					}
+
+					const string *directory = nullptr;
+					for(const auto &watch : mWatches) {
+						if(watch.first == event->wd) {
+							directory = &watch.second;
+						}
+					}
+					for(const WatchedFile &file : mFiles) {
+						if(directory && file.directory == *directory && file.name == event->name) {
+							changed.insert(file.filename);
+						}
+					}
+				}
+			}
+			continue;
+		}
+
+		// Quiet for kSettleMilliseconds: report what has changed.
+		for(const string &filename : changed) {
+			mCallback(filename);
+		}
+		changed.clear();
+	}
+#endif
+}
+
+void FileWatcher::pollLoop() {
+	while(!mStopping) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(kPollMilliseconds));
+
+		for(WatchedFile &file : mFiles) {
+			std::time_t modified = modificationTime(file.filename);
+			if(modified != file.modified) {
+				file.modified = modified;
+				mCallback(file.filename);
+			}
+		}
+	}
+}
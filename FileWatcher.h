@@ -0,0 +1,53 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Calls back when any of a set of files is rewritten. On Linux it listens to
+// inotify for the file being closed after writing or moved into place, which
+// covers editors and exporters that save through a temporary file. Elsewhere
+// it compares modification times twice a second.
+//
+// Events that arrive close together are merged, so each changed file is
+// reported once per save. The callback runs on the watcher's own thread with
+// the filename exactly as it was passed in.
+class FileWatcher {
+public:
+	typedef std::function<void(const std::string &filename)> Callback;
+
+	FileWatcher(const std::vector<std::string> &filenames, Callback callback);
+	~FileWatcher();
+
+	bool usesInotify() const { return mInotify != -1; }
+private:
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+
+	void watchLoop();
+	void pollLoop();
+private:
+	struct WatchedFile {
+		std::string filename;
+		std::string directory;
+		std::string name;
+		std::time_t modified;
+	};
+
+	std::vector<WatchedFile> mFiles;
+	Callback mCallback;
+	std::atomic<bool> mStopping;
+
+	int mInotify;
+	// inotify watch descriptor and directory, one per directory watched.
+	std::vector<std::pair<int, std::string>> mWatches;
+
+	std::thread mThread;
+};
+
+#endif
@@ -1,53 +1,36 @@
 #ifndef MD5READER_H
 #define MD5READER_H
 
+#include <future>
 #include <string>
-#include <fstream>
+#include <vector>
 #include "AnimCore.h"
 #include "MD5_MeshReader.h"
-
-struct JointInfo {
-	std::string name;
-	int parent;
-	int flags;
-	int startIndex;
-};
-
-struct BaseframeJoint {
-	glm::vec3 position;
-	glm::quat orientation;
-	glm::mat4 jointToWorld;
-};
-
-struct MD5_AnimInfo {
-	std::vector<BaseframeJoint> baseframeJoints;
-	std::vector<JointInfo> jointsInfo;
-	std::vector<std::vector<float>> framesData;
-	int numFrames;
-};
+#include "MD5_AnimReader.h"
 
 struct MD5_VO {
 	MD5_MeshInfo mesh;
 	std::vector<MD5_AnimInfo> animations;
 };
 
+// A mesh and the animation played on it. An empty animFilename loads the
+// mesh alone.
+struct MD5_AssetPaths {
+	std::string meshFilename;
+	std::string animFilename;
+};
+
 class Md5Reader {
 public:
-	MD5_VO parse(const std::string &meshFilename, const std::string &animFilename);
-private:
-	void processAnimHeader();
-	void processHierarchy();
-	void processBounds();
-	void processBaseframeJoints();
-	void processFramesData();
-private:
-	int mNumFrames;
-	int mFrameRate;
-	std::vector<JointInfo> mJointsInfo;
-	std::vector<BaseframeJoint> mBaseframeJoints;
-	std::vector<std::vector<float>> mFramesData;
-	
-	std::ifstream mAnimFile;
+	// With a pool the animation's frame blocks are decoded in parallel.
+	static MD5_VO parse(const std::string &meshFilename, const std::string &animFilename, ThreadPool *pool = nullptr);
+
+	// Queues every asset on pool and returns at once with one future per
+	// asset, in order. Meshes and animations are parsed as separate jobs, and
+	// long animations also split their frames over the pool. A parse error
+	// is rethrown by that asset's get(). The futures are deferred, so wait
+	// with get() or wait(), not wait_for().
+	static std::vector<std::future<MD5_VO>> parseBatch(const std::vector<MD5_AssetPaths> &assets, ThreadPool &pool);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,13 @@
 #include "MD5_AnimReader.h"
+#include "MD5_FrameScanner.h"
+#include "MD5_Tokenizer.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 
@@ -9,33 +16,356 @@ using std::endl;
 using std::runtime_error;
 using std::string;
 using std::stringstream;
+using std::vector;
+
+namespace {
+
+// Clips shorter than this are decoded on the calling thread.
+const int kMinFramesForParallelDecode = 256;
+
+// Decodes every `frame N { ... }` block that starts in [begin, end). file is
+// the whole md5anim so errors report the real line. Returns the frame numbers
+// seen so the caller can check that each frame appears exactly once.
+vector<int> decodeFrameRange(const MD5_Tokenizer &file, const char *begin, const char *end, MD5_AnimInfo &anim, int numComponents) {
+	MD5_Tokenizer tokens(file.begin(), file.end());
+	vector<int> frameNumbers;
+
+	tokens.setPosition(begin);
+	while(tokens.skipSpace() && tokens.position() < end) {
+		tokens.expect("frame");
+		int frameNumber = tokens.readInt();
+		if(frameNumber < 0 || frameNumber >= anim.numFrames) {
+			tokens.error("Frame number out of range.");
+		}
+		tokens.expect("{");
 
-MD5_AnimInfo MD5_AnimReader::parse(const std::string &filename) {
-	mAnimFile.open(filename);
+		float *frameData = anim.framesData.frame(frameNumber);
+		try {
+			tokens.setPosition(MD5_FrameScanner::scanFrame(tokens.position(), tokens.end(), frameData, numComponents));
+		} catch(runtime_error &e) {
+			tokens.error(e.what());
+		}
+
+		frameNumbers.push_back(frameNumber);
+	}
+
+	return frameNumbers;
+}
+
+// Moves p forward to the start of the next line that begins with the frame
+// keyword. Frame bodies only hold numbers, so that line opens a new block.
+const char *nextFrameStart(const char *p, const char *begin, const char *end) {
+	while(p != end) {
+		if(p == begin || p[-1] == '\n') {
+			const char *q = p;
+			while(q != end && (*q == ' ' || *q == '\t')) {
+				++q;
+			}
+			if(end - q > 5 && memcmp(q, "frame", 5) == 0 && (q[5] == ' ' || q[5] == '\t')) {
+				return q;
+			}
+		}
+		p = static_cast<const char *>(memchr(p, '\n', end - p));
+		p = p ? p + 1 : end;
+	}
+
+	return end;
+}
+
+void decodeFrames(const MD5_Tokenizer &file, MD5_AnimInfo &anim, int numComponents, ThreadPool *pool) {
+	const char *begin = file.position();
+	const char *end = file.end();
+	vector<vector<int>> chunkFrames;
+
+	if(!pool || anim.numFrames < kMinFramesForParallelDecode) {
+		chunkFrames.push_back(decodeFrameRange(file, begin, end, anim, numComponents));
+	} else {
+		// A few chunks per worker evens out uneven frame sizes.
+		int numChunks = pool->size() * 4;
+		size_t chunkSize = (end - begin) / numChunks;
+
+		vector<const char *> starts;
+		starts.push_back(begin);
+		for(int i = 1; i < numChunks; ++i) {
+			const char *start = nextFrameStart(begin + i * chunkSize, begin, end);
+			if(start > starts.back()) {
+				starts.push_back(start);
+			}
+		}
+		starts.push_back(end);
+
+		chunkFrames.resize(starts.size() - 1);
+		pool->parallelFor(chunkFrames.size(), [&](int i) {
+			chunkFrames[i] = decodeFrameRange(file, starts[i], starts[i + 1], anim, numComponents);
+		});
+	}
+
+	vector<bool> seen(anim.numFrames, false);
+	int count = 0;
+	for(auto &frames : chunkFrames) {
+		for(int frameNumber : frames) {
+			if(seen[frameNumber]) {
+				throw runtime_error("Frame block appears more than once.");
+			}
+			seen[frameNumber] = true;
+			++count;
+		}
+	}
+
+	if(count != anim.numFrames) {
+		throw runtime_error("numFrames does not match the number of frame blocks.");
+	}
+}
+
+}
+
+Skeleton buildSkeleton(const MD5_AnimInfo &anim) {
+	Skeleton skeleton;
+	skeleton.resize(anim.jointsInfo.size());
+
+	for(int i = 0; i < anim.jointsInfo.size(); ++i) {
+		skeleton.names[i] = anim.jointsInfo[i].name;
+		skeleton.parents[i] = anim.jointsInfo[i].parent;
+		skeleton.positions[i] = anim.baseframeJoints[i].position;
+		skeleton.orientations[i] = anim.baseframeJoints[i].orientation;
+	}
+
+	validateJointOrder(skeleton.parents);
+	return skeleton;
+}
+
+vector<int> findChangingChannels(const MD5_AnimInfo &anim) {
+	const AnimFrames &frames = anim.framesData;
+	vector<int> changing(anim.jointsInfo.size(), 0);
+
+	// Without frames nothing is known to be constant.
+	if(frames.numFrames() == 0) {
+		for(int i = 0; i < anim.jointsInfo.size(); ++i) {
+			changing[i] = anim.jointsInfo[i].flags & 63;
+		}
+		return changing;
+	}
+
+	for(int i = 0; i < anim.jointsInfo.size(); ++i) {
+		const JointInfo &jointInfo = anim.jointsInfo[i];
+		int component = jointInfo.startIndex;
+
+		for(int channel = 0; channel < 6; ++channel) {
+			if(!(jointInfo.flags & (1 << channel))) {
+				continue;
+			}
+
+			// Compared as bits, so -0 and 0 count as a change like any other.
+			const float first = frames.value(0, component);
+			for(int f = 1; f < frames.numFrames(); ++f) {
+				float value = frames.value(f, component);
+				if(memcmp(&value, &first, sizeof(float)) != 0) {
+					changing[i] |= 1 << channel;
+					break;
+				}
+			}
+			++component;
+		}
+	}
+
+	return changing;
+}
+
+int frameAtTime(const MD5_AnimInfo &anim, double seconds) {
+	if(anim.numFrames <= 0 || anim.frameRate <= 0) {
+		return 0;
+	}
+
+	int frame = static_cast<int>(fmod(floor(seconds * anim.frameRate), anim.numFrames));
+	return frame < 0 ? frame + anim.numFrames : frame;
+}
+
+double framePositionAtTime(const MD5_AnimInfo &anim, double seconds) {
+	if(anim.numFrames <= 0 || anim.frameRate <= 0) {
+		return 0.0;
+	}
+
+	double position = fmod(seconds * anim.frameRate, anim.numFrames);
+	if(position < 0) {
+		position += anim.numFrames;
+	}
+	// Wrapping a tiny negative position can round up to the end.
+	return position < anim.numFrames ? position : 0.0;
+}
+
+void computeLocalPose(const MD5_AnimInfo &anim, int frame, vector<glm::vec3> &positions, vector<glm::quat> &orientations) {
+	const int numJoints = anim.jointsInfo.size();
+	const AnimFrames &frames = anim.framesData;
+
+	positions.resize(numJoints);
+	orientations.resize(numJoints);
+
+	for(int i = 0; i < numJoints; ++i) {
+		const BaseframeJoint &baseframeJoint = anim.baseframeJoints[i];
+		const JointInfo &jointInfo = anim.jointsInfo[i];
+
+		glm::vec3 position = baseframeJoint.position;
+		glm::quat orientation = baseframeJoint.orientation;
+
+		int flags = jointInfo.flags;
+		int offset = jointInfo.startIndex;
+
+		if(flags & (1 << 0)) {
+			position.x = frames.value(frame, offset++);
+		}
+		if(flags & (1 << 1)) {
+			position.y = frames.value(frame, offset++);
+		}
+		if(flags & (1 << 2)) {
+			position.z = frames.value(frame, offset++);
+		}
+		if(flags & (1 << 3)) {
+			orientation.x = frames.value(frame, offset++);
+		}
+		if(flags & (1 << 4)) {
+			orientation.y = frames.value(frame, offset++);
+		}
+		if(flags & (1 << 5)) {
+			orientation.z = frames.value(frame, offset++);
+		}
 
-	processAnimHeader();
-	processHierarchy();
-	processBounds();
-	processBaseframeJoints();
-	processFramesData();
+		// Compute the w-component of the quaternion
+		float temp = 1 - orientation.x * orientation.x
+					   - orientation.y * orientation.y
+					   - orientation.z * orientation.z;
+		if(temp < 0) {
+			orientation.w = 0;
+		} else {
+			orientation.w = -1 * sqrtf(temp);
+		}
+
+		positions[i] = position;
+		orientations[i] = orientation;
+	}
+}
+
+MD5_AnimInfo MD5_AnimReader::parse(const std::string &filename) {
+	ParseState state;
+	state.animFile.open(filename);
+
+	processAnimHeader(state);
+	processHierarchy(state);
+	processBounds(state);
+	processBaseframeJoints(state);
+	processFramesData(state);
 	
 	MD5_AnimInfo anim;
 
-	anim.baseframeJoints = mBaseframeJoints;
-	anim.jointsInfo = mJointsInfo;
-	anim.framesData = mFramesData;
-	anim.numFrames = mNumFrames;
+	anim.baseframeJoints.swap(state.baseframeJoints);
+	anim.jointsInfo.swap(state.jointsInfo);
+	anim.bounds.swap(state.bounds);
+	swap(anim.framesData, state.framesData);
+	anim.numFrames = state.numFrames;
+	anim.frameRate = state.frameRate;
 
 	return anim;
 }
 
+MD5_AnimInfo MD5_AnimReader::parseMapped(const std::string &filename, ThreadPool *pool) {
+	MappedFile file(filename);
+	MD5_Tokenizer tokens(file.begin(), file.end());
+	MD5_AnimInfo anim;
+
+	int numAnimatedComponents = parseHeader(tokens, anim);
+	anim.framesData.resize(anim.numFrames, numAnimatedComponents);
+
+	// Frames
+	decodeFrames(tokens, anim, numAnimatedComponents, pool);
 
-void MD5_AnimReader::processAnimHeader() {
+	return anim;
+}
+
+int MD5_AnimReader::parseHeader(MD5_Tokenizer &tokens, MD5_AnimInfo &anim) {
+	// Header
+	tokens.expect("MD5Version");
+	if(tokens.readInt() != 10) {
+		throw runtime_error("Can only parse version 10");
+	}
+
+	tokens.expect("commandline");
+	tokens.readString();
+	tokens.expect("numFrames");
+	int numFrames = tokens.readInt();
+	tokens.expect("numJoints");
+	int numJoints = tokens.readInt();
+	tokens.expect("frameRate");
+	anim.frameRate = tokens.readInt();
+	tokens.expect("numAnimatedComponents");
+	int numAnimatedComponents = tokens.readInt();
+
+	if(numFrames < 0 || numJoints < 0 || numAnimatedComponents < 0) {
+		throw runtime_error("Negative count in the md5anim header.");
+	}
+
+	anim.numFrames = numFrames;
+	anim.jointsInfo.resize(numJoints);
+	anim.baseframeJoints.resize(numJoints);
+
+	// Hierarchy
+	tokens.expect("hierarchy");
+	tokens.expect("{");
+	for(int i = 0; i < numJoints; ++i) {
+		JointInfo &jointInfo = anim.jointsInfo[i];
+		jointInfo.name = tokens.readWord();
+		jointInfo.parent = tokens.readInt();
+		jointInfo.flags = tokens.readInt();
+		jointInfo.startIndex = tokens.readInt();
+
+		if(jointInfo.parent < -1 || jointInfo.parent >= i) {
+			tokens.error("Joint parents must come before their children.");
+		}
+	}
+	tokens.expect("}");
+
+	// Bounds
+	tokens.expect("bounds");
+	tokens.expect("{");
+	anim.bounds.resize(numFrames);
+	for(auto &bounds : anim.bounds) {
+		tokens.expect("(");
+		bounds.min.x = tokens.readFloat();
+		bounds.min.y = tokens.readFloat();
+		bounds.min.z = tokens.readFloat();
+		tokens.expect(")");
+		tokens.expect("(");
+		bounds.max.x = tokens.readFloat();
+		bounds.max.y = tokens.readFloat();
+		bounds.max.z = tokens.readFloat();
+		tokens.expect(")");
+	}
+	tokens.expect("}");
+
+	// Baseframe
+	tokens.expect("baseframe");
+	tokens.expect("{");
+	for(auto &joint : anim.baseframeJoints) {
+		tokens.expect("(");
+		joint.position.x = tokens.readFloat();
+		joint.position.y = tokens.readFloat();
+		joint.position.z = tokens.readFloat();
+		tokens.expect(")");
+		tokens.expect("(");
+		joint.orientation.x = tokens.readFloat();
+		joint.orientation.y = tokens.readFloat();
+		joint.orientation.z = tokens.readFloat();
+		tokens.expect(")");
+	}
+	tokens.expect("}");
+
+	return numAnimatedComponents;
+}
+
+void MD5_AnimReader::processAnimHeader(ParseState &state) {
 	string line;
 	stringstream tokens;
 	int numJoints;
 
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	tokens.str(line);
 
 	string fieldName;
@@ -47,42 +377,39 @@ void MD5_AnimReader::processAnimHeader() {
 	}
 
 	// Command line
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	
 	// Blank line
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	
 	// Number of frames
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	tokens.clear();
 	tokens.str(line);
-	tokens >> fieldName >> mNumFrames;
-	mFramesData.resize(mNumFrames);
+	tokens >> fieldName >> state.numFrames;
 	
 	// Number of joints
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	tokens.clear();
 	tokens.str(line);
 	tokens >> fieldName >> numJoints;
-	mJointsInfo.reserve(numJoints);
-	mBaseframeJoints.reserve(numJoints);
+	state.jointsInfo.reserve(numJoints);
+	state.baseframeJoints.reserve(numJoints);
 	
 	// Frame rate
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	tokens.clear();
 	tokens.str(line);
-	tokens >> fieldName >> mFrameRate;
+	tokens >> fieldName >> state.frameRate;
 	
 	// Number of animated components
 	int numAnimatedComponents;
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	tokens.clear();
 	tokens.str(line);
 	tokens >> fieldName >> numAnimatedComponents;
 	
-	for(auto &frameData : mFramesData) {
-		frameData.resize(numAnimatedComponents);
-	}
+	state.framesData.resize(state.numFrames, numAnimatedComponents);
 }
 
 // TEMP
@@ -91,13 +418,13 @@ std::ostream &operator<<(std::ostream &out, const JointInfo &info) {
 	return out;
 }
 
-void MD5_AnimReader::processHierarchy() {
+void MD5_AnimReader::processHierarchy(ParseState &state) {
 	string line;
 	stringstream tokens;
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 
 	while(line == "") {
-		getline(mAnimFile, line);
+		getline(state.animFile, line);
 	}
 
 	tokens.str(line);
@@ -108,7 +435,7 @@ void MD5_AnimReader::processHierarchy() {
 		throw runtime_error("File-out-of-order exception. hierarchy should come next.");
 	}
 
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	while(line != "}") {
 		tokens.clear();
 		tokens.str(line);
@@ -119,19 +446,22 @@ void MD5_AnimReader::processHierarchy() {
 		tokens >> jointInfo.flags;
 		tokens >> jointInfo.startIndex;
 
-		mJointsInfo.push_back(jointInfo);
+		if(jointInfo.parent < -1 || jointInfo.parent >= int(state.jointsInfo.size())) {
+			throw runtime_error("Joint parents must come before their children.");
+		}
+		state.jointsInfo.push_back(jointInfo);
 		
-		getline(mAnimFile, line);
+		getline(state.animFile, line);
 	}
 }
 
-void MD5_AnimReader::processBounds() {
+void MD5_AnimReader::processBounds(ParseState &state) {
 	string line;
 	stringstream tokens;
 
 	// Eat space
 	do {
-		getline(mAnimFile, line);
+		getline(state.animFile, line);
 	} while(line == ""); 
 
 	string fieldName;
@@ -143,9 +473,26 @@ void MD5_AnimReader::processBounds() {
 		throw runtime_error("Expected a bounds section." );
 	}
 
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
+	string junk;
 	while(line != "}") {
-		getline(mAnimFile, line);
+		tokens.clear();
+		tokens.str(line);
+		FrameBounds bounds;
+
+		tokens >> junk; // (
+		tokens >> bounds.min.x;
+		tokens >> bounds.min.y;
+		tokens >> bounds.min.z;
+		tokens >> junk; // )
+		tokens >> junk; // (
+		tokens >> bounds.max.x;
+		tokens >> bounds.max.y;
+		tokens >> bounds.max.z;
+
+		state.bounds.push_back(bounds);
+
+		getline(state.animFile, line);
 	}
 }
 
@@ -157,13 +504,13 @@ std::ostream &operator<<(std::ostream &out, const BaseframeJoint &j) {
 	return out;
 }
 
-void MD5_AnimReader::processBaseframeJoints() {
+void MD5_AnimReader::processBaseframeJoints(ParseState &state) {
 	string line;
 	stringstream tokens;
 
 	// Eat space
 	do {
-		getline(mAnimFile, line);
+		getline(state.animFile, line);
 	} while(line == ""); 
 
 	string fieldName;
@@ -174,7 +521,7 @@ void MD5_AnimReader::processBaseframeJoints() {
 		throw runtime_error("Expected a baseframe section." );
 	}
 
-	getline(mAnimFile, line);
+	getline(state.animFile, line);
 	string junk;
 	unsigned count = 0;
 	while(line != "}") {
@@ -192,22 +539,22 @@ void MD5_AnimReader::processBaseframeJoints() {
 		tokens >> joint.orientation.y;
 		tokens >> joint.orientation.z;
 
-		mBaseframeJoints.push_back(joint);
+		state.baseframeJoints.push_back(joint);
 		//cout << joint << endl;
 
-		getline(mAnimFile, line);
+		getline(state.animFile, line);
 	}
 }
 
-void MD5_AnimReader::processFramesData() {
+void MD5_AnimReader::processFramesData(ParseState &state) {
 	string line;
 	stringstream tokens;
 	unsigned frameCount = 0;
 
-	while(frameCount < mNumFrames) {
+	while(frameCount < state.numFrames) {
 		// Eat space
 		do {
-			getline(mAnimFile, line);
+			getline(state.animFile, line);
 		} while(line == ""); 
 
 		string fieldName;
@@ -221,8 +568,8 @@ void MD5_AnimReader::processFramesData() {
 		}
 		
 
-		getline(mAnimFile, line);		
-		std::vector<float> &frameData = mFramesData[frameNumber];
+		getline(state.animFile, line);		
+		float *frameData = state.framesData.frame(frameNumber);
 		unsigned count = 0;
 		while(line != "}") {
 			tokens.clear();
@@ -234,7 +581,7 @@ void MD5_AnimReader::processFramesData() {
 				frameData[count++] = value;
 			}
 
-			getline(mAnimFile, line);
+			getline(state.animFile, line);
 		}
 	
 		++frameCount;
@@ -7,6 +7,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include "AnimCore.h"
+#include "AnimFrames.h"
+
+class MD5_Tokenizer;
+class ThreadPool;
+
 struct JointInfo {
 	std::string name;
 	int parent;
@@ -20,30 +26,74 @@ struct BaseframeJoint {
 	glm::mat4 jointToWorld;
 };
 
+// Axis aligned box around the animated model at one frame, in model space.
+struct FrameBounds {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
 struct MD5_AnimInfo {
 	std::vector<BaseframeJoint> baseframeJoints;
 	std::vector<JointInfo> jointsInfo;
-	std::vector<std::vector<float>> framesData;
+	std::vector<FrameBounds> bounds;
+	AnimFrames framesData;
 	int numFrames;
+	int frameRate;
 };
 
+// Joint space position and orientation of every joint at one frame of the
+// clip, the way the renderers build them: baseframe values replaced by the
+// animated components and w recomputed.
+void computeLocalPose(const MD5_AnimInfo &anim, int frame,
+					  std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations);
+
+// The clip's hierarchy with the baseframe as its joint space transforms.
+// computeLocalPose can write a frame straight into positions and orientations.
+Skeleton buildSkeleton(const MD5_AnimInfo &anim);
+
+// The frame on show seconds into the clip at its frameRate: the time in
+// frames rounded down and wrapped, so the clip loops and negative times count
+// back from its end. 0 for a clip with no frames or no frame rate.
+int frameAtTime(const MD5_AnimInfo &anim, double seconds);
+// The same without rounding down: where seconds falls in the clip, in frames
+// from its start, in [0, numFrames).
+double framePositionAtTime(const MD5_AnimInfo &anim, double seconds);
+
+// Each joint's flags with the channels that hold the same value in every
+// frame cleared. 0 means the joint never moves relative to its parent.
+std::vector<int> findChangingChannels(const MD5_AnimInfo &anim);
+
+// Like MD5_MeshReader, keeps no state between calls and is safe to use from
+// any number of threads at once.
 class MD5_AnimReader {
 public:
-	MD5_AnimInfo parse(const std::string &filename);
-private:
-	void processAnimHeader();
-	void processHierarchy();
-	void processBounds();
-	void processBaseframeJoints();
-	void processFramesData();
+	static MD5_AnimInfo parse(const std::string &filename);
+	// Same result as parse() but maps the file. Frame blocks are decoded in
+	// bulk by MD5_FrameScanner. With a pool, long clips are split at frame
+	// boundaries and the pieces are decoded in parallel.
+	static MD5_AnimInfo parseMapped(const std::string &filename, ThreadPool *pool = nullptr);
+	// Reads everything up to the first frame block into anim and returns
+	// numAnimatedComponents. framesData is left alone and tokens is left at
+	// the first frame block.
+	static int parseHeader(MD5_Tokenizer &tokens, MD5_AnimInfo &anim);
 private:
-	int mNumFrames;
-	int mFrameRate;
-	std::vector<JointInfo> mJointsInfo;
-	std::vector<BaseframeJoint> mBaseframeJoints;
-	std::vector<std::vector<float>> mFramesData;
-	
-	std::ifstream mAnimFile;
+	// What the stream based parse() carries between its steps.
+	struct ParseState {
+		int numFrames;
+		int frameRate;
+		std::vector<JointInfo> jointsInfo;
+		std::vector<BaseframeJoint> baseframeJoints;
+		std::vector<FrameBounds> bounds;
+		AnimFrames framesData;
+
+		std::ifstream animFile;
+	};
+
+	static void processAnimHeader(ParseState &state);
+	static void processHierarchy(ParseState &state);
+	static void processBounds(ParseState &state);
+	static void processBaseframeJoints(ParseState &state);
+	static void processFramesData(ParseState &state);
 };
 
 #endif
\ No newline at end of file
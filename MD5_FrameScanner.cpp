@@ -0,0 +1,167 @@
+#include "MD5_FrameScanner.h"
+#include "MD5_Tokenizer.h"
+
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MD5_FRAME_SCANNER_SSE2
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+using std::runtime_error;
+
+namespace {
+
+inline bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void throwCountMismatch() {
+	throw runtime_error("Frame block does not hold numAnimatedComponents values.");
+}
+
+void throwBadValue() {
+	throw runtime_error("Expected a number in a frame block.");
+}
+
+#ifdef MD5_FRAME_SCANNER_SSE2
+inline unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Bit i is set when p[i] is printable, i.e. not whitespace or a control char.
+inline unsigned printableMask(const char *p) {
+	const __m128i space = _mm_set1_epi8(' ');
+	__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	return _mm_movemask_epi8(_mm_cmpgt_epi8(chunk, space));
+}
+
+inline const char *skipSpaceSimd(const char *p, const char *end) {
+	while(end - p >= 16) {
+		unsigned mask = printableMask(p);
+		if(mask) {
+			return p + lowestBit(mask);
+		}
+		p += 16;
+	}
+
+	while(p != end && isSpace(*p)) {
+		++p;
+	}
+	return p;
+}
+
+inline const char *tokenEndSimd(const char *p, const char *end) {
+	while(end - p >= 16) {
+		unsigned mask = ~printableMask(p) & 0xFFFF;
+		if(mask) {
+			return p + lowestBit(mask);
+		}
+		p += 16;
+	}
+
+	while(p != end && !isSpace(*p)) {
+		++p;
+	}
+	return p;
+}
+#endif
+
+}
+
+namespace MD5_FrameScanner {
+
+const char *scanFrame(const char *p, const char *end, float *out, int count) {
+	return scanFrameSimd(p, end, out, count);
+}
+
+const char *scanFrameScalar(const char *p, const char *end, float *out, int count) {
+	int n = 0;
+
+	for(;;) {
+		while(p != end && isSpace(*p)) {
+			++p;
+		}
+
+		if(p == end) {
+			throw runtime_error("Unterminated frame block.");
+		}
+
+		if(*p == '}') {
+			break;
+		}
+
+		if(n == count) {
+			throwCountMismatch();
+		}
+
+		p = MD5_Number::parseFloat(p, end, out[n++]);
+		if(!p || (p != end && !isSpace(*p) && *p != '}')) {
+			throwBadValue();
+		}
+	}
+
+	if(n != count) {
+		throwCountMismatch();
+	}
+
+	return p + 1;
+}
+
+const char *scanFrameSimd(const char *p, const char *end, float *out, int count) {
+#ifdef MD5_FRAME_SCANNER_SSE2
+	int n = 0;
+
+	for(;;) {
+		p = skipSpaceSimd(p, end);
+
+		if(p == end) {
+			throw runtime_error("Unterminated frame block.");
+		}
+
+		if(*p == '}') {
+			break;
+		}
+
+		if(n == count) {
+			throwCountMismatch();
+		}
+
+		// Knowing where the token stops lets the digit loop run without
+		// looking for delimiters itself.
+		const char *tokenEnd = tokenEndSimd(p, end);
+		const char *after = MD5_Number::parseFloat(p, tokenEnd, out[n++]);
+		if(!after || (after != tokenEnd && *after != '}')) {
+			throwBadValue();
+		}
+		p = after;
+	}
+
+	if(n != count) {
+		throwCountMismatch();
+	}
+
+	return p + 1;
+#else
+	return scanFrameScalar(p, end, out, count);
+#endif
+}
+
+bool simdAvailable() {
+#ifdef MD5_FRAME_SCANNER_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+}
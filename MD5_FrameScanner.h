@@ -0,0 +1,25 @@
+#ifndef MD5_FRAME_SCANNER_H
+#define MD5_FRAME_SCANNER_H
+
+// Bulk decoder for the body of an md5anim `frame N { ... }` block. The block
+// is nothing but whitespace separated floats, so it skips the tokenizer and
+// writes the values straight into the caller's storage.
+namespace MD5_FrameScanner {
+
+// p points just past the opening '{'. Exactly count values are written to out
+// and the position after the closing '}' is returned. Throws a runtime_error
+// if the block holds a different number of values or something that is not a
+// number.
+const char *scanFrame(const char *p, const char *end, float *out, int count);
+
+// The two implementations behind scanFrame(). The SSE2 one finds whitespace
+// runs and token ends 16 bytes at a time; it is only compiled where SSE2 is
+// available and otherwise forwards to the scalar version.
+const char *scanFrameScalar(const char *p, const char *end, float *out, int count);
+const char *scanFrameSimd(const char *p, const char *end, float *out, int count);
+
+bool simdAvailable();
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "MD5_MeshReader.h"
+#include "MappedFile.h"
 
 #include <iostream>
 #include <fstream>
@@ -6,7 +7,6 @@
 #include <string>
 #include <sstream>
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
 
 using glm::mat4;
 
@@ -24,31 +24,158 @@ std::ostream &operator<<(std::ostream &, const MD5_Triangle &);
 std::ostream &operator<<(std::ostream &, const MD5_Weight &);
 
 MD5_MeshInfo MD5_MeshReader::parse(const std::string &filename) {
-	mMeshFile.open(filename);
+	ParseState state;
+	state.meshFile.open(filename);
 
-	if(!mMeshFile) {				
+	if(!state.meshFile) {				
 		throw runtime_error("Could not open the file.");
 	} 
 
 	MD5_MeshInfo mesh;
 
-	processVersion();
-	processCommandLine();
-	processJointsAndMeshCounts();
-	processJoints();
-	processMeshes();
+	processVersion(state);
+	processCommandLine(state);
+	processJointsAndMeshCounts(state);
+	processJoints(state);
+	processMeshes(state);
 
-	mMeshFile.close();
-	mesh.meshes = mMeshes;
-	mesh.joints = mJoints;
+	state.meshFile.close();
+	mesh.meshes.swap(state.meshes);
+	mesh.joints.swap(state.joints);
 	
 	return mesh;
 }
 
-void MD5_MeshReader::processVersion() {	
+MD5_MeshInfo MD5_MeshReader::parseMapped(const std::string &filename) {
+	MappedFile file(filename);
+	MD5_Tokenizer tokens(file.begin(), file.end());
+	MD5_MeshInfo mesh;
+
+	tokens.expect("MD5Version");
+	if(tokens.readInt() != 10) {
+		throw runtime_error("Only processing version 10 of the MD5 spec.");
+	}
+
+	tokens.expect("commandline");
+	tokens.readString();
+
+	tokens.expect("numJoints");
+	int numJoints = tokens.readInt();
+	tokens.expect("numMeshes");
+	int numMeshes = tokens.readInt();
+
+	if(numJoints < 0 || numMeshes < 0) {
+		throw runtime_error("Negative joint or mesh count.");
+	}
+
+	mesh.joints.resize(numJoints);
+	mesh.meshes.reserve(numMeshes);
+
+	tokens.expect("joints");
+	tokens.expect("{");
+
+	for(int i = 0; i < numJoints; ++i) {
+		Joint j;
+		j.name = tokens.readWord();
+		j.parentIndex = tokens.readInt();
+
+		if(j.parentIndex < -1 || j.parentIndex >= i) {
+			tokens.error("Joint parents must come before their children.");
+		}
+
+		tokens.expect("(");
+		j.position.x = tokens.readFloat();
+		j.position.y = tokens.readFloat();
+		j.position.z = tokens.readFloat();
+		tokens.expect(")");
+		tokens.expect("(");
+		j.orientation.x = tokens.readFloat();
+		j.orientation.y = tokens.readFloat();
+		j.orientation.z = tokens.readFloat();
+		tokens.expect(")");
+
+		computeWComponent(j);
+		computeJointToWorld(j, mesh.joints);
+
+		mesh.joints[i] = j;
+	}
+
+	tokens.expect("}");
+
+	while(!tokens.atEnd()) {
+		tokens.expect("mesh");
+		tokens.expect("{");
+
+		mesh.meshes.push_back(MD5_Mesh());
+		parseMappedMesh(tokens, mesh.meshes.back());
+	}
+
+	return mesh;
+}
+
+void MD5_MeshReader::parseMappedMesh(MD5_Tokenizer &tokens, MD5_Mesh &mesh) {
+	for(;;) {
+		MD5_Token field = tokens.next();
+
+		if(field == "}") {
+			return;
+		}
+
+		if(field == "vert") {
+			int index = tokens.readInt();
+			if(index < 0 || index >= static_cast<int>(mesh.vertices.size())) {
+				tokens.error("Vertex index out of range.");
+			}
+
+			MD5_Vertex &vertex = mesh.vertices[index];
+			tokens.expect("(");
+			vertex.u = tokens.readFloat();
+			vertex.v = tokens.readFloat();
+			tokens.expect(")");
+			vertex.startWeight = tokens.readInt();
+			vertex.weightCount = tokens.readInt();
+		} else if(field == "tri") {
+			int index = tokens.readInt();
+			if(index < 0 || index >= static_cast<int>(mesh.triangles.size())) {
+				tokens.error("Triangle index out of range.");
+			}
+
+			MD5_Triangle &tri = mesh.triangles[index];
+			tri.indices[0] = static_cast<unsigned short>(tokens.readInt());
+			tri.indices[1] = static_cast<unsigned short>(tokens.readInt());
+			tri.indices[2] = static_cast<unsigned short>(tokens.readInt());
+		} else if(field == "weight") {
+			int index = tokens.readInt();
+			if(index < 0 || index >= static_cast<int>(mesh.weights.size())) {
+				tokens.error("Weight index out of range.");
+			}
+
+			MD5_Weight &weight = mesh.weights[index];
+			weight.jointIndex = tokens.readInt();
+			weight.weightBias = tokens.readFloat();
+			tokens.expect("(");
+			weight.position.x = tokens.readFloat();
+			weight.position.y = tokens.readFloat();
+			weight.position.z = tokens.readFloat();
+			tokens.expect(")");
+		} else if(field == "shader") {
+			mesh.textureFilename = tokens.readString();
+		} else if(field == "numverts") {
+			mesh.vertices.resize(tokens.readInt());
+		} else if(field == "numtris") {
+			mesh.triangles.resize(tokens.readInt());
+		} else if(field == "numweights") {
+			mesh.weights.resize(tokens.readInt());
+		} else {
+			tokens.error("Unexpected '" + field.str() + "' in mesh block.");
+		}
+	}
+}
+
+void MD5_MeshReader::processVersion(ParseState &state) {	
 	string line;
 	
-	getline(mMeshFile, line); 
+	getline(state.meshFile, line); 
 	stringstream sstream(line);
 	string versionStr;
 	int versionNum;
@@ -61,22 +188,22 @@ void MD5_MeshReader::processVersion() {
 	}
 }
 
-void MD5_MeshReader::processCommandLine() {
+void MD5_MeshReader::processCommandLine(ParseState &state) {
 	string line;
-	getline(mMeshFile, line);
+	getline(state.meshFile, line);
 
 	// Just by-passing this for now
 }
 
-void MD5_MeshReader::processJointsAndMeshCounts() {
+void MD5_MeshReader::processJointsAndMeshCounts(ParseState &state) {
 	string line;
 	
 	// Eat spaces
 	do {
-		getline(mMeshFile, line);
-	} while(mMeshFile && line == "");
+		getline(state.meshFile, line);
+	} while(state.meshFile && line == "");
 
-	if(!mMeshFile) {
+	if(!state.meshFile) {
 		throw runtime_error("EOF reached and no joint count found.");
 	}
 
@@ -86,14 +213,14 @@ void MD5_MeshReader::processJointsAndMeshCounts() {
 
 	tokens >> numJointsStr;
 	tokens >> numJoints;
-	mJoints.resize(numJoints);
+	state.joints.resize(numJoints);
 
 	// Get the mesh info
 	do {
-		getline(mMeshFile, line);
-	} while(mMeshFile && line == "");
+		getline(state.meshFile, line);
+	} while(state.meshFile && line == "");
 
-	if(!mMeshFile) {
+	if(!state.meshFile) {
 		throw runtime_error("EOF reached and no mesh count found.");
 	}
 
@@ -109,12 +236,12 @@ void MD5_MeshReader::processJointsAndMeshCounts() {
 
 
 
-void MD5_MeshReader::processJoints() {
+void MD5_MeshReader::processJoints(ParseState &state) {
 	string line;
 
 	do {
-		getline(mMeshFile, line);
-	} while(mMeshFile && line == "");
+		getline(state.meshFile, line);
+	} while(state.meshFile && line == "");
 
 	stringstream tokens(line);
 	string type;
@@ -126,23 +253,23 @@ void MD5_MeshReader::processJoints() {
 	}
 
 	int count = 0;
-	getline(mMeshFile, line); // Advance to the next line
-	while(mMeshFile.good() && line != "}") {
-		buildJoint(line, count++);
-		getline(mMeshFile, line);		
+	getline(state.meshFile, line); // Advance to the next line
+	while(state.meshFile.good() && line != "}") {
+		buildJoint(state, line, count++);
+		getline(state.meshFile, line);		
 	}
 }
 
-void MD5_MeshReader::processMeshes() {
+void MD5_MeshReader::processMeshes(ParseState &state) {
 	string line;
 
 	// The rest of the file should be mesh section.
-	while(mMeshFile) {
+	while(state.meshFile) {
 		do {
-			getline(mMeshFile, line);
-		} while(mMeshFile && line == "");
+			getline(state.meshFile, line);
+		} while(state.meshFile && line == "");
 
-		if(!mMeshFile) {
+		if(!state.meshFile) {
 			// We hit the end of the file.
 			return;
 		}
@@ -156,22 +283,22 @@ void MD5_MeshReader::processMeshes() {
 			throw runtime_error("Expected a mesh block.");
 		}
 
-		processMesh();
-		mMeshes.push_back(mCurMesh);
+		processMesh(state);
+		state.meshes.push_back(state.curMesh);
 	}
 }
 
-void MD5_MeshReader::processMesh() {
+void MD5_MeshReader::processMesh(ParseState &state) {
 	string line;
 	string fieldName;
 	stringstream tokens;
 	string junk;
 
-	mCurMesh.vertices.clear();
-	mCurMesh.triangles.clear();
-	mCurMesh.weights.clear();
+	state.curMesh.vertices.clear();
+	state.curMesh.triangles.clear();
+	state.curMesh.weights.clear();
 
-	getline(mMeshFile, line); // Advance to the next line
+	getline(state.meshFile, line); // Advance to the next line
 	tokens.str(line);
 	
 	tokens >> fieldName;
@@ -182,12 +309,12 @@ void MD5_MeshReader::processMesh() {
 
 	string quotedFilename;
 	tokens >> quotedFilename;
-	mCurMesh.textureFilename = quotedFilename.substr(1, quotedFilename.size() - 2);
+	state.curMesh.textureFilename = quotedFilename.substr(1, quotedFilename.size() - 2);
 	
 	// Eat spaces
 	do {
-		getline(mMeshFile, line);
-	} while(mMeshFile && line == "");
+		getline(state.meshFile, line);
+	} while(state.meshFile && line == "");
 
 	tokens.clear();
 	tokens.str(line);
@@ -201,10 +328,10 @@ void MD5_MeshReader::processMesh() {
 	}
 
 	tokens >> numVerts;
-	mCurMesh.vertices.resize(numVerts);
+	state.curMesh.vertices.resize(numVerts);
 
 	// Read the verts
-	while(mMeshFile) {
+	while(state.meshFile) {
 		if(line != "") {			
 			tokens.clear();
 			tokens.str(line);
@@ -223,19 +350,19 @@ void MD5_MeshReader::processMesh() {
 				tokens >> junk;
 				tokens >> vertex.startWeight;
 				tokens >> vertex.weightCount;
-				mCurMesh.vertices[index] = vertex;
+				state.curMesh.vertices[index] = vertex;
 			}			
 		}
 		
-		getline(mMeshFile, line);
+		getline(state.meshFile, line);
 	}
 
 	int numTris;
 	tokens >> numTris;
-	mCurMesh.triangles.resize(numTris);
+	state.curMesh.triangles.resize(numTris);
 	
 	// Read the tris
-	while(mMeshFile) {
+	while(state.meshFile) {
 		if(line != "") {
 			tokens.clear();
 			tokens.str(line);
@@ -252,19 +379,19 @@ void MD5_MeshReader::processMesh() {
 				tokens >> tri.indices[1];
 				tokens >> tri.indices[2];
 
-				mCurMesh.triangles[index] = tri;
+				state.curMesh.triangles[index] = tri;
 			}			
 		}
 
-		getline(mMeshFile, line);		
+		getline(state.meshFile, line);		
 	}
 	
 	// Read the weights
 	int numWeights;
 	tokens >> numWeights;
-	mCurMesh.weights.resize(numWeights);
+	state.curMesh.weights.resize(numWeights);
 
-	while(mMeshFile) {
+	while(state.meshFile) {
 		if(line != "") {
 			tokens.clear();
 			tokens.str(line);
@@ -285,33 +412,20 @@ void MD5_MeshReader::processMesh() {
 				tokens >> weight.position.z;
 				tokens >> junk;
 
-				mCurMesh.weights[index] = weight;
+				state.curMesh.weights[index] = weight;
 			}			
 		}
 		
-		getline(mMeshFile, line);
+		getline(state.meshFile, line);
 	}
 }
 
-mat4 MD5_MeshReader::getChildToParentMatrix(const Joint &joint) {
-	mat4 rotM(glm::mat4_cast(joint.orientation));
-	mat4 transM = glm::translate(mat4(1.0f), joint.position);
-	
-	return transM * rotM;
-}
-
-void MD5_MeshReader::computeJointToWorld(Joint &joint) {
-	mat4 P(1.0);
-	const Joint *pJoint = &joint;
-
-	while(pJoint) {		
-		mat4 P_next = getChildToParentMatrix(*pJoint);
-		P = P_next * P;
-
-		pJoint = (pJoint->parentIndex == -1) ? nullptr : &mJoints[pJoint->parentIndex];
+void MD5_MeshReader::computeJointToWorld(Joint &joint, const std::vector<Joint> &joints) {
+	// Parents are read first, so theirs is already complete.
+	joint.jointToWorld = jointToParentMatrix(joint.position, joint.orientation);
+	if(joint.parentIndex > -1) {
+		joint.jointToWorld = joints[joint.parentIndex].jointToWorld * joint.jointToWorld;
 	}
-		 
-	joint.jointToWorld = P;
 }
 
 void MD5_MeshReader::computeWComponent(Joint &j) {
@@ -367,7 +481,7 @@ std::ostream & operator<<(std::ostream &out, Joint &joint) {
 	return out;
 }
 
-void MD5_MeshReader::buildJoint(const string &line, int count) {		
+void MD5_MeshReader::buildJoint(ParseState &state, const string &line, int count) {		
 	Joint j;
 	stringstream tokens(line);
 	string dump;
@@ -390,7 +504,10 @@ void MD5_MeshReader::buildJoint(const string &line, int count) {
 	j.orientation.z = orientZ;
 	computeWComponent(j);
 
-	computeJointToWorld(j);
+	if(j.parentIndex < -1 || j.parentIndex >= count) {
+		throw runtime_error("Joint parents must come before their children.");
+	}
+	computeJointToWorld(j, state.joints);
 
-	mJoints[count] = j;	
+	state.joints[count] = j;	
 }
\ No newline at end of file
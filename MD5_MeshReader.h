@@ -2,6 +2,7 @@
 #define MD5_MESH_READER
 
 #include "AnimCore.h"
+#include "MD5_Tokenizer.h"
 
 #include <fstream>
 #include <string>
@@ -36,27 +37,35 @@ struct MD5_MeshInfo {
 	std::vector<MD5_Mesh> meshes;
 };
 
+// The readers keep no state between calls. Each parse works on its own
+// locals, so any number of files can be parsed at once from any threads.
 class MD5_MeshReader {
 public:
-	MD5_MeshInfo parse(const std::string &filename);
+	static MD5_MeshInfo parse(const std::string &filename);
+	// Same result as parse() but maps the file and tokenizes it in place.
+	static MD5_MeshInfo parseMapped(const std::string &filename);
 private:
-	void processVersion();
-	void processCommandLine();
-	void processJointsAndMeshCounts();
-	void processJoints();
-	void processMeshes();
-	void processMesh();
-
-	void buildJoint(const std::string &line, int count);
-	glm::mat4 getChildToParentMatrix(const Joint &joint);
-	void computeJointToWorld(Joint &joint);
-	void computeWComponent(Joint &joint);
-private:
-	std::ifstream mMeshFile;
-	std::vector<Joint> mJoints;
+	// What the stream based parse() carries between its steps.
+	struct ParseState {
+		std::ifstream meshFile;
+		std::vector<Joint> joints;
+
+		MD5_Mesh curMesh;
+		std::vector<MD5_Mesh> meshes;
+	};
+
+	static void processVersion(ParseState &state);
+	static void processCommandLine(ParseState &state);
+	static void processJointsAndMeshCounts(ParseState &state);
+	static void processJoints(ParseState &state);
+	static void processMeshes(ParseState &state);
+	static void processMesh(ParseState &state);
 
-	MD5_Mesh mCurMesh;
-	std::vector<MD5_Mesh> mMeshes;
+	static void buildJoint(ParseState &state, const std::string &line, int count);
+	static void parseMappedMesh(MD5_Tokenizer &tokens, MD5_Mesh &mesh);
+	// Needs the joints before it in joints to be complete.
+	static void computeJointToWorld(Joint &joint, const std::vector<Joint> &joints);
+	static void computeWComponent(Joint &joint);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "MD5_Tokenizer.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using std::runtime_error;
+using std::string;
+using std::stringstream;
+
+MD5_Tokenizer::MD5_Tokenizer(const char *begin, const char *end)
+	: mBegin(begin), mCur(begin), mEnd(end) {
+}
+
+string MD5_Tokenizer::readWord() {
+	return next().str();
+}
+
+string MD5_Tokenizer::readString() {
+	if(!skipSpace() || *mCur != '"') {
+		error("Expected a quoted string.");
+	}
+
+	const char *start = mCur + 1;
+	const char *close = std::find(start, mEnd, '"');
+	if(close == mEnd) {
+		error("Unterminated string.");
+	}
+
+	mCur = close + 1;
+	return string(start, close);
+}
+
+void MD5_Tokenizer::error(const string &message) const {
+	// Only count lines when something went wrong.
+	long line = 1 + std::count(mBegin, mCur, '\n');
+
+	stringstream out;
+	out << "Line " << line << ": " << message;
+	throw runtime_error(out.str());
+}
@@ -0,0 +1,253 @@
+#ifndef MD5_TOKENIZER_H
+#define MD5_TOKENIZER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+struct MD5_Token {
+	const char *begin;
+	const char *end;
+
+	bool operator==(const char *text) const {
+		size_t len = strlen(text);
+		return static_cast<size_t>(end - begin) == len && memcmp(begin, text, len) == 0;
+	}
+	bool operator!=(const char *text) const { return !(*this == text); }
+	std::string str() const { return std::string(begin, end); }
+};
+
+// Scans an in-memory MD5 file (md5mesh or md5anim) in place. Tokens are
+// whitespace delimited and // comments are skipped, which matches how the
+// stream based readers split each line.
+class MD5_Tokenizer {
+public:
+	MD5_Tokenizer(const char *begin, const char *end);
+
+	// Skips whitespace and comments. Returns false at the end of the input.
+	bool skipSpace();
+	bool atEnd();
+
+	MD5_Token next();
+	void expect(const char *keyword);
+
+	int readInt();
+	float readFloat();
+	// The raw token, quotes included, e.g. "origin" for a joint name.
+	std::string readWord();
+	// The contents of a quoted string without the quotes.
+	std::string readString();
+
+	const char *position() const { return mCur; }
+	void setPosition(const char *pos) { mCur = pos; }
+	const char *begin() const { return mBegin; }
+	const char *end() const { return mEnd; }
+
+	// Throws a runtime_error that names the current line.
+	[[noreturn]] void error(const std::string &message) const;
+private:
+	const char *mBegin;
+	const char *mCur;
+	const char *mEnd;
+};
+
+// Number parsing shared by the tokenizer and the bulk frame scanners. Both
+// return the position after the number or nullptr if there is no number at p.
+namespace MD5_Number {
+
+inline bool isDigit(char c) {
+	return static_cast<unsigned>(c - '0') < 10;
+}
+
+inline const char *parseInt(const char *p, const char *end, int &out) {
+	bool negative = false;
+
+	if(p != end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	if(p == end || !isDigit(*p)) {
+		return nullptr;
+	}
+
+	int value = 0;
+	while(p != end && isDigit(*p)) {
+		value = value * 10 + (*p - '0');
+		++p;
+	}
+
+	out = negative ? -value : value;
+	return p;
+}
+
+// Slow path for numbers we cannot convert exactly: too many significant digits
+// or an exponent outside the exactly representable powers of ten.
+inline const char *parseFloatFallback(const char *p, const char *end, float &out) {
+	char buffer[64];
+	size_t len = 0;
+
+	while(p + len != end && len < sizeof(buffer) - 1) {
+		char c = p[len];
+		if(!isDigit(c) && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') {
+			break;
+		}
+		buffer[len++] = c;
+	}
+	buffer[len] = '\0';
+
+	char *stop;
+	out = strtof(buffer, &stop);
+	return (stop == buffer) ? nullptr : p + (stop - buffer);
+}
+
+inline const char *parseFloat(const char *p, const char *end, float &out) {
+	static const double kPow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+
+	const char *start = p;
+	bool negative = false;
+
+	if(p != end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	bool sawDigit = false;
+
+	while(p != end && isDigit(*p)) {
+		if(mantissa < kMaxExactMantissa) {
+			mantissa = mantissa * 10 + (*p - '0');
+		} else {
+			++exponent;
+		}
+		sawDigit = true;
+		++p;
+	}
+
+	if(p != end && *p == '.') {
+		++p;
+		while(p != end && isDigit(*p)) {
+			if(mantissa < kMaxExactMantissa) {
+				mantissa = mantissa * 10 + (*p - '0');
+				--exponent;
+			}
+			sawDigit = true;
+			++p;
+		}
+	}
+
+	if(!sawDigit) {
+		return nullptr;
+	}
+
+	if(p != end && (*p == 'e' || *p == 'E')) {
+		int e;
+		const char *afterExp = parseInt(p + 1, end, e);
+		if(afterExp) {
+			exponent += e;
+			p = afterExp;
+		}
+	}
+
+	if(mantissa > kMaxExactMantissa || exponent < -22 || exponent > 22) {
+		return parseFloatFallback(start, end, out);
+	}
+
+	// Both the mantissa and the power of ten are exact doubles, so a single
+	// correctly rounded multiply/divide gives the nearest double.
+	double value = static_cast<double>(mantissa);
+	if(exponent < 0) {
+		value /= kPow10[-exponent];
+	} else {
+		value *= kPow10[exponent];
+	}
+
+	out = static_cast<float>(negative ? -value : value);
+	return p;
+}
+
+}
+
+// The per-token functions live here so the readers can inline them.
+inline bool MD5_Tokenizer::skipSpace() {
+	while(mCur != mEnd) {
+		char c = *mCur;
+
+		if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			++mCur;
+		} else if(c == '/' && mCur + 1 != mEnd && mCur[1] == '/') {
+			// Comment runs to the end of the line
+			mCur = std::find(mCur, mEnd, '\n');
+		} else {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline bool MD5_Tokenizer::atEnd() {
+	return !skipSpace();
+}
+
+inline MD5_Token MD5_Tokenizer::next() {
+	if(!skipSpace()) {
+		error("Unexpected end of file.");
+	}
+
+	MD5_Token token;
+	token.begin = mCur;
+
+	while(mCur != mEnd && *mCur != ' ' && *mCur != '\t' && *mCur != '\n' && *mCur != '\r') {
+		++mCur;
+	}
+
+	token.end = mCur;
+	return token;
+}
+
+inline void MD5_Tokenizer::expect(const char *keyword) {
+	const char *start = mCur;
+	MD5_Token token = next();
+
+	if(token != keyword) {
+		mCur = start;
+		error(std::string("Expected '") + keyword + "' but found '" + token.str() + "'.");
+	}
+}
+
+inline int MD5_Tokenizer::readInt() {
+	skipSpace();
+
+	int value;
+	const char *p = MD5_Number::parseInt(mCur, mEnd, value);
+	if(!p) {
+		error("Expected an integer.");
+	}
+
+	mCur = p;
+	return value;
+}
+
+inline float MD5_Tokenizer::readFloat() {
+	skipSpace();
+
+	float value;
+	const char *p = MD5_Number::parseFloat(mCur, mEnd, value);
+	if(!p) {
+		error("Expected a number.");
+	}
+
+	mCur = p;
+	return value;
+}
+
+#endif
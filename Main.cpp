@@ -6,8 +6,10 @@
 #endif
 
 #include <algorithm>
+#include <cstdlib>
 #include <exception>
 #include <fstream>
+#include <future>
 #include <sstream>
 #include <string>
 #include <iostream>
@@ -18,7 +20,14 @@
 
 #include "Shader.h"
 #include "AnimCore.h"
+#include "AnimSampler.h"
+#include "AnimationThread.h"
+#include "BakedAsset.h"
+#include "ColladaReader.h"
+#include "Culling.h"
 #include "MD5Reader.h"
+#include "ThreadPool.h"
+#include "TripleBuffer.h"
 
 using namespace std;
 using glm::mat4;
@@ -26,24 +35,10 @@ using glm::vec3;
 using glm::vec4;
 using glm::quat;
 
-struct Bounds {
-	float minX;
-	float maxX;
-	float minY;
-	float maxY;
-	float minZ;
-	float maxZ;
-};
-
-struct FrameJoint {
-	string name;
-	vec3 position;
-	quat orientation;
-	int parentIndex;
-};
-
 struct RenderableMesh {
 	MD5_Mesh mesh;
+	// Written by the skinning tasks, uploaded to hVBO by the GL thread.
+	vector<GLfloat> skinnedPositions;
 	GLuint hVBO;
 	GLuint hVAO;
 	GLuint hIndexBuffer;
@@ -72,20 +67,52 @@ GLuint g_hSkeletonBuffer;
 GLuint g_hSkeletonVAO;
 GLuint g_numBonesToDraw;
 
-Bounds g_bounds;
+FrameBounds g_bounds;
+// Set once with the camera, before the animation thread starts, so that
+// thread reads it without a lock.
+Frustum g_viewFrustum;
 
 bool frameChanged = true;
-int curFrame = 0;
-int elapsedTime = 0;
+// Where in the clip the pose being drawn is, in frames.
+float curFrame = 0.0f;
 GLuint hVerticesBuffer;
 GLuint hColorsBuffer;
 
-const int kTimerPeriod = 50;
+// Redraw period. Animation keeps its own time on g_animationThread.
+const int kTimerPeriod = 16;
+// Animation step. Poses are sampled between the clip's frames, so this need
+// not match its frame rate.
+const double kAnimationStep = 1.0 / 60.0;
 const float kFovY = 45.0f;
+// Vertices skinned per task.
+const int kSkinBatchSize = 256;
 
-vector<vector<FrameJoint>> frameSkeletons;
 vector<RenderableMesh> g_Meshes;
 
+// Runs the load, then the per frame skinning.
+ThreadPool *g_pJobPool;
+// One task per kSkinBatchSize vertices of each mesh.
+TaskGraph g_skinTasks;
+// Whether the mesh buffers hold the pose being drawn.
+bool meshesSkinned = false;
+
+// A model space pose, one matrix per joint, and where in the clip it is from.
+// Off screen the pose is not evaluated and holds whatever the slot last had.
+struct AnimationFrame {
+	float frame;
+	bool visible;
+	vector<mat4> pose;
+};
+
+// Steps the clip and hands each pose to the render thread, which reads the
+// latest one without waiting.
+AnimationThread g_animationThread;
+TripleBuffer<AnimationFrame> g_animationFrames;
+// Only used by the animation thread.
+AnimSampler g_animationSampler;
+// -bake: decode every frame up front instead of on each step.
+bool g_bakeAnimation = false;
+
 bool buildShaders() {
 	g_pPassthroughShader = new Shader();
 	g_pPassthroughShader->compile("simple.vert", GL_VERTEX_SHADER);
@@ -106,138 +133,30 @@ bool buildShaders() {
 	return true;
 }
 
-void CalculateBounds(GLfloat *vertices, int n, Bounds &bounds) {
-	if(n % 3 != 0) {		
-		throw runtime_error("Each vertex must have 3 floats");
-	}
-
-	bounds.minX = bounds.minY = bounds.minZ = std::numeric_limits<GLfloat>::max();
-	bounds.maxX = bounds.maxY = bounds.maxZ = std::numeric_limits<GLfloat>::min();
-
-	for(int i = 0; i < n; /* Incremented in loop */) {
-		GLfloat x = vertices[i++];
-		GLfloat y = vertices[i++];
-		GLfloat z = vertices[i++];
-
-		if(x < bounds.minX) {
-			bounds.minX = x;
-		}
-		if(x > bounds.maxX) {
-			bounds.maxX = x;
-		}
-		if(y < bounds.minY) {
-			bounds.minY = y;
-		}
-		if(y > bounds.maxY) {
-			bounds.maxY = y;
-		}
-		if(z < bounds.minZ) {
-			bounds.minZ = z;
-		}
-		if(z > bounds.maxZ) {
-			bounds.maxZ = z;
-		}
-	}
-}
-
 ostream &operator<<(ostream &out, const vec4 &v) {
 	out << "<" << v.x << ", " << v.y << ", " << v.z << ">";
 	return out;
 }
 
-void createFrameSkeletons() {
-	const int kNumJoints = g_MD5_VO.animations[0].baseframeJoints.size();
-	
-	for(int i = 0; i < g_MD5_VO.animations[0].numFrames; ++i) {
-		vector<float> frameData = g_MD5_VO.animations[0].framesData[i]; // Render frame 0
-		vector<FrameJoint> frameSkeleton;
-
-		for(int i = 0; i < kNumJoints; ++i) {
-			FrameJoint frameJoint;
-			const BaseframeJoint &baseframeJoint = g_MD5_VO.animations[0].baseframeJoints[i];
-			const JointInfo &jointInfo = g_MD5_VO.animations[0].jointsInfo[i];
-
-
-			// Start with the default settings from basejoint
-			frameJoint.position = baseframeJoint.position;
-			frameJoint.orientation = baseframeJoint.orientation;
-			frameJoint.name = jointInfo.name;
-			frameJoint.parentIndex = jointInfo.parent;
-
-			// Start replacing with specific frame data
-			int flags = jointInfo.flags;
-			int offset = jointInfo.startIndex;
-
-			if(flags & (1 << 0)) {
-				frameJoint.position.x = frameData[offset++];
-			}
-			if(flags & (1 << 1)) {
-				frameJoint.position.y = frameData[offset++];
-			}
-			if(flags & (1 << 2)) {
-				frameJoint.position.z = frameData[offset++];
-			}
-			if(flags & (1 << 3)) {
-				frameJoint.orientation.x = frameData[offset++];
-			}
-			if(flags & (1 << 4)) {
-				frameJoint.orientation.y = frameData[offset++];
-			}
-			if(flags & (1 << 5)) {
-				frameJoint.orientation.z = frameData[offset++];
-			}
-
-			// Compute the w-component of the quaternion
-			float temp = 1 - frameJoint.orientation.x * frameJoint.orientation.x
-						   - frameJoint.orientation.y * frameJoint.orientation.y
-						   - frameJoint.orientation.z * frameJoint.orientation.z;
-			if(temp < 0) {
-				frameJoint.orientation.w = 0;
-			} else {
-				frameJoint.orientation.w = -1 * sqrtf(temp);
-			}
-
-			// Convert this point to model space
-			if(jointInfo.parent > -1) {			
-				const FrameJoint &parent = frameSkeleton[frameJoint.parentIndex];
-
-				vec3 rotPos = parent.orientation * frameJoint.position;
-				frameJoint.position.x = rotPos.x + parent.position.x;
-				frameJoint.position.y = rotPos.y + parent.position.y;
-				frameJoint.position.z = rotPos.z + parent.position.z;
-
-				frameJoint.orientation = parent.orientation * frameJoint.orientation;
-				glm::normalize(frameJoint.orientation);
-			}
-
-			frameSkeleton.push_back(frameJoint);
-		}
-
-		frameSkeletons.push_back(frameSkeleton);
-	}
-}
-
 void setUpModel() {
 	float zPos = 0.0f;
 	vector<GLfloat> vertices;
 	vector<GLfloat> colors;
 
-	vector<FrameJoint> frameSkeleton = frameSkeletons[curFrame];
+	const vector<mat4> &pose = g_animationFrames.front().pose;
 
-	for(int i = 0; i < frameSkeleton.size(); ++i) {
-		const FrameJoint &joint = frameSkeleton[i];
+	for(int i = 0; i < pose.size(); ++i) {
+		const vec4 &position = pose[i][3];
 
-		vertices.push_back(joint.position.x);
-		vertices.push_back(joint.position.y);
-		vertices.push_back(joint.position.z);
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
 
 		colors.push_back(1.0f);
 		colors.push_back(0.0f);
 		colors.push_back(0.0f);
 		colors.push_back(1.0f);
 	}
-	
-	CalculateBounds(&vertices[0], vertices.size(), g_bounds);
 
 	// Set up the vertex buffer object
 	glGenBuffers(1, &hVerticesBuffer);
@@ -278,26 +197,28 @@ void setUpSkeletonRendering() {
 	vector<GLfloat> vertexData;
 	g_numBonesToDraw = 0;
 
-	vector<FrameJoint> frameSkeleton = frameSkeletons[curFrame];
+	const vector<JointInfo> &joints = g_MD5_VO.animations[0].jointsInfo;
+	const vector<mat4> &pose = g_animationFrames.front().pose;
 
-	for(int i = 0; i < frameSkeleton.size(); ++i) {
-		FrameJoint &joint = frameSkeleton[i];
+	for(int i = 0; i < pose.size(); ++i) {
+		const int parent = joints[i].parent;
 
-		if(joint.parentIndex > -1) {
-			FrameJoint &parentJoint = frameSkeleton[joint.parentIndex];
+		if(parent > -1) {
+			const vec4 &position = pose[i][3];
+			const vec4 &parentPosition = pose[parent][3];
 
-			vertexData.push_back(joint.position.x);
-			vertexData.push_back(joint.position.y);
-			vertexData.push_back(joint.position.z);
+			vertexData.push_back(position.x);
+			vertexData.push_back(position.y);
+			vertexData.push_back(position.z);
 			vertexData.push_back(0.0f); // R
 			vertexData.push_back(1.0f); // G
 			vertexData.push_back(0.0f); // B
 			vertexData.push_back(1.0f); // A
 
 			// End joint			
-			vertexData.push_back(parentJoint.position.x);
-			vertexData.push_back(parentJoint.position.y);
-			vertexData.push_back(parentJoint.position.z);
+			vertexData.push_back(parentPosition.x);
+			vertexData.push_back(parentPosition.y);
+			vertexData.push_back(parentPosition.z);
 			vertexData.push_back(0.0f); // R
 			vertexData.push_back(1.0f); // G
 			vertexData.push_back(0.0f); // B
@@ -331,14 +252,14 @@ void updateJointData() {
 	vector<GLfloat> vertices;
 	vector<GLfloat> colors;
 
-	vector<FrameJoint> frameSkeleton = frameSkeletons[curFrame];
+	const vector<mat4> &pose = g_animationFrames.front().pose;
 
-	for(int i = 0; i < frameSkeleton.size(); ++i) {
-		const FrameJoint &joint = frameSkeleton[i];
+	for(int i = 0; i < pose.size(); ++i) {
+		const vec4 &position = pose[i][3];
 
-		vertices.push_back(joint.position.x);
-		vertices.push_back(joint.position.y);
-		vertices.push_back(joint.position.z);
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
 
 		colors.push_back(1.0f);
 		colors.push_back(0.0f);
@@ -357,26 +278,28 @@ void updateSkeletonData() {
 	vector<GLfloat> vertexData;
 	g_numBonesToDraw = 0;
 
-	vector<FrameJoint> &frameSkeleton = frameSkeletons[curFrame];
+	const vector<JointInfo> &joints = g_MD5_VO.animations[0].jointsInfo;
+	const vector<mat4> &pose = g_animationFrames.front().pose;
 
-	for(int i = 0; i < frameSkeleton.size(); ++i) {
-		FrameJoint &joint = frameSkeleton[i];
+	for(int i = 0; i < pose.size(); ++i) {
+		const int parent = joints[i].parent;
 
-		if(joint.parentIndex > -1) {
-			FrameJoint &parentJoint = frameSkeleton[joint.parentIndex];
+		if(parent > -1) {
+			const vec4 &position = pose[i][3];
+			const vec4 &parentPosition = pose[parent][3];
 
-			vertexData.push_back(joint.position.x);
-			vertexData.push_back(joint.position.y);
-			vertexData.push_back(joint.position.z);
+			vertexData.push_back(position.x);
+			vertexData.push_back(position.y);
+			vertexData.push_back(position.z);
 			vertexData.push_back(0.0f); // R
 			vertexData.push_back(1.0f); // G
 			vertexData.push_back(0.0f); // B
 			vertexData.push_back(1.0f); // A
 
 			// End joint			
-			vertexData.push_back(parentJoint.position.x);
-			vertexData.push_back(parentJoint.position.y);
-			vertexData.push_back(parentJoint.position.z);
+			vertexData.push_back(parentPosition.x);
+			vertexData.push_back(parentPosition.y);
+			vertexData.push_back(parentPosition.z);
 			vertexData.push_back(0.0f); // R
 			vertexData.push_back(1.0f); // G
 			vertexData.push_back(0.0f); // B
@@ -441,9 +364,10 @@ void setUpMeshRendering() {
 
 void setUpCamera() {
 	// Set up the camera to frame the model. 
+	g_bounds = boundsAtFrame(g_MD5_VO.animations[0], 0.0f);
 	g_projection = glm::perspective(kFovY, 4.0f/3.0f, 0.1f, 1000.0f);
 	
-	float modelLen = max(g_bounds.minY, g_bounds.maxY);
+	float modelLen = max(g_bounds.min.y, g_bounds.max.y);
 	float totalLen = modelLen / 0.8f;
 	float half_fov = kFovY / 2.0f; // Normally done by our camera
 
@@ -455,6 +379,7 @@ void setUpCamera() {
 	
 	// temp
 	g_model = glm::rotate(mat4(), -90.0f, vec3(1.0, 0.0, 0.0));
+	g_viewFrustum = extractFrustum(g_projection * g_view);
 
 	glPointSize(5.0f);
 }
@@ -481,34 +406,61 @@ void renderSkeleton() {
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void updateVertexPositions(RenderableMesh &renderMesh) {
-	MD5_Mesh &mesh = renderMesh.mesh;
+// Skins vertices [begin, end) of the mesh for the current frame. Touches no
+// GL state, so it runs on the job pool.
+void updateVertexPositions(RenderableMesh &renderMesh, int begin, int end) {
+	const MD5_Mesh &mesh = renderMesh.mesh;
 
-	// We can use an interpolated version later
-	vector<FrameJoint> &curSkeleton = frameSkeletons[curFrame];
-	vector<GLfloat> updatedBuffer;
+	const vector<mat4> &pose = g_animationFrames.front().pose;
+	GLfloat *updatedBuffer = renderMesh.skinnedPositions.data();
 
-	for(MD5_Vertex &vertex: mesh.vertices) {
+	for(int v = begin; v < end; ++v) {
+		const MD5_Vertex &vertex = mesh.vertices[v];
 		vec3 pos(0,0,0);
 
 		for(int i = 0; i < vertex.weightCount; ++i) {
 			// Get the weight
 			const MD5_Weight &weight = mesh.weights[vertex.startWeight+i];
-			const FrameJoint &joint = curSkeleton[weight.jointIndex];
 			
-			vec3 tempPos = joint.orientation * weight.position + joint.position;
-			pos += tempPos * weight.weightBias;			
+			vec4 tempPos = pose[weight.jointIndex] * vec4(weight.position, 1.0f);
+			pos += vec3(tempPos.x, tempPos.y, tempPos.z) * weight.weightBias;			
 		}
 
-		updatedBuffer.push_back(pos.x);
-		updatedBuffer.push_back(pos.y);
-		updatedBuffer.push_back(pos.z);
+		updatedBuffer[v * 3] = pos.x;
+		updatedBuffer[v * 3 + 1] = pos.y;
+		updatedBuffer[v * 3 + 2] = pos.z;
+	}
+}
+
+// The meshes don't depend on each other, so every batch of every mesh can
+// run at once.
+void createSkinTasks() {
+	for(auto &renderMesh : g_Meshes) {
+		RenderableMesh *mesh = &renderMesh;
+		const int numVertices = mesh->mesh.vertices.size();
+		mesh->skinnedPositions.resize(numVertices * 3);
+
+		for(int begin = 0; begin < numVertices; begin += kSkinBatchSize) {
+			const int end = std::min(begin + kSkinBatchSize, numVertices);
+			g_skinTasks.add([mesh, begin, end]() { updateVertexPositions(*mesh, begin, end); });
+		}
+	}
+}
+
+// Skins every mesh on the job pool, then updates the VBOs.
+void skinMeshes() {
+	if(meshesSkinned) {
+		return;
 	}
 
-	// Update the VBO
-	glBindBuffer(GL_ARRAY_BUFFER, renderMesh.hVBO);
-	GLsizei size = updatedBuffer.size() * sizeof(GLfloat);
-	glBufferData(GL_ARRAY_BUFFER, size, &updatedBuffer[0], GL_STATIC_DRAW);
+	g_skinTasks.run(*g_pJobPool);
+	meshesSkinned = true;
+
+	for(auto &mesh : g_Meshes) {
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.hVBO);
+		GLsizei size = mesh.skinnedPositions.size() * sizeof(GLfloat);
+		glBufferData(GL_ARRAY_BUFFER, size, mesh.skinnedPositions.data(), GL_STATIC_DRAW);
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -518,6 +470,8 @@ void renderMeshes() {
 	GLint location = glGetUniformLocation(g_pPassthroughShader->handle(), "MVP");
 	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(g_MVP));
 
+	skinMeshes();
+
 	// Start wireframe rendering
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -527,8 +481,6 @@ void renderMeshes() {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.hIndexBuffer);
 		
 		GLsizei count = mesh.mesh.triangles.size() * 3;
-		
-		updateVertexPositions(mesh);
 		glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, 0);		
 	}
 
@@ -539,12 +491,67 @@ void renderMeshes() {
 	glBindVertexArray(0);
 }
 
+// Tests the clip's bounds at the frame against the view frustum. An
+// off-screen character skips pose evaluation, skinning, buffer updates and
+// draws.
+bool isCharacterVisible(float frame) {
+	FrameBounds bounds = transformBounds(boundsAtFrame(g_MD5_VO.animations[0], frame), g_model);
+	return isVisible(g_viewFrustum, bounds);
+}
+
+void stepAnimation(double time) {
+	const MD5_AnimInfo &anim = g_MD5_VO.animations[0];
+	AnimationFrame &next = g_animationFrames.back();
+
+	next.frame = static_cast<float>(framePositionAtTime(anim, time));
+	next.visible = isCharacterVisible(next.frame);
+	if(next.visible) {
+		g_animationSampler.samplePose(time, next.pose);
+	}
+	g_animationFrames.publish();
+}
+
+void startAnimation() {
+	const MD5_AnimInfo &anim = g_MD5_VO.animations[0];
+	g_animationSampler = AnimSampler(anim);
+	if(g_bakeAnimation) {
+		g_animationSampler.bake();
+		cout << "Baked " << g_animationSampler.bakedSizeInBytes() << " bytes of animation." << endl;
+	}
+
+	AnimationFrame first = {0.0f, false, vector<mat4>(anim.jointsInfo.size())};
+	g_animationFrames.fill(first);
+	g_animationThread.start(kAnimationStep, stepAnimation);
+
+	g_animationFrames.update();
+	curFrame = g_animationFrames.front().frame;
+}
+
+// glutMainLoop leaves through exit(), which destroys g_animationFrames and
+// g_animationSampler while stepAnimation may still be using them. The
+// thread has to stop first.
+void stopAnimation() {
+	g_animationThread.stop();
+}
+
+// Takes the newest pose the animation thread has published, if any.
+void takeAnimationFrame() {
+	if(g_animationFrames.update()) {
+		curFrame = g_animationFrames.front().frame;
+		frameChanged = true;
+		meshesSkinned = false;
+	}
+}
+
 void render() {
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	renderMeshes();
-	renderSkeleton();
+	takeAnimationFrame();
+	if(g_animationFrames.front().visible) {
+		renderMeshes();
+		renderSkeleton();
+	}
 
 	glutSwapBuffers();
 }
@@ -554,33 +561,56 @@ void onTimerTick(int value) {
 	//model = glm::rotate(mat4(), yRotation, vec3(0, 1, 0)); 
 	//model = glm::rotate(model, -90.0f, vec3(1, 0, 0));
 	//model = glm::rotate(mat4(), -90.0f, vec3(1, 0, 0));
-	
-	elapsedTime += kTimerPeriod;
-	int temp = (elapsedTime / 24) % 140;
-	
-	if(temp != curFrame) {
-		curFrame = temp;
-		//cout << "Frame: " << curFrame << endl;
-		frameChanged = true;
-	}
 
 	glutTimerFunc(kTimerPeriod, onTimerTick, 0);
 	glutPostRedisplay();
 }
 
+// Uses the file cooked by bones_cook when it is there and valid.
+bool loadBakedModel(const string &filename, MD5_VO &vo) {
+	try {
+		BakedAsset baked(filename);
+		if(!baked.hasMesh() || !baked.hasAnim()) {
+			return false;
+		}
+
+		vo.mesh = baked.meshInfo();
+		vo.animations.assign(1, baked.animInfo());
+		return true;
+	}
+	catch(exception &e) {
+		cout << "Parsing the MD5 files instead of " << filename << ": " << e.what() << endl;
+		return false;
+	}
+}
+
 int main(int argc, char **argv) {
-	Md5Reader reader;
 	const string meshFilename("Boblamp/boblampclean.md5mesh");
 	const string animFilename("Boblamp/boblampclean.md5anim");
+	const string bakedFilename("Boblamp/boblampclean.bones");
+	// A .dae on the command line replaces Boblamp.
+	string colladaFilename;
+	for(int i = 1; i < argc; ++i) {
+		if(string(argv[i]) == "-bake") {
+			g_bakeAnimation = true;
+		} else {
+			colladaFilename = argv[i];
+		}
+	}
 
+	// The model loads on the pool while the window opens and the shaders compile.
 	cout << "Loading the model data." << endl;
-	try {
-		 g_MD5_VO = reader.parse(meshFilename, animFilename);
-	}
-	catch(exception &e) {
-		cout << e.what() << endl;
-		return -1;
-	}
+	ThreadPool loadPool;
+	g_pJobPool = &loadPool;
+	future<MD5_VO> modelResult = loadPool.submit([&]() {
+		MD5_VO vo;
+		if(!colladaFilename.empty()) {
+			vo = ColladaReader::parse(colladaFilename);
+		} else if(!loadBakedModel(bakedFilename, vo)) {
+			vo = Md5Reader::parse(meshFilename, animFilename, &loadPool);
+		}
+		return vo;
+	});
 	
 	cout << "Initializing GLUT." << endl;
 	glutInit(&argc, argv);
@@ -600,12 +630,23 @@ int main(int argc, char **argv) {
 		return -1;
 	}
 
+	try {
+		g_MD5_VO = modelResult.get();
+	}
+	catch(exception &e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+
 	cout << "Created the shader and loaded the mesh." << endl;
-	createFrameSkeletons();
+	atexit(stopAnimation);
+	// The animation thread culls against the camera, so it goes first.
+	setUpCamera();
+	startAnimation();
 	setUpModel();
 	setUpSkeletonRendering();
 	setUpMeshRendering();
-	setUpCamera();
+	createSkinTasks();
 
 	glutDisplayFunc(render);
 	glutTimerFunc(kTimerPeriod, onTimerTick, 0);
@@ -0,0 +1,116 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+	#define MAPPED_FILE_USE_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using std::ifstream;
+using std::runtime_error;
+using std::string;
+
+MappedFile::MappedFile()
+	: mData(nullptr), mSize(0), mMapped(false) {
+}
+
+MappedFile::MappedFile(const string &filename)
+	: mData(nullptr), mSize(0), mMapped(false) {
+	open(filename);
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+void MappedFile::open(const string &filename) {
+	close();
+
+#ifdef MAPPED_FILE_USE_MMAP
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd == -1) {
+		throw runtime_error(string("Could not open ") + filename);
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) == -1) {
+		::close(fd);
+		throw runtime_error(string("Could not stat ") + filename);
+	}
+
+	mSize = info.st_size;
+	if(mSize == 0) {
+		// mmap refuses empty mappings; an empty view is still valid.
+		::close(fd);
+		mData = "";
+		return;
+	}
+
+	void *addr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if(addr == MAP_FAILED) {
+		mSize = 0;
+		throw runtime_error(string("Could not map ") + filename);
+	}
+
+	// The parsers walk the file front to back exactly once.
+	madvise(addr, mSize, MADV_SEQUENTIAL);
+
+	mData = static_cast<const char *>(addr);
+	mMapped = true;
+#else
+	ifstream file(filename, std::ios::binary | std::ios::ate);
+	if(!file) {
+		throw runtime_error(string("Could not open ") + filename);
+	}
+
+	mSize = static_cast<size_t>(file.tellg());
+	mBuffer.resize(mSize + 1);
+	file.seekg(0);
+	file.read(&mBuffer[0], mSize);
+	mData = &mBuffer[0];
+#endif
+}
+
+void MappedFile::close() {
+#ifdef MAPPED_FILE_USE_MMAP
+	if(mMapped) {
+		munmap(const_cast<char *>(mData), mSize);
+	}
+#endif
+	mBuffer.clear();
+	mData = nullptr;
+	mSize = 0;
+	mMapped = false;
+}
+
+const char *MappedFile::begin() const {
+	return mData;
+}
+
+const char *MappedFile::end() const {
+	return mData + mSize;
+}
+
+size_t MappedFile::size() const {
+	return mSize;
+}
+
+bool MappedFile::isOpen() const {
+	return mData != nullptr;
+}
+
+uint64_t checksum(const char *data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < size; ++i) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
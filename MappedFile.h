@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Uses mmap where it is available and falls
+// back to reading the file into memory otherwise (Windows, Emscripten).
+class MappedFile {
+public:
+	MappedFile();
+	explicit MappedFile(const std::string &filename);
+	~MappedFile();
+
+	void open(const std::string &filename);
+	void close();
+
+	const char *begin() const;
+	const char *end() const;
+	size_t size() const;
+	bool isOpen() const;
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+private:
+	const char *mData;
+	size_t mSize;
+	bool mMapped;
+	std::vector<char> mBuffer;
+};
+
+// FNV-1a over size bytes. The baked asset and cooked texture formats store
+// it for everything after their header.
+uint64_t checksum(const char *data, size_t size);
+
+#endif
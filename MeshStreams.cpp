@@ -0,0 +1,88 @@
+#include "MeshStreams.h"
+
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+using std::runtime_error;
+using std::vector;
+
+using glm::mat4;
+using glm::vec3;
+
+MeshStreams buildMeshStreams(const MD5_Mesh &md5mesh, const vector<Joint> &joints) {
+	MeshStreams streams;
+
+	streams.positions.reserve(md5mesh.vertices.size() * 3);
+	streams.jointIndices.reserve(md5mesh.vertices.size() * kMaxJointsPerVertex);
+	streams.jointWeights.reserve(md5mesh.vertices.size() * kMaxJointsPerVertex);
+	streams.textureCoords.reserve(md5mesh.vertices.size() * 2);
+	streams.indices.reserve(md5mesh.triangles.size() * 3);
+
+	for(const MD5_Vertex &md5vertex : md5mesh.vertices) {
+		if(md5vertex.weightCount > kMaxJointsPerVertex) {
+			throw runtime_error("A vertex has more joint weights than the shaders support.");
+		}
+
+		vec3 finalPos(0);
+
+		for(int i = 0; i < md5vertex.weightCount; ++i) {
+			const MD5_Weight &weight = md5mesh.weights[md5vertex.startWeight + i];
+			const Joint &joint = joints[weight.jointIndex];
+
+			// Convert joint-space position to model space position using.
+			// TranslationMatrix * RotationMatrix * jointLocalPoint
+			vec3 tempPos = joint.orientation * weight.position + joint.position;
+			finalPos += tempPos * weight.weightBias;
+
+			streams.jointIndices.push_back(weight.jointIndex);
+			streams.jointWeights.push_back(weight.weightBias);
+		}
+
+		for(int i = md5vertex.weightCount; i < kMaxJointsPerVertex; ++i) {
+			streams.jointIndices.push_back(-1);
+			streams.jointWeights.push_back(0.0f);
+		}
+
+		streams.positions.push_back(finalPos.x);
+		streams.positions.push_back(finalPos.y);
+		streams.positions.push_back(finalPos.z);
+
+		streams.textureCoords.push_back(md5vertex.u);
+		streams.textureCoords.push_back(md5vertex.v);
+	}
+
+	for(const MD5_Triangle &triangle : md5mesh.triangles) {
+		streams.indices.push_back(triangle.indices[0]);
+		streams.indices.push_back(triangle.indices[1]);
+		streams.indices.push_back(triangle.indices[2]);
+	}
+
+	return streams;
+}
+
+vector<mat4> buildInverseBindPose(const vector<Joint> &joints) {
+	vector<mat4> inverseBindPose;
+	inverseBindPose.reserve(joints.size());
+
+	for(const Joint &joint : joints) {
+		// rotM and transM are model space transformation matrices.
+		// Combine then invert them to construct the inverse bind pose matrix for each joint.
+		mat4 rotM = glm::mat4_cast(joint.orientation);
+		mat4 transM = glm::translate(mat4(), joint.position);
+		mat4 combinedM = transM * rotM;
+		inverseBindPose.push_back(glm::inverse(combinedM));
+	}
+
+	return inverseBindPose;
+}
+
+MeshStreamsDiff diffMeshStreams(const MeshStreams &before, const MeshStreams &after) {
+	MeshStreamsDiff diff;
+	diff.positions = before.positions != after.positions;
+	diff.jointIndices = before.jointIndices != after.jointIndices;
+	diff.jointWeights = before.jointWeights != after.jointWeights;
+	diff.textureCoords = before.textureCoords != after.textureCoords;
+	diff.indices = before.indices != after.indices;
+	return diff;
+}
@@ -0,0 +1,42 @@
+#ifndef MESH_STREAMS_H
+#define MESH_STREAMS_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "MD5_MeshReader.h"
+
+// The shaders take at most this many joint influences per vertex.
+const int kMaxJointsPerVertex = 4;
+
+// GPU-ready vertex data for one MD5 mesh in its bind pose. Each vector maps
+// directly onto one vertex buffer.
+struct MeshStreams {
+	std::vector<float> positions;         // xyz per vertex, model space
+	std::vector<int> jointIndices;        // kMaxJointsPerVertex per vertex, -1 when unused
+	std::vector<float> jointWeights;      // kMaxJointsPerVertex per vertex
+	std::vector<float> textureCoords;     // uv per vertex
+	std::vector<unsigned short> indices;  // 3 per triangle
+};
+
+// Which streams differ between two versions of a mesh, so a reload only
+// re-uploads the vertex buffers that changed.
+struct MeshStreamsDiff {
+	bool positions;
+	bool jointIndices;
+	bool jointWeights;
+	bool textureCoords;
+	bool indices;
+
+	bool any() const { return positions || jointIndices || jointWeights || textureCoords || indices; }
+};
+
+MeshStreamsDiff diffMeshStreams(const MeshStreams &before, const MeshStreams &after);
+
+// Resolves the weights of every vertex against the bind pose joints.
+MeshStreams buildMeshStreams(const MD5_Mesh &mesh, const std::vector<Joint> &joints);
+
+// Model space to joint space for every bind pose joint.
+std::vector<glm::mat4> buildInverseBindPose(const std::vector<Joint> &joints);
+
+#endif
@@ -0,0 +1,124 @@
+#include "PoseCache.h"
+
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_future;
+using std::vector;
+
+using glm::mat4;
+
+double PoseCache::Stats::hitRate() const {
+	const uint64_t lookups = hits + misses;
+	return lookups > 0 ? double(hits) / lookups : 0.0;
+}
+
+size_t PoseCache::KeyHash::operator()(const Key &key) const {
+	size_t hash = std::hash<const void *>()(key.skeleton);
+	hash = hash * 31 + std::hash<const void *>()(key.clip);
+	hash = hash * 31 + std::hash<int64_t>()(key.tick);
+	return hash;
+}
+
+PoseCache::PoseCache(size_t maxSizeInBytes, double quantum)
+	: mMaxSizeInBytes(maxSizeInBytes), mQuantum(quantum), mSizeInBytes(0), mHits(0), mMisses(0), mEvictions(0) {
+	if(!(quantum > 0)) {
+		throw std::invalid_argument("The pose cache quantum must be above 0.");
+	}
+}
+
+double PoseCache::quantize(double seconds) const {
+	return std::floor(seconds / mQuantum) * mQuantum;
+}
+
+PoseCache::Palette PoseCache::get(const void *skeleton, const void *clip, double seconds,
+								  const EvaluateFunction &evaluate) {
+	const Key key = {skeleton, clip, static_cast<int64_t>(std::floor(seconds / mQuantum))};
+	std::promise<Palette> promise;
+	shared_future<Palette> cached;
+	EntryList::iterator entry;
+
+	{
+		lock_guard<mutex> lock(mMutex);
+
+		auto found = mIndex.find(key);
+		if(found != mIndex.end()) {
+			++mHits;
+			mEntries.splice(mEntries.begin(), mEntries, found->second);
+			cached = found->second->palette;
+		} else {
+			++mMisses;
+			Entry pending = {key, promise.get_future().share(), false, 0};
+			mEntries.push_front(pending);
+			entry = mEntries.begin();
+			mIndex[key] = entry;
+		}
+	}
+
+	// May wait for another thread's evaluation, so not under the lock.
+	if(cached.valid()) {
+		return cached.get();
+	}
+
+	std::shared_ptr<vector<mat4>> palette = std::make_shared<vector<mat4>>();
+	try {
+		evaluate(key.tick * mQuantum, *palette);
+	}
+	catch(...) {
+		promise.set_exception(std::current_exception());
+
+		lock_guard<mutex> lock(mMutex);
+		mIndex.erase(key);
+		mEntries.erase(entry);
+		throw;
+	}
+	promise.set_value(palette);
+
+	lock_guard<mutex> lock(mMutex);
+	entry->ready = true;
+	entry->sizeInBytes = palette->size() * sizeof(mat4);
+	mSizeInBytes += entry->sizeInBytes;
+	trim();
+	return palette;
+}
+
+void PoseCache::trim() {
+	auto entry = mEntries.end();
+	while(mSizeInBytes > mMaxSizeInBytes && entry != mEntries.begin()) {
+		--entry;
+		if(!entry->ready) {
+			continue;
+		}
+
+		mSizeInBytes -= entry->sizeInBytes;
+		++mEvictions;
+		mIndex.erase(entry->key);
+		entry = mEntries.erase(entry);
+	}
+}
+
+PoseCache::Stats PoseCache::stats() const {
+	lock_guard<mutex> lock(mMutex);
+	Stats stats = {mHits, mMisses, mEvictions, mEntries.size(), mSizeInBytes};
+	return stats;
+}
+
+void PoseCache::clear() {
+	lock_guard<mutex> lock(mMutex);
+
+	for(auto entry = mEntries.begin(); entry != mEntries.end();) {
+		if(!entry->ready) {
+			++entry;
+			continue;
+		}
+		mIndex.erase(entry->key);
+		entry = mEntries.erase(entry);
+	}
+	mSizeInBytes = 0;
+	mHits = 0;
+	mMisses = 0;
+	mEvictions = 0;
+}
@@ -0,0 +1,109 @@
+#ifndef POSE_CACHE_H
+#define POSE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Poses shared between characters that play the same clip at the same
+// moment, so a crowd costs one evaluation per distinct pose rather than one
+// per character.
+//
+// Entries are keyed by skeleton, clip and time quantized to a fixed step.
+// skeleton and clip are only compared, never read: pass whatever identifies
+// them, e.g. the evaluator and the MD5_AnimInfo. The cache keeps the most
+// recently used palettes up to a size in bytes and drops the least recently
+// used beyond it.
+//
+// Any thread may call get(). A palette is evaluated once; other threads that
+// ask for it meanwhile wait for that evaluation instead of repeating it.
+class PoseCache {
+public:
+	typedef std::shared_ptr<const std::vector<glm::mat4>> Palette;
+	// Fills palette with the pose at seconds, the quantized time.
+	typedef std::function<void(double seconds, std::vector<glm::mat4> &palette)> EvaluateFunction;
+
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t numEntries;
+		// The palettes held, not counting the cache's own bookkeeping.
+		size_t sizeInBytes;
+
+		// hits / (hits + misses), 0 before the first get().
+		double hitRate() const;
+	};
+
+	// Throws an invalid_argument unless quantum is above 0.
+	PoseCache(size_t maxSizeInBytes, double quantum);
+
+	size_t maxSizeInBytes() const { return mMaxSizeInBytes; }
+	double quantum() const { return mQuantum; }
+	// seconds rounded down to a whole number of quanta. Times are not wrapped
+	// to the clip; callers that loop should pass the time within the clip.
+	double quantize(double seconds) const;
+
+	// The palette for the quantized time, evaluated by evaluate if the cache
+	// does not hold it. A palette stays valid for as long as it is held, even
+	// after it is evicted. If evaluate throws, the exception reaches every
+	// caller waiting for that palette and nothing is cached.
+	Palette get(const void *skeleton, const void *clip, double seconds, const EvaluateFunction &evaluate);
+
+	Stats stats() const;
+	// Drops every palette that is not being evaluated and resets the counts.
+	void clear();
+private:
+	PoseCache(const PoseCache &);
+	PoseCache &operator=(const PoseCache &);
+
+	struct Key {
+		const void *skeleton;
+		const void *clip;
+		int64_t tick;
+
+		bool operator==(const Key &other) const {
+			return skeleton == other.skeleton && clip == other.clip && tick == other.tick;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+
+	struct Entry {
+		Key key;
+		std::shared_future<Palette> palette;
+		// False while the palette is being evaluated. Those entries are never
+		// evicted, so the evaluating thread can find its entry again.
+		bool ready;
+		size_t sizeInBytes;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	// Evicts from the least recently used end until the cache fits. Called
+	// with mMutex held.
+	void trim();
+private:
+	const size_t mMaxSizeInBytes;
+	const double mQuantum;
+
+	mutable std::mutex mMutex;
+	// Most recently used first.
+	EntryList mEntries;
+	std::unordered_map<Key, EntryList::iterator, KeyHash> mIndex;
+	size_t mSizeInBytes;
+	uint64_t mHits;
+	uint64_t mMisses;
+	uint64_t mEvictions;
+};
+
+#endif
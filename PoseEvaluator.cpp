@@ -0,0 +1,510 @@
+#include "PoseEvaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define POSE_EVALUATOR_SSE2
+	#include <emmintrin.h>
+#endif
+
+// The AVX kernel is compiled for its own function only, so the rest of the
+// build keeps running on CPUs without AVX.
+#if defined(POSE_EVALUATOR_SSE2) && (defined(__GNUC__) || defined(__clang__))
+	#define POSE_EVALUATOR_AVX
+	#include <immintrin.h>
+#endif
+
+// The kernels only stay bit-identical if the compiler does not fuse their
+// multiplies and adds; CMakeLists.txt builds this file with -ffp-contract=off.
+using glm::mat4;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Rows of the block. The first kNumInputRows come from the frame; the
+// rotation rows are filled by the local stage. RotationCR is column C, row R
+// of the joint's rotation matrix.
+enum Row {
+	PositionX,
+	PositionY,
+	PositionZ,
+	OrientationX,
+	OrientationY,
+	OrientationZ,
+	Rotation00,
+	Rotation01,
+	Rotation02,
+	Rotation10,
+	Rotation11,
+	Rotation12,
+	Rotation20,
+	Rotation21,
+	Rotation22,
+	kNumRows
+};
+
+const int kNumInputRows = Rotation00;
+
+// Joints per row are padded to a whole number of AVX registers.
+const int kJointsPerBatch = 8;
+
+// w is recomputed as in the readers, then the quaternion is expanded to a
+// rotation matrix.
+inline void localJoint(float *block, int stride, int i) {
+	float x = block[OrientationX * stride + i];
+	float y = block[OrientationY * stride + i];
+	float z = block[OrientationZ * stride + i];
+
+	float temp = 1.0f - x * x - y * y - z * z;
+	float w = temp < 0.0f ? 0.0f : -sqrtf(temp);
+
+	float x2 = x + x;
+	float y2 = y + y;
+	float z2 = z + z;
+	float xx = x * x2;
+	float yy = y * y2;
+	float zz = z * z2;
+	float xy = x * y2;
+	float xz = x * z2;
+	float yz = y * z2;
+	float wx = w * x2;
+	float wy = w * y2;
+	float wz = w * z2;
+
+	block[Rotation00 * stride + i] = 1.0f - (yy + zz);
+	block[Rotation01 * stride + i] = xy + wz;
+	block[Rotation02 * stride + i] = xz - wy;
+	block[Rotation10 * stride + i] = xy - wz;
+	block[Rotation11 * stride + i] = 1.0f - (xx + zz);
+	block[Rotation12 * stride + i] = yz + wx;
+	block[Rotation20 * stride + i] = xz + wy;
+	block[Rotation21 * stride + i] = yz - wx;
+	block[Rotation22 * stride + i] = 1.0f - (xx + yy);
+}
+
+// pose[i] = pose[parent] * [rotation | position]. The multiply skips the
+// local matrix's constant bottom row.
+inline void concatJoint(const int *parents, const float *block, int stride, int i, mat4 *pose) {
+	float local[4][3];
+	for(int c = 0; c < 3; ++c) {
+		for(int r = 0; r < 3; ++r) {
+			local[c][r] = block[(Rotation00 + c * 3 + r) * stride + i];
+		}
+	}
+	local[3][0] = block[PositionX * stride + i];
+	local[3][1] = block[PositionY * stride + i];
+	local[3][2] = block[PositionZ * stride + i];
+
+	float *out = &pose[i][0][0];
+	if(parents[i] < 0) {
+		for(int c = 0; c < 4; ++c) {
+			out[c * 4 + 0] = local[c][0];
+			out[c * 4 + 1] = local[c][1];
+			out[c * 4 + 2] = local[c][2];
+			out[c * 4 + 3] = c == 3 ? 1.0f : 0.0f;
+		}
+		return;
+	}
+
+	const float *P = &pose[parents[i]][0][0];
+	for(int r = 0; r < 4; ++r) {
+		for(int c = 0; c < 3; ++c) {
+			out[c * 4 + r] = P[r] * local[c][0] + P[4 + r] * local[c][1] + P[8 + r] * local[c][2];
+		}
+		out[12 + r] = P[r] * local[3][0] + P[4 + r] * local[3][1] + P[8 + r] * local[3][2] + P[12 + r];
+	}
+}
+
+void localScalar(float *block, int stride, int numJoints) {
+	for(int i = 0; i < numJoints; ++i) {
+		localJoint(block, stride, i);
+	}
+}
+
+void concatScalar(const int *parents, const float *block, int stride, int numJoints, mat4 *pose) {
+	for(int i = 0; i < numJoints; ++i) {
+		concatJoint(parents, block, stride, i, pose);
+	}
+}
+
+#ifdef POSE_EVALUATOR_SSE2
+void localSSE(float *block, int stride) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	for(int i = 0; i < stride; i += 4) {
+		__m128 x = _mm_loadu_ps(block + OrientationX * stride + i);
+		__m128 y = _mm_loadu_ps(block + OrientationY * stride + i);
+		__m128 z = _mm_loadu_ps(block + OrientationZ * stride + i);
+
+		__m128 temp = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 negative = _mm_cmplt_ps(temp, zero);
+		__m128 w = _mm_andnot_ps(negative, _mm_xor_ps(_mm_sqrt_ps(temp), signBit));
+
+		__m128 x2 = _mm_add_ps(x, x);
+		__m128 y2 = _mm_add_ps(y, y);
+		__m128 z2 = _mm_add_ps(z, z);
+		__m128 xx = _mm_mul_ps(x, x2);
+		__m128 yy = _mm_mul_ps(y, y2);
+		__m128 zz = _mm_mul_ps(z, z2);
+		__m128 xy = _mm_mul_ps(x, y2);
+		__m128 xz = _mm_mul_ps(x, z2);
+		__m128 yz = _mm_mul_ps(y, z2);
+		__m128 wx = _mm_mul_ps(w, x2);
+		__m128 wy = _mm_mul_ps(w, y2);
+		__m128 wz = _mm_mul_ps(w, z2);
+
+		_mm_storeu_ps(block + Rotation00 * stride + i, _mm_sub_ps(one, _mm_add_ps(yy, zz)));
+		_mm_storeu_ps(block + Rotation01 * stride + i, _mm_add_ps(xy, wz));
+		_mm_storeu_ps(block + Rotation02 * stride + i, _mm_sub_ps(xz, wy));
+		_mm_storeu_ps(block + Rotation10 * stride + i, _mm_sub_ps(xy, wz));
+		_mm_storeu_ps(block + Rotation11 * stride + i, _mm_sub_ps(one, _mm_add_ps(xx, zz)));
+		_mm_storeu_ps(block + Rotation12 * stride + i, _mm_add_ps(yz, wx));
+		_mm_storeu_ps(block + Rotation20 * stride + i, _mm_add_ps(xz, wy));
+		_mm_storeu_ps(block + Rotation21 * stride + i, _mm_sub_ps(yz, wx));
+		_mm_storeu_ps(block + Rotation22 * stride + i, _mm_sub_ps(one, _mm_add_ps(xx, yy)));
+	}
+}
+
+// One parent column per register; each output column is a sum of parent
+// columns scaled by the local matrix entries.
+void concatSSE(const int *parents, const float *block, int stride, int numJoints, mat4 *pose) {
+	for(int i = 0; i < numJoints; ++i) {
+		float *out = &pose[i][0][0];
+		const float px = block[PositionX * stride + i];
+		const float py = block[PositionY * stride + i];
+		const float pz = block[PositionZ * stride + i];
+
+		if(parents[i] < 0) {
+			for(int c = 0; c < 3; ++c) {
+				const float *column = block + (Rotation00 + c * 3) * stride + i;
+				_mm_storeu_ps(out + c * 4, _mm_setr_ps(column[0], column[stride], column[2 * stride], 0.0f));
+			}
+			_mm_storeu_ps(out + 12, _mm_setr_ps(px, py, pz, 1.0f));
+			continue;
+		}
+
+		const float *P = &pose[parents[i]][0][0];
+		const __m128 p0 = _mm_loadu_ps(P);
+		const __m128 p1 = _mm_loadu_ps(P + 4);
+		const __m128 p2 = _mm_loadu_ps(P + 8);
+		const __m128 p3 = _mm_loadu_ps(P + 12);
+
+		for(int c = 0; c < 3; ++c) {
+			const float *column = block + (Rotation00 + c * 3) * stride + i;
+			__m128 sum = _mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(column[0])), _mm_mul_ps(p1, _mm_set1_ps(column[stride])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(p2, _mm_set1_ps(column[2 * stride])));
+			_mm_storeu_ps(out + c * 4, sum);
+		}
+
+		__m128 sum = _mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(px)), _mm_mul_ps(p1, _mm_set1_ps(py)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(p2, _mm_set1_ps(pz)));
+		_mm_storeu_ps(out + 12, _mm_add_ps(sum, p3));
+	}
+}
+#endif
+
+#ifdef POSE_EVALUATOR_AVX
+__attribute__((target("avx")))
+void localAVX(float *block, int stride) {
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	for(int i = 0; i < stride; i += 8) {
+		__m256 x = _mm256_loadu_ps(block + OrientationX * stride + i);
+		__m256 y = _mm256_loadu_ps(block + OrientationY * stride + i);
+		__m256 z = _mm256_loadu_ps(block + OrientationZ * stride + i);
+
+		__m256 temp = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		__m256 negative = _mm256_cmp_ps(temp, zero, _CMP_LT_OQ);
+		__m256 w = _mm256_andnot_ps(negative, _mm256_xor_ps(_mm256_sqrt_ps(temp), signBit));
+
+		__m256 x2 = _mm256_add_ps(x, x);
+		__m256 y2 = _mm256_add_ps(y, y);
+		__m256 z2 = _mm256_add_ps(z, z);
+		__m256 xx = _mm256_mul_ps(x, x2);
+		__m256 yy = _mm256_mul_ps(y, y2);
+		__m256 zz = _mm256_mul_ps(z, z2);
+		__m256 xy = _mm256_mul_ps(x, y2);
+		__m256 xz = _mm256_mul_ps(x, z2);
+		__m256 yz = _mm256_mul_ps(y, z2);
+		__m256 wx = _mm256_mul_ps(w, x2);
+		__m256 wy = _mm256_mul_ps(w, y2);
+		__m256 wz = _mm256_mul_ps(w, z2);
+
+		_mm256_storeu_ps(block + Rotation00 * stride + i, _mm256_sub_ps(one, _mm256_add_ps(yy, zz)));
+		_mm256_storeu_ps(block + Rotation01 * stride + i, _mm256_add_ps(xy, wz));
+		_mm256_storeu_ps(block + Rotation02 * stride + i, _mm256_sub_ps(xz, wy));
+		_mm256_storeu_ps(block + Rotation10 * stride + i, _mm256_sub_ps(xy, wz));
+		_mm256_storeu_ps(block + Rotation11 * stride + i, _mm256_sub_ps(one, _mm256_add_ps(xx, zz)));
+		_mm256_storeu_ps(block + Rotation12 * stride + i, _mm256_add_ps(yz, wx));
+		_mm256_storeu_ps(block + Rotation20 * stride + i, _mm256_add_ps(xz, wy));
+		_mm256_storeu_ps(block + Rotation21 * stride + i, _mm256_sub_ps(yz, wx));
+		_mm256_storeu_ps(block + Rotation22 * stride + i, _mm256_sub_ps(one, _mm256_add_ps(xx, yy)));
+	}
+}
+#endif
+
+}
+
+PoseEvaluator::PoseEvaluator() : mStride(0), mNumComponents(0), mKernel(bestKernel()) {
+}
+
+PoseEvaluator::PoseEvaluator(const MD5_AnimInfo &anim)
+	: mDecoder(anim.jointsInfo, anim.framesData.numComponents()),
+	  mNumComponents(anim.framesData.numComponents()), mKernel(bestKernel()) {
+	Skeleton skeleton = buildSkeleton(anim);
+	const int numJoints = skeleton.numJoints();
+
+	mParents = skeleton.parents;
+	mStride = (numJoints + kJointsPerBatch - 1) / kJointsPerBatch * kJointsPerBatch;
+	mBase.assign(kNumInputRows * mStride, 0.0f);
+	mBlock.assign(kNumRows * mStride, 0.0f);
+
+	for(int i = 0; i < numJoints; ++i) {
+		mBase[PositionX * mStride + i] = skeleton.positions[i].x;
+		mBase[PositionY * mStride + i] = skeleton.positions[i].y;
+		mBase[PositionZ * mStride + i] = skeleton.positions[i].z;
+		mBase[OrientationX * mStride + i] = skeleton.orientations[i].x;
+		mBase[OrientationY * mStride + i] = skeleton.orientations[i].y;
+		mBase[OrientationZ * mStride + i] = skeleton.orientations[i].z;
+	}
+}
+
+bool PoseEvaluator::supports(Kernel kernel) {
+	switch(kernel) {
+	case Scalar:
+		return true;
+	case SSE:
+#ifdef POSE_EVALUATOR_SSE2
+		return true;
+#else
+		return false;
+#endif
+	case AVX:
+#ifdef POSE_EVALUATOR_AVX
+		return __builtin_cpu_supports("avx");
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+PoseEvaluator::Kernel PoseEvaluator::bestKernel() {
+	if(supports(AVX)) {
+		return AVX;
+	}
+	return supports(SSE) ? SSE : Scalar;
+}
+
+const char *PoseEvaluator::kernelName(Kernel kernel) {
+	switch(kernel) {
+	case Scalar:
+		return "scalar";
+	case SSE:
+		return "SSE2";
+	case AVX:
+		return "AVX";
+	}
+	return "unknown";
+}
+
+void PoseEvaluator::setKernel(Kernel kernel) {
+	if(!supports(kernel)) {
+		throw runtime_error(string("The ") + kernelName(kernel) + " pose kernel is not available.");
+	}
+	mKernel = kernel;
+}
+
+void PoseEvaluator::evaluate(const float *components, vector<mat4> &pose) {
+	const int numJoints = mParents.size();
+	pose.resize(numJoints);
+	if(numJoints == 0) {
+		return;
+	}
+
+	std::copy(mBase.begin(), mBase.end(), mBlock.begin());
+	float *block = mBlock.data();
+
+	// The input rows are in flag bit order.
+	ChannelTargets targets;
+	for(int row = 0; row < kNumInputRows; ++row) {
+		targets.rows[row] = block + row * mStride;
+		targets.steps[row] = 1;
+	}
+	mDecoder.decode(components, targets);
+
+	buildPose(pose);
+}
+
+void PoseEvaluator::evaluate(const vector<glm::vec3> &positions, const vector<glm::quat> &orientations,
+							 vector<mat4> &pose) {
+	const int numJoints = mParents.size();
+	pose.resize(numJoints);
+	if(numJoints == 0) {
+		return;
+	}
+
+	float *block = mBlock.data();
+	for(int i = 0; i < numJoints; ++i) {
+		const glm::quat &q = orientations[i];
+		const float sign = q.w > 0.0f ? -1.0f : 1.0f;
+
+		block[PositionX * mStride + i] = positions[i].x;
+		block[PositionY * mStride + i] = positions[i].y;
+		block[PositionZ * mStride + i] = positions[i].z;
+		block[OrientationX * mStride + i] = sign * q.x;
+		block[OrientationY * mStride + i] = sign * q.y;
+		block[OrientationZ * mStride + i] = sign * q.z;
+	}
+
+	buildPose(pose);
+}
+
+void PoseEvaluator::buildPose(vector<mat4> &pose) {
+	const int numJoints = mParents.size();
+	float *block = mBlock.data();
+
+	switch(mKernel) {
+#ifdef POSE_EVALUATOR_AVX
+	case AVX:
+		localAVX(block, mStride);
+		concatSSE(mParents.data(), block, mStride, numJoints, pose.data());
+		break;
+#endif
+#ifdef POSE_EVALUATOR_SSE2
+	case SSE:
+		localSSE(block, mStride);
+		concatSSE(mParents.data(), block, mStride, numJoints, pose.data());
+		break;
+#endif
+	default:
+		localScalar(block, mStride, numJoints);
+		concatScalar(mParents.data(), block, mStride, numJoints, pose.data());
+		break;
+	}
+}
+
+void PoseEvaluator::evaluate(const AnimFrames &frames, int frame, vector<mat4> &pose) {
+	if(frames.layout() == AnimFrames::FrameMajor) {
+		evaluate(frames.frame(frame), pose);
+		return;
+	}
+
+	mComponents.resize(frames.numComponents());
+	for(int i = 0; i < frames.numComponents(); ++i) {
+		mComponents[i] = frames.value(frame, i);
+	}
+	evaluate(mComponents.data(), pose);
+}
+
+LazyPoseEvaluator::LazyPoseEvaluator() : mStride(0), mNumConstantChannels(0), mNumUpdated(0) {
+}
+
+LazyPoseEvaluator::LazyPoseEvaluator(const MD5_AnimInfo &anim)
+	: mNumConstantChannels(0), mNumUpdated(0) {
+	Skeleton skeleton = buildSkeleton(anim);
+	// Only built to check the component ranges.
+	ChannelDecoder decoder(anim.jointsInfo, anim.framesData.numComponents());
+	const int numJoints = skeleton.numJoints();
+	const vector<int> changing = findChangingChannels(anim);
+
+	mParents = skeleton.parents;
+	mStride = (numJoints + kJointsPerBatch - 1) / kJointsPerBatch * kJointsPerBatch;
+	mBlock.assign(kNumRows * mStride, 0.0f);
+	mDirty.assign(numJoints, 0);
+	mPose.resize(numJoints);
+
+	vector<bool> constant(numJoints);
+	for(int i = 0; i < numJoints; ++i) {
+		mBlock[PositionX * mStride + i] = skeleton.positions[i].x;
+		mBlock[PositionY * mStride + i] = skeleton.positions[i].y;
+		mBlock[PositionZ * mStride + i] = skeleton.positions[i].z;
+		mBlock[OrientationX * mStride + i] = skeleton.orientations[i].x;
+		mBlock[OrientationY * mStride + i] = skeleton.orientations[i].y;
+		mBlock[OrientationZ * mStride + i] = skeleton.orientations[i].z;
+
+		const JointInfo &jointInfo = anim.jointsInfo[i];
+		int component = jointInfo.startIndex;
+		for(int row = 0; row < kNumInputRows; ++row) {
+			if(!(jointInfo.flags & (1 << row))) {
+				continue;
+			}
+			if(changing[i] & (1 << row)) {
+				Channel channel = {component, row * mStride + i, i};
+				mChannels.push_back(channel);
+			} else {
+				mBlock[row * mStride + i] = anim.framesData.value(0, component);
+				++mNumConstantChannels;
+			}
+			++component;
+		}
+
+		const int parent = mParents[i];
+		constant[i] = changing[i] == 0 && (parent < 0 || constant[parent]);
+		if(!constant[i]) {
+			mLiveJoints.push_back(i);
+		}
+	}
+
+	// The changing channels start out at their base values too, so this is
+	// the pose the block describes.
+	for(int i = 0; i < numJoints; ++i) {
+		localJoint(mBlock.data(), mStride, i);
+		concatJoint(mParents.data(), mBlock.data(), mStride, i, mPose.data());
+	}
+}
+
+const vector<mat4> &LazyPoseEvaluator::evaluate(const float *components) {
+	float *block = mBlock.data();
+	unsigned char *dirty = mDirty.data();
+
+	for(const Channel &channel : mChannels) {
+		uint32_t value, previous;
+		memcpy(&value, components + channel.component, sizeof(float));
+		memcpy(&previous, block + channel.destination, sizeof(float));
+		dirty[channel.joint] |= value != previous;
+		block[channel.destination] = components[channel.component];
+	}
+
+	mNumUpdated = 0;
+	for(int i : mLiveJoints) {
+		const int parent = mParents[i];
+		if(parent > -1 && dirty[parent]) {
+			dirty[i] = 1;
+		}
+		if(dirty[i]) {
+			localJoint(block, mStride, i);
+			concatJoint(mParents.data(), block, mStride, i, mPose.data());
+			++mNumUpdated;
+		}
+	}
+
+	// Cleared afterwards so the parent test above sees this call's flags.
+	for(int i : mLiveJoints) {
+		dirty[i] = 0;
+	}
+	return mPose;
+}
+
+const vector<mat4> &LazyPoseEvaluator::evaluate(const AnimFrames &frames, int frame) {
+	if(frames.layout() == AnimFrames::FrameMajor) {
+		return evaluate(frames.frame(frame));
+	}
+
+	mComponents.resize(frames.numComponents());
+	for(int i = 0; i < frames.numComponents(); ++i) {
+		mComponents[i] = frames.value(frame, i);
+	}
+	return evaluate(mComponents.data());
+}
@@ -0,0 +1,130 @@
+#ifndef POSE_EVALUATOR_H
+#define POSE_EVALUATOR_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "ChannelDecoder.h"
+#include "MD5_AnimReader.h"
+
+// Builds the model space pose of a clip's skeleton from one frame of
+// animated components, a few joints at a time.
+//
+// The joint space transforms live in a struct of arrays block, one row per
+// component padded to a multiple of 8 joints. A frame is applied by copying
+// the baseframe rows and letting a ChannelDecoder write the animated
+// components into them, so there are no per joint branches. The quaternion w
+// and the rotation matrices are then computed 4 (SSE2) or 8 (AVX) joints at
+// once, and each joint is concatenated with its parent one column per
+// register.
+//
+// Every kernel performs the same float operations in the same order, so they
+// produce bit-identical poses. They agree with computeModelSpace up to
+// rounding.
+class PoseEvaluator {
+public:
+	enum Kernel {
+		Scalar,
+		SSE,
+		AVX
+	};
+
+	PoseEvaluator();
+	// Throws a runtime_error if the hierarchy is out of order or a joint's
+	// components run past the end of the frame.
+	explicit PoseEvaluator(const MD5_AnimInfo &anim);
+
+	// Compiled in and supported by this CPU.
+	static bool supports(Kernel kernel);
+	static Kernel bestKernel();
+	static const char *kernelName(Kernel kernel);
+
+	// Starts out as bestKernel().
+	Kernel kernel() const { return mKernel; }
+	void setKernel(Kernel kernel);
+
+	int numJoints() const { return mParents.size(); }
+	int numComponents() const { return mNumComponents; }
+
+	// components holds the numComponents animated values of one frame, as
+	// AnimFrames::frame returns them.
+	void evaluate(const float *components, std::vector<glm::mat4> &pose);
+	void evaluate(const AnimFrames &frames, int frame, std::vector<glm::mat4> &pose);
+	// Every joint's joint space transform instead of a frame, e.g. blended
+	// between two. Only x, y and z of each orientation are read and w is
+	// recomputed as for a frame, so a unit quaternion with w > 0 stands for
+	// its negation, which is the same rotation.
+	void evaluate(const std::vector<glm::vec3> &positions, const std::vector<glm::quat> &orientations,
+				  std::vector<glm::mat4> &pose);
+private:
+	// Runs the kernel on the input rows of mBlock.
+	void buildPose(std::vector<glm::mat4> &pose);
+
+	std::vector<int> mParents;
+	ChannelDecoder mDecoder;
+	int mStride;
+	int mNumComponents;
+	Kernel mKernel;
+
+	// Baseframe rows, copied over the front of mBlock for each frame.
+	std::vector<float> mBase;
+	std::vector<float> mBlock;
+	// One frame gathered from a ComponentMajor clip.
+	std::vector<float> mComponents;
+};
+
+// Keeps the last pose it built and only recomputes the joints that moved.
+//
+// At load, channels that hold one value through the whole clip are folded
+// into the base pose and never read again. Joints left with no changing
+// channels whose ancestors have none either are constant: they are computed
+// once here and skipped from then on. Each evaluate() compares the remaining
+// channels with the values it saw last time, marks the joints whose channels
+// differ, and recomputes those and their descendants in hierarchy order.
+//
+// The result is bit-identical to PoseEvaluator's, since the joints that are
+// recomputed go through the same arithmetic as its scalar kernel.
+class LazyPoseEvaluator {
+public:
+	LazyPoseEvaluator();
+	// Throws a runtime_error for the same clips PoseEvaluator does.
+	explicit LazyPoseEvaluator(const MD5_AnimInfo &anim);
+
+	int numJoints() const { return mParents.size(); }
+	// Joints whose model space transform is the same in every frame.
+	int numConstantJoints() const { return numJoints() - mLiveJoints.size(); }
+	// Animated channels folded into the base pose.
+	int numConstantChannels() const { return mNumConstantChannels; }
+	// Joints the last evaluate() recomputed.
+	int numUpdated() const { return mNumUpdated; }
+
+	// The pose for one frame of the clip, valid until the next call.
+	const std::vector<glm::mat4> &evaluate(const float *components);
+	const std::vector<glm::mat4> &evaluate(const AnimFrames &frames, int frame);
+	const std::vector<glm::mat4> &pose() const { return mPose; }
+private:
+	// A channel that changes during the clip and where it goes in the block.
+	struct Channel {
+		int component;
+		int destination;
+		int joint;
+	};
+
+	std::vector<int> mParents;
+	std::vector<Channel> mChannels;
+	// Joints outside the constant subtrees, parents first.
+	std::vector<int> mLiveJoints;
+	int mStride;
+	int mNumConstantChannels;
+	int mNumUpdated;
+
+	// Laid out like PoseEvaluator's block. The input rows hold the values
+	// mPose was built from.
+	std::vector<float> mBlock;
+	std::vector<unsigned char> mDirty;
+	std::vector<glm::mat4> mPose;
+	std::vector<float> mComponents;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "QuantizedAnim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <glm/gtc/matrix_transform.hpp>
+
+using std::endl;
+using std::max;
+using std::min;
+using std::ostream;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+namespace {
+
+const float kPositionLevels = 65535.0f;
+
+// The three smallest components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)].
+const float kSmallestThreeRange = 0.707106781f;
+const float kSmallestThreeLevels = 32767.0f;
+const float kSmallestThreeStep = 2.0f * kSmallestThreeRange / kSmallestThreeLevels;
+
+// MD5 orientations are stored with only x, y and z. w is the negative root.
+float computeW(const quat &q) {
+	float temp = 1 - q.x * q.x - q.y * q.y - q.z * q.z;
+	return temp < 0 ? 0 : -1 * sqrtf(temp);
+}
+
+// Packs the dropped component's index (2 bits) and the other three (15 bits
+// each) into 47 of the 48 bits of out[0..2]. The dropped component is made
+// positive so the decoder can recover it from the other three.
+void encodeOrientation(const quat &orientation, uint16_t *out) {
+	quat q = glm::normalize(orientation);
+	float c[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for(int i = 1; i < 4; ++i) {
+		if(fabsf(c[i]) > fabsf(c[largest])) {
+			largest = i;
+		}
+	}
+	float sign = c[largest] < 0 ? -1.0f : 1.0f;
+
+	uint64_t bits = largest;
+	for(int i = 0; i < 4; ++i) {
+		if(i == largest) {
+			continue;
+		}
+		float t = (c[i] * sign + kSmallestThreeRange) / (2.0f * kSmallestThreeRange);
+		t = min(max(t, 0.0f), 1.0f);
+		bits = (bits << 15) | static_cast<uint64_t>(t * kSmallestThreeLevels + 0.5f);
+	}
+
+	out[0] = static_cast<uint16_t>(bits >> 32);
+	out[1] = static_cast<uint16_t>(bits >> 16);
+	out[2] = static_cast<uint16_t>(bits);
+}
+
+// Returns the orientation with w <= 0 to match the MD5 convention of the
+// float clip. q and -q are the same rotation.
+inline quat decodeOrientation(const uint16_t *in) {
+	uint64_t bits = (static_cast<uint64_t>(in[0]) << 32) | (static_cast<uint64_t>(in[1]) << 16) | in[2];
+	int largest = static_cast<int>(bits >> 45) & 3;
+
+	float c[4];
+	float sum = 0;
+	for(int i = 3; i >= 0; --i) {
+		if(i == largest) {
+			continue;
+		}
+		c[i] = (bits & 0x7fff) * kSmallestThreeStep - kSmallestThreeRange;
+		sum += c[i] * c[i];
+		bits >>= 15;
+	}
+	c[largest] = sqrtf(max(1.0f - sum, 0.0f));
+
+	float sign = c[3] > 0 ? -1.0f : 1.0f;
+	return quat(sign * c[3], sign * c[0], sign * c[1], sign * c[2]);
+}
+
+}
+
+QuantizedAnim::QuantizedAnim()
+	: mNumFrames(0), mFrameRate(0), mRecordSize(0) {
+}
+
+QuantizedAnim::QuantizedAnim(const MD5_AnimInfo &anim)
+	: mNumFrames(anim.numFrames), mFrameRate(anim.frameRate), mRecordSize(0) {
+	const int numJoints = anim.jointsInfo.size();
+
+	// Find the range of every animated position component and which animated
+	// orientations never change. Components that hold still for the whole
+	// clip are folded into the joint's base values and not stored per frame.
+	vector<vec3> positions;
+	vector<quat> orientations;
+	vector<vec3> positionMin(numJoints, vec3(HUGE_VALF, HUGE_VALF, HUGE_VALF));
+	vector<vec3> positionMax(numJoints, vec3(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF));
+	vector<quat> firstOrientations;
+	vector<bool> orientationChanges(numJoints, false);
+
+	for(int f = 0; f < mNumFrames; ++f) {
+		computeLocalPose(anim, f, positions, orientations);
+		if(f == 0) {
+			firstOrientations = orientations;
+		}
+
+		for(int i = 0; i < numJoints; ++i) {
+			for(int axis = 0; axis < 3; ++axis) {
+				positionMin[i][axis] = min(positionMin[i][axis], positions[i][axis]);
+				positionMax[i][axis] = max(positionMax[i][axis], positions[i][axis]);
+			}
+			const quat &first = firstOrientations[i];
+			if(orientations[i].x != first.x || orientations[i].y != first.y || orientations[i].z != first.z) {
+				orientationChanges[i] = true;
+			}
+		}
+	}
+
+	// Lay out one frame's record.
+	mJoints.resize(numJoints);
+	mJointNames.resize(numJoints);
+
+	for(int i = 0; i < numJoints; ++i) {
+		const JointInfo &info = anim.jointsInfo[i];
+		QuantizedJoint &joint = mJoints[i];
+
+		joint.parent = info.parent;
+		joint.positionMask = 0;
+		joint.rotated = (info.flags & (7 << 3)) != 0 && orientationChanges[i];
+		joint.firstChannel = mChannels.size();
+		joint.offset = mRecordSize;
+		joint.basePosition = anim.baseframeJoints[i].position;
+		joint.baseOrientation = anim.baseframeJoints[i].orientation;
+		joint.baseOrientation.w = computeW(joint.baseOrientation);
+		joint.maxPositionError = 0;
+		joint.maxRotationError = 0;
+		mJointNames[i] = info.name;
+
+		if(mNumFrames == 0) {
+			continue;
+		}
+
+		for(int axis = 0; axis < 3; ++axis) {
+			if(!(info.flags & (1 << axis))) {
+				continue;
+			}
+			if(positionMin[i][axis] == positionMax[i][axis]) {
+				joint.basePosition[axis] = positionMin[i][axis];
+			} else {
+				ChannelRange channel = { positionMin[i][axis], (positionMax[i][axis] - positionMin[i][axis]) / kPositionLevels };
+				mChannels.push_back(channel);
+				joint.positionMask |= 1 << axis;
+				++mRecordSize;
+			}
+		}
+
+		if(joint.rotated) {
+			mRecordSize += 3;
+		} else if(info.flags & (7 << 3)) {
+			joint.baseOrientation = firstOrientations[i];
+		}
+	}
+
+	// Quantize every frame, then decode it again to measure the error.
+	mRecords.resize(static_cast<size_t>(mNumFrames) * mRecordSize);
+
+	for(int f = 0; f < mNumFrames; ++f) {
+		computeLocalPose(anim, f, positions, orientations);
+		uint16_t *record = mRecords.data() + static_cast<size_t>(f) * mRecordSize;
+
+		for(int i = 0; i < numJoints; ++i) {
+			QuantizedJoint &joint = mJoints[i];
+			uint16_t *out = record + joint.offset;
+			int channel = joint.firstChannel;
+
+			for(int axis = 0; axis < 3; ++axis) {
+				if(joint.positionMask & (1 << axis)) {
+					const ChannelRange &range = mChannels[channel++];
+					float level = (positions[i][axis] - range.min) / range.step;
+					*out++ = static_cast<uint16_t>(min(max(level + 0.5f, 0.0f), kPositionLevels));
+				}
+			}
+			if(joint.rotated) {
+				encodeOrientation(orientations[i], out);
+			}
+
+			vec3 position;
+			quat orientation;
+			decodeJoint(record, joint, position, orientation);
+			joint.maxPositionError = max(joint.maxPositionError, glm::length(position - positions[i]));
+			joint.maxRotationError = max(joint.maxRotationError, angleBetween(orientation, orientations[i]));
+		}
+	}
+}
+
+size_t QuantizedAnim::sizeInBytes() const {
+	return mRecords.size() * sizeof(uint16_t)
+		 + mChannels.size() * sizeof(ChannelRange)
+		 + mJoints.size() * sizeof(QuantizedJoint);
+}
+
+inline void QuantizedAnim::decodeJoint(const uint16_t *record, const QuantizedJoint &joint, vec3 &position, quat &orientation) const {
+	const uint16_t *in = record + joint.offset;
+
+	position = joint.basePosition;
+	if(joint.positionMask) {
+		const ChannelRange *channel = &mChannels[joint.firstChannel];
+		for(int axis = 0; axis < 3; ++axis) {
+			if(joint.positionMask & (1 << axis)) {
+				position[axis] = channel->min + *in++ * channel->step;
+				++channel;
+			}
+		}
+	}
+
+	orientation = joint.rotated ? decodeOrientation(in) : joint.baseOrientation;
+}
+
+void QuantizedAnim::sampleLocalPose(int frame, vector<vec3> &positions, vector<quat> &orientations) const {
+	const uint16_t *record = mRecords.data() + static_cast<size_t>(frame) * mRecordSize;
+
+	positions.resize(mJoints.size());
+	orientations.resize(mJoints.size());
+
+	for(int i = 0; i < mJoints.size(); ++i) {
+		decodeJoint(record, mJoints[i], positions[i], orientations[i]);
+	}
+}
+
+void QuantizedAnim::samplePose(int frame, vector<mat4> &pose) const {
+	const uint16_t *record = mRecords.data() + static_cast<size_t>(frame) * mRecordSize;
+
+	pose.resize(mJoints.size());
+
+	for(int i = 0; i < mJoints.size(); ++i) {
+		const QuantizedJoint &joint = mJoints[i];
+		vec3 position;
+		quat orientation;
+		decodeJoint(record, joint, position, orientation);
+
+		mat4 combinedM = glm::translate(mat4(), position) * glm::mat4_cast(orientation);
+		if(joint.parent > -1) {
+			combinedM = pose[joint.parent] * combinedM;
+		}
+		pose[i] = combinedM;
+	}
+}
+
+void QuantizedAnim::printErrorReport(ostream &out) const {
+	float worstPosition = 0;
+	float worstRotation = 0;
+
+	out << "Quantization error per joint (position, rotation in radians):" << endl;
+	for(int i = 0; i < mJoints.size(); ++i) {
+		const QuantizedJoint &joint = mJoints[i];
+		out << "\t" << std::left << std::setw(24) << mJointNames[i] << std::right
+			<< " " << joint.maxPositionError << " " << joint.maxRotationError << endl;
+		worstPosition = max(worstPosition, joint.maxPositionError);
+		worstRotation = max(worstRotation, joint.maxRotationError);
+	}
+	out << "Worst: " << worstPosition << " " << worstRotation << endl;
+}
@@ -0,0 +1,75 @@
+#ifndef QUANTIZED_ANIM_H
+#define QUANTIZED_ANIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "MD5_AnimReader.h"
+
+// A compact copy of an MD5_AnimInfo's frame data.
+//
+// Each animated position component is stored as 16 bits over the range that
+// component covers in the clip. Each animated orientation is stored in 48
+// bits as its three smallest components (15 bits each) plus the index of the
+// dropped one. Components a joint does not animate come from the baseframe,
+// as with the float data, and so do components that never change.
+//
+// The samplers dequantize as they go, so there is no float copy of a frame.
+class QuantizedAnim {
+public:
+	QuantizedAnim();
+	explicit QuantizedAnim(const MD5_AnimInfo &anim);
+
+	int numFrames() const { return mNumFrames; }
+	int numJoints() const { return mJoints.size(); }
+	int frameRate() const { return mFrameRate; }
+
+	// Resident size of the quantized frames and the tables needed to decode them.
+	size_t sizeInBytes() const;
+
+	void sampleLocalPose(int frame, std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations) const;
+	// Model space transform of every joint, as computeCurrentPose builds them.
+	void samplePose(int frame, std::vector<glm::mat4> &pose) const;
+
+	// Worst case over all frames, measured against the float clip when the
+	// clip was quantized. Position error is a distance in joint space,
+	// rotation error an angle in radians.
+	float maxPositionError(int joint) const { return mJoints[joint].maxPositionError; }
+	float maxRotationError(int joint) const { return mJoints[joint].maxRotationError; }
+
+	void printErrorReport(std::ostream &out) const;
+private:
+	struct ChannelRange {
+		float min;
+		float step;
+	};
+
+	struct QuantizedJoint {
+		int parent;
+		int positionMask;
+		bool rotated;
+		int firstChannel;
+		int offset;
+		glm::vec3 basePosition;
+		glm::quat baseOrientation;
+		float maxPositionError;
+		float maxRotationError;
+	};
+
+	void decodeJoint(const uint16_t *record, const QuantizedJoint &joint, glm::vec3 &position, glm::quat &orientation) const;
+private:
+	int mNumFrames;
+	int mFrameRate;
+	int mRecordSize;
+	std::vector<QuantizedJoint> mJoints;
+	std::vector<ChannelRange> mChannels;
+	std::vector<uint16_t> mRecords;
+	std::vector<std::string> mJointNames;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "ReducedAnim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+using std::max;
+using std::min;
+using std::runtime_error;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+namespace {
+
+// Key frames are stored in 16 bits.
+const int kMaxFrames = 65536;
+
+inline vec3 interpolate(const vec3 &a, const vec3 &b, float t) {
+	return a + (b - a) * t;
+}
+
+// Normalized lerp along the shorter arc.
+inline quat interpolate(const quat &a, const quat &b, float t) {
+	float sign = (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) < 0 ? -1.0f : 1.0f;
+	quat q(a.w + (sign * b.w - a.w) * t,
+		   a.x + (sign * b.x - a.x) * t,
+		   a.y + (sign * b.y - a.y) * t,
+		   a.z + (sign * b.z - a.z) * t);
+	return glm::normalize(q);
+}
+
+inline float distance(const vec3 &a, const vec3 &b) {
+	return glm::length(a - b);
+}
+
+// Orientations are apart by an angle in radians.
+inline float distance(const quat &a, const quat &b) {
+	return angleBetween(a, b);
+}
+
+// True if keys at first and last reproduce every frame between them.
+template<typename T>
+bool spanFits(const vector<T> &values, int first, int last, float tolerance) {
+	for(int i = first + 1; i < last; ++i) {
+		float t = float(i - first) / (last - first);
+		if(distance(interpolate(values[first], values[last], t), values[i]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Greedily picks the frames of values to keep as keys. Each span is grown by
+// doubling and then narrowed by bisection, so long still stretches cost
+// O(n log n) to check rather than O(n^2). Only spans that were checked are
+// used, so every frame stays within tolerance.
+template<typename T>
+void reduceChannel(const vector<T> &values, float tolerance, vector<uint16_t> &keyFrames, vector<T> &keys) {
+	const int numFrames = values.size();
+
+	// A channel that never leaves its first value needs one key.
+	bool still = true;
+	for(int i = 1; still && i < numFrames; ++i) {
+		still = distance(values[0], values[i]) <= tolerance;
+	}
+	if(still) {
+		keyFrames.push_back(0);
+		keys.push_back(values[0]);
+		return;
+	}
+
+	int first = 0;
+	keyFrames.push_back(0);
+	keys.push_back(values[0]);
+
+	while(first < numFrames - 1) {
+		int good = first + 1;
+		int step = 1;
+		while(good + step < numFrames && spanFits(values, first, good + step, tolerance)) {
+			good += step;
+			step *= 2;
+		}
+
+		int bad = min(good + step, numFrames);
+		while(bad - good > 1) {
+			int mid = good + (bad - good) / 2;
+			if(spanFits(values, first, mid, tolerance)) {
+				good = mid;
+			} else {
+				bad = mid;
+			}
+		}
+
+		keyFrames.push_back(good);
+		keys.push_back(values[good]);
+		first = good;
+	}
+}
+
+// Moves cursor to the key span holding frame and returns the interpolation
+// weight within it. Sequential samples move the cursor by at most one key.
+inline float seek(const uint16_t *keyFrames, int numKeys, int &cursor, float frame) {
+	while(cursor > 0 && keyFrames[cursor] > frame) {
+		--cursor;
+	}
+	while(cursor + 1 < numKeys && keyFrames[cursor + 1] <= frame) {
+		++cursor;
+	}
+
+	if(cursor + 1 >= numKeys) {
+		return 0;
+	}
+	return (frame - keyFrames[cursor]) / (keyFrames[cursor + 1] - keyFrames[cursor]);
+}
+
+}
+
+ReducedAnim::ReducedAnim()
+	: mNumFrames(0), mFrameRate(0) {
+}
+
+ReducedAnim::ReducedAnim(const MD5_AnimInfo &anim, float positionTolerance, float rotationTolerance)
+	: mNumFrames(anim.numFrames), mFrameRate(anim.frameRate) {
+	if(mNumFrames < 1 || mNumFrames > kMaxFrames) {
+		throw runtime_error("Can only reduce clips of 1 to 65536 frames.");
+	}
+
+	const int numJoints = anim.jointsInfo.size();
+
+	// Gather every joint's channels over the whole clip.
+	vector<vector<vec3>> positions(numJoints, vector<vec3>(mNumFrames));
+	vector<vector<quat>> orientations(numJoints, vector<quat>(mNumFrames));
+	vector<vec3> framePositions;
+	vector<quat> frameOrientations;
+
+	for(int f = 0; f < mNumFrames; ++f) {
+		computeLocalPose(anim, f, framePositions, frameOrientations);
+		for(int i = 0; i < numJoints; ++i) {
+			positions[i][f] = framePositions[i];
+			orientations[i][f] = frameOrientations[i];
+		}
+	}
+
+	mJoints.resize(numJoints);
+	for(int i = 0; i < numJoints; ++i) {
+		ReducedJoint &joint = mJoints[i];
+		joint.parent = anim.jointsInfo[i].parent;
+
+		joint.position.firstKey = mPositionKeys.size();
+		reduceChannel(positions[i], positionTolerance, mPositionKeyFrames, mPositionKeys);
+		joint.position.numKeys = mPositionKeys.size() - joint.position.firstKey;
+
+		joint.rotation.firstKey = mRotationKeys.size();
+		reduceChannel(orientations[i], rotationTolerance, mRotationKeyFrames, mRotationKeys);
+		joint.rotation.numKeys = mRotationKeys.size() - joint.rotation.firstKey;
+	}
+}
+
+size_t ReducedAnim::sizeInBytes() const {
+	return mJoints.size() * sizeof(ReducedJoint)
+		 + mPositionKeyFrames.size() * sizeof(uint16_t)
+		 + mPositionKeys.size() * sizeof(vec3)
+		 + mRotationKeyFrames.size() * sizeof(uint16_t)
+		 + mRotationKeys.size() * sizeof(quat);
+}
+
+ReducedAnimSampler::ReducedAnimSampler(const ReducedAnim &anim)
+	: mAnim(anim), mPositionCursors(anim.numJoints(), 0), mRotationCursors(anim.numJoints(), 0) {
+}
+
+void ReducedAnimSampler::sampleLocalPose(float frame, vector<vec3> &positions, vector<quat> &orientations) {
+	const int numJoints = mAnim.mJoints.size();
+	frame = min(max(frame, 0.0f), float(mAnim.mNumFrames - 1));
+
+	positions.resize(numJoints);
+	orientations.resize(numJoints);
+
+	for(int i = 0; i < numJoints; ++i) {
+		const ReducedAnim::ReducedJoint &joint = mAnim.mJoints[i];
+
+		const uint16_t *keyFrames = &mAnim.mPositionKeyFrames[joint.position.firstKey];
+		const vec3 *positionKeys = &mAnim.mPositionKeys[joint.position.firstKey];
+		int &positionCursor = mPositionCursors[i];
+		float t = seek(keyFrames, joint.position.numKeys, positionCursor, frame);
+		positions[i] = t > 0 ? interpolate(positionKeys[positionCursor], positionKeys[positionCursor + 1], t)
+							 : positionKeys[positionCursor];
+
+		keyFrames = &mAnim.mRotationKeyFrames[joint.rotation.firstKey];
+		const quat *rotationKeys = &mAnim.mRotationKeys[joint.rotation.firstKey];
+		int &rotationCursor = mRotationCursors[i];
+		t = seek(keyFrames, joint.rotation.numKeys, rotationCursor, frame);
+		orientations[i] = t > 0 ? interpolate(rotationKeys[rotationCursor], rotationKeys[rotationCursor + 1], t)
+								: rotationKeys[rotationCursor];
+	}
+}
+
+void ReducedAnimSampler::samplePose(float frame, vector<mat4> &pose) {
+	sampleLocalPose(frame, mPositions, mOrientations);
+	pose.resize(mPositions.size());
+
+	for(int i = 0; i < mPositions.size(); ++i) {
+		mat4 combinedM = glm::translate(mat4(), mPositions[i]) * glm::mat4_cast(mOrientations[i]);
+
+		int parent = mAnim.mJoints[i].parent;
+		if(parent > -1) {
+			combinedM = pose[parent] * combinedM;
+		}
+		pose[i] = combinedM;
+	}
+}
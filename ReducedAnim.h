@@ -0,0 +1,75 @@
+#ifndef REDUCED_ANIM_H
+#define REDUCED_ANIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "MD5_AnimReader.h"
+
+// A clip with the keyframes each joint does not need removed.
+//
+// Every joint has a position channel and an orientation channel, each with
+// its own sparse list of key frames. A frame is dropped from a channel when
+// interpolating its neighbouring keys reproduces it within the tolerance:
+// a distance for positions, an angle in radians for orientations. Positions
+// are interpolated linearly, orientations with a normalized lerp, exactly as
+// ReducedAnimSampler does, so the tolerances hold for every original frame.
+class ReducedAnim {
+public:
+	ReducedAnim();
+	ReducedAnim(const MD5_AnimInfo &anim, float positionTolerance, float rotationTolerance);
+
+	int numFrames() const { return mNumFrames; }
+	int numJoints() const { return mJoints.size(); }
+	int frameRate() const { return mFrameRate; }
+
+	int numPositionKeys() const { return mPositionKeys.size(); }
+	int numRotationKeys() const { return mRotationKeys.size(); }
+	size_t sizeInBytes() const;
+private:
+	friend class ReducedAnimSampler;
+
+	struct Channel {
+		int firstKey;
+		int numKeys;
+	};
+
+	struct ReducedJoint {
+		int parent;
+		Channel position;
+		Channel rotation;
+	};
+private:
+	int mNumFrames;
+	int mFrameRate;
+	std::vector<ReducedJoint> mJoints;
+	std::vector<uint16_t> mPositionKeyFrames;
+	std::vector<glm::vec3> mPositionKeys;
+	std::vector<uint16_t> mRotationKeyFrames;
+	std::vector<glm::quat> mRotationKeys;
+};
+
+// Evaluates a ReducedAnim at any frame, including fractional ones. Each
+// channel remembers the key span it was last sampled in and only walks from
+// there, so playing forwards or backwards costs O(1) per channel per sample.
+// A sampler is not shared between threads; use one per playing instance.
+class ReducedAnimSampler {
+public:
+	explicit ReducedAnimSampler(const ReducedAnim &anim);
+
+	// frame is clamped to [0, numFrames - 1].
+	void sampleLocalPose(float frame, std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations);
+	// Model space transform of every joint, as computeCurrentPose builds them.
+	void samplePose(float frame, std::vector<glm::mat4> &pose);
+private:
+	const ReducedAnim &mAnim;
+	std::vector<int> mPositionCursors;
+	std::vector<int> mRotationCursors;
+	std::vector<glm::vec3> mPositions;
+	std::vector<glm::quat> mOrientations;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "StreamingAnim.h"
+#include "MD5_FrameScanner.h"
+#include "MD5_Tokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using std::lock_guard;
+using std::max;
+using std::min;
+using std::mutex;
+using std::runtime_error;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+namespace {
+
+// True for the `frame N {` line that opens a frame block.
+bool isFrameLine(const string &line) {
+	size_t start = line.find_first_not_of(" \t");
+	return start != string::npos && line.compare(start, 5, "frame") == 0 &&
+		   line.size() > start + 5 && (line[start + 5] == ' ' || line[start + 5] == '\t');
+}
+
+}
+
+StreamingAnim::StreamingAnim(const string &filename, int windowFrames)
+	: mNumComponents(0), mPlayhead(0), mStopping(false) {
+	indexFile(filename);
+
+	mWindowFrames = min(max(windowFrames, 1), mInfo.numFrames);
+	mFramesBehind = mWindowFrames / 4;
+	mWindow.resize(mWindowFrames, mNumComponents);
+	mSlotFrames.assign(mWindowFrames, -1);
+	mDecoded.resize(mNumComponents);
+
+	mPoseInfo.jointsInfo = mInfo.jointsInfo;
+	mPoseInfo.baseframeJoints = mInfo.baseframeJoints;
+	mPoseInfo.numFrames = 1;
+	mPoseInfo.frameRate = mInfo.frameRate;
+	mPoseInfo.framesData.resize(1, mNumComponents);
+	mEvaluator = PoseEvaluator(mPoseInfo);
+
+	mPrefetcher = std::thread(&StreamingAnim::prefetchLoop, this);
+}
+
+StreamingAnim::~StreamingAnim() {
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWork.notify_all();
+	mPrefetcher.join();
+}
+
+// One pass over the file. Everything before the first frame block goes
+// through MD5_AnimReader::parseHeader; after that only the offsets of the
+// frame lines are kept.
+void StreamingAnim::indexFile(const string &filename) {
+	mFile.open(filename, std::ios::binary);
+	if(!mFile) {
+		throw runtime_error("Could not open " + filename);
+	}
+
+	string header;
+	string line;
+	uint64_t offset = 0;
+	bool inFrames = false;
+	int current = -1;
+	vector<bool> seen;
+	int count = 0;
+
+	while(getline(mFile, line)) {
+		uint64_t lineStart = offset;
+		offset += line.size() + 1;
+
+		if(!isFrameLine(line)) {
+			if(!inFrames) {
+				header += line;
+				header += '\n';
+			}
+			continue;
+		}
+
+		if(!inFrames) {
+			MD5_Tokenizer tokens(header.data(), header.data() + header.size());
+			mNumComponents = MD5_AnimReader::parseHeader(tokens, mInfo);
+			mIndex.resize(mInfo.numFrames);
+			seen.assign(mInfo.numFrames, false);
+			string().swap(header);
+			inFrames = true;
+		} else {
+			mIndex[current].size = lineStart - mIndex[current].offset;
+		}
+
+		MD5_Tokenizer tokens(line.data(), line.data() + line.size());
+		tokens.expect("frame");
+		current = tokens.readInt();
+		if(current < 0 || current >= mInfo.numFrames || seen[current]) {
+			throw runtime_error("Frame " + std::to_string(current) + " is out of range or appears more than once.");
+		}
+		seen[current] = true;
+		++count;
+		mIndex[current].offset = lineStart;
+	}
+
+	if(!inFrames) {
+		MD5_Tokenizer tokens(header.data(), header.data() + header.size());
+		mNumComponents = MD5_AnimReader::parseHeader(tokens, mInfo);
+	} else {
+		mFile.clear();
+		mFile.seekg(0, std::ios::end);
+		mIndex[current].size = static_cast<uint64_t>(mFile.tellg()) - mIndex[current].offset;
+	}
+
+	if(count != mInfo.numFrames) {
+		throw runtime_error("numFrames does not match the number of frame blocks.");
+	}
+
+	mFile.clear();
+}
+
+void StreamingAnim::decodeFrame(int frame, float *out) {
+	const FrameExtent &extent = mIndex[frame];
+	mReadBuffer.resize(extent.size);
+
+	mFile.seekg(extent.offset);
+	mFile.read(mReadBuffer.data(), extent.size);
+	if(!mFile) {
+		mFile.clear();
+		throw runtime_error("Could not read frame " + std::to_string(frame) + ".");
+	}
+
+	const char *begin = mReadBuffer.data();
+	MD5_Tokenizer tokens(begin, begin + mReadBuffer.size());
+	try {
+		tokens.expect("frame");
+		tokens.readInt();
+		tokens.expect("{");
+		MD5_FrameScanner::scanFrame(tokens.position(), tokens.end(), out, mNumComponents);
+	} catch(runtime_error &e) {
+		throw runtime_error("In frame " + std::to_string(frame) + ": " + e.what());
+	}
+}
+
+void StreamingAnim::prefetchLoop() {
+	unique_lock<mutex> lock(mMutex);
+
+	for(;;) {
+		int frame = -1;
+		mWork.wait(lock, [&]() { return mStopping || (frame = nextMissingFrame()) >= 0; });
+		if(mStopping) {
+			return;
+		}
+
+		// Decode without the lock so the sampling thread can keep reading
+		// the frames it already has.
+		lock.unlock();
+		try {
+			decodeFrame(frame, mDecoded.data());
+		} catch(...) {
+			lock.lock();
+			mError = std::current_exception();
+			mFrameReady.notify_all();
+			return;
+		}
+		lock.lock();
+
+		// The playhead may have jumped away while the frame was decoded.
+		if(inWindow(frame)) {
+			int slot = freeSlot();
+			memcpy(mWindow.frame(slot), mDecoded.data(), mNumComponents * sizeof(float));
+			mSlotFrames[slot] = frame;
+			mFrameReady.notify_all();
+		}
+	}
+}
+
+bool StreamingAnim::inWindow(int frame) const {
+	const int numFrames = mInfo.numFrames;
+	if(numFrames <= mWindowFrames) {
+		return true;
+	}
+
+	int ahead = (frame - mPlayhead + numFrames) % numFrames;
+	return ahead < mWindowFrames - mFramesBehind || ahead >= numFrames - mFramesBehind;
+}
+
+// The first frame from the playhead on that the window wants and lacks.
+int StreamingAnim::nextMissingFrame() const {
+	const int numFrames = mInfo.numFrames;
+	int count = numFrames <= mWindowFrames ? numFrames : mWindowFrames - mFramesBehind;
+
+	for(int i = 0; i < count; ++i) {
+		int frame = (mPlayhead + i) % numFrames;
+		if(findSlot(frame) < 0) {
+			return frame;
+		}
+	}
+	return -1;
+}
+
+int StreamingAnim::findSlot(int frame) const {
+	for(int slot = 0; slot < mWindowFrames; ++slot) {
+		if(mSlotFrames[slot] == frame) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+// The window holds mWindowFrames frames, so a frame that belongs in it always
+// finds an empty slot or one holding a frame that has fallen out.
+int StreamingAnim::freeSlot() const {
+	for(int slot = 0; slot < mWindowFrames; ++slot) {
+		if(mSlotFrames[slot] < 0 || !inWindow(mSlotFrames[slot])) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+void StreamingAnim::readFrame(int frame, float *out) {
+	if(frame < 0 || frame >= mInfo.numFrames) {
+		throw runtime_error("Frame " + std::to_string(frame) + " is outside the clip.");
+	}
+
+	unique_lock<mutex> lock(mMutex);
+	if(mPlayhead != frame) {
+		mPlayhead = frame;
+		mWork.notify_one();
+	}
+
+	int slot = -1;
+	mFrameReady.wait(lock, [&]() { return mError || (slot = findSlot(frame)) >= 0; });
+	if(slot < 0) {
+		std::rethrow_exception(mError);
+	}
+
+	memcpy(out, mWindow.frame(slot), mNumComponents * sizeof(float));
+}
+
+void StreamingAnim::sampleLocalPose(int frame, vector<vec3> &positions, vector<quat> &orientations) {
+	readFrame(frame, mPoseInfo.framesData.frame(0));
+	computeLocalPose(mPoseInfo, 0, positions, orientations);
+}
+
+void StreamingAnim::samplePose(int frame, vector<mat4> &pose) {
+	readFrame(frame, mPoseInfo.framesData.frame(0));
+	mEvaluator.evaluate(mPoseInfo.framesData.frame(0), pose);
+}
+
+size_t StreamingAnim::residentBytes() const {
+	return mWindow.sizeInBytes()
+		 + mIndex.size() * sizeof(FrameExtent)
+		 + mInfo.bounds.size() * sizeof(FrameBounds);
+}
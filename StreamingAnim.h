@@ -0,0 +1,110 @@
+#ifndef STREAMING_ANIM_H
+#define STREAMING_ANIM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "AnimFrames.h"
+#include "MD5_AnimReader.h"
+#include "PoseEvaluator.h"
+
+// An md5anim clip read from disk a few frames at a time.
+//
+// Opening the clip reads the header, hierarchy, bounds and baseframe, and
+// records where each frame block starts in the file. Only a window of decoded
+// frames around the playhead is kept: a quarter of it behind, the rest ahead.
+// A background thread decodes the frames ahead of the playhead, wrapping
+// around at the end of the clip, so the frame data held stays the same size
+// however long the clip is. The frame index and the bounds still hold one
+// entry per frame, 40 bytes in all.
+//
+// Asking for a frame moves the playhead to it. Frames the prefetcher has not
+// reached yet are waited for. One thread samples a StreamingAnim at a time.
+class StreamingAnim {
+public:
+	static const int kDefaultWindowFrames = 128;
+
+	// Throws a runtime_error if the file cannot be read or is malformed
+	// before the first frame block, or if the frame blocks do not number
+	// 0 to numFrames - 1 exactly once each.
+	explicit StreamingAnim(const std::string &filename, int windowFrames = kDefaultWindowFrames);
+	~StreamingAnim();
+
+	int numFrames() const { return mInfo.numFrames; }
+	int numJoints() const { return mInfo.jointsInfo.size(); }
+	int numComponents() const { return mNumComponents; }
+	int frameRate() const { return mInfo.frameRate; }
+	int windowFrames() const { return mWindowFrames; }
+
+	// The clip without its frames: framesData is empty.
+	const MD5_AnimInfo &info() const { return mInfo; }
+
+	// Copies frame's numComponents() values to out. Rethrows the error if
+	// the prefetcher failed to decode a frame.
+	void readFrame(int frame, float *out);
+
+	void sampleLocalPose(int frame, std::vector<glm::vec3> &positions, std::vector<glm::quat> &orientations);
+	// Model space transform of every joint, as computeCurrentPose builds them.
+	void samplePose(int frame, std::vector<glm::mat4> &pose);
+
+	// Decoded frames plus the per frame index and bounds.
+	size_t residentBytes() const;
+private:
+	StreamingAnim(const StreamingAnim &);
+	StreamingAnim &operator=(const StreamingAnim &);
+
+	// Where a `frame N { ... }` block sits in the file.
+	struct FrameExtent {
+		uint64_t offset;
+		uint32_t size;
+	};
+
+	void indexFile(const std::string &filename);
+	void decodeFrame(int frame, float *out);
+	void prefetchLoop();
+
+	// These expect mMutex to be held.
+	bool inWindow(int frame) const;
+	int nextMissingFrame() const;
+	int findSlot(int frame) const;
+	int freeSlot() const;
+private:
+	MD5_AnimInfo mInfo;
+	int mNumComponents;
+	std::vector<FrameExtent> mIndex;
+
+	// Only touched by the sampling thread. framesData holds the one frame
+	// being sampled so computeLocalPose and mEvaluator can read it.
+	MD5_AnimInfo mPoseInfo;
+	PoseEvaluator mEvaluator;
+
+	// Only touched by the prefetch thread once it has started.
+	std::ifstream mFile;
+	std::vector<char> mReadBuffer;
+	std::vector<float> mDecoded;
+
+	// Guarded by mMutex.
+	int mWindowFrames;
+	int mFramesBehind;
+	AnimFrames mWindow;
+	std::vector<int> mSlotFrames;
+	int mPlayhead;
+	bool mStopping;
+	std::exception_ptr mError;
+
+	std::mutex mMutex;
+	std::condition_variable mWork;
+	std::condition_variable mFrameReady;
+	std::thread mPrefetcher;
+};
+
+#endif
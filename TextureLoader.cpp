@@ -0,0 +1,250 @@
+#include "TextureLoader.h"
+#include "CookedTexture.h"
+#include "ThreadPool.h"
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <utility>
+#include <SOIL.h>
+
+using std::cout;
+using std::endl;
+using std::lock_guard;
+using std::map;
+using std::mutex;
+using std::string;
+using std::vector;
+
+DecodedImage decodeImage(const string &filename, bool invertY) {
+	DecodedImage image;
+	image.filename = filename;
+	image.pixels = SOIL_load_image(filename.c_str(), &image.width, &image.height, &image.channels, SOIL_LOAD_AUTO);
+
+	// Luminance formats are gone from core profiles, so grey images are
+	// loaded again as RGB or RGBA. They are rare enough to decode twice.
+	if(image.pixels && image.channels < 3) {
+		int forced = image.channels == 1 ? SOIL_LOAD_RGB : SOIL_LOAD_RGBA;
+		SOIL_free_image_data(image.pixels);
+		image.pixels = SOIL_load_image(filename.c_str(), &image.width, &image.height, &image.channels, forced);
+		image.channels = forced;
+	}
+
+	if(!image.pixels) {
+		// Not necessarily this image's, if another decode failed meanwhile.
+		image.error = SOIL_last_result();
+		return image;
+	}
+
+	if(invertY) {
+		const size_t rowSize = size_t(image.width) * image.channels;
+		vector<unsigned char> row(rowSize);
+		for(int top = 0, bottom = image.height - 1; top < bottom; ++top, --bottom) {
+			unsigned char *a = image.pixels + top * rowSize;
+			unsigned char *b = image.pixels + bottom * rowSize;
+			memcpy(row.data(), a, rowSize);
+			memcpy(a, b, rowSize);
+			memcpy(b, row.data(), rowSize);
+		}
+	}
+
+	return image;
+}
+
+TextureLoader::TextureLoader(ThreadPool &pool, map<string, GLint> &nameToTexID)
+	: mPool(pool), mNameToTexID(nameToTexID), mUnpackBuffer(0), mUploadedBytes(0), mDecodeSeconds(0) {
+}
+
+TextureLoader::~TextureLoader() {
+	for(auto &pending : mPending) {
+		Prepared prepared = pending.second.get();
+		SOIL_free_image_data(prepared.image.pixels);
+	}
+
+	if(mUnpackBuffer != 0) {
+		glDeleteBuffers(1, &mUnpackBuffer);
+	}
+}
+
+void TextureLoader::request(const string &name, const string &filename) {
+	lock_guard<mutex> lock(mMutex);
+	if(!mRequested.insert(name).second) {
+		return;
+	}
+	if(mPending.empty()) {
+		mFirstRequest = Clock::now();
+	}
+
+	mPending[name] = mPool.submit([this, filename]() {
+		Clock::time_point start = Clock::now();
+		Prepared prepared = prepare(filename);
+		std::chrono::duration<double> taken = Clock::now() - start;
+
+		lock_guard<mutex> lock(mMutex);
+		mDecodeSeconds += taken.count();
+		return prepared;
+	});
+}
+
+TextureLoader::Prepared TextureLoader::prepare(const string &filename) {
+	Prepared prepared;
+	prepared.image.filename = filename;
+	prepared.image.pixels = nullptr;
+
+	// Like the baked assets, a valid cooked file is trusted to match its
+	// image; bones_cook rewrites them together.
+	string cookedFilename = cookedTextureFilename(filename);
+	struct stat info;
+	if(stat(cookedFilename.c_str(), &info) == 0) {
+		try {
+			prepared.cooked.reset(new CookedTexture(cookedFilename));
+			return prepared;
+		}
+		catch(std::exception &e) {
+			cout << "Decoding " << filename << " instead: " << e.what() << endl;
+			prepared.cooked.reset();
+		}
+	}
+
+	prepared.image = decodeImage(filename);
+	return prepared;
+}
+
+bool TextureLoader::busy() const {
+	lock_guard<mutex> lock(mMutex);
+	return !mPending.empty();
+}
+
+vector<string> TextureLoader::uploadReady() {
+	map<string, Prepared> ready;
+	{
+		lock_guard<mutex> lock(mMutex);
+		for(auto pending = mPending.begin(); pending != mPending.end(); ) {
+			if(pending->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				ready[pending->first] = pending->second.get();
+				pending = mPending.erase(pending);
+			} else {
+				++pending;
+			}
+		}
+	}
+
+	vector<string> uploaded;
+	for(auto &prepared : ready) {
+		GLuint texID = prepared.second.cooked ? uploadCooked(*prepared.second.cooked) : upload(prepared.second.image);
+		if(texID != 0) {
+			mNameToTexID[prepared.first] = texID;
+			uploaded.push_back(prepared.first);
+		}
+	}
+
+	if(!ready.empty()) {
+		lock_guard<mutex> lock(mMutex);
+		mLastUpload = Clock::now();
+	}
+	return uploaded;
+}
+
+GLuint TextureLoader::upload(DecodedImage &image, GLuint texID) {
+	if(!image.pixels) {
+		cout << "Error preparing " << image.filename << " as a texture." << endl;
+		cout << image.error << endl;
+		return 0;
+	}
+
+	if(texID == 0) {
+		glGenTextures(1, &texID);
+	}
+
+	const GLenum format = image.channels == 4 ? GL_RGBA : GL_RGB;
+	const size_t size = size_t(image.width) * image.height * image.channels;
+	const GLvoid *source = image.pixels;
+
+	if(GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) {
+		if(mUnpackBuffer == 0) {
+			glGenBuffers(1, &mUnpackBuffer);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mUnpackBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+		void *mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if(mapped) {
+			memcpy(mapped, image.pixels, size);
+		}
+		// The copy is lost if the buffer was corrupted while mapped.
+		if(mapped && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+			source = nullptr;
+		} else {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+
+	// Rows of RGB images are not 4 byte aligned in general.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, texID);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if(source == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// The driver pads RGB texels to 4 bytes.
+	mUploadedBytes += size_t(image.width) * image.height * 4;
+	SOIL_free_image_data(image.pixels);
+	image.pixels = nullptr;
+	return texID;
+}
+
+GLuint TextureLoader::uploadCooked(const CookedTexture &texture, GLuint texID) {
+	if(texID == 0) {
+		glGenTextures(1, &texID);
+	}
+	glBindTexture(GL_TEXTURE_2D, texID);
+
+	const bool compressed = GLEW_EXT_texture_compression_s3tc != 0;
+	const GLenum format = texture.format() == CookedTexture::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+																 : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	vector<unsigned char> rgba;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for(int level = 0; level < texture.numLevels(); ++level) {
+		const int width = texture.levelWidth(level);
+		const int height = texture.levelHeight(level);
+
+		if(compressed) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0,
+								   texture.levelSize(level), texture.levelData(level));
+			mUploadedBytes += texture.levelSize(level);
+		} else {
+			texture.decodeLevel(level, rgba);
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+			mUploadedBytes += rgba.size();
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.numLevels() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texID;
+}
+
+double TextureLoader::decodeSeconds() const {
+	lock_guard<mutex> lock(mMutex);
+	return mDecodeSeconds;
+}
+
+double TextureLoader::elapsedSeconds() const {
+	lock_guard<mutex> lock(mMutex);
+	std::chrono::duration<double> elapsed = mLastUpload - mFirstRequest;
+	return elapsed.count();
+}
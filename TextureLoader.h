@@ -0,0 +1,104 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class CookedTexture;
+class ThreadPool;
+
+// An image decoded into memory, waiting for the GL thread to upload it.
+struct DecodedImage {
+	std::string filename;
+	// Allocated by SOIL. nullptr when decoding failed, and error says why.
+	unsigned char *pixels;
+	int width;
+	int height;
+	// 3 or 4. Grey images are widened so every upload takes the same path.
+	int channels;
+	std::string error;
+};
+
+// invertY flips the rows. Decodes may run on several threads at once, but
+// SOIL keeps its last error in one process wide string, so when two of them
+// fail together error can describe the other image's failure.
+DecodedImage decodeImage(const std::string &filename, bool invertY = false);
+
+// Decodes textures on a ThreadPool and uploads them from the GL thread.
+//
+// Each finished image is copied into a pixel buffer object and glTexImage2D
+// reads it from there, so the transfer to the texture is left to the driver
+// instead of stalling the GL thread. The buffer is orphaned before each copy
+// and reused. Without PBO support the pixels are passed directly.
+//
+// When bones_cook has left a cooked texture next to the image, the pool maps
+// that instead and its compressed mip levels are uploaded as they are.
+// Nothing is decoded then.
+//
+// Uploaded textures are entered into the name to texture map the loader was
+// given. A name is decoded once however often it is requested.
+class TextureLoader {
+public:
+	TextureLoader(ThreadPool &pool, std::map<std::string, GLint> &nameToTexID);
+	~TextureLoader();
+
+	// Any thread. Queues filename for decoding under name.
+	void request(const std::string &name, const std::string &filename);
+	// True while requested textures have not been uploaded yet.
+	bool busy() const;
+
+	// GL thread. Uploads every texture whose decode has finished and returns
+	// their names. Images that failed to decode are reported and left out.
+	std::vector<std::string> uploadReady();
+
+	// GL thread. Uploads image into texID, or a new texture when texID is 0,
+	// and frees its pixels. Returns 0 when the image failed to decode.
+	GLuint upload(DecodedImage &image, GLuint texID = 0);
+	// GL thread. Uploads every level of texture, compressed when the driver
+	// takes S3TC and expanded to RGBA otherwise.
+	GLuint uploadCooked(const CookedTexture &texture, GLuint texID = 0);
+
+	// Decode time summed over the pool threads, and the time from the first
+	// request to the last upload. Their ratio is the gain from the pool.
+	double decodeSeconds() const;
+	double elapsedSeconds() const;
+	// Bytes of texture memory the uploads asked for, mip levels included.
+	size_t uploadedBytes() const { return mUploadedBytes; }
+private:
+	TextureLoader(const TextureLoader &);
+	TextureLoader &operator=(const TextureLoader &);
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// What the pool hands back: a cooked texture, or the decoded image.
+	struct Prepared {
+		std::unique_ptr<CookedTexture> cooked;
+		DecodedImage image;
+	};
+
+	static Prepared prepare(const std::string &filename);
+
+	ThreadPool &mPool;
+	// Only touched on the GL thread.
+	std::map<std::string, GLint> &mNameToTexID;
+	GLuint mUnpackBuffer;
+	size_t mUploadedBytes;
+
+	// Guarded by mMutex.
+	mutable std::mutex mMutex;
+	std::set<std::string> mRequested;
+	std::map<std::string, std::future<Prepared>> mPending;
+	double mDecodeSeconds;
+	Clock::time_point mFirstRequest;
+	Clock::time_point mLastUpload;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using std::atomic;
+using std::exception_ptr;
+using std::function;
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+
+// Which pool the current thread works for, and its deque there.
+thread_local const ThreadPool *tlPool = nullptr;
+thread_local int tlWorkerIndex = -1;
+
+}
+
+ThreadPool::ThreadPool(unsigned numThreads)
+	: mPending(0), mStopping(false) {
+	if(numThreads == 0) {
+		numThreads = std::max(1u, thread::hardware_concurrency());
+	}
+
+	// Every queue exists before any worker can steal from it.
+	for(unsigned i = 0; i <= numThreads; ++i) {
+		mQueues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+	}
+	for(unsigned i = 0; i < numThreads; ++i) {
+		mWorkers.push_back(thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+
+	for(auto &worker : mWorkers) {
+		worker.join();
+	}
+}
+
+unsigned ThreadPool::size() const {
+	return mWorkers.size();
+}
+
+int ThreadPool::workerIndex() const {
+	return tlPool == this ? tlWorkerIndex : -1;
+}
+
+void ThreadPool::enqueue(function<void()> task) {
+	const int self = workerIndex();
+	TaskQueue &queue = *mQueues[self < 0 ? mWorkers.size() : self];
+	{
+		lock_guard<mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	++mPending;
+
+	// Sleepers test mPending under mMutex, so taking it here means none of
+	// them can miss the wake up.
+	{
+		lock_guard<mutex> lock(mMutex);
+	}
+	mCondition.notify_one();
+}
+
+bool ThreadPool::takeTask(int self, function<void()> &task) {
+	const int numQueues = mQueues.size();
+	const int shared = numQueues - 1;
+
+	// Own deque newest first, then the shared deque, then the other workers'
+	// oldest tasks, starting with the next worker along.
+	if(self >= 0) {
+		TaskQueue &own = *mQueues[self];
+		lock_guard<mutex> lock(own.mutex);
+		if(!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--mPending;
+			return true;
+		}
+	}
+
+	for(int i = 0; i < numQueues; ++i) {
+		const int victim = self < 0 ? (shared + i) % numQueues : (i == 0 ? shared : (self + i) % shared);
+		if(victim == self) {
+			continue;
+		}
+
+		TaskQueue &queue = *mQueues[victim];
+		lock_guard<mutex> lock(queue.mutex);
+		if(!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			--mPending;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+	tlPool = this;
+	tlWorkerIndex = index;
+
+	for(;;) {
+		function<void()> task;
+		if(takeTask(index, task)) {
+			task();
+			continue;
+		}
+
+		unique_lock<mutex> lock(mMutex);
+		mCondition.wait(lock, [this]() { return mStopping || mPending > 0; });
+
+		if(mStopping && mPending == 0) {
+			// Only reached when stopping with nothing left to run.
+			return;
+		}
+	}
+}
+
+void ThreadPool::runUntil(const function<bool()> &done) {
+	const int self = workerIndex();
+
+	while(!done()) {
+		function<void()> task;
+		if(takeTask(self, task)) {
+			task();
+			continue;
+		}
+
+		unique_lock<mutex> lock(mMutex);
+		mCondition.wait(lock, [&]() { return mPending > 0 || done(); });
+	}
+}
+
+void ThreadPool::wakeWaiters() {
+	{
+		lock_guard<mutex> lock(mMutex);
+	}
+	mCondition.notify_all();
+}
+
+namespace {
+
+struct ParallelForState {
+	atomic<int> next;
+	atomic<int> done;
+	int count;
+	exception_ptr error;
+	function<void(int)> fn;
+	mutex errorMutex;
+
+	// Claims indices until there are none left. Returns true if this call
+	// finished the last one.
+	bool run() {
+		int finished = 0;
+
+		for(int i = next++; i < count; i = next++) {
+			try {
+				fn(i);
+			} catch(...) {
+				lock_guard<mutex> lock(errorMutex);
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
+			++finished;
+		}
+
+		return finished > 0 && (done += finished) == count;
+	}
+};
+
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)> &fn) {
+	if(count <= 0) {
+		return;
+	}
+
+	// Helpers may still be queued after the loop finishes, so they share
+	// ownership of the state instead of pointing into this stack frame.
+	auto state = make_shared<ParallelForState>();
+	state->next = 0;
+	state->done = 0;
+	state->count = count;
+	state->fn = fn;
+
+	int helpers = std::min<int>(count - 1, mWorkers.size());
+	for(int i = 0; i < helpers; ++i) {
+		enqueue([this, state]() {
+			if(state->run()) {
+				wakeWaiters();
+			}
+		});
+	}
+
+	state->run();
+	runUntil([&state]() { return state->done == state->count; });
+
+	if(state->error) {
+		std::rethrow_exception(state->error);
+	}
+}
+
+TaskGraph::TaskGraph() : mUnfinished(0), mFailed(false) {
+}
+
+int TaskGraph::add(function<void()> fn, const vector<int> &dependencies) {
+	const int id = mNodes.size();
+	Node node = {std::move(fn), vector<int>(), static_cast<int>(dependencies.size())};
+
+	for(int dependency : dependencies) {
+		if(dependency < 0 || dependency >= id) {
+			throw std::runtime_error("Task " + std::to_string(id) + " depends on a task that has not been added.");
+		}
+	}
+	mNodes.push_back(std::move(node));
+	for(int dependency : dependencies) {
+		mNodes[dependency].successors.push_back(id);
+	}
+	// Reallocated at the next run.
+	mWaitingFor.reset();
+
+	return id;
+}
+
+void TaskGraph::clear() {
+	mNodes.clear();
+	mWaitingFor.reset();
+}
+
+void TaskGraph::queue(ThreadPool &pool, int node) {
+	pool.enqueue([this, &pool, node]() { runNode(pool, node); });
+}
+
+void TaskGraph::runNode(ThreadPool &pool, int node) {
+	if(!mFailed) {
+		try {
+			mNodes[node].fn();
+		} catch(...) {
+			lock_guard<mutex> lock(mErrorMutex);
+			if(!mError) {
+				mError = std::current_exception();
+			}
+			mFailed = true;
+		}
+	}
+
+	for(int successor : mNodes[node].successors) {
+		if(--mWaitingFor[successor] == 0) {
+			queue(pool, successor);
+		}
+	}
+
+	// run() may return as soon as this reaches 0, so nothing of the graph is
+	// touched after it.
+	if(--mUnfinished == 0) {
+		pool.wakeWaiters();
+	}
+}
+
+void TaskGraph::run(ThreadPool &pool) {
+	const int numNodes = mNodes.size();
+	if(numNodes == 0) {
+		return;
+	}
+
+	if(!mWaitingFor) {
+		mWaitingFor.reset(new atomic<int>[numNodes]);
+	}
+	for(int i = 0; i < numNodes; ++i) {
+		mWaitingFor[i] = mNodes[i].numDependencies;
+	}
+	mUnfinished = numNodes;
+	mFailed = false;
+	mError = nullptr;
+
+	for(int i = 0; i < numNodes; ++i) {
+		if(mNodes[i].numDependencies == 0) {
+			queue(pool, i);
+		}
+	}
+	pool.runUntil([this]() { return mUnfinished == 0; });
+
+	if(mError) {
+		std::rethrow_exception(mError);
+	}
+}
@@ -0,0 +1,130 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that share work by stealing.
+//
+// Each worker owns a deque. Tasks queued from a worker go on the back of its
+// own deque and it takes them back from there, newest first, so a task's
+// follow-up work tends to run on the same core while its data is still in
+// cache. Tasks queued from other threads go on a shared deque. A worker with
+// nothing of its own takes from the shared deque, then steals the oldest
+// task of another worker.
+class ThreadPool {
+public:
+	// 0 picks one worker per hardware thread.
+	explicit ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+
+	unsigned size() const;
+
+	template<typename F>
+	std::future<typename std::result_of<F()>::type> submit(F task);
+
+	// Runs fn(i) for every i in [0, count) and returns once all calls are done.
+	// The calling thread works through indices too, so this is safe to call
+	// from inside a pool task. The first exception thrown by fn is rethrown.
+	void parallelFor(int count, const std::function<void(int)> &fn);
+
+	// Runs queued tasks on the calling thread until done() returns true,
+	// sleeping while there are none. Whoever makes done() true must call
+	// wakeWaiters() afterwards.
+	void runUntil(const std::function<bool()> &done);
+	void wakeWaiters();
+private:
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void enqueue(std::function<void()> task);
+	// The calling thread's own deque, or -1 outside this pool's workers.
+	int workerIndex() const;
+	bool takeTask(int self, std::function<void()> &task);
+	void workerLoop(int index);
+private:
+	std::vector<std::thread> mWorkers;
+	// One per worker, then the shared one.
+	std::vector<std::unique_ptr<TaskQueue>> mQueues;
+	// Tasks queued and not yet taken.
+	std::atomic<int> mPending;
+	// Sleeping workers and runUntil callers wait on mCondition.
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping;
+
+	friend class TaskGraph;
+};
+
+template<typename F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F task) {
+	typedef typename std::result_of<F()>::type Result;
+
+	// std::function needs a copyable target, so the packaged_task is shared.
+	auto packaged = std::make_shared<std::packaged_task<Result()>>(task);
+	std::future<Result> result = packaged->get_future();
+
+	enqueue([packaged]() { (*packaged)(); });
+
+	return result;
+}
+
+// Tasks and the order they must run in, built once and run on a pool as
+// often as needed, e.g. once per frame.
+//
+// A task is queued the moment the last task it depends on finishes, on the
+// worker that finished it, so a chain of dependent tasks usually stays on one
+// thread while independent chains spread across the pool.
+class TaskGraph {
+public:
+	TaskGraph();
+
+	// Returns the task's id. Dependencies must already have been added, so a
+	// graph cannot have cycles.
+	int add(std::function<void()> fn, const std::vector<int> &dependencies = std::vector<int>());
+
+	int size() const { return mNodes.size(); }
+	void clear();
+
+	// Runs every task once and returns when they have all finished. The
+	// calling thread runs tasks too. If a task throws, the tasks that have
+	// not started yet are skipped and the first exception is rethrown. A
+	// graph runs on one thread at a time.
+	void run(ThreadPool &pool);
+private:
+	TaskGraph(const TaskGraph &);
+	TaskGraph &operator=(const TaskGraph &);
+
+	struct Node {
+		std::function<void()> fn;
+		std::vector<int> successors;
+		int numDependencies;
+	};
+
+	void queue(ThreadPool &pool, int node);
+	void runNode(ThreadPool &pool, int node);
+
+	std::vector<Node> mNodes;
+
+	// State of the current run.
+	std::unique_ptr<std::atomic<int>[]> mWaitingFor;
+	std::atomic<int> mUnfinished;
+	std::atomic<bool> mFailed;
+	std::exception_ptr mError;
+	std::mutex mErrorMutex;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Hands the latest value from one writer thread to one reader thread without
+// either of them waiting.
+//
+// There are three slots. The writer fills its back slot and publishes it by
+// swapping it with the middle one; the reader takes the middle slot by
+// swapping it with its front one. Each swap is a single atomic exchange of
+// the middle index, so neither side ever holds a lock or sees a half written
+// value. The writer can publish faster than the reader reads; values in
+// between are dropped, never queued.
+template<typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : mMiddle(1), mFront(0), mBack(2) {
+	}
+
+	// Writer thread. Fill back(), then publish() it.
+	T &back() { return mSlots[mBack]; }
+	void publish() {
+		mBack = mMiddle.exchange(mBack | kFresh, std::memory_order_acq_rel) & kIndexMask;
+	}
+
+	// Reader thread. Moves to the latest published value, if there is a new
+	// one, and returns whether it did. front() stays valid and unchanged
+	// until the next call.
+	bool update() {
+		if(!(mMiddle.load(std::memory_order_relaxed) & kFresh)) {
+			return false;
+		}
+		mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & kIndexMask;
+		return true;
+	}
+	const T &front() const { return mSlots[mFront]; }
+
+	// Sets every slot, e.g. to size them. Only while neither thread is using
+	// the buffer.
+	void fill(const T &value) {
+		for(T &slot : mSlots) {
+			slot = value;
+		}
+	}
+private:
+	TripleBuffer(const TripleBuffer &);
+	TripleBuffer &operator=(const TripleBuffer &);
+
+	// The middle index carries a flag for "published and not yet read".
+	static const int kIndexMask = 3;
+	static const int kFresh = 4;
+
+	T mSlots[3];
+	std::atomic<int> mMiddle;
+	int mFront;
+	int mBack;
+};
+
+#endif
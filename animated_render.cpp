@@ -5,31 +5,52 @@
 	#include <GL/freeglut.h>
 #endif
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <SOIL.h>
 
+#include "AnimationThread.h"
+#include "BakedAsset.h"
+#include "Culling.h"
+#include "FileWatcher.h"
 #include "MD5_MeshReader.h"
 #include "MD5_AnimReader.h"
+#include "MeshStreams.h"
+#include "PoseEvaluator.h"
+#include "QuantizedAnim.h"
+#include "ReducedAnim.h"
 #include "Shader.h"
+#include "StreamingAnim.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "TripleBuffer.h"
 
 #define MAX_JOINTS 64
 
 using std::map;
+using std::set;
 using std::unique_ptr;
 using std::cout;
 using std::endl;
 using std::make_pair;
 using std::for_each;
+using std::future;
 using std::string;
 using std::vector;
 
@@ -39,16 +60,9 @@ using glm::mat4;
 using glm::quat;
 
 // Structures / Classes
-struct Vertex {
-	vec3 position;
-	vec4 indices;
-	vec4 weights;
-};
-
 typedef vector<mat4> CurrentPose;
 
 struct Mesh {
-	vector<Vertex> vertices;
 	vector<GLushort> indices;
 	
 	// Used to calculate VBO data
@@ -63,10 +77,28 @@ struct Mesh {
 	GLuint hIndexBuffer;
 	GLuint hTextureCoordsBuffer;
 	GLuint texID;
+	string textureFilename;
+};
+
+// Everything initModel needs that can be prepared without a GL context.
+struct ModelData {
+	vector<MeshStreams> meshStreams;
+	vector<string> textureFilenames;
+	vector<mat4> inverseBindPose;
 };
 
 // GLOBALS
+const string kMeshFilename("Boblamp/boblampclean.md5mesh");
+const string kAnimFilename("Boblamp/boblampclean.md5anim");
+const string kBakedFilename("Boblamp/boblampclean.bones");
+// TODO: Prepare textures in a neutral manner, i.e. not for just Boblamp
+const string kTextureDirectory("Boblamp/");
+BakedAsset gBakedAsset;
+bool gUseBakedAsset = false;
+
 map<string, GLint> gNameToTexID;
+// Fills gNameToTexID. Never deleted, like the shaders.
+TextureLoader *gpTextureLoader;
 
 mat4 gModel;
 mat4 gView;
@@ -77,11 +109,49 @@ vector<mat4> gMatrixPalette;
 
 unsigned int gCurrentFrame = 0;
 MD5_AnimInfo gAnimInfo;
+PoseEvaluator gPoseEvaluator;
+// Recompute only the joints that moved since the last frame.
+bool gUseLazyPose = false;
+LazyPoseEvaluator gLazyPoseEvaluator;
+QuantizedAnim gQuantizedAnim;
+bool gUseQuantizedAnim = false;
+bool gUseReducedAnim = false;
+const float kReducedPositionTolerance = 0.01f;
+const float kReducedRotationTolerance = 0.001f;
+ReducedAnim gReducedAnim;
+unique_ptr<ReducedAnimSampler> gpReducedSampler;
+bool gUseStreamingAnim = false;
+unique_ptr<StreamingAnim> gpStreamingAnim;
 GLuint ghSkeletonPositionBuffer;
 
 vector<Mesh> gMeshes;
 CurrentPose gCurrentPose;
 
+// The load pool stays up and runs each frame's character work: the pose,
+// then the palette built from it.
+ThreadPool *gpJobPool;
+TaskGraph gCharacterTasks;
+
+// What the animation thread hands the render thread after each step. Off
+// screen the pose and palette are not rebuilt and hold whatever the slot
+// last had.
+struct CharacterFrame {
+	unsigned int frame;
+	bool visible;
+	CurrentPose pose;
+	vector<mat4> palette;
+};
+
+// Steps the clip at its own frame rate. While it runs, gCurrentFrame,
+// gCurrentPose and gMatrixPalette belong to it; rendering reads the copies
+// in gCharacterFrames.front() instead.
+AnimationThread gAnimationThread;
+TripleBuffer<CharacterFrame> gCharacterFrames;
+const int kRedrawPeriod = 16;
+// Set once by initCamera, before the animation thread starts, so that
+// thread reads it without a lock.
+Frustum gViewFrustum;
+
 // Shaders
 Shader *gpShader;
 Shader *gpSkeletonShader;
@@ -94,63 +164,25 @@ GLuint ghTestIndices;
 GLuint ghTexID;
 
 void computeCurrentPose() {
-	vector<float> &frameData= gAnimInfo.framesData[gCurrentFrame];
-	unsigned int numJoints = gAnimInfo.baseframeJoints.size();
-
-	for(int i = 0; i < numJoints; ++i) {
-		const BaseframeJoint &baseframeJoint = gAnimInfo.baseframeJoints[i];
-		const JointInfo &jointInfo = gAnimInfo.jointsInfo[i];
-
-		// Start with the default settings from basejoint
-		vec3 position = baseframeJoint.position;
-		quat orientation = baseframeJoint.orientation;
-
-		// Start replacing with specific frame data
-		int flags = jointInfo.flags;
-		int offset = jointInfo.startIndex;
-
-		if(flags & (1 << 0)) {
-			position.x = frameData[offset++];
-		}
-		if(flags & (1 << 1)) {
-			position.y = frameData[offset++];
-		}
-		if(flags & (1 << 2)) {
-			position.z = frameData[offset++];
-		}
-		if(flags & (1 << 3)) {
-			orientation.x = frameData[offset++];
-		}
-		if(flags & (1 << 4)) {
-			orientation.y = frameData[offset++];
-		}
-		if(flags & (1 << 5)) {
-			orientation.z = frameData[offset++];
-		}
-
-		// Compute the w-component of the quaternion
-		float temp = 1 - orientation.x * orientation.x
-					   - orientation.y * orientation.y
-					   - orientation.z * orientation.z;
-		if(temp < 0) {
-			orientation.w = 0;
-		} else {
-			orientation.w = -1 * sqrtf(temp);
-		}
-
-		mat4 transM = glm::translate(mat4(), position);
-		mat4 rotM = glm::mat4_cast(orientation);
-		mat4 combinedM = transM * rotM;
-
-		// Convert this point to model space
-		if(jointInfo.parent > -1) {			
-			mat4 parentM = gCurrentPose[jointInfo.parent];
-			combinedM = parentM * combinedM;
-		}
+	if(gpStreamingAnim) {
+		gpStreamingAnim->samplePose(gCurrentFrame, gCurrentPose);
+		return;
+	}
+	if(gUseQuantizedAnim) {
+		gQuantizedAnim.samplePose(gCurrentFrame, gCurrentPose);
+		return;
+	}
+	if(gpReducedSampler) {
+		gpReducedSampler->samplePose(gCurrentFrame, gCurrentPose);
+		return;
+	}
 
-		gCurrentPose[i] = combinedM;
-		//cout << jointInfo.name << " " << combinedM[3][0] << ", " << combinedM[3][1] << ", " << combinedM[3][2] << endl;
+	if(gUseLazyPose) {
+		gCurrentPose = gLazyPoseEvaluator.evaluate(gAnimInfo.framesData, gCurrentFrame);
+		return;
 	}
+
+	gPoseEvaluator.evaluate(gAnimInfo.framesData, gCurrentFrame, gCurrentPose);
 }
 
 void initTestMesh() {
@@ -189,107 +221,147 @@ void initTestMesh() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices) * sizeof(GLushort), indices, GL_STATIC_DRAW);
 }
 
-void initModel() {
-	MD5_MeshReader parser;
-	MD5_MeshInfo meshInfo = parser.parse("Boblamp/boblampclean.md5mesh");
+// Cooked by bones_cook. Used instead of the text files when it is present and valid.
+bool openBakedAsset() {
+	try {
+		gBakedAsset.open(kBakedFilename);
+		return gBakedAsset.hasMesh() && gBakedAsset.hasAnim();
+	}
+	catch(std::exception &e) {
+		cout << "Parsing the MD5 files instead of " << kBakedFilename << ": " << e.what() << endl;
+		return false;
+	}
+}
 
-	// Process each mesh found in the md5mesh file
-	for(auto meshIter = meshInfo.meshes.cbegin(); meshIter != meshInfo.meshes.cend(); ++meshIter) {
-		const MD5_Mesh &md5mesh = *meshIter;
-		Mesh mesh;
+// Runs on the load pool. Each texture starts decoding as soon as its name is
+// known.
+ModelData loadModelData(TextureLoader &textureLoader) {
+	ModelData data;
+	MD5_MeshInfo meshInfo;
 
-		// Prepare the vertices
-		for(auto vertIter = md5mesh.vertices.cbegin(); vertIter != md5mesh.vertices.cend(); ++vertIter) {
-			const MD5_Vertex &md5vertex = *vertIter;
-			vec3 finalPos(0);
-			Vertex vert;
-			vert.weights = vec4(0);
-			vert.indices = vec4(0);
-
-			for(int i = 0; i < md5vertex.weightCount; ++i) {
-				const MD5_Weight &weight = md5mesh.weights[md5vertex.startWeight + i];
-				const Joint &joint = meshInfo.joints[weight.jointIndex];
-
-				// Convert joint-space position to model space position using.
-				// TranslationMatrix * RotationMatrix * jointLocalPoint
-				vec3 tempPos = tempPos = joint.orientation * weight.position + joint.position;				
-				finalPos += tempPos * weight.weightBias;
-
-				vert.indices[i] = weight.jointIndex;
-				vert.weights[i] = weight.weightBias;
-
-				mesh.jointIndices.push_back(weight.jointIndex);
-				mesh.jointWeights.push_back(weight.weightBias);
-				//mesh.jointWeights.push_back(0);
-			}
-			
-			// WE NEED 4 ENTRIES; RIGHT NOW I ONLY HAVE WEIGHTCOUNT ENTRIES
-			for(int i = md5vertex.weightCount; i < 4; ++i) {
-				mesh.jointIndices.push_back(-1);
-				mesh.jointWeights.push_back(0.0f);
-			}
+	if(gUseBakedAsset) {
+		for(int i = 0; i < gBakedAsset.numMeshes(); ++i) {
+			data.textureFilenames.push_back(gBakedAsset.textureFilename(i));
+		}
+	} else {
+		MD5_MeshReader parser;
+		meshInfo = parser.parseMapped(kMeshFilename);
 
-			vert.position = finalPos;	
-			
-			mesh.vertices.push_back(vert);
-			mesh.positions.push_back(vert.position.x);
-			mesh.positions.push_back(vert.position.y);
-			mesh.positions.push_back(vert.position.z);
+		for(const MD5_Mesh &md5mesh : meshInfo.meshes) {
+			data.textureFilenames.push_back(md5mesh.textureFilename);
+		}
+	}
 
-			mesh.textureCoords.push_back(md5vertex.u);
-			mesh.textureCoords.push_back(md5vertex.v);
+	for(const string &textureFilename : data.textureFilenames) {
+		textureLoader.request(textureFilename, kTextureDirectory + textureFilename);
+	}
+
+	if(gUseBakedAsset) {
+		for(int i = 0; i < gBakedAsset.numMeshes(); ++i) {
+			data.meshStreams.push_back(gBakedAsset.meshStreams(i));
 		}
-		
-		// Set up the triangle indices
-		for(int i = 0; i < md5mesh.triangles.size(); ++i) {
-			const MD5_Triangle &triangle = md5mesh.triangles[i];
-			mesh.indices.push_back(triangle.indices[0]);
-			mesh.indices.push_back(triangle.indices[1]);
-			mesh.indices.push_back(triangle.indices[2]);
+		data.inverseBindPose = gBakedAsset.inverseBindPose();
+	} else {
+		for(const MD5_Mesh &md5mesh : meshInfo.meshes) {
+			data.meshStreams.push_back(buildMeshStreams(md5mesh, meshInfo.joints));
 		}
 
-		// Prepare the texutre, if necessary
-		GLuint texID = 0;
+		// Set up the inverse bind pose matrix for each joint
+		data.inverseBindPose = buildInverseBindPose(meshInfo.joints);
+	}
 
-		if(gNameToTexID.find(md5mesh.textureFilename) == gNameToTexID.end()) {
+	return data;
+}
 
-			// TODO: Prepare this in a neutral manner, i.e. not for just Boblamp
-			string fullname = "Boblamp/" + md5mesh.textureFilename;
-			texID = SOIL_load_OGL_texture(fullname.c_str(), SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, 0);
-			if(texID == 0) {
-				cout << "Error preparing " << fullname << " as a texture." << endl;
-				cout << SOIL_last_result() << endl;
-			} else {
-				gNameToTexID.insert(make_pair(md5mesh.textureFilename, texID));
-			}
+// Runs on the load pool. A streamed clip only returns what comes before the
+// frames; computeCurrentPose reads them from gpStreamingAnim.
+MD5_AnimInfo loadAnimInfo(ThreadPool &pool) {
+	if(gUseStreamingAnim) {
+		gpStreamingAnim.reset(new StreamingAnim(kAnimFilename));
+		return gpStreamingAnim->info();
+	}
+	if(gUseBakedAsset) {
+		return gBakedAsset.animInfo();
+	}
+
+	MD5_AnimReader reader;
+	return reader.parseMapped(kAnimFilename, &pool);
+}
+
+// Points every mesh using textureFilename at texID.
+void setMeshTexture(const string &textureFilename, GLuint texID) {
+	gNameToTexID[textureFilename] = texID;
+
+	for(Mesh &mesh : gMeshes) {
+		if(mesh.textureFilename == textureFilename) {
+			mesh.texID = texID;
 		}
+	}
+}
 
-		mesh.texID = texID;
+void initModel(ModelData &data) {
+	gIBPMatrices.swap(data.inverseBindPose);
 
-		gMeshes.push_back(mesh);
-	};
+	// Process each mesh found in the md5mesh file
+	for(int i = 0; i < data.meshStreams.size(); ++i) {
+		MeshStreams &streams = data.meshStreams[i];
+		Mesh mesh;
 
-	// Set up the inverse bind pose matrix for each joint
-	for(int i = 0; i < meshInfo.joints.size(); ++i) {
-		const Joint &joint = meshInfo.joints[i];
+		mesh.positions.swap(streams.positions);
+		mesh.jointIndices.swap(streams.jointIndices);
+		mesh.jointWeights.swap(streams.jointWeights);
+		mesh.textureCoords.swap(streams.textureCoords);
+		mesh.indices.swap(streams.indices);
+		mesh.textureFilename = data.textureFilenames[i];
 
-		// rotM and transM are model space transformation matrices. 
-		// Combine then invert them to construct the inverse bind pose matrix for each joint.
-		mat4 rotM = glm::mat4_cast(joint.orientation);
-		mat4 transM = glm::translate(mat4(), joint.position);
-		mat4 combinedM = transM * rotM;
-		mat4 InvBindPosM = glm::inverse(combinedM);
-		gIBPMatrices.push_back(InvBindPosM);
-	}
+		// The texture may not be uploaded yet; setMeshTexture fills it in then.
+		auto texIter = gNameToTexID.find(mesh.textureFilename);
+		mesh.texID = texIter == gNameToTexID.end() ? 0 : texIter->second;
+
+		gMeshes.push_back(mesh);
+	};
 
 	// We can also initialize the skinning palette to have the required number of joints.
-	gMatrixPalette.resize(meshInfo.joints.size());
+	gMatrixPalette.resize(gIBPMatrices.size());
 }
 
 void initAnimations() {
-	MD5_AnimReader reader;
-	gAnimInfo = reader.parse("Boblamp/boblampclean.md5anim");
 	gCurrentPose.resize(gAnimInfo.baseframeJoints.size());
+
+	if(gpStreamingAnim) {
+		cout << "Streaming animation: " << gpStreamingAnim->windowFrames() << " frame window, "
+			 << gpStreamingAnim->residentBytes() << " bytes resident." << endl;
+		return;
+	}
+
+	gPoseEvaluator = PoseEvaluator(gAnimInfo);
+	cout << "Pose kernel: " << PoseEvaluator::kernelName(gPoseEvaluator.kernel()) << endl;
+
+	if(gUseLazyPose) {
+		gLazyPoseEvaluator = LazyPoseEvaluator(gAnimInfo);
+		cout << "Lazy pose: " << gLazyPoseEvaluator.numConstantJoints() << " of " << gLazyPoseEvaluator.numJoints()
+			 << " joints constant, " << gLazyPoseEvaluator.numConstantChannels() << " channels folded." << endl;
+	}
+
+	if(gUseQuantizedAnim) {
+		gQuantizedAnim = QuantizedAnim(gAnimInfo);
+		cout << "Quantized animation: " << gQuantizedAnim.sizeInBytes() << " bytes, float frames: "
+			 << gAnimInfo.framesData.sizeInBytes() << " bytes." << endl;
+		gQuantizedAnim.printErrorReport(cout);
+	}
+
+	if(gUseReducedAnim) {
+		gReducedAnim = ReducedAnim(gAnimInfo, kReducedPositionTolerance, kReducedRotationTolerance);
+		gpReducedSampler.reset(new ReducedAnimSampler(gReducedAnim));
+		cout << "Reduced animation: " << gReducedAnim.numPositionKeys() << " position keys, "
+			 << gReducedAnim.numRotationKeys() << " rotation keys, " << gReducedAnim.sizeInBytes() << " bytes." << endl;
+	}
+}
+
+template<typename T>
+void uploadBuffer(GLenum target, GLuint buffer, const vector<T> &data) {
+	glBindBuffer(target, buffer);
+	glBufferData(target, data.size() * sizeof(T), &data[0], GL_STATIC_DRAW);
 }
 
 void initModelRenderData() {
@@ -298,33 +370,23 @@ void initModelRenderData() {
 
 		// positions
 		glGenBuffers(1, &mesh.hPositionBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.hPositionBuffer);
-		GLsizei bufferSize = mesh.positions.size() * sizeof(GLfloat);
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, &mesh.positions[0], GL_STATIC_DRAW);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hPositionBuffer, mesh.positions);
 
 		// joint indices
 		glGenBuffers(1, &mesh.hJointIndexBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.hJointIndexBuffer);
-		bufferSize = mesh.jointIndices.size() * sizeof(int);
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, &mesh.jointIndices[0], GL_STATIC_DRAW);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hJointIndexBuffer, mesh.jointIndices);
 
 		// joint weights
 		glGenBuffers(1, &mesh.hJointWeightBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.hJointWeightBuffer);
-		bufferSize = mesh.jointWeights.size() * sizeof(GLfloat);
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, &mesh.jointWeights[0], GL_STATIC_DRAW);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hJointWeightBuffer, mesh.jointWeights);
 
 		// texture coordinates
 		glGenBuffers(1, &mesh.hTextureCoordsBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.hTextureCoordsBuffer);
-		bufferSize = mesh.textureCoords.size() * sizeof(GLfloat);
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, &mesh.textureCoords[0], GL_STATIC_DRAW);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hTextureCoordsBuffer, mesh.textureCoords);
 		
 		// triangle indices
 		glGenBuffers(1, &mesh.hIndexBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.hIndexBuffer);
-		bufferSize = mesh.indices.size() * sizeof(GLushort);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, bufferSize, &mesh.indices[0], GL_STATIC_DRAW);
+		uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.hIndexBuffer, mesh.indices);
 	}
 }
 
@@ -368,8 +430,9 @@ void renderMeshes() {
 	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(MVP));
 
 	std::stringstream name;
+	const vector<mat4> &palette = gCharacterFrames.front().palette;
 
-	for(int i = 0; i < gMatrixPalette.size(); ++i) {
+	for(int i = 0; i < palette.size(); ++i) {
 		name.str("");
 		name.clear();
 		name << "MatrixPalette[" << i << "]";
@@ -377,7 +440,7 @@ void renderMeshes() {
 		if(location == -1) {
 			cout << name.str() << " did not correspond to a valid uniform location." << endl;
 		} else {
-			glUniformMatrix4fv(location, 1, false, glm::value_ptr(gMatrixPalette[i]));
+			glUniformMatrix4fv(location, 1, false, glm::value_ptr(palette[i]));
 		}
 	}
 
@@ -427,12 +490,13 @@ void renderMeshes() {
 
 void renderSkeleton() {
 	vector<GLfloat> vertices;
+	const CurrentPose &pose = gCharacterFrames.front().pose;
 
 	for(int i = 0; i < gAnimInfo.jointsInfo.size(); ++i) {
 		const JointInfo &jointInfo = gAnimInfo.jointsInfo[i];
 		if(jointInfo.parent > 1) {
-			mat4 transformM = gCurrentPose[i];
-			mat4 parentTransformM = gCurrentPose[jointInfo.parent];
+			mat4 transformM = pose[i];
+			mat4 parentTransformM = pose[jointInfo.parent];
 			
 			vertices.push_back(transformM[3][0]);
 			vertices.push_back(transformM[3][1]);
@@ -460,7 +524,8 @@ void renderSkeleton() {
 }
 
 void updateMatrixPalette() {
-	const int numJoints = gCurrentPose.size();
+	// A reload can briefly pair a mesh and a clip with different skeletons.
+	const int numJoints = std::min(gCurrentPose.size(), gIBPMatrices.size());
 
 	for(int i = 0 ; i < numJoints; ++i) {
 		mat4 &IBP = gIBPMatrices[i];
@@ -470,16 +535,71 @@ void updateMatrixPalette() {
 	}
 }
 
+void initCharacterTasks() {
+	int pose = gCharacterTasks.add(computeCurrentPose);
+	gCharacterTasks.add(updateMatrixPalette, {pose});
+}
+
+// Poses the character and rebuilds its palette on the job pool.
+void updateCharacter() {
+	gCharacterTasks.run(*gpJobPool);
+}
+
+// Tests the clip's bounds at the frame against the view frustum. An
+// off-screen character skips its pose, its palette and its draws.
+bool isCharacterVisible(unsigned int frame) {
+	mat4 model = glm::rotate(mat4(), -90.0f, vec3(1.0, 0.0, 0.0));
+	FrameBounds bounds = transformBounds(boundsAtFrame(gAnimInfo, frame), model);
+	return isVisible(gViewFrustum, bounds);
+}
+
+// Runs on the animation thread.
+void stepCharacter(double time) {
+	gCurrentFrame = frameAtTime(gAnimInfo, time);
+
+	CharacterFrame &next = gCharacterFrames.back();
+	next.frame = gCurrentFrame;
+	next.visible = isCharacterVisible(gCurrentFrame);
+	if(next.visible) {
+		updateCharacter();
+		next.pose = gCurrentPose;
+		next.palette = gMatrixPalette;
+	}
+	gCharacterFrames.publish();
+}
+
+// One step per clip frame, at the clip's own frame rate.
+void startAnimation(double time) {
+	gAnimationThread.start(1.0 / std::max(gAnimInfo.frameRate, 1), stepCharacter, time);
+	gCharacterFrames.update();
+}
+
+// glutMainLoop leaves through exit(), which destroys gCharacterFrames and
+// the rest of what stepCharacter writes. The thread has to stop first.
+void stopAnimation() {
+	gAnimationThread.stop();
+}
+
+void onRedrawTimer(int value) {
+	glutPostRedisplay();
+	glutTimerFunc(kRedrawPeriod, onRedrawTimer, 0);
+}
+
 void render() {
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// The newest pose the animation thread has published, if there is one.
+	gCharacterFrames.update();
+
 	glPointSize(5.0f);
 
 	//renderTestMesh();
 	//glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 	glEnable(GL_DEPTH_TEST);
-	renderMeshes();
+	if(gCharacterFrames.front().visible) {
+		renderMeshes();
+	}
 	//glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 	//glDisable(GL_DEPTH_TEST);
 	//renderSkeleton();
@@ -531,7 +651,7 @@ void initShader() {
 	}
 }
 
-void initTestMeshShader() {
+void initTestMeshShader(DecodedImage &uvMapper) {
 	gpTestMeshShader = new Shader();
 	const string &vertShaderName = "testmesh.vert";
 	const string &fragShaderName = "testmesh.frag";
@@ -555,7 +675,7 @@ void initTestMeshShader() {
 	}
 
 	// Set up the texture down here
-	ghTexID = SOIL_load_OGL_texture("UV_mapper.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_INVERT_Y);
+	ghTexID = gpTextureLoader->upload(uvMapper);
 	if(ghTexID == 0) {
 		cout << "Could not load the UV_mapper.jpg file and make a GL texture out of it." << endl;
 		exit(EXIT_FAILURE);
@@ -592,24 +712,419 @@ void initCamera() {
 	//gView = glm::translate(mat4(), vec3(0, -20, -120));
 	gView = glm::translate(mat4(), vec3(0, -20, -150));
 	gProjection = glm::perspective(45.0f, 1.0f, 0.1f, 1000.0f);
+	gViewFrustum = extractFrustum(gProjection * gView);
+}
+
+template<typename T>
+bool isReady(const future<T> &result) {
+	return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// Uploads each piece of the model as soon as its load job finishes, rather
+// than in a fixed order, then poses the character.
+void finishLoading(future<ModelData> &modelResult, future<MD5_AnimInfo> &animResult) {
+	ModelData model;
+	bool haveModel = false;
+	bool haveAnim = false;
+
+	try {
+		while(!haveModel || !haveAnim || gpTextureLoader->busy()) {
+			bool uploaded = false;
+
+			if(!haveModel && isReady(modelResult)) {
+				model = modelResult.get();
+				initModel(model);
+				initModelRenderData();
+				haveModel = uploaded = true;
+			}
+
+			if(!haveAnim && isReady(animResult)) {
+				gAnimInfo = animResult.get();
+				initAnimations();
+				haveAnim = uploaded = true;
+			}
+
+			for(const string &textureFilename : gpTextureLoader->uploadReady()) {
+				setMeshTexture(textureFilename, gNameToTexID[textureFilename]);
+				uploaded = true;
+			}
+
+			if(!uploaded) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+	catch(std::exception &e) {
+		cout << "Could not load the model: " << e.what() << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	cout << "Textures decoded in " << gpTextureLoader->decodeSeconds() << "s of pool time, ready after "
+		 << gpTextureLoader->elapsedSeconds() << "s, " << gpTextureLoader->uploadedBytes() / 1024 << " KB." << endl;
+
+	startAnimation(0.0);
+}
+
+// Hot reload. The watcher thread re-parses whichever file changed and diffs
+// it against the version it last passed on. The GL thread picks the result up
+// between frames and applies all of it at once, re-uploading only the
+// buffers and textures that differ.
+const int kReloadCheckPeriod = 250;
+
+// The assets as the watcher thread last passed them on. Only the watcher
+// thread uses it once watching starts.
+struct LiveAssets {
+	vector<MeshStreams> meshStreams;
+	vector<string> textureFilenames;
+	vector<mat4> inverseBindPose;
+	MD5_AnimInfo anim;
+};
+
+// Changes waiting for the GL thread.
+struct PendingReload {
+	PendingReload()
+		: meshesReplaced(false), bindPoseChanged(false), animChanged(false) {
+	}
+
+	bool empty() const {
+		for(int i = 0; i < meshDiffs.size(); ++i) {
+			if(meshDiffs[i].any() || texturesRenamed[i]) {
+				return false;
+			}
+		}
+		return !meshesReplaced && !bindPoseChanged && !animChanged && textures.empty();
+	}
+
+	// Set when the number of meshes changed and every mesh is rebuilt.
+	bool meshesReplaced;
+	// Otherwise one entry per mesh.
+	vector<MeshStreamsDiff> meshDiffs;
+	vector<bool> texturesRenamed;
+
+	vector<MeshStreams> meshStreams;
+	vector<string> textureFilenames;
+	bool bindPoseChanged;
+	vector<mat4> inverseBindPose;
+
+	bool animChanged;
+	MD5_AnimInfo anim;
+	unique_ptr<StreamingAnim> streamingAnim;
+
+	map<string, DecodedImage> textures;
+};
+
+LiveAssets gLiveAssets;
+// Deleted by stopWatchingAssets at exit, which joins its thread.
+FileWatcher *gpAssetWatcher;
+std::mutex gReloadMutex;
+std::condition_variable gReloadTaken;
+unique_ptr<PendingReload> gpPendingReload;
+// Set under gReloadMutex once the process is exiting; no reload is handed
+// over after that.
+bool gStoppingReloads;
+
+bool sameClip(const MD5_AnimInfo &a, const MD5_AnimInfo &b) {
+	if(a.numFrames != b.numFrames || a.frameRate != b.frameRate || a.framesData != b.framesData ||
+	   a.jointsInfo.size() != b.jointsInfo.size() || a.bounds.size() != b.bounds.size()) {
+		return false;
+	}
+
+	for(int i = 0; i < a.jointsInfo.size(); ++i) {
+		const JointInfo &ja = a.jointsInfo[i];
+		const JointInfo &jb = b.jointsInfo[i];
+		const BaseframeJoint &ba = a.baseframeJoints[i];
+		const BaseframeJoint &bb = b.baseframeJoints[i];
+		if(ja.name != jb.name || ja.parent != jb.parent || ja.flags != jb.flags || ja.startIndex != jb.startIndex ||
+		   ba.position != bb.position || ba.orientation.x != bb.orientation.x ||
+		   ba.orientation.y != bb.orientation.y || ba.orientation.z != bb.orientation.z) {
+			return false;
+		}
+	}
+
+	for(int i = 0; i < a.bounds.size(); ++i) {
+		if(a.bounds[i].min != b.bounds[i].min || a.bounds[i].max != b.bounds[i].max) {
+			return false;
+		}
+	}
+	return true;
 }
 
-int main(int argc, char **argv) {	
+void diffMesh(PendingReload &reload) {
+	MD5_MeshInfo meshInfo = MD5_MeshReader::parseMapped(kMeshFilename);
+
+	vector<MeshStreams> meshStreams;
+	vector<string> textureFilenames;
+	for(const MD5_Mesh &md5mesh : meshInfo.meshes) {
+		meshStreams.push_back(buildMeshStreams(md5mesh, meshInfo.joints));
+		textureFilenames.push_back(md5mesh.textureFilename);
+	}
+	vector<mat4> inverseBindPose = buildInverseBindPose(meshInfo.joints);
+
+	reload.meshesReplaced = meshStreams.size() != gLiveAssets.meshStreams.size();
+	if(!reload.meshesReplaced) {
+		for(int i = 0; i < meshStreams.size(); ++i) {
+			reload.meshDiffs.push_back(diffMeshStreams(gLiveAssets.meshStreams[i], meshStreams[i]));
+			reload.texturesRenamed.push_back(textureFilenames[i] != gLiveAssets.textureFilenames[i]);
+		}
+	}
+	reload.bindPoseChanged = inverseBindPose != gLiveAssets.inverseBindPose;
+
+	// Textures the renderer has not seen yet are decoded here too.
+	set<string> knownTextures(gLiveAssets.textureFilenames.begin(), gLiveAssets.textureFilenames.end());
+	for(const string &textureFilename : textureFilenames) {
+		if(knownTextures.insert(textureFilename).second) {
+			reload.textures[textureFilename] = decodeImage(kTextureDirectory + textureFilename);
+		}
+	}
+
+	gLiveAssets.meshStreams = meshStreams;
+	gLiveAssets.textureFilenames = textureFilenames;
+	gLiveAssets.inverseBindPose = inverseBindPose;
+	reload.meshStreams.swap(meshStreams);
+	reload.textureFilenames.swap(textureFilenames);
+	reload.inverseBindPose.swap(inverseBindPose);
+}
+
+void diffAnim(PendingReload &reload) {
+	// The frame offsets a StreamingAnim indexed are stale, so it is replaced.
+	if(gUseStreamingAnim) {
+		reload.streamingAnim.reset(new StreamingAnim(kAnimFilename));
+		reload.animChanged = true;
+		return;
+	}
+
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	reload.animChanged = !sameClip(anim, gLiveAssets.anim);
+	if(reload.animChanged) {
+		gLiveAssets.anim = anim;
+		reload.anim = std::move(anim);
+	}
+}
+
+// Runs on the watcher thread. Waits for the GL thread to take the previous
+// reload, so changes are applied in the order they were saved.
+void onAssetChanged(const string &filename) {
+	{
+		std::lock_guard<std::mutex> lock(gReloadMutex);
+		if(gStoppingReloads) {
+			return;
+		}
+	}
+
+	unique_ptr<PendingReload> reload(new PendingReload());
+
+	try {
+		if(filename == kMeshFilename) {
+			diffMesh(*reload);
+		} else if(filename == kAnimFilename) {
+			diffAnim(*reload);
+		} else {
+			reload->textures[filename.substr(kTextureDirectory.size())] = decodeImage(filename);
+		}
+	}
+	catch(std::exception &e) {
+		cout << "Keeping the previous " << filename << ": " << e.what() << endl;
+		return;
+	}
+
+	if(reload->empty()) {
+		return;
+	}
+	cout << "Reloading " << filename << endl;
+
+	std::unique_lock<std::mutex> lock(gReloadMutex);
+	gReloadTaken.wait(lock, []() { return !gpPendingReload || gStoppingReloads; });
+	if(!gStoppingReloads) {
+		gpPendingReload = std::move(reload);
+	}
+}
+
+void deleteMeshBuffers(const Mesh &mesh) {
+	GLuint buffers[] = { mesh.hPositionBuffer, mesh.hJointIndexBuffer, mesh.hJointWeightBuffer,
+						 mesh.hTextureCoordsBuffer, mesh.hIndexBuffer };
+	glDeleteBuffers(5, buffers);
+}
+
+void reloadMeshBuffers(Mesh &mesh, MeshStreams &streams, const MeshStreamsDiff &changed) {
+	if(changed.positions) {
+		mesh.positions.swap(streams.positions);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hPositionBuffer, mesh.positions);
+	}
+	if(changed.jointIndices) {
+		mesh.jointIndices.swap(streams.jointIndices);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hJointIndexBuffer, mesh.jointIndices);
+	}
+	if(changed.jointWeights) {
+		mesh.jointWeights.swap(streams.jointWeights);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hJointWeightBuffer, mesh.jointWeights);
+	}
+	if(changed.textureCoords) {
+		mesh.textureCoords.swap(streams.textureCoords);
+		uploadBuffer(GL_ARRAY_BUFFER, mesh.hTextureCoordsBuffer, mesh.textureCoords);
+	}
+	if(changed.indices) {
+		mesh.indices.swap(streams.indices);
+		uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.hIndexBuffer, mesh.indices);
+	}
+}
+
+void applyReload(PendingReload &reload) {
+	// Resumed at the same time once everything is swapped in.
+	const double time = gAnimationThread.time();
+	gAnimationThread.stop();
+
+	if(reload.meshesReplaced) {
+		for_each(gMeshes.begin(), gMeshes.end(), deleteMeshBuffers);
+		gMeshes.clear();
+
+		ModelData data;
+		data.meshStreams.swap(reload.meshStreams);
+		data.textureFilenames.swap(reload.textureFilenames);
+		data.inverseBindPose.swap(reload.inverseBindPose);
+		initModel(data);
+		initModelRenderData();
+	} else {
+		for(int i = 0; i < reload.meshDiffs.size(); ++i) {
+			Mesh &mesh = gMeshes[i];
+			reloadMeshBuffers(mesh, reload.meshStreams[i], reload.meshDiffs[i]);
+
+			if(reload.texturesRenamed[i]) {
+				mesh.textureFilename = reload.textureFilenames[i];
+				auto texIter = gNameToTexID.find(mesh.textureFilename);
+				mesh.texID = texIter == gNameToTexID.end() ? 0 : texIter->second;
+			}
+		}
+
+		if(reload.bindPoseChanged) {
+			gIBPMatrices.swap(reload.inverseBindPose);
+			gMatrixPalette.resize(gIBPMatrices.size());
+		}
+	}
+
+	for(auto &texture : reload.textures) {
+		auto texIter = gNameToTexID.find(texture.first);
+		GLuint texID = gpTextureLoader->upload(texture.second, texIter == gNameToTexID.end() ? 0 : texIter->second);
+		if(texID != 0) {
+			setMeshTexture(texture.first, texID);
+		}
+	}
+
+	if(reload.animChanged) {
+		if(reload.streamingAnim) {
+			gpStreamingAnim = std::move(reload.streamingAnim);
+			gAnimInfo = gpStreamingAnim->info();
+		} else {
+			gAnimInfo = std::move(reload.anim);
+		}
+		initAnimations();
+	}
+
+	startAnimation(time);
+}
+
+void checkForReload(int value) {
+	unique_ptr<PendingReload> reload;
+	{
+		std::lock_guard<std::mutex> lock(gReloadMutex);
+		reload = std::move(gpPendingReload);
+	}
+
+	if(reload) {
+		gReloadTaken.notify_one();
+		applyReload(*reload);
+		glutPostRedisplay();
+	}
+
+	glutTimerFunc(kReloadCheckPeriod, checkForReload, 0);
+}
+
+// Snapshots what was loaded, then watches the MD5 files and the textures in use.
+void startWatchingAssets() {
+	vector<string> filenames;
+	filenames.push_back(kMeshFilename);
+	filenames.push_back(kAnimFilename);
+
+	for(const Mesh &mesh : gMeshes) {
+		MeshStreams streams;
+		streams.positions = mesh.positions;
+		streams.jointIndices = mesh.jointIndices;
+		streams.jointWeights = mesh.jointWeights;
+		streams.textureCoords = mesh.textureCoords;
+		streams.indices = mesh.indices;
+		gLiveAssets.meshStreams.push_back(streams);
+		gLiveAssets.textureFilenames.push_back(mesh.textureFilename);
+
+		string fullname = kTextureDirectory + mesh.textureFilename;
+		if(std::find(filenames.begin(), filenames.end(), fullname) == filenames.end()) {
+			filenames.push_back(fullname);
+		}
+	}
+	gLiveAssets.inverseBindPose = gIBPMatrices;
+	if(!gpStreamingAnim) {
+		gLiveAssets.anim = gAnimInfo;
+	}
+
+	gpAssetWatcher = new FileWatcher(filenames, onAssetChanged);
+	glutTimerFunc(kReloadCheckPeriod, checkForReload, 0);
+}
+
+// Like stopAnimation: the watcher thread writes gLiveAssets and may be
+// waiting on gReloadTaken, both destroyed after exit() returns from the
+// hooks. Nothing takes reloads once glutMainLoop is gone, so the wait is
+// released here rather than left for the GL thread.
+void stopWatchingAssets() {
+	{
+		std::lock_guard<std::mutex> lock(gReloadMutex);
+		gStoppingReloads = true;
+	}
+	gReloadTaken.notify_one();
+
+	delete gpAssetWatcher;
+	gpAssetWatcher = nullptr;
+}
+
+int main(int argc, char **argv) {
+	// -quantized samples poses from a QuantizedAnim copy of the clip,
+	// -reduced from a ReducedAnim one. -streamed reads frames from disk
+	// through a StreamingAnim and takes precedence over both. -lazy poses
+	// the float frames with a LazyPoseEvaluator, when none of those is on.
+	for(int i = 1; i < argc; ++i) {
+		if(string(argv[i]) == "-lazy") {
+			gUseLazyPose = true;
+		} else if(string(argv[i]) == "-quantized") {
+			gUseQuantizedAnim = true;
+		} else if(string(argv[i]) == "-reduced") {
+			gUseReducedAnim = true;
+		} else if(string(argv[i]) == "-streamed") {
+			gUseStreamingAnim = true;
+		}
+	}
+
+	// Parse and decode on the pool while the window opens and the shaders
+	// compile. Nothing here touches GL.
+	ThreadPool loadPool;
+	gpJobPool = &loadPool;
+	initCharacterTasks();
+	atexit(stopAnimation);
+	atexit(stopWatchingAssets);
+	gpTextureLoader = new TextureLoader(loadPool, gNameToTexID);
+	gUseBakedAsset = openBakedAsset();
+	future<DecodedImage> uvMapperResult = loadPool.submit([]() { return decodeImage("UV_mapper.jpg", true); });
+	future<ModelData> modelResult = loadPool.submit([]() { return loadModelData(*gpTextureLoader); });
+	future<MD5_AnimInfo> animResult = loadPool.submit([&loadPool]() { return loadAnimInfo(loadPool); });
+
 	initGL(argc, argv);
 	initShader();
 	initSkeletonShader();
 	initCamera();
 	initTestMesh();
-	initTestMeshShader();
-	initModel();
-	initAnimations();
-	initModelRenderData();
-
-	// Temp
-	computeCurrentPose();
-	updateMatrixPalette();
+	DecodedImage uvMapper = uvMapperResult.get();
+	initTestMeshShader(uvMapper);
+	finishLoading(modelResult, animResult);
+	startWatchingAssets();
+	glutTimerFunc(kRedrawPeriod, onRedrawTimer, 0);
 
 	glutMainLoop();
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 	#include <GL/freeglut.h>
 #endif
 #include <algorithm>
+#include <exception>
 #include <memory>
 #include <iostream>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "BakedAsset.h"
 #include "MD5_MeshReader.h"
 #include "Shader.h"
 
@@ -75,9 +77,34 @@ void initTestMesh() {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices) * sizeof(GLushort), indices, GL_STATIC_DRAW);
 }
 
+// The bind pose positions are already in the file cooked by bones_cook.
+bool initBakedModel() {
+	try {
+		BakedAsset baked("Boblamp/boblampclean.bones");
+		if(!baked.hasMesh()) {
+			return false;
+		}
+
+		for(int i = 0; i < baked.numMeshes(); ++i) {
+			Mesh mesh;
+			mesh.positions = baked.meshStreams(i).positions;
+			gMeshes.push_back(mesh);
+		}
+		return true;
+	}
+	catch(std::exception &e) {
+		cout << "Parsing the md5mesh instead of the baked asset: " << e.what() << endl;
+		return false;
+	}
+}
+
 void initModel() {
+	if(initBakedModel()) {
+		return;
+	}
+
 	MD5_MeshReader parser;
-	MD5_MeshInfo meshInfo = parser.parse("Boblamp/boblampclean.md5mesh");
+	MD5_MeshInfo meshInfo = parser.parseMapped("Boblamp/boblampclean.md5mesh");
 
 	for(auto meshIter = meshInfo.meshes.cbegin(); meshIter != meshInfo.meshes.cend(); ++meshIter) {
 		const MD5_Mesh &md5mesh = *meshIter;
@@ -162,7 +189,7 @@ void renderMeshes() {
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		glEnableVertexAttribArray(0);
 
-		glDrawArrays(GL_POINTS, 0, mesh.vertices.size());
+		glDrawArrays(GL_POINTS, 0, mesh.positions.size() / 3);
 	}
 }
 
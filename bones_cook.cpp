@@ -0,0 +1,131 @@
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <SOIL.h>
+
+#include "BakedAsset.h"
+#include "CookedTexture.h"
+#include "MD5_MeshReader.h"
+#include "MD5_AnimReader.h"
+#include "ThreadPool.h"
+
+using std::cout;
+using std::endl;
+using std::exception;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+// Bakes an .md5mesh and/or .md5anim into one binary file the renderers can
+// map at start up instead of parsing text. Each -texture image is cooked
+// into a block compressed .btex with its mip chain, written next to the
+// image or into -texdir.
+//
+// bones_cook [-mesh file.md5mesh] [-anim file.md5anim] [-o out.bones]
+//            [-texdir dir] [-texture image]...
+void printUsage() {
+	cout << "Usage: bones_cook [-mesh file.md5mesh] [-anim file.md5anim] [-o out.bones] "
+		 << "[-texdir dir] [-texture image]..." << endl;
+}
+
+void cookTexture(const string &imageFilename, const string &textureDirectory) {
+	string outFilename = cookedTextureFilename(imageFilename);
+	if(!textureDirectory.empty()) {
+		size_t slash = outFilename.find_last_of("/\\");
+		outFilename = textureDirectory + "/" + (slash == string::npos ? outFilename : outFilename.substr(slash + 1));
+	}
+
+	int width, height, channels;
+	unsigned char *pixels = SOIL_load_image(imageFilename.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+	if(!pixels) {
+		throw runtime_error("Could not decode " + imageFilename + ": " + SOIL_last_result());
+	}
+
+	try {
+		writeCookedTexture(outFilename, pixels, width, height, 4);
+	}
+	catch(...) {
+		SOIL_free_image_data(pixels);
+		throw;
+	}
+	SOIL_free_image_data(pixels);
+
+	// Read it back, as for the baked assets.
+	CookedTexture check(outFilename);
+	size_t uncompressed = size_t(width) * height * 4;
+	cout << "Cooked " << outFilename << ": " << width << "x" << height << " "
+		 << (check.format() == CookedTexture::BC1 ? "BC1" : "BC3") << ", "
+		 << check.numLevels() << " levels, " << check.sizeInBytes() << " bytes ("
+		 << uncompressed << " as RGBA without mips)." << endl;
+}
+
+int main(int argc, char **argv) {
+	string meshFilename;
+	string animFilename;
+	string outFilename;
+	string textureDirectory;
+	vector<string> textureFilenames;
+
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+
+		if(i + 1 < argc && arg == "-mesh") {
+			meshFilename = argv[++i];
+		} else if(i + 1 < argc && arg == "-anim") {
+			animFilename = argv[++i];
+		} else if(i + 1 < argc && arg == "-o") {
+			outFilename = argv[++i];
+		} else if(i + 1 < argc && arg == "-texdir") {
+			textureDirectory = argv[++i];
+		} else if(i + 1 < argc && arg == "-texture") {
+			textureFilenames.push_back(argv[++i]);
+		} else {
+			printUsage();
+			return -1;
+		}
+	}
+
+	const bool bake = !meshFilename.empty() || !animFilename.empty();
+	if((bake && outFilename.empty()) || (!bake && textureFilenames.empty())) {
+		printUsage();
+		return -1;
+	}
+
+	try {
+		for(const string &textureFilename : textureFilenames) {
+			cookTexture(textureFilename, textureDirectory);
+		}
+		if(!bake) {
+			return 0;
+		}
+
+		MD5_MeshInfo mesh;
+		MD5_AnimInfo anim;
+
+		if(!meshFilename.empty()) {
+			mesh = MD5_MeshReader().parseMapped(meshFilename);
+		}
+		if(!animFilename.empty()) {
+			ThreadPool pool;
+			anim = MD5_AnimReader().parseMapped(animFilename, &pool);
+		}
+
+		writeBakedAsset(outFilename,
+						meshFilename.empty() ? nullptr : &mesh,
+						animFilename.empty() ? nullptr : &anim);
+
+		// Read it back so a bad bake fails here rather than in a renderer.
+		BakedAsset check(outFilename);
+		cout << "Baked " << outFilename << ": "
+			 << mesh.joints.size() << " joints, " << check.numMeshes() << " meshes, "
+			 << (animFilename.empty() ? 0 : anim.numFrames) << " frames." << endl;
+	}
+	catch(exception &e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+
+	return 0;
+}
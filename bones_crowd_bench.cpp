@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CrowdEvaluator.h"
+#include "MD5_AnimReader.h"
+#include "PoseCache.h"
+#include "ThreadPool.h"
+
+using std::cout;
+using std::endl;
+using std::exception;
+using std::string;
+using std::vector;
+
+// Times CrowdEvaluator on a crowd playing one clip at scattered times and
+// prints poses per second as JSON, for every batch width the build and CPU
+// have, on one thread and on a pool. Then times the same crowd going through a
+// PoseCache, which only evaluates each distinct pose once:
+//
+// bones_crowd_bench [-anim file] [-instances n] [-runs n] [-threads n] [-quantum s] [-cache-mb n]
+//
+// -threads 0 uses one pool thread per hardware thread. Each run evaluates
+// skinning palettes against the inverse of the clip's baseframe. -quantum 0,
+// the default, shares poses per clip frame. Each cached run moves the crowd
+// on by a 60 Hz step, so runs after the first mix hits and new poses the way
+// consecutive frames would.
+
+struct BenchConfig {
+	string animFilename;
+	int numInstances;
+	int runs;
+	int threads;
+	double quantum;
+	int cacheMb;
+};
+
+struct BenchResult {
+	int lanes;
+	int threads;
+	double bestMs;
+	double medianMs;
+};
+
+struct CacheResult {
+	int threads;
+	double bestMs;
+	double medianMs;
+	PoseCache::Stats stats;
+};
+
+BenchResult runBench(const CrowdEvaluator &evaluator, const vector<CrowdInstance> &instances, int runs,
+					 ThreadPool *pool) {
+	vector<glm::mat4> palettes;
+	vector<double> times;
+
+	for(int i = 0; i < runs; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		evaluator.evaluate(instances, palettes, pool);
+		auto stop = std::chrono::steady_clock::now();
+
+		times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+	}
+
+	std::sort(times.begin(), times.end());
+	BenchResult result = {evaluator.lanes(), pool ? static_cast<int>(pool->size()) : 1, times.front(),
+						  times[times.size() / 2]};
+	return result;
+}
+
+// One palette per instance, shared through the cache. Palettes are evaluated
+// one at a time, at the quantized time within the clip.
+CacheResult runCacheBench(const CrowdEvaluator &evaluator, const MD5_AnimInfo &anim,
+						  const vector<CrowdInstance> &instances, int runs, PoseCache &cache, ThreadPool *pool) {
+	const double kStep = 1.0 / 60.0;
+	const double clipSeconds = double(anim.numFrames) / std::max(anim.frameRate, 1);
+	vector<PoseCache::Palette> palettes(instances.size());
+	vector<double> times;
+
+	cache.clear();
+	for(int run = 0; run < runs; ++run) {
+		auto evaluate = [&](double seconds, vector<glm::mat4> &palette) {
+			CrowdInstance instance = {0, static_cast<float>(seconds)};
+			evaluator.evaluate({instance}, palette);
+		};
+		auto lookUp = [&](int i) {
+			const double seconds = std::fmod(instances[i].time + run * kStep, clipSeconds);
+			palettes[i] = cache.get(&evaluator, &anim, seconds, evaluate);
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		if(pool) {
+			pool->parallelFor(instances.size(), lookUp);
+		} else {
+			for(int i = 0; i < instances.size(); ++i) {
+				lookUp(i);
+			}
+		}
+		auto stop = std::chrono::steady_clock::now();
+
+		times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+	}
+
+	std::sort(times.begin(), times.end());
+	CacheResult result = {pool ? static_cast<int>(pool->size()) : 1, times.front(), times[times.size() / 2],
+						  cache.stats()};
+	return result;
+}
+
+void printJson(const BenchConfig &config, int numJoints, const vector<BenchResult> &results,
+			   const vector<CacheResult> &cacheResults) {
+	cout << "{\n";
+	cout << "  \"config\": { \"anim\": \"" << config.animFilename << "\", \"joints\": " << numJoints
+		 << ", \"instances\": " << config.numInstances << ", \"runs\": " << config.runs
+		 << ", \"max_lanes\": " << CrowdEvaluator::maxLanes() << ", \"quantum_s\": " << config.quantum << ", \"cache_mb\": " << config.cacheMb << " },\n";
+	cout << "  \"results\": [\n";
+
+	for(size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &r = results[i];
+		double posesPerSecond = config.numInstances / (r.bestMs / 1000.0);
+
+		cout << "    { \"lanes\": " << r.lanes
+			 << ", \"threads\": " << r.threads
+			 << ", \"best_ms\": " << r.bestMs
+			 << ", \"median_ms\": " << r.medianMs
+			 << ", \"poses_per_s\": " << posesPerSecond
+			 << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	cout << "  ],\n";
+	cout << "  \"cached\": [\n";
+
+	for(size_t i = 0; i < cacheResults.size(); ++i) {
+		const CacheResult &r = cacheResults[i];
+		double posesPerSecond = config.numInstances / (r.bestMs / 1000.0);
+
+		cout << "    { \"threads\": " << r.threads
+			 << ", \"best_ms\": " << r.bestMs
+			 << ", \"median_ms\": " << r.medianMs
+			 << ", \"poses_per_s\": " << posesPerSecond
+			 << ", \"hit_rate\": " << r.stats.hitRate()
+			 << ", \"evaluated\": " << r.stats.misses
+			 << ", \"evictions\": " << r.stats.evictions
+			 << ", \"entries\": " << r.stats.numEntries
+			 << ", \"bytes\": " << r.stats.sizeInBytes
+			 << " }" << (i + 1 < cacheResults.size() ? "," : "") << "\n";
+	}
+
+	cout << "  ]\n}" << endl;
+}
+
+void printUsage() {
+	cout << "Usage: bones_crowd_bench [-anim file] [-instances n] [-runs n] [-threads n] [-quantum s] [-cache-mb n]" << endl;
+}
+
+int main(int argc, char **argv) {
+	BenchConfig config = { "Boblamp/boblampclean.md5anim", 10000, 20, 0, 0.0, 64 };
+
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(i + 1 >= argc) {
+			printUsage();
+			return -1;
+		}
+
+		if(arg == "-anim") {
+			config.animFilename = argv[++i];
+		} else if(arg == "-instances") {
+			config.numInstances = atoi(argv[++i]);
+		} else if(arg == "-runs") {
+			config.runs = atoi(argv[++i]);
+		} else if(arg == "-threads") {
+			config.threads = atoi(argv[++i]);
+		} else if(arg == "-quantum") {
+			config.quantum = atof(argv[++i]);
+		} else if(arg == "-cache-mb") {
+			config.cacheMb = atoi(argv[++i]);
+		} else {
+			printUsage();
+			return -1;
+		}
+	}
+
+	if(config.numInstances < 1 || config.runs < 1 || config.threads < 0 || config.quantum < 0 || config.cacheMb < 0) {
+		printUsage();
+		return -1;
+	}
+
+	vector<BenchResult> results;
+	vector<CacheResult> cacheResults;
+	int numJoints = 0;
+
+	try {
+		MD5_AnimInfo anim = MD5_AnimReader::parseMapped(config.animFilename);
+
+		vector<glm::mat4> inverseBindPose;
+		for(const BaseframeJoint &joint : anim.baseframeJoints) {
+			inverseBindPose.push_back(glm::inverse(joint.jointToWorld));
+		}
+		CrowdEvaluator evaluator({&anim}, inverseBindPose);
+		numJoints = evaluator.numJoints();
+
+		// Spread over the clip so neighbouring lanes read different frames.
+		vector<CrowdInstance> instances;
+		for(int i = 0; i < config.numInstances; ++i) {
+			CrowdInstance instance = {0, i * 0.137f};
+			instances.push_back(instance);
+		}
+
+		ThreadPool pool(config.threads);
+		for(int lanes : {1, 4, 8}) {
+			if(lanes > CrowdEvaluator::maxLanes()) {
+				continue;
+			}
+			evaluator.setLanes(lanes);
+			results.push_back(runBench(evaluator, instances, config.runs, nullptr));
+			results.push_back(runBench(evaluator, instances, config.runs, &pool));
+		}
+
+		// Cached palettes are evaluated one at a time, so scalar is fastest.
+		evaluator.setLanes(1);
+		if(config.quantum == 0) {
+			config.quantum = 1.0 / std::max(anim.frameRate, 1);
+		}
+		PoseCache cache(size_t(config.cacheMb) << 20, config.quantum);
+		cacheResults.push_back(runCacheBench(evaluator, anim, instances, config.runs, cache, nullptr));
+		cacheResults.push_back(runCacheBench(evaluator, anim, instances, config.runs, cache, &pool));
+	}
+	catch(exception &e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+
+	printJson(config, numJoints, results, cacheResults);
+	return 0;
+}
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/resource.h>
+#endif
+
+#include "MD5Reader.h"
+#include "MD5_MeshReader.h"
+#include "MD5_AnimReader.h"
+#include "ThreadPool.h"
+
+using std::cout;
+using std::endl;
+using std::exception;
+using std::function;
+using std::ofstream;
+using std::string;
+using std::vector;
+
+// Times the MD5 loaders on synthetic files of a chosen size and prints the
+// results as JSON, one object per loader:
+//
+// bones_parse_bench [-joints n] [-meshes n] [-verts n] [-weights n]
+//                   [-frames n] [-runs n] [-threads n] [-keep]
+//
+// -weights is per vertex. -threads 0 runs without a pool. The generated
+// files are written to the working directory and removed unless -keep.
+
+////////////////////////
+// Allocation counting
+////////////////////////
+std::atomic<unsigned long long> gAllocations(0);
+std::atomic<unsigned long long> gAllocatedBytes(0);
+
+void *operator new(size_t size) {
+	++gAllocations;
+	gAllocatedBytes += size;
+	void *p = malloc(size ? size : 1);
+	if(!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+////////////////////////
+// Peak resident set
+////////////////////////
+
+// Linux lets the high water mark be reset, so each loader gets its own peak.
+// Elsewhere the peak is for the whole process so far.
+void resetPeakRSS() {
+#ifdef __linux__
+	ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+#endif
+}
+
+long peakRSSKilobytes() {
+#ifdef __linux__
+	std::ifstream status("/proc/self/status");
+	string line;
+	while(getline(status, line)) {
+		if(line.compare(0, 6, "VmHWM:") == 0) {
+			return atol(line.c_str() + 6);
+		}
+	}
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+		return usage.ru_maxrss / 1024;
+	#else
+		return usage.ru_maxrss;
+	#endif
+#else
+	return -1;
+#endif
+}
+
+////////////////////////
+// Synthetic assets
+////////////////////////
+struct BenchConfig {
+	int numJoints;
+	int numMeshes;
+	int vertsPerMesh;
+	int weightsPerVertex;
+	int numFrames;
+	int runs;
+	int threads;
+	bool keepFiles;
+};
+
+// Deterministic so runs are comparable.
+class Random {
+public:
+	explicit Random(unsigned seed) : mState(seed) {}
+
+	float next(float low, float high) {
+		mState = mState * 1664525u + 1013904223u;
+		return low + (high - low) * ((mState >> 8) / 16777216.0f);
+	}
+private:
+	unsigned mState;
+};
+
+string jointName(int joint) {
+	return "\"joint" + std::to_string(joint) + "\"";
+}
+
+int jointParent(int joint) {
+	return joint == 0 ? -1 : (joint - 1) / 2;
+}
+
+void writeMesh(const BenchConfig &config, const string &filename) {
+	ofstream out(filename);
+	Random random(1);
+	out.setf(std::ios::fixed);
+	out.precision(6);
+
+	out << "MD5Version 10\ncommandline \"\"\n\n";
+	out << "numJoints " << config.numJoints << "\n";
+	out << "numMeshes " << config.numMeshes << "\n\n";
+
+	out << "joints {\n";
+	for(int i = 0; i < config.numJoints; ++i) {
+		out << "\t" << jointName(i) << "\t" << jointParent(i)
+			<< " ( " << random.next(-50, 50) << " " << random.next(-50, 50) << " " << random.next(-50, 50) << " )"
+			<< " ( " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << " )"
+			<< "\t\t// " << (i == 0 ? "" : jointName(jointParent(i))) << "\n";
+	}
+	out << "}\n\n";
+
+	const int numVerts = config.vertsPerMesh;
+	const int numTris = std::max(numVerts - 2, 0) * 2;
+	const int numWeights = numVerts * config.weightsPerVertex;
+
+	for(int m = 0; m < config.numMeshes; ++m) {
+		out << "mesh {\n";
+		out << "\tshader \"mesh" << m << ".tga\"\n\n";
+
+		out << "\tnumverts " << numVerts << "\n";
+		for(int i = 0; i < numVerts; ++i) {
+			out << "\tvert " << i << " ( " << random.next(0, 1) << " " << random.next(0, 1) << " ) "
+				<< i * config.weightsPerVertex << " " << config.weightsPerVertex << "\n";
+		}
+
+		out << "\n\tnumtris " << numTris << "\n";
+		for(int i = 0; i < numTris; ++i) {
+			int first = i / 2;
+			out << "\ttri " << i << " " << first << " " << first + 1 + (i & 1) << " " << first + 2 - (i & 1) << "\n";
+		}
+
+		out << "\n\tnumweights " << numWeights << "\n";
+		for(int i = 0; i < numWeights; ++i) {
+			int joint = static_cast<int>(random.next(0, float(config.numJoints))) % config.numJoints;
+			out << "\tweight " << i << " " << joint << " " << 1.0f / config.weightsPerVertex
+				<< " ( " << random.next(-10, 10) << " " << random.next(-10, 10) << " " << random.next(-10, 10) << " )\n";
+		}
+		out << "}\n\n";
+	}
+}
+
+void writeAnim(const BenchConfig &config, const string &filename) {
+	ofstream out(filename);
+	Random random(2);
+	out.setf(std::ios::fixed);
+	out.precision(6);
+
+	const int numComponents = config.numJoints * 6;
+
+	out << "MD5Version 10\ncommandline \"\"\n\n";
+	out << "numFrames " << config.numFrames << "\n";
+	out << "numJoints " << config.numJoints << "\n";
+	out << "frameRate 24\n";
+	out << "numAnimatedComponents " << numComponents << "\n\n";
+
+	out << "hierarchy {\n";
+	for(int i = 0; i < config.numJoints; ++i) {
+		out << "\t" << jointName(i) << "\t" << jointParent(i) << " 63 " << i * 6
+			<< "\t// " << (i == 0 ? "" : jointName(jointParent(i))) << "\n";
+	}
+	out << "}\n\n";
+
+	out << "bounds {\n";
+	for(int i = 0; i < config.numFrames; ++i) {
+		out << "\t( " << random.next(-60, -40) << " " << random.next(-60, -40) << " " << random.next(-60, -40) << " )"
+			<< " ( " << random.next(40, 60) << " " << random.next(40, 60) << " " << random.next(40, 60) << " )\n";
+	}
+	out << "}\n\n";
+
+	out << "baseframe {\n";
+	for(int i = 0; i < config.numJoints; ++i) {
+		out << "\t( " << random.next(-50, 50) << " " << random.next(-50, 50) << " " << random.next(-50, 50) << " )"
+			<< " ( " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << " )\n";
+	}
+	out << "}\n\n";
+
+	for(int f = 0; f < config.numFrames; ++f) {
+		out << "frame " << f << " {\n";
+		for(int i = 0; i < config.numJoints; ++i) {
+			out << "\t" << random.next(-50, 50) << " " << random.next(-50, 50) << " " << random.next(-50, 50)
+				<< " " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << " " << random.next(-0.5f, 0.5f) << "\n";
+		}
+		out << "}\n\n";
+	}
+}
+
+long fileSize(const string &filename) {
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	return static_cast<long>(in.tellg());
+}
+
+////////////////////////
+// Timing
+////////////////////////
+struct BenchResult {
+	string name;
+	long bytes;
+	int runs;
+	double bestMs;
+	double medianMs;
+	unsigned long long allocations;
+	unsigned long long allocatedBytes;
+	long peakRSSKilobytes;
+};
+
+// Calls load runs times. Allocations are those of one run; the peak
+// resident set covers all of them.
+BenchResult runBench(const string &name, long bytes, int runs, const function<void()> &load) {
+	vector<double> times;
+	BenchResult result;
+	result.name = name;
+	result.bytes = bytes;
+	result.runs = runs;
+
+	resetPeakRSS();
+	for(int i = 0; i < runs; ++i) {
+		unsigned long long allocations = gAllocations;
+		unsigned long long allocatedBytes = gAllocatedBytes;
+
+		auto start = std::chrono::steady_clock::now();
+		load();
+		auto stop = std::chrono::steady_clock::now();
+
+		times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+		result.allocations = gAllocations - allocations;
+		result.allocatedBytes = gAllocatedBytes - allocatedBytes;
+	}
+	result.peakRSSKilobytes = peakRSSKilobytes();
+
+	std::sort(times.begin(), times.end());
+	result.bestMs = times.front();
+	result.medianMs = times[times.size() / 2];
+	return result;
+}
+
+void printJson(const BenchConfig &config, const vector<BenchResult> &results) {
+	cout << "{\n";
+	cout << "  \"config\": { \"joints\": " << config.numJoints << ", \"meshes\": " << config.numMeshes
+		 << ", \"verts\": " << config.vertsPerMesh << ", \"weights\": " << config.weightsPerVertex
+		 << ", \"frames\": " << config.numFrames << ", \"runs\": " << config.runs
+		 << ", \"threads\": " << config.threads << " },\n";
+	cout << "  \"results\": [\n";
+
+	for(size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &r = results[i];
+		double mbPerSecond = r.bytes / (1024.0 * 1024.0) / (r.bestMs / 1000.0);
+
+		cout << "    { \"name\": \"" << r.name << "\""
+			 << ", \"bytes\": " << r.bytes
+			 << ", \"best_ms\": " << r.bestMs
+			 << ", \"median_ms\": " << r.medianMs
+			 << ", \"mb_per_s\": " << mbPerSecond
+			 << ", \"allocations\": " << r.allocations
+			 << ", \"allocated_bytes\": " << r.allocatedBytes
+			 << ", \"peak_rss_kb\": " << r.peakRSSKilobytes
+			 << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	cout << "  ]\n}" << endl;
+}
+
+void printUsage() {
+	cout << "Usage: bones_parse_bench [-joints n] [-meshes n] [-verts n] [-weights n] "
+			"[-frames n] [-runs n] [-threads n] [-keep]" << endl;
+}
+
+int main(int argc, char **argv) {
+	BenchConfig config = { 64, 4, 5000, 4, 2000, 5, 4, false };
+
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		int *value = nullptr;
+
+		if(arg == "-joints") {
+			value = &config.numJoints;
+		} else if(arg == "-meshes") {
+			value = &config.numMeshes;
+		} else if(arg == "-verts") {
+			value = &config.vertsPerMesh;
+		} else if(arg == "-weights") {
+			value = &config.weightsPerVertex;
+		} else if(arg == "-frames") {
+			value = &config.numFrames;
+		} else if(arg == "-runs") {
+			value = &config.runs;
+		} else if(arg == "-threads") {
+			value = &config.threads;
+		} else if(arg == "-keep") {
+			config.keepFiles = true;
+			continue;
+		}
+
+		if(!value || i + 1 >= argc) {
+			printUsage();
+			return -1;
+		}
+		*value = atoi(argv[++i]);
+	}
+
+	if(config.numJoints < 1 || config.numMeshes < 0 || config.vertsPerMesh < 0 ||
+	   config.weightsPerVertex < 1 || config.numFrames < 1 || config.runs < 1 || config.threads < 0) {
+		printUsage();
+		return -1;
+	}
+
+	const string meshFilename("bones_parse_bench.md5mesh");
+	const string animFilename("bones_parse_bench.md5anim");
+	vector<BenchResult> results;
+
+	try {
+		writeMesh(config, meshFilename);
+		writeAnim(config, animFilename);
+
+		long meshBytes = fileSize(meshFilename);
+		long animBytes = fileSize(animFilename);
+
+		std::unique_ptr<ThreadPool> pool;
+		if(config.threads > 0) {
+			pool.reset(new ThreadPool(config.threads));
+		}
+
+		results.push_back(runBench("MD5_MeshReader::parse", meshBytes, config.runs, [&]() {
+			MD5_MeshReader().parse(meshFilename);
+		}));
+		results.push_back(runBench("MD5_MeshReader::parseMapped", meshBytes, config.runs, [&]() {
+			MD5_MeshReader().parseMapped(meshFilename);
+		}));
+		results.push_back(runBench("MD5_AnimReader::parse", animBytes, config.runs, [&]() {
+			MD5_AnimReader().parse(animFilename);
+		}));
+		results.push_back(runBench("MD5_AnimReader::parseMapped", animBytes, config.runs, [&]() {
+			MD5_AnimReader().parseMapped(animFilename, pool.get());
+		}));
+		results.push_back(runBench("Md5Reader::parse", meshBytes + animBytes, config.runs, [&]() {
+			Md5Reader().parse(meshFilename, animFilename, pool.get());
+		}));
+	}
+	catch(exception &e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+
+	if(!config.keepFiles) {
+		remove(meshFilename.c_str());
+		remove(animFilename.c_str());
+	}
+
+	printJson(config, results);
+	return 0;
+}
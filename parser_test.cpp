@@ -0,0 +1,1756 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "AnimSampler.h"
+#include "AnimationThread.h"
+#include "BakedAsset.h"
+#include "ChannelDecoder.h"
+#include "ColladaReader.h"
+#include "CookedTexture.h"
+#include "CrowdEvaluator.h"
+#include "Culling.h"
+#include "FileWatcher.h"
+#include "MD5Reader.h"
+#include "MD5_MeshReader.h"
+#include "MD5_AnimReader.h"
+#include "MD5_FrameScanner.h"
+#include "MeshStreams.h"
+#include "PoseCache.h"
+#include "PoseEvaluator.h"
+#include "QuantizedAnim.h"
+#include "ReducedAnim.h"
+#include "StreamingAnim.h"
+#include "ThreadPool.h"
+#include "TripleBuffer.h"
+
+using namespace std;
+
+using glm::mat4;
+using glm::quat;
+using glm::vec3;
+
+const string kMeshFilename("Boblamp/boblampclean.md5mesh");
+const string kAnimFilename("Boblamp/boblampclean.md5anim");
+const string kLongAnimFilename("parser_test_long.md5anim");
+const string kBakedFilename("parser_test.bones");
+const string kColladaFilename("Character.dae");
+const string kBrokenColladaFilename("parser_test_broken.dae");
+const string kSkinnedColladaFilename("parser_test_skinned.dae");
+const string kCookedTextureFilename("parser_test.btex");
+
+template<typename T>
+bool sameBits(const T &a, const T &b) {
+	return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+bool sameJoint(const Joint &a, const Joint &b) {
+	return a.name == b.name &&
+		   a.parentIndex == b.parentIndex &&
+		   sameBits(a.position, b.position) &&
+		   sameBits(a.orientation, b.orientation) &&
+		   sameBits(a.jointToWorld, b.jointToWorld);
+}
+
+bool sameMesh(const MD5_Mesh &a, const MD5_Mesh &b) {
+	if(a.textureFilename != b.textureFilename ||
+	   a.vertices.size() != b.vertices.size() ||
+	   a.triangles.size() != b.triangles.size() ||
+	   a.weights.size() != b.weights.size()) {
+		return false;
+	}
+
+	for(int i = 0; i < a.vertices.size(); ++i) {
+		if(!sameBits(a.vertices[i], b.vertices[i])) {
+			return false;
+		}
+	}
+	for(int i = 0; i < a.triangles.size(); ++i) {
+		if(!sameBits(a.triangles[i], b.triangles[i])) {
+			return false;
+		}
+	}
+	for(int i = 0; i < a.weights.size(); ++i) {
+		if(!sameBits(a.weights[i], b.weights[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool sameMeshInfo(const MD5_MeshInfo &expected, const MD5_MeshInfo &actual) {
+	if(expected.joints.size() != actual.joints.size() || expected.meshes.size() != actual.meshes.size()) {
+		cout << "Joint or mesh counts differ." << endl;
+		return false;
+	}
+
+	for(int i = 0; i < expected.joints.size(); ++i) {
+		if(!sameJoint(expected.joints[i], actual.joints[i])) {
+			cout << "Joint " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	for(int i = 0; i < expected.meshes.size(); ++i) {
+		if(!sameMesh(expected.meshes[i], actual.meshes[i])) {
+			cout << "Mesh " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool meshParseTest() {
+	MD5_MeshInfo streamed = MD5_MeshReader().parse(kMeshFilename);
+	MD5_MeshInfo mapped = MD5_MeshReader().parseMapped(kMeshFilename);
+
+	return sameMeshInfo(streamed, mapped);
+}
+
+bool sameAnimInfo(const MD5_AnimInfo &expected, const MD5_AnimInfo &actual) {
+	if(expected.numFrames != actual.numFrames ||
+	   expected.frameRate != actual.frameRate ||
+	   expected.jointsInfo.size() != actual.jointsInfo.size() ||
+	   expected.baseframeJoints.size() != actual.baseframeJoints.size() ||
+	   expected.bounds.size() != actual.bounds.size()) {
+		cout << "Header counts differ." << endl;
+		return false;
+	}
+
+	for(int i = 0; i < expected.bounds.size(); ++i) {
+		if(!sameBits(expected.bounds[i], actual.bounds[i])) {
+			cout << "Bounds of frame " << i << " differ." << endl;
+			return false;
+		}
+	}
+
+	for(int i = 0; i < expected.jointsInfo.size(); ++i) {
+		const JointInfo &a = expected.jointsInfo[i];
+		const JointInfo &b = actual.jointsInfo[i];
+		if(a.name != b.name || a.parent != b.parent || a.flags != b.flags || a.startIndex != b.startIndex) {
+			cout << "Hierarchy entry " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	for(int i = 0; i < expected.baseframeJoints.size(); ++i) {
+		if(!sameBits(expected.baseframeJoints[i], actual.baseframeJoints[i])) {
+			cout << "Baseframe joint " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	if(expected.framesData != actual.framesData) {
+		cout << "Frame data differs." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool animParseTest() {
+	MD5_AnimInfo streamed = MD5_AnimReader().parse(kAnimFilename);
+	MD5_AnimInfo mapped = MD5_AnimReader().parseMapped(kAnimFilename);
+
+	return sameAnimInfo(streamed, mapped);
+}
+
+bool frameScannerTest() {
+	const string block = "\t-0.000000 0.016430 -0.006044\n\t1e-3 42 .5 -7.25E+1\n}";
+	const float expected[] = { -0.0f, 0.016430f, -0.006044f, 0.001f, 42.0f, 0.5f, -72.5f };
+	const int count = sizeof(expected) / sizeof(expected[0]);
+	float scalar[count];
+	float simd[count];
+
+	const char *begin = block.data();
+	const char *end = begin + block.size();
+
+	if(MD5_FrameScanner::scanFrameScalar(begin, end, scalar, count) != end ||
+	   MD5_FrameScanner::scanFrameSimd(begin, end, simd, count) != end) {
+		cout << "Scanner did not stop after the closing brace." << endl;
+		return false;
+	}
+
+	for(int i = 0; i < count; ++i) {
+		if(!sameBits(scalar[i], expected[i]) || !sameBits(simd[i], expected[i])) {
+			cout << "Value " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Writes the Boblamp clip looped out to numFrames frames.
+void writeLongAnim(const MD5_AnimInfo &anim, int numFrames, const string &filename) {
+	ofstream out(filename);
+	const int numComponents = anim.framesData.numComponents();
+
+	out << "MD5Version 10\ncommandline \"\"\n\n";
+	out << "numFrames " << numFrames << "\n";
+	out << "numJoints " << anim.jointsInfo.size() << "\n";
+	out << "frameRate 24\n";
+	out << "numAnimatedComponents " << numComponents << "\n\n";
+
+	out << "hierarchy {\n";
+	for(auto &info : anim.jointsInfo) {
+		out << "\t" << info.name << "\t" << info.parent << " " << info.flags << " " << info.startIndex << "\n";
+	}
+	out << "}\n\nbounds {\n";
+	for(int i = 0; i < numFrames; ++i) {
+		out << "\t( -1 -1 -1 ) ( 1 1 1 )\n";
+	}
+	out << "}\n\nbaseframe {\n";
+	for(auto &joint : anim.baseframeJoints) {
+		out << "\t( " << joint.position.x << " " << joint.position.y << " " << joint.position.z << " ) ";
+		out << "( " << joint.orientation.x << " " << joint.orientation.y << " " << joint.orientation.z << " )\n";
+	}
+	out << "}\n\n";
+
+	out.precision(9);
+	for(int i = 0; i < numFrames; ++i) {
+		const float *frame = anim.framesData.frame(i % anim.numFrames);
+		out << "frame " << i << " {\n";
+		for(int j = 0; j < numComponents; ++j) {
+			out << ((j % 6 == 0) ? "\t" : " ") << frame[j] << ((j % 6 == 5) ? "\n" : "");
+		}
+		out << "}\n\n";
+	}
+}
+
+bool animFramesTest() {
+	MD5_AnimInfo anim = MD5_AnimReader().parseMapped(kAnimFilename);
+	const AnimFrames &frameMajor = anim.framesData;
+	AnimFrames componentMajor = frameMajor.withLayout(AnimFrames::ComponentMajor);
+
+	if(reinterpret_cast<uintptr_t>(frameMajor.data()) % AnimFrames::kAlignment != 0 ||
+	   reinterpret_cast<uintptr_t>(componentMajor.data()) % AnimFrames::kAlignment != 0) {
+		cout << "Frame data is not aligned." << endl;
+		return false;
+	}
+
+	for(int c = 0; c < frameMajor.numComponents(); ++c) {
+		const float *channel = componentMajor.channel(c);
+		for(int f = 0; f < frameMajor.numFrames(); ++f) {
+			if(!sameBits(channel[f], frameMajor.frame(f)[c])) {
+				cout << "Component " << c << " of frame " << f << " differs." << endl;
+				return false;
+			}
+		}
+	}
+
+	return componentMajor == frameMajor && componentMajor.withLayout(AnimFrames::FrameMajor) == frameMajor;
+}
+
+bool quantizedAnimTest() {
+	MD5_AnimInfo anim = MD5_AnimReader().parseMapped(kAnimFilename);
+	QuantizedAnim quantized(anim);
+
+	if(quantized.sizeInBytes() * 2 > anim.framesData.sizeInBytes()) {
+		cout << "Quantized clip is " << quantized.sizeInBytes() << " bytes, float clip "
+			 << anim.framesData.sizeInBytes() << "." << endl;
+		return false;
+	}
+
+	for(int i = 0; i < quantized.numJoints(); ++i) {
+		if(quantized.maxPositionError(i) > 0.01f || quantized.maxRotationError(i) > 0.0005f) {
+			cout << "Joint " << i << " error is too large." << endl;
+			return false;
+		}
+	}
+
+	// The fused sampler must agree with the float clip in model space.
+	vector<vec3> positions;
+	vector<quat> orientations;
+	vector<mat4> pose;
+	for(int f = 0; f < anim.numFrames; ++f) {
+		computeLocalPose(anim, f, positions, orientations);
+		quantized.samplePose(f, pose);
+
+		vector<vec3> expected(positions.size());
+		vector<quat> expectedOrientations(positions.size());
+		for(int i = 0; i < positions.size(); ++i) {
+			int parent = anim.jointsInfo[i].parent;
+			expected[i] = positions[i];
+			expectedOrientations[i] = orientations[i];
+			if(parent > -1) {
+				expected[i] = expectedOrientations[parent] * positions[i] + expected[parent];
+				expectedOrientations[i] = expectedOrientations[parent] * orientations[i];
+			}
+
+			vec3 actual(pose[i][3][0], pose[i][3][1], pose[i][3][2]);
+			if(glm::length(actual - expected[i]) > 0.05f) {
+				cout << "Joint " << i << " of frame " << f << " moved." << endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool reducedAnimTest() {
+	const float kPositionTolerance = 0.01f;
+	const float kRotationTolerance = 0.001f;
+
+	MD5_AnimInfo anim = MD5_AnimReader().parseMapped(kAnimFilename);
+	ReducedAnim reduced(anim, kPositionTolerance, kRotationTolerance);
+	ReducedAnimSampler sampler(reduced);
+
+	if(reduced.sizeInBytes() >= anim.framesData.sizeInBytes()) {
+		cout << "Reduced clip is no smaller." << endl;
+		return false;
+	}
+
+	// Forwards, backwards, then jumping around, so the cursors are exercised
+	// in every direction.
+	vector<int> order;
+	for(int f = 0; f < anim.numFrames; ++f) {
+		order.push_back(f);
+	}
+	for(int f = anim.numFrames - 1; f >= 0; --f) {
+		order.push_back(f);
+	}
+	for(int f = 0; f < anim.numFrames; ++f) {
+		order.push_back((f * 37) % anim.numFrames);
+	}
+
+	vector<vec3> expectedPositions;
+	vector<quat> expectedOrientations;
+	vector<vec3> positions;
+	vector<quat> orientations;
+	for(int f : order) {
+		computeLocalPose(anim, f, expectedPositions, expectedOrientations);
+		sampler.sampleLocalPose(float(f), positions, orientations);
+
+		for(int i = 0; i < positions.size(); ++i) {
+			quat a = glm::normalize(orientations[i]);
+			quat b = glm::normalize(expectedOrientations[i]);
+			float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+
+			if(glm::length(positions[i] - expectedPositions[i]) > kPositionTolerance * 1.001f ||
+			   d < cosf(kRotationTolerance * 0.5f) - 1e-6f) {
+				cout << "Joint " << i << " of frame " << f << " is out of tolerance." << endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Joint to model by walking up the parent chain, the way the mesh reader
+// used to, as a reference for the single pass.
+mat4 chainToModel(const vector<int> &parents, const vector<vec3> &positions, const vector<quat> &orientations, int joint) {
+	mat4 P(1.0f);
+	for(int i = joint; i > -1; i = parents[i]) {
+		P = jointToParentMatrix(positions[i], orientations[i]) * P;
+	}
+	return P;
+}
+
+bool closeMatrices(const mat4 &a, const mat4 &b, float tolerance) {
+	for(int c = 0; c < 4; ++c) {
+		for(int r = 0; r < 4; ++r) {
+			if(fabs(a[c][r] - b[c][r]) > tolerance) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool skeletonTest() {
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	Skeleton skeleton = buildSkeleton(anim);
+
+	if(skeleton.numJoints() != anim.jointsInfo.size() || skeleton.names[0] != anim.jointsInfo[0].name) {
+		cout << "Skeleton does not match the clip." << endl;
+		return false;
+	}
+
+	for(int f = 0; f < anim.numFrames; ++f) {
+		computeLocalPose(anim, f, skeleton.positions, skeleton.orientations);
+		computeModelSpace(skeleton);
+
+		for(int i = 0; i < skeleton.numJoints(); ++i) {
+			mat4 expected = chainToModel(skeleton.parents, skeleton.positions, skeleton.orientations, i);
+			if(!closeMatrices(expected, skeleton.modelSpace[i], 0.001f)) {
+				cout << "Joint " << i << " of frame " << f << " differs from its parent chain." << endl;
+				return false;
+			}
+		}
+	}
+
+	// The mesh reader builds jointToWorld from the parent's as well.
+	MD5_MeshInfo mesh = MD5_MeshReader::parseMapped(kMeshFilename);
+	Skeleton bindPose = buildSkeleton(mesh.joints);
+	for(int i = 0; i < bindPose.numJoints(); ++i) {
+		mat4 expected = chainToModel(bindPose.parents, bindPose.positions, bindPose.orientations, i);
+		if(!closeMatrices(expected, mesh.joints[i].jointToWorld, 0.001f)) {
+			cout << "Mesh joint " << i << " differs from its parent chain." << endl;
+			return false;
+		}
+	}
+
+	// A child ahead of its parent is refused.
+	vector<Joint> joints(2);
+	joints[0].parentIndex = 1;
+	joints[1].parentIndex = -1;
+	try {
+		buildSkeleton(joints);
+		cout << "Child before its parent was accepted." << endl;
+		return false;
+	}
+	catch(exception &) {
+	}
+
+	return true;
+}
+
+// Joints that animate different subsets of their components, including an
+// orientation too long to be a unit quaternion, so w is clamped to 0. Joints
+// 8 and 10 animate a channel that never changes, which leaves 9 and 10 as a
+// constant subtree.
+MD5_AnimInfo mixedFlagsAnim() {
+	const int kFlags[] = {63, 0, 1, 6, 56, 21, 42, 63, 8, 0, 4};
+	const int kParents[] = {-1, 0, 1, 1, 3, 4, 0, 6, 7, -1, 9};
+	const int kNumJoints = sizeof(kFlags) / sizeof(kFlags[0]);
+	const int kNumFrames = 4;
+
+	MD5_AnimInfo anim;
+	anim.numFrames = kNumFrames;
+	anim.frameRate = 24;
+	anim.jointsInfo.resize(kNumJoints);
+	anim.baseframeJoints.resize(kNumJoints);
+
+	int numComponents = 0;
+	for(int i = 0; i < kNumJoints; ++i) {
+		JointInfo &jointInfo = anim.jointsInfo[i];
+		jointInfo.name = "\"joint" + to_string(i) + "\"";
+		jointInfo.parent = kParents[i];
+		jointInfo.flags = kFlags[i];
+		jointInfo.startIndex = numComponents;
+		for(int bit = 0; bit < 6; ++bit) {
+			numComponents += (kFlags[i] >> bit) & 1;
+		}
+
+		BaseframeJoint &base = anim.baseframeJoints[i];
+		base.position = vec3(i * 1.5f, -0.25f * i, 3.0f);
+		base.orientation = quat(0, 0.1f * (i % 3), -0.2f, 0.05f * i);
+	}
+
+	anim.framesData.resize(kNumFrames, numComponents);
+	for(int f = 0; f < kNumFrames; ++f) {
+		for(int c = 0; c < numComponents; ++c) {
+			anim.framesData.value(f, c) = 0.4f * sinf(f * 1.3f + c * 0.7f);
+		}
+	}
+	anim.framesData.value(kNumFrames - 1, 3) = 0.9f;
+	anim.framesData.value(kNumFrames - 1, 4) = 0.9f;
+	for(int f = 0; f < kNumFrames; ++f) {
+		anim.framesData.value(f, anim.jointsInfo[8].startIndex) = 0.3f;
+		anim.framesData.value(f, anim.jointsInfo[10].startIndex) = -2.0f;
+	}
+	return anim;
+}
+
+bool channelDecoderTest() {
+	const MD5_AnimInfo anims[] = {MD5_AnimReader::parseMapped(kAnimFilename), mixedFlagsAnim()};
+	vector<vec3> expectedPositions;
+	vector<quat> expectedOrientations;
+
+	for(const MD5_AnimInfo &anim : anims) {
+		ChannelDecoder decoder(anim.jointsInfo, anim.framesData.numComponents());
+
+		set<int> patterns;
+		for(const JointInfo &jointInfo : anim.jointsInfo) {
+			if(jointInfo.flags != 0) {
+				patterns.insert(jointInfo.flags);
+			}
+		}
+		if(decoder.numGroups() != patterns.size()) {
+			cout << decoder.numGroups() << " groups for " << patterns.size() << " flag patterns." << endl;
+			return false;
+		}
+
+		// The decoder leaves w alone; computeLocalPose recomputes it.
+		for(int f = 0; f < anim.numFrames; ++f) {
+			computeLocalPose(anim, f, expectedPositions, expectedOrientations);
+
+			Skeleton skeleton = buildSkeleton(anim);
+			decoder.decode(anim.framesData.frame(f), ChannelDecoder::targets(skeleton.positions, skeleton.orientations));
+			for(int i = 0; i < skeleton.numJoints(); ++i) {
+				const quat &expected = expectedOrientations[i];
+				const quat &actual = skeleton.orientations[i];
+				if(!sameBits(skeleton.positions[i], expectedPositions[i]) ||
+				   !sameBits(vec3(actual.x, actual.y, actual.z), vec3(expected.x, expected.y, expected.z))) {
+					cout << "Joint " << i << " of frame " << f << " decoded differently." << endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool poseEvaluatorAnimTest(const MD5_AnimInfo &anim) {
+	PoseEvaluator evaluator(anim);
+	const AnimFrames componentMajor = anim.framesData.withLayout(AnimFrames::ComponentMajor);
+	Skeleton skeleton = buildSkeleton(anim);
+	vector<mat4> expected;
+	vector<mat4> actual;
+
+	for(int f = 0; f < anim.numFrames; ++f) {
+		evaluator.setKernel(PoseEvaluator::Scalar);
+		evaluator.evaluate(anim.framesData, f, expected);
+
+		computeLocalPose(anim, f, skeleton.positions, skeleton.orientations);
+		computeModelSpace(skeleton);
+		for(int i = 0; i < skeleton.numJoints(); ++i) {
+			if(!closeMatrices(skeleton.modelSpace[i], expected[i], 0.001f)) {
+				cout << "Joint " << i << " of frame " << f << " differs from computeModelSpace." << endl;
+				return false;
+			}
+		}
+
+		const PoseEvaluator::Kernel kernels[] = {PoseEvaluator::Scalar, PoseEvaluator::SSE, PoseEvaluator::AVX};
+		for(PoseEvaluator::Kernel kernel : kernels) {
+			if(!PoseEvaluator::supports(kernel)) {
+				continue;
+			}
+			evaluator.setKernel(kernel);
+			for(const AnimFrames *frames : {&anim.framesData, &componentMajor}) {
+				evaluator.evaluate(*frames, f, actual);
+				if(actual.size() != expected.size() ||
+				   memcmp(actual.data(), expected.data(), expected.size() * sizeof(mat4)) != 0) {
+					cout << "The " << PoseEvaluator::kernelName(kernel) << " kernel differs from the scalar one at frame "
+						 << f << "." << endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool lazyPoseAnimTest(const MD5_AnimInfo &anim) {
+	LazyPoseEvaluator lazy(anim);
+	PoseEvaluator evaluator(anim);
+	vector<mat4> expected;
+
+	// Forwards, backwards, then jumping about, repeating some frames.
+	vector<int> frames;
+	for(int f = 0; f < anim.numFrames; ++f) {
+		frames.push_back(f);
+	}
+	for(int f = anim.numFrames - 1; f >= 0; --f) {
+		frames.push_back(f);
+	}
+	for(int i = 0; i < anim.numFrames; ++i) {
+		frames.push_back((i * 7) % anim.numFrames);
+	}
+
+	for(int f : frames) {
+		evaluator.evaluate(anim.framesData, f, expected);
+		const vector<mat4> &actual = lazy.evaluate(anim.framesData, f);
+		if(memcmp(actual.data(), expected.data(), expected.size() * sizeof(mat4)) != 0) {
+			cout << "Lazy pose differs at frame " << f << "." << endl;
+			return false;
+		}
+
+		lazy.evaluate(anim.framesData, f);
+		if(lazy.numUpdated() != 0) {
+			cout << "Repeating frame " << f << " updated " << lazy.numUpdated() << " joints." << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool lazyPoseEvaluatorTest() {
+	MD5_AnimInfo mixed = mixedFlagsAnim();
+	LazyPoseEvaluator lazy(mixed);
+	if(lazy.numConstantChannels() != 2 || lazy.numConstantJoints() != 2) {
+		cout << lazy.numConstantChannels() << " constant channels and " << lazy.numConstantJoints()
+			 << " constant joints, expected 2 and 2." << endl;
+		return false;
+	}
+
+	// Only joint 6's subtree moves when joint 6 alone changes.
+	MD5_AnimInfo held = mixed;
+	for(int c = 0; c < held.framesData.numComponents(); ++c) {
+		if(c < held.jointsInfo[6].startIndex || c >= held.jointsInfo[6].startIndex + 3) {
+			held.framesData.value(1, c) = held.framesData.value(0, c);
+		}
+	}
+	LazyPoseEvaluator heldLazy(held);
+	heldLazy.evaluate(held.framesData, 0);
+	heldLazy.evaluate(held.framesData, 1);
+	if(heldLazy.numUpdated() != 3) {
+		cout << "Moving joint 6 updated " << heldLazy.numUpdated() << " joints." << endl;
+		return false;
+	}
+
+	return lazyPoseAnimTest(MD5_AnimReader::parseMapped(kAnimFilename)) && lazyPoseAnimTest(mixed) &&
+		   lazyPoseAnimTest(held);
+}
+
+bool poseEvaluatorTest() {
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	if(!poseEvaluatorAnimTest(anim) || !poseEvaluatorAnimTest(mixedFlagsAnim())) {
+		return false;
+	}
+
+	// Components past the end of the frame are refused up front.
+	anim.jointsInfo.back().startIndex = anim.framesData.numComponents() - 2;
+	try {
+		PoseEvaluator evaluator(anim);
+		cout << "Joint reading past the frame was accepted." << endl;
+		return false;
+	}
+	catch(exception &) {
+	}
+
+	return true;
+}
+
+bool crowdEvaluatorTest() {
+	const MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	MD5_AnimInfo reversed = anim;
+	reversed.framesData = AnimFrames(anim.numFrames, anim.framesData.numComponents(), AnimFrames::ComponentMajor);
+	for(int f = 0; f < anim.numFrames; ++f) {
+		for(int c = 0; c < anim.framesData.numComponents(); ++c) {
+			reversed.framesData.value(f, c) = anim.framesData.value(anim.numFrames - 1 - f, c);
+		}
+	}
+
+	vector<mat4> inverseBindPose;
+	for(const BaseframeJoint &joint : anim.baseframeJoints) {
+		inverseBindPose.push_back(glm::inverse(joint.jointToWorld));
+	}
+	CrowdEvaluator poses({&anim, &reversed});
+	CrowdEvaluator palettes({&anim, &reversed}, inverseBindPose);
+
+	// Not a whole number of batches, and some times before the start or past
+	// the end of the clip.
+	vector<CrowdInstance> instances;
+	for(int i = 0; i < 37; ++i) {
+		CrowdInstance instance = {i % 2, (i - 5) * 0.37f};
+		instances.push_back(instance);
+	}
+	CrowdInstance last = {0, -0.01f};
+	if(poses.frameOf(last) != anim.numFrames - 1) {
+		cout << "Time before the start did not wrap to the last frame." << endl;
+		return false;
+	}
+
+	const int numJoints = poses.numJoints();
+	vector<vector<mat4>> expected(instances.size());
+	PoseEvaluator evaluators[] = {PoseEvaluator(anim), PoseEvaluator(reversed)};
+	for(int i = 0; i < instances.size(); ++i) {
+		evaluators[instances[i].clip].evaluate(instances[i].clip == 0 ? anim.framesData : reversed.framesData,
+												poses.frameOf(instances[i]), expected[i]);
+	}
+
+	ThreadPool pool(3);
+	vector<mat4> actual;
+	for(int lanes : {1, 4, 8}) {
+		if(lanes > CrowdEvaluator::maxLanes()) {
+			continue;
+		}
+		poses.setLanes(lanes);
+		palettes.setLanes(lanes);
+
+		for(ThreadPool *threads : {static_cast<ThreadPool *>(nullptr), &pool}) {
+			poses.evaluate(instances, actual, threads);
+			for(int i = 0; i < instances.size(); ++i) {
+				if(memcmp(&actual[i * numJoints], expected[i].data(), numJoints * sizeof(mat4)) != 0) {
+					cout << "Instance " << i << " differs from PoseEvaluator with " << lanes << " lanes." << endl;
+					return false;
+				}
+			}
+
+			palettes.evaluate(instances, actual, threads);
+			for(int i = 0; i < instances.size(); ++i) {
+				for(int j = 0; j < numJoints; ++j) {
+					if(!closeMatrices(actual[i * numJoints + j], expected[i][j] * inverseBindPose[j], 0.001f)) {
+						cout << "Palette entry " << j << " of instance " << i << " is wrong with " << lanes << " lanes."
+							 << endl;
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	// Clips must share a hierarchy.
+	const MD5_AnimInfo mixed = mixedFlagsAnim();
+	try {
+		CrowdEvaluator evaluator({&anim, &mixed});
+		cout << "Clips with different hierarchies were accepted." << endl;
+		return false;
+	}
+	catch(exception &) {
+	}
+
+	return true;
+}
+
+bool poseCacheTest() {
+	const double kQuantum = 0.1;
+	const int kNumJoints = 33;
+	const size_t paletteBytes = kNumJoints * sizeof(mat4);
+	int skeleton = 0;
+	int clips[2] = {};
+
+	// Each palette records the time it was evaluated at.
+	atomic<int> evaluations(0);
+	auto evaluate = [&](double seconds, vector<mat4> &palette) {
+		++evaluations;
+		palette.assign(kNumJoints, mat4(static_cast<float>(seconds)));
+	};
+
+	// Times within one quantum share a palette, evaluated at its start.
+	PoseCache cache(3 * paletteBytes, kQuantum);
+	PoseCache::Palette a = cache.get(&skeleton, &clips[0], 0.12, evaluate);
+	PoseCache::Palette b = cache.get(&skeleton, &clips[0], 0.19, evaluate);
+	if(a != b || evaluations != 1 || fabs((*a)[0][0][0] - 0.1f) > 1e-6f) {
+		cout << "Times in one quantum were not shared." << endl;
+		return false;
+	}
+	// Another clip, or another skeleton, is another pose.
+	PoseCache::Palette c = cache.get(&skeleton, &clips[1], 0.12, evaluate);
+	PoseCache::Palette d = cache.get(&clips[1], &clips[1], 0.12, evaluate);
+	if(c == a || d == c || evaluations != 3) {
+		cout << "Different clips or skeletons shared a palette." << endl;
+		return false;
+	}
+
+	// Full at 3. Using the first again leaves the second least recently
+	// used, so it goes when a fourth arrives. It stays valid for its holder.
+	cache.get(&skeleton, &clips[0], 0.15, evaluate);
+	cache.get(&skeleton, &clips[0], 0.3, evaluate);
+	PoseCache::Stats stats = cache.stats();
+	if(stats.hits != 2 || stats.misses != 4 || stats.evictions != 1 || stats.numEntries != 3 ||
+	   stats.sizeInBytes != 3 * paletteBytes || fabs(stats.hitRate() - 2.0 / 6.0) > 1e-9) {
+		cout << "Stats after an eviction are wrong." << endl;
+		return false;
+	}
+	cache.get(&skeleton, &clips[0], 0.1, evaluate);
+	cache.get(&skeleton, &clips[1], 0.1, evaluate);
+	if(evaluations != 5 || c->size() != kNumJoints || fabs((*c)[0][0][0] - 0.1f) > 1e-6f) {
+		cout << "The least recently used palette was not the one evicted." << endl;
+		return false;
+	}
+
+	// A failed evaluation is reported and not cached.
+	try {
+		cache.get(&skeleton, &clips[0], 5.0, [](double, vector<mat4> &) { throw runtime_error("no pose"); });
+		cout << "A failed evaluation was not reported." << endl;
+		return false;
+	}
+	catch(runtime_error &) {
+	}
+	if(cache.get(&skeleton, &clips[0], 5.0, evaluate)->size() != kNumJoints) {
+		cout << "A failed evaluation was cached." << endl;
+		return false;
+	}
+
+	cache.clear();
+	stats = cache.stats();
+	if(stats.numEntries != 0 || stats.sizeInBytes != 0 || stats.hits != 0 || stats.misses != 0) {
+		cout << "clear() left entries or counts behind." << endl;
+		return false;
+	}
+
+	// Many threads asking for a few poses at once evaluate each one once.
+	const int kNumPoses = 10;
+	const int kNumLookUps = 4000;
+	PoseCache shared(kNumPoses * paletteBytes, kQuantum);
+	ThreadPool pool(4);
+	evaluations = 0;
+	vector<PoseCache::Palette> palettes(kNumLookUps);
+	pool.parallelFor(kNumLookUps, [&](int i) {
+		palettes[i] = shared.get(&skeleton, &clips[0], (i % kNumPoses) * kQuantum + 0.05, [&](double seconds, vector<mat4> &palette) {
+			this_thread::sleep_for(chrono::microseconds(200));
+			evaluate(seconds, palette);
+		});
+	});
+	stats = shared.stats();
+	if(evaluations != kNumPoses || stats.misses != kNumPoses || stats.hits != kNumLookUps - kNumPoses) {
+		cout << evaluations << " evaluations for " << kNumPoses << " poses." << endl;
+		return false;
+	}
+	for(int i = kNumPoses; i < kNumLookUps; ++i) {
+		if(palettes[i] != palettes[i % kNumPoses]) {
+			cout << "Look up " << i << " got its own palette." << endl;
+			return false;
+		}
+	}
+
+	// A crowd through the cache gets the palettes the evaluator builds.
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	CrowdEvaluator evaluator({&anim});
+	PoseCache crowdCache(1 << 20, 1.0 / anim.frameRate);
+	vector<mat4> expected;
+	for(int i = 0; i < 50; ++i) {
+		const double seconds = (i % 7) * 0.25;
+		const CrowdInstance instance = {0, static_cast<float>(crowdCache.quantize(seconds))};
+		PoseCache::Palette palette = crowdCache.get(&evaluator, &anim, seconds, [&](double quantizedSeconds, vector<mat4> &out) {
+			const CrowdInstance quantized = {0, static_cast<float>(quantizedSeconds)};
+			evaluator.evaluate({quantized}, out);
+		});
+		evaluator.evaluate({instance}, expected);
+		if(palette->size() != expected.size() || memcmp(palette->data(), expected.data(), expected.size() * sizeof(mat4)) != 0) {
+			cout << "Crowd instance " << i << " got another pose." << endl;
+			return false;
+		}
+	}
+	if(crowdCache.stats().misses != 7) {
+		cout << "The crowd evaluated " << crowdCache.stats().misses << " poses for 7 times." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool cullingTest() {
+	MD5_AnimInfo anim = MD5_AnimReader().parseMapped(kAnimFilename);
+	if(anim.bounds.size() != anim.numFrames) {
+		cout << "Expected one bounds box per frame." << endl;
+		return false;
+	}
+
+	// Whole frames give the stored box; halfway blends; the clip wraps.
+	const FrameBounds &last = anim.bounds[anim.numFrames - 1];
+	const FrameBounds &first = anim.bounds[0];
+	FrameBounds wrapped = boundsAtFrame(anim, anim.numFrames - 0.5f);
+	if(!sameBits(boundsAtFrame(anim, 3.0f), anim.bounds[3]) ||
+	   !sameBits(boundsAtFrame(anim, anim.numFrames + 3.0f), anim.bounds[3]) ||
+	   fabsf(wrapped.min.x - (last.min.x + first.min.x) * 0.5f) > 1e-4f ||
+	   fabsf(wrapped.max.z - (last.max.z + first.max.z) * 0.5f) > 1e-4f) {
+		cout << "Interpolated bounds are wrong." << endl;
+		return false;
+	}
+
+	// The camera at the origin looks down -z.
+	mat4 projection = glm::perspective(45.0f, 1.0f, 0.1f, 1000.0f);
+	Frustum frustum = extractFrustum(projection);
+	FrameBounds box = { vec3(-1, -1, -1), vec3(1, 1, 1) };
+
+	bool ahead = isVisible(frustum, transformBounds(box, glm::translate(mat4(), vec3(0, 0, -50))));
+	bool behind = isVisible(frustum, transformBounds(box, glm::translate(mat4(), vec3(0, 0, 50))));
+	bool aside = isVisible(frustum, transformBounds(box, glm::translate(mat4(), vec3(200, 0, -50))));
+	bool beyond = isVisible(frustum, transformBounds(box, glm::translate(mat4(), vec3(0, 0, -2000))));
+	bool straddling = isVisible(frustum, transformBounds(box, glm::translate(mat4(), vec3(20.5f, 0, -50))));
+
+	if(!ahead || behind || aside || beyond || !straddling) {
+		cout << "Frustum test gave the wrong answer." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool taskGraphTest() {
+	ThreadPool pool(4);
+	const int kNumChains = 40;
+
+	// Chains of pose, palette and skin stages, as the renderers use them,
+	// with a parallelFor inside each skin stage and one task after them all.
+	TaskGraph graph;
+	atomic<int> clock(0);
+	vector<int> stamps(kNumChains * 3);
+	vector<int> skinned(kNumChains);
+	int finishedAt = 0;
+	vector<int> lastStages;
+	for(int c = 0; c < kNumChains; ++c) {
+		int pose = graph.add([&, c]() { stamps[c * 3] = ++clock; });
+		int palette = graph.add([&, c]() { stamps[c * 3 + 1] = ++clock; }, {pose});
+		lastStages.push_back(graph.add([&, c]() {
+			atomic<int> count(0);
+			pool.parallelFor(16, [&](int) { ++count; });
+			skinned[c] = count;
+			stamps[c * 3 + 2] = ++clock;
+		}, {palette}));
+	}
+	graph.add([&]() { finishedAt = ++clock; }, lastStages);
+
+	for(int run = 0; run < 3; ++run) {
+		clock = 0;
+		graph.run(pool);
+
+		for(int c = 0; c < kNumChains; ++c) {
+			if(!(stamps[c * 3] < stamps[c * 3 + 1] && stamps[c * 3 + 1] < stamps[c * 3 + 2]) || skinned[c] != 16) {
+				cout << "Chain " << c << " ran out of order." << endl;
+				return false;
+			}
+		}
+		if(finishedAt != kNumChains * 3 + 1) {
+			cout << "The final task ran before the chains were done." << endl;
+			return false;
+		}
+	}
+
+	// Tasks queued from inside the pool, waited on by a pool task.
+	future<int> nested = pool.submit([&pool]() {
+		atomic<int> sum(0);
+		pool.parallelFor(100, [&](int i) {
+			pool.parallelFor(10, [&](int j) { sum += i * 10 + j; });
+		});
+		return static_cast<int>(sum);
+	});
+	if(nested.get() != 999 * 1000 / 2) {
+		cout << "Nested parallelFor lost work." << endl;
+		return false;
+	}
+
+	// A failed task stops its dependents and the error reaches run().
+	TaskGraph failing;
+	bool dependentRan = false;
+	int thrower = failing.add([]() { throw runtime_error("task failed"); });
+	failing.add([&]() { dependentRan = true; }, {thrower});
+	try {
+		failing.run(pool);
+		cout << "A failed task was not reported." << endl;
+		return false;
+	}
+	catch(exception &) {
+	}
+	if(dependentRan) {
+		cout << "A task ran after the task it depends on failed." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool animationThreadTest() {
+	// The reader only ever sees whole values, newest last.
+	struct Value {
+		int id;
+		int copies[63];
+	};
+	const int kNumValues = 20000;
+	TripleBuffer<Value> buffer;
+	Value zero = {};
+	buffer.fill(zero);
+
+	thread writer([&buffer]() {
+		for(int i = 1; i <= kNumValues; ++i) {
+			Value &next = buffer.back();
+			next.id = i;
+			for(int &copy : next.copies) {
+				copy = i;
+			}
+			buffer.publish();
+		}
+	});
+
+	int last = 0;
+	bool torn = false;
+	while(last != kNumValues && !torn) {
+		if(!buffer.update()) {
+			continue;
+		}
+		const Value &value = buffer.front();
+		torn = value.id <= last;
+		for(int copy : value.copies) {
+			torn = torn || copy != value.id;
+		}
+		last = value.id;
+	}
+	writer.join();
+	if(torn) {
+		cout << "The reader saw a torn or stale value." << endl;
+		return false;
+	}
+
+	// Steps land exactly a step apart, the first on the calling thread.
+	const double kStep = 0.002;
+	mutex stepMutex;
+	vector<double> times;
+	vector<thread::id> threads;
+	AnimationThread animation;
+	animation.start(kStep, [&](double time) {
+		lock_guard<mutex> lock(stepMutex);
+		times.push_back(time);
+		threads.push_back(this_thread::get_id());
+	}, 1.0);
+
+	{
+		lock_guard<mutex> lock(stepMutex);
+		if(times.empty() || threads[0] != this_thread::get_id()) {
+			cout << "The first step did not run inside start()." << endl;
+			animation.stop();
+			return false;
+		}
+	}
+	this_thread::sleep_for(chrono::milliseconds(60));
+	animation.stop();
+
+	lock_guard<mutex> lock(stepMutex);
+	const size_t numSteps = times.size();
+	if(numSteps < 5 || numSteps != animation.numSteps()) {
+		cout << "Only " << numSteps << " steps ran." << endl;
+		return false;
+	}
+	for(size_t i = 1; i < numSteps; ++i) {
+		if(fabs(times[i] - (1.0 + i * kStep)) > 1e-9 || threads[i] == this_thread::get_id()) {
+			cout << "Step " << i << " ran at " << times[i] << "." << endl;
+			return false;
+		}
+	}
+
+	// The clip's own rate and length decide the frame.
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	const double frameTime = 1.0 / anim.frameRate;
+	if(frameAtTime(anim, 0.0) != 0 || frameAtTime(anim, 5.5 * frameTime) != 5 ||
+	   frameAtTime(anim, (anim.numFrames + 2.5) * frameTime) != 2 || frameAtTime(anim, -0.5 * frameTime) != anim.numFrames - 1) {
+		cout << "frameAtTime does not follow the clip's frame rate." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool animSamplerTest() {
+	MD5_AnimInfo anim = MD5_AnimReader::parseMapped(kAnimFilename);
+	const double frameTime = 1.0 / anim.frameRate;
+	const int last = anim.numFrames - 1;
+	AnimSampler sampler(anim);
+	AnimSampler slerpSampler(anim, AnimSampler::Slerp);
+
+	// On a frame it is that frame.
+	PoseEvaluator evaluator(anim);
+	vector<mat4> expected;
+	vector<mat4> pose;
+	for(int f = 0; f < anim.numFrames; ++f) {
+		evaluator.evaluate(anim.framesData, f, expected);
+		sampler.samplePose(f * frameTime, pose);
+
+		for(int i = 0; i < pose.size(); ++i) {
+			if(!closeMatrices(pose[i], expected[i], 0.001f)) {
+				cout << "Joint " << i << " of frame " << f << " differs from the evaluator." << endl;
+				return false;
+			}
+		}
+	}
+
+	// The evaluator takes a joint space pose as well as a frame, and a frame's
+	// own transforms build exactly that frame's pose.
+	vector<vec3> positions;
+	vector<quat> orientations;
+	for(int f = 0; f < anim.numFrames; f += 7) {
+		computeLocalPose(anim, f, positions, orientations);
+		evaluator.evaluate(anim.framesData, f, expected);
+		evaluator.evaluate(positions, orientations, pose);
+		if(memcmp(pose.data(), expected.data(), pose.size() * sizeof(mat4)) != 0) {
+			cout << "The joint space pose of frame " << f << " evaluates differently." << endl;
+			return false;
+		}
+	}
+
+	// Half way between frames it is half way between their joints, including
+	// from the last frame back round to the first.
+	vector<vec3> slerpPositions;
+	vector<quat> slerpOrientations;
+	vector<vec3> positionsA, positionsB;
+	vector<quat> orientationsA, orientationsB;
+	for(int f : {0, anim.numFrames / 2, last}) {
+		computeLocalPose(anim, f, positionsA, orientationsA);
+		computeLocalPose(anim, (f + 1) % anim.numFrames, positionsB, orientationsB);
+		sampler.sampleLocalPose((f + 0.5) * frameTime, positions, orientations);
+		slerpSampler.sampleLocalPose((f + 0.5) * frameTime, slerpPositions, slerpOrientations);
+
+		for(int i = 0; i < positions.size(); ++i) {
+			const quat &a = orientationsA[i];
+			const quat &b = orientationsB[i];
+			const float sign = (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) < 0 ? -1.0f : 1.0f;
+			const quat half = glm::normalize(quat(a.w + sign * b.w, a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z));
+
+			// Half way along the arc, both ways of blending meet.
+			for(const quat &q : {orientations[i], slerpOrientations[i]}) {
+				if(fabsf(q.x * half.x + q.y * half.y + q.z * half.z + q.w * half.w) < 0.9999f) {
+					cout << "Joint " << i << " is not half way round between frames " << f << " and the next." << endl;
+					return false;
+				}
+			}
+			if(glm::length(positions[i] - (positionsA[i] + positionsB[i]) * 0.5f) > 0.0001f ||
+			   !sameBits(positions[i], slerpPositions[i])) {
+				cout << "Joint " << i << " is not half way between frames " << f << " and the next." << endl;
+				return false;
+			}
+		}
+	}
+
+	// A quarter of the way, slerp turns at a steady rate: a third as far as it
+	// has left to go.
+	computeLocalPose(anim, 0, positionsA, orientationsA);
+	computeLocalPose(anim, 1, positionsB, orientationsB);
+	slerpSampler.sampleLocalPose(0.25 * frameTime, slerpPositions, slerpOrientations);
+	for(int i = 0; i < slerpOrientations.size(); ++i) {
+		const quat &a = orientationsA[i];
+		const quat &b = orientationsB[i];
+		const quat &q = slerpOrientations[i];
+		const float toA = acosf(std::min(1.0f, fabsf(q.x * a.x + q.y * a.y + q.z * a.z + q.w * a.w)));
+		const float toB = acosf(std::min(1.0f, fabsf(q.x * b.x + q.y * b.y + q.z * b.z + q.w * b.w)));
+		if(toB > 0.01f && fabsf(toB - 3 * toA) > 0.001f) {
+			cout << "Joint " << i << " does not slerp at a steady rate." << endl;
+			return false;
+		}
+	}
+
+	// A baked sampler gives exactly the same poses from its own copy.
+	AnimSampler baked(anim);
+	baked.bake();
+	if(!baked.baked() || baked.bakedSizeInBytes() != size_t(anim.numFrames) * anim.jointsInfo.size() * 32) {
+		cout << "The bake is " << baked.bakedSizeInBytes() << " bytes." << endl;
+		return false;
+	}
+	vector<mat4> bakedPose;
+	for(double time : {0.0, 1.3 * frameTime, (last + 0.75) * frameTime, -2.2 * frameTime, 1000.1}) {
+		sampler.samplePose(time, pose);
+		baked.samplePose(time, bakedPose);
+		if(pose.size() != bakedPose.size() || memcmp(pose.data(), bakedPose.data(), pose.size() * sizeof(mat4)) != 0) {
+			cout << "The baked pose at " << time << "s differs." << endl;
+			return false;
+		}
+	}
+	baked.clearBake();
+	if(baked.baked() || baked.bakedSizeInBytes() != 0) {
+		cout << "The bake was not freed." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool parallelDecodeTest() {
+	MD5_AnimInfo boblamp = MD5_AnimReader().parseMapped(kAnimFilename);
+	writeLongAnim(boblamp, 3000, kLongAnimFilename);
+
+	ThreadPool pool(4);
+	MD5_AnimInfo serial = MD5_AnimReader().parseMapped(kLongAnimFilename);
+	MD5_AnimInfo parallel = MD5_AnimReader().parseMapped(kLongAnimFilename, &pool);
+	remove(kLongAnimFilename.c_str());
+
+	if(serial.numFrames != 3000 || parallel.numFrames != 3000) {
+		cout << "Wrong frame count." << endl;
+		return false;
+	}
+
+	if(serial.framesData != parallel.framesData) {
+		cout << "Parallel frame data differs." << endl;
+		return false;
+	}
+
+	const int numComponents = boblamp.framesData.numComponents();
+	for(int i = 0; i < serial.numFrames; ++i) {
+		if(memcmp(serial.framesData.frame(i), boblamp.framesData.frame(i % boblamp.numFrames), numComponents * sizeof(float)) != 0) {
+			cout << "Frame " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool streamingAnimTest() {
+	const int kWindowFrames = 32;
+
+	MD5_AnimInfo boblamp = MD5_AnimReader().parseMapped(kAnimFilename);
+	writeLongAnim(boblamp, 3000, kLongAnimFilename);
+	MD5_AnimInfo whole = MD5_AnimReader().parseMapped(kLongAnimFilename);
+
+	bool passed = true;
+	try {
+		StreamingAnim streamed(kLongAnimFilename, kWindowFrames);
+		const int numComponents = streamed.numComponents();
+
+		if(streamed.numFrames() != whole.numFrames || numComponents != whole.framesData.numComponents() ||
+		   streamed.info().bounds.size() != whole.bounds.size() || !streamed.info().framesData.empty()) {
+			cout << "Streamed header differs." << endl;
+			passed = false;
+		}
+
+		// Playing through, wrapping around, then jumping.
+		vector<int> order;
+		for(int f = 0; f < whole.numFrames + 100; ++f) {
+			order.push_back(f % whole.numFrames);
+		}
+		for(int f = 0; f < 200; ++f) {
+			order.push_back((f * 977) % whole.numFrames);
+		}
+
+		vector<float> frame(numComponents);
+		for(int i = 0; passed && i < order.size(); ++i) {
+			streamed.readFrame(order[i], frame.data());
+			if(memcmp(frame.data(), whole.framesData.frame(order[i]), numComponents * sizeof(float)) != 0) {
+				cout << "Frame " << order[i] << " differs." << endl;
+				passed = false;
+			}
+		}
+
+		size_t frameBytes = static_cast<size_t>(kWindowFrames) * numComponents * sizeof(float);
+		if(passed && streamed.residentBytes() > frameBytes + 64 * whole.numFrames) {
+			cout << "Streamed clip holds more than its window." << endl;
+			passed = false;
+		}
+	} catch(exception &e) {
+		cout << e.what() << endl;
+		passed = false;
+	}
+
+	remove(kLongAnimFilename.c_str());
+	return passed;
+}
+
+bool hotReloadTest() {
+	const string kWatchedFilename("parser_test_watched.md5anim");
+
+	// Only the streams that were edited are reported.
+	MD5_MeshInfo mesh = MD5_MeshReader().parseMapped(kMeshFilename);
+	MeshStreams before = buildMeshStreams(mesh.meshes[0], mesh.joints);
+	MeshStreams after = before;
+	after.positions[4] += 1.0f;
+	after.indices[0] = after.indices[1];
+
+	MeshStreamsDiff same = diffMeshStreams(before, before);
+	MeshStreamsDiff edited = diffMeshStreams(before, after);
+	if(same.any() || !edited.positions || !edited.indices ||
+	   edited.jointIndices || edited.jointWeights || edited.textureCoords) {
+		cout << "Mesh stream diff is wrong." << endl;
+		return false;
+	}
+
+	ofstream(kWatchedFilename) << "before\n";
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	vector<string> reported;
+	{
+		FileWatcher watcher(vector<string>(1, kWatchedFilename), [&](const string &filename) {
+			std::lock_guard<std::mutex> lock(mutex);
+			reported.push_back(filename);
+			changed.notify_all();
+		});
+
+		// Polling only sees whole second modification times.
+		if(!watcher.usesInotify()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+		}
+		ofstream(kWatchedFilename) << "after\n";
+
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait_for(lock, std::chrono::seconds(3), [&]() { return !reported.empty(); });
+	}
+	remove(kWatchedFilename.c_str());
+
+	if(reported != vector<string>(1, kWatchedFilename)) {
+		cout << "Expected one change to " << kWatchedFilename << ", got " << reported.size() << "." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool colladaTest() {
+	MD5_VO vo = ColladaReader::parse(kColladaFilename);
+	const MD5_MeshInfo &mesh = vo.mesh;
+	const MD5_AnimInfo &anim = vo.animations[0];
+
+	if(mesh.joints.size() != 15 || mesh.meshes.size() != 1 || anim.jointsInfo.size() != mesh.joints.size()) {
+		cout << "Expected 15 joints and one mesh, got " << mesh.joints.size() << " and " << mesh.meshes.size() << "." << endl;
+		return false;
+	}
+
+	for(int i = 0; i < mesh.joints.size(); ++i) {
+		if(mesh.joints[i].parentIndex >= i || anim.jointsInfo[i].parent != mesh.joints[i].parentIndex) {
+			cout << "Joint " << i << " comes before its parent." << endl;
+			return false;
+		}
+	}
+
+	// The sample clip runs 2 seconds and animates both legs' hip and knee.
+	if(anim.numFrames != 2 * anim.frameRate + 1 || anim.bounds.size() != anim.numFrames) {
+		cout << "Expected " << 2 * anim.frameRate + 1 << " frames, got " << anim.numFrames << "." << endl;
+		return false;
+	}
+
+	int hip = -1;
+	for(int i = 0; i < anim.jointsInfo.size(); ++i) {
+		if(anim.jointsInfo[i].name == "\"R_Hip\"") {
+			hip = i;
+		}
+	}
+	if(hip < 0 || anim.jointsInfo[hip].flags != 63) {
+		cout << "R_Hip is not animated." << endl;
+		return false;
+	}
+
+	vector<vec3> firstPositions, midPositions;
+	vector<quat> firstOrientations, midOrientations;
+	computeLocalPose(anim, 0, firstPositions, firstOrientations);
+	computeLocalPose(anim, anim.frameRate, midPositions, midOrientations);
+	if(sameBits(firstOrientations[hip], midOrientations[hip])) {
+		cout << "R_Hip does not move." << endl;
+		return false;
+	}
+
+	// Nothing in the sample is skinned, so every vertex rides on the root,
+	// which holds still. The bounds must contain the mesh throughout.
+	const MD5_Mesh &first = mesh.meshes[0];
+	MeshStreams streams = buildMeshStreams(first, mesh.joints);
+	if(first.triangles.empty() || streams.indices.size() != first.triangles.size() * 3) {
+		cout << "The mesh is empty." << endl;
+		return false;
+	}
+
+	const float kTolerance = 1e-3f;
+	for(const FrameBounds &bounds : anim.bounds) {
+		for(int i = 0; i < streams.positions.size(); i += 3) {
+			for(int axis = 0; axis < 3; ++axis) {
+				float p = streams.positions[i + axis];
+				if(p < bounds.min[axis] - kTolerance || p > bounds.max[axis] + kTolerance) {
+					cout << "Vertex " << i / 3 << " lies outside the bounds." << endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	// Three joints with inverse bind matrices that translate and rotate, in
+	// a Y up file. Vertex 0 has five influences, two on joints it already
+	// has, and keeps the heaviest four.
+	ofstream(kSkinnedColladaFilename) <<
+		"<COLLADA><asset><up_axis>Y_UP</up_axis></asset>\n"
+		"<library_geometries><geometry id=\"g\"><mesh>\n"
+		"<source id=\"p\"><float_array>0 0 0  1 0 0  0 2 1</float_array>"
+		"<technique_common><accessor stride=\"3\"/></technique_common></source>\n"
+		"<source id=\"n\"><float_array>0 0 1  0 0 1  0 0 1</float_array>"
+		"<technique_common><accessor stride=\"3\"/></technique_common></source>\n"
+		"<vertices id=\"v\"><input semantic=\"POSITION\" source=\"#p\"/></vertices>\n"
+		"<triangles count=\"1\"><input semantic=\"VERTEX\" source=\"#v\" offset=\"0\"/>"
+		"<input semantic=\"NORMAL\" source=\"#n\" offset=\"0\"/><p>0 1 2</p></triangles>\n"
+		"</mesh></geometry></library_geometries>\n"
+		"<library_controllers><controller id=\"c\"><skin source=\"#g\">\n"
+		"<bind_shape_matrix>1 0 0 0  0 1 0 0  0 0 1 1  0 0 0 1</bind_shape_matrix>\n"
+		"<source id=\"joints\"><Name_array>j0 j1 j2</Name_array></source>\n"
+		"<source id=\"ibm\"><float_array>"
+		"1 0 0 0  0 1 0 -1  0 0 1 0  0 0 0 1 "
+		"0 1 0 -2  -1 0 0 1  0 0 1 0  0 0 0 1 "
+		"1 0 0 0  0 1 0 0  0 0 1 -3  0 0 0 1</float_array>"
+		"<technique_common><accessor stride=\"16\"/></technique_common></source>\n"
+		"<source id=\"w\"><float_array>0.1 0.4 0.2 0.25 0.05 1 0.5</float_array></source>\n"
+		"<joints><input semantic=\"JOINT\" source=\"#joints\"/>"
+		"<input semantic=\"INV_BIND_MATRIX\" source=\"#ibm\"/></joints>\n"
+		"<vertex_weights count=\"3\"><input semantic=\"JOINT\" source=\"#joints\" offset=\"0\"/>"
+		"<input semantic=\"WEIGHT\" source=\"#w\" offset=\"1\"/>"
+		"<vcount>5 1 2</vcount><v>0 0 1 1 2 2 0 3 1 4  2 5  1 6 2 6</v></vertex_weights>\n"
+		"</skin></controller></library_controllers>\n"
+		"<library_visual_scenes><visual_scene id=\"s\">\n"
+		"<node id=\"j0\" sid=\"j0\" name=\"j0\" type=\"JOINT\"><translate>0 1 0</translate>"
+		"<node id=\"j1\" sid=\"j1\" name=\"j1\" type=\"JOINT\">"
+		"<node id=\"j2\" sid=\"j2\" name=\"j2\" type=\"JOINT\"/></node></node>\n"
+		"</visual_scene></library_visual_scenes></COLLADA>\n";
+	MD5_VO skinned = ColladaReader::parse(kSkinnedColladaFilename);
+	remove(kSkinnedColladaFilename.c_str());
+
+	const MD5_MeshInfo &skinnedMesh = skinned.mesh;
+	if(skinnedMesh.joints.size() != 3 || skinnedMesh.meshes.size() != 1 ||
+	   skinnedMesh.meshes[0].vertices.size() != 3) {
+		cout << "Expected 3 joints and 3 skinned vertices." << endl;
+		return false;
+	}
+
+	// Each joint is bound where its inverse bind matrix says, turned Z up.
+	const mat4 upAxis = glm::rotate(mat4(), 90.0f, vec3(1, 0, 0));
+	const mat4 expectedBind[] = {
+		upAxis * glm::translate(mat4(), vec3(0, 1, 0)),
+		upAxis * glm::rotate(glm::translate(mat4(), vec3(1, 2, 0)), 90.0f, vec3(0, 0, 1)),
+		upAxis * glm::translate(mat4(), vec3(0, 0, 3))
+	};
+	for(int i = 0; i < 3; ++i) {
+		for(int col = 0; col < 4; ++col) {
+			for(int row = 0; row < 4; ++row) {
+				if(fabs(skinnedMesh.joints[i].jointToWorld[col][row] - expectedBind[i][col][row]) > kTolerance) {
+					cout << "Joint " << i << " is not bound where its inverse bind matrix says." << endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	const MD5_Mesh &skinnedFirst = skinnedMesh.meshes[0];
+	const int expectedCounts[] = { 4, 1, 2 };
+	for(int v = 0; v < 3; ++v) {
+		const MD5_Vertex &vertex = skinnedFirst.vertices[v];
+		if(vertex.weightCount != expectedCounts[v]) {
+			cout << "Vertex " << v << " has " << vertex.weightCount << " weights, expected " << expectedCounts[v] << "." << endl;
+			return false;
+		}
+
+		float total = 0;
+		for(int k = 0; k < vertex.weightCount; ++k) {
+			const MD5_Weight &weight = skinnedFirst.weights[vertex.startWeight + k];
+			if(k > 0 && weight.weightBias > skinnedFirst.weights[vertex.startWeight + k - 1].weightBias) {
+				cout << "The weights of vertex " << v << " are not heaviest first." << endl;
+				return false;
+			}
+			total += weight.weightBias;
+		}
+		if(fabs(total - 1) > kTolerance) {
+			cout << "The weights of vertex " << v << " sum to " << total << "." << endl;
+			return false;
+		}
+	}
+
+	// The 0.05 influence is the one dropped; the rest are renormalized.
+	if(fabs(skinnedFirst.weights[skinnedFirst.vertices[0].startWeight].weightBias - 0.4f / 0.95f) > kTolerance) {
+		cout << "Vertex 0 kept the wrong influences." << endl;
+		return false;
+	}
+
+	// In bind pose the weights put each vertex back on its source position,
+	// moved by the bind shape and turned Z up.
+	const vec3 sourcePositions[] = { vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 2, 1) };
+	MeshStreams skinnedStreams = buildMeshStreams(skinnedFirst, skinnedMesh.joints);
+	for(int v = 0; v < 3; ++v) {
+		glm::vec4 expected = upAxis * glm::vec4(sourcePositions[v] + vec3(0, 0, 1), 1);
+		for(int axis = 0; axis < 3; ++axis) {
+			if(fabs(skinnedStreams.positions[v * 3 + axis] - expected[axis]) > kTolerance) {
+				cout << "Skinned vertex " << v << " is not at its bind position." << endl;
+				return false;
+			}
+		}
+	}
+
+	ofstream(kBrokenColladaFilename) << "<COLLADA><library_geometries><geometry id=\"g\"><mesh>\n<source id=\"s\">";
+	bool threw = false;
+	try {
+		ColladaReader::parse(kBrokenColladaFilename);
+	}
+	catch(exception &) {
+		threw = true;
+	}
+	remove(kBrokenColladaFilename.c_str());
+
+	if(!threw) {
+		cout << "A truncated file was accepted." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool batchLoadTest() {
+	const int kNumAssets = 8;
+
+	MD5_MeshInfo mesh = MD5_MeshReader::parse(kMeshFilename);
+	MD5_AnimInfo anim = MD5_AnimReader::parse(kAnimFilename);
+
+	// A reader used twice must not carry the first file into the second.
+	MD5_MeshReader meshReader;
+	MD5_AnimReader animReader;
+	meshReader.parse(kMeshFilename);
+	animReader.parse(kAnimFilename);
+	if(!sameMeshInfo(mesh, meshReader.parse(kMeshFilename)) || !sameAnimInfo(anim, animReader.parse(kAnimFilename))) {
+		cout << "Reusing a reader changed its result." << endl;
+		return false;
+	}
+
+	vector<MD5_AssetPaths> assets;
+	for(int i = 0; i < kNumAssets; ++i) {
+		MD5_AssetPaths paths = { kMeshFilename, i % 2 ? kAnimFilename : "" };
+		assets.push_back(paths);
+	}
+	MD5_AssetPaths missing = { "missing.md5mesh", kAnimFilename };
+	assets.push_back(missing);
+
+	ThreadPool pool(4);
+	vector<future<MD5_VO>> results = Md5Reader::parseBatch(assets, pool);
+
+	for(int i = 0; i < kNumAssets; ++i) {
+		MD5_VO vo = results[i].get();
+		if(!sameMeshInfo(mesh, vo.mesh) || vo.animations.size() != (i % 2 ? 1 : 0) ||
+		   (i % 2 && !sameAnimInfo(anim, vo.animations[0]))) {
+			cout << "Asset " << i << " differs." << endl;
+			return false;
+		}
+	}
+
+	try {
+		results[kNumAssets].get();
+		cout << "Loading a missing file did not throw." << endl;
+		return false;
+	}
+	catch(exception &) {
+	}
+
+	return true;
+}
+
+bool bakedAssetTest() {
+	MD5_MeshInfo mesh = MD5_MeshReader().parseMapped(kMeshFilename);
+	MD5_AnimInfo anim = MD5_AnimReader().parseMapped(kAnimFilename);
+	writeBakedAsset(kBakedFilename, &mesh, &anim);
+
+	BakedAsset baked(kBakedFilename);
+	bool result = sameMeshInfo(mesh, baked.meshInfo()) && sameAnimInfo(anim, baked.animInfo());
+
+	for(int i = 0; result && i < mesh.meshes.size(); ++i) {
+		MeshStreams expected = buildMeshStreams(mesh.meshes[i], mesh.joints);
+		MeshStreams loaded = baked.meshStreams(i);
+		if(expected.positions != loaded.positions || expected.indices != loaded.indices ||
+		   expected.jointIndices != loaded.jointIndices || expected.jointWeights != loaded.jointWeights) {
+			cout << "Streams for mesh " << i << " differ." << endl;
+			result = false;
+		}
+	}
+
+	// Flip one byte of frame data; the checksum has to catch it.
+	{
+		fstream file(kBakedFilename, ios::in | ios::out | ios::binary);
+		file.seekg(-8, ios::end);
+		char c = file.peek();
+		file.seekp(-8, ios::end);
+		file.put(c ^ 0x5a);
+	}
+
+	try {
+		BakedAsset corrupt(kBakedFilename);
+		cout << "Corrupt file was accepted." << endl;
+		result = false;
+	}
+	catch(exception &) {
+	}
+
+	remove(kBakedFilename.c_str());
+	return result;
+}
+
+// Largest difference in any channel between an image and a cooked level 0.
+int cookedError(const vector<unsigned char> &rgba, const CookedTexture &texture) {
+	vector<unsigned char> decoded;
+	texture.decodeLevel(0, decoded);
+
+	int worst = 0;
+	for(size_t i = 0; i < rgba.size(); ++i) {
+		worst = max(worst, abs(int(rgba[i]) - int(decoded[i])));
+	}
+	return worst;
+}
+
+bool cookedTextureTest() {
+	const int kWidth = 64;
+	const int kHeight = 20;
+
+	if(cookedTextureFilename("Boblamp/guard1_body.tga") != "Boblamp/guard1_body.btex") {
+		cout << "Unexpected cooked filename." << endl;
+		return false;
+	}
+
+	// Smooth gradients, which block compression keeps close.
+	vector<unsigned char> rgba(kWidth * kHeight * 4);
+	for(int y = 0; y < kHeight; ++y) {
+		for(int x = 0; x < kWidth; ++x) {
+			unsigned char *texel = &rgba[(y * kWidth + x) * 4];
+			texel[0] = x * 4;
+			texel[1] = y * 12;
+			texel[2] = 128;
+			texel[3] = 255;
+		}
+	}
+
+	writeCookedTexture(kCookedTextureFilename, rgba.data(), kWidth, kHeight, 4);
+	{
+		CookedTexture texture(kCookedTextureFilename);
+		// 64x20 down to 1x1 is 7 levels; the last ones are padded to a block.
+		if(texture.format() != CookedTexture::BC1 || texture.numLevels() != 7 ||
+		   texture.levelWidth(6) != 1 || texture.levelHeight(6) != 1 ||
+		   texture.levelSize(0) != 16 * 5 * 8 || texture.levelSize(6) != 8) {
+			cout << "Unexpected BC1 layout." << endl;
+			return false;
+		}
+		if(cookedError(rgba, texture) > 12) {
+			cout << "BC1 error " << cookedError(rgba, texture) << " is too large." << endl;
+			return false;
+		}
+	}
+
+	// Any alpha below 255 switches to BC3.
+	for(int i = 0; i < kWidth * kHeight; ++i) {
+		rgba[i * 4 + 3] = (i % kWidth) * 4;
+	}
+	writeCookedTexture(kCookedTextureFilename, rgba.data(), kWidth, kHeight, 4);
+	{
+		CookedTexture texture(kCookedTextureFilename);
+		if(texture.format() != CookedTexture::BC3 || texture.levelSize(0) != 16 * 5 * 16 ||
+		   cookedError(rgba, texture) > 12) {
+			cout << "Unexpected BC3 result." << endl;
+			return false;
+		}
+	}
+
+	// Flip one byte of level data; the checksum has to catch it.
+	{
+		fstream file(kCookedTextureFilename, ios::in | ios::out | ios::binary);
+		file.seekg(-4, ios::end);
+		char c = file.peek();
+		file.seekp(-4, ios::end);
+		file.put(c ^ 0x5a);
+	}
+
+	bool result = false;
+	try {
+		CookedTexture corrupt(kCookedTextureFilename);
+		cout << "Corrupt texture was accepted." << endl;
+	}
+	catch(exception &) {
+		result = true;
+	}
+
+	remove(kCookedTextureFilename.c_str());
+	return result;
+}
+
+int main() {
+	bool passed = true;
+
+	cout << "mesh parse: ";
+	bool result = meshParseTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "anim parse: ";
+	result = animParseTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "frame scanner: ";
+	result = frameScannerTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "anim frames: ";
+	result = animFramesTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "quantized anim: ";
+	result = quantizedAnimTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "reduced anim: ";
+	result = reducedAnimTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "skeleton: ";
+	result = skeletonTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "channel decoder: ";
+	result = channelDecoderTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "pose evaluator: ";
+	result = poseEvaluatorTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "lazy pose evaluator: ";
+	result = lazyPoseEvaluatorTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "crowd evaluator: ";
+	result = crowdEvaluatorTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "pose cache: ";
+	result = poseCacheTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "culling: ";
+	result = cullingTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "parallel decode: ";
+	result = parallelDecodeTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "task graph: ";
+	result = taskGraphTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "animation thread: ";
+	result = animationThreadTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "anim sampler: ";
+	result = animSamplerTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "streaming anim: ";
+	result = streamingAnimTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "hot reload: ";
+	result = hotReloadTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "collada import: ";
+	result = colladaTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "batch load: ";
+	result = batchLoadTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "baked asset: ";
+	result = bakedAssetTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	cout << "cooked texture: ";
+	result = cookedTextureTest();
+	cout << (result ? "ok" : "FAILED") << endl;
+	passed = passed && result;
+
+	return passed ? 0 : 1;
+}
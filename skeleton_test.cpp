@@ -31,45 +31,12 @@ mat4 getChildToParentMatrix(const Joint &joint) {
 	//return rotM * transM;
 }
 
-mat4 jointToWorld(const Skeleton &skeleton, const Joint &joint) {
-	mat4 P(1.0);
-	const Joint *pJoint = &joint;
-
-	while(pJoint) {
-		if(pJoint->parentIndex > -1) {
-			cout << pJoint->name << " to " << skeleton.joints[pJoint->parentIndex].name << endl;
-		} else {
-			cout << pJoint->name << " to model" << endl;
-		}
-
-		mat4 P_next = getChildToParentMatrix(*pJoint);
-		printMatrix(P_next);
-		P = P_next * P;
-
-		pJoint = (pJoint->parentIndex == -1) ? nullptr : &skeleton.joints[pJoint->parentIndex];
-	}
-		 
-	return P;
-}
-
 void buildJointToWorldMatrices(Skeleton &skeleton) {
-	for(int i = 0; i < skeleton.joints.size(); ++i) {
-		Joint &joint = skeleton.joints[i];
+	computeModelSpace(skeleton);
 
-		glm::mat4 rotM = glm::mat4_cast(joint.orientation);
-		glm::mat4 transM = glm::translate(mat4(1.0f), joint.position);
-
-		mat4 toParentM = transM * rotM;
-
-		if(i == 0) {
-			joint.jointToWorld = toParentM;
-		} else {
-			const Joint &parent = skeleton.joints[joint.parentIndex];
-			joint.jointToWorld = parent.jointToWorld * toParentM;
-		}
-
-		cout << joint.name << " to model: " << endl;
-		printMatrix(joint.jointToWorld);
+	for(int i = 0; i < skeleton.numJoints(); ++i) {
+		cout << skeleton.names[i] << " to model: " << endl;
+		printMatrix(skeleton.modelSpace[i]);
 	}
 }
 
@@ -97,19 +64,16 @@ void jointToWorldTest() {
 	//j2.orientation = glm::quat_cast(glm::rotate(mat4(), 45.0f, vec3(0, 0, 1)));
 
 
-	Skeleton skeleton;
-	skeleton.joints.push_back(j0);
-	skeleton.joints.push_back(j1);
-	skeleton.joints.push_back(j2);
+	vector<Joint> joints;
+	joints.push_back(j0);
+	joints.push_back(j1);
+	joints.push_back(j2);
 
+	Skeleton skeleton = buildSkeleton(joints);
 	buildJointToWorldMatrices(skeleton);
-	//mat4 worldM = jointToWorld(skeleton, j2);
-
-	//cout << "World coordinate: " << worldM[3][0] << ", " << worldM[3][1] << ", " << worldM[3][2] << endl;
 }
 
 void childToParentTest() {
-	Skeleton skeleton;
 	Joint j0;
 
 	j0.name = "J0";
@@ -117,8 +81,6 @@ void childToParentTest() {
 	j0.position = vec3(70.71, 70.71, 0);
 	j0.orientation = glm::quat_cast(glm::rotate(mat4(), 45.0f, vec3(0, 0, 1)));
 
-	skeleton.joints.push_back(j0);
-
 	mat4 P = getChildToParentMatrix(j0)  ;
 	printMatrix(P);
 